@@ -18,12 +18,13 @@ PACKAGES_TO_INSTALL=""
 # Required packages list
 REQUIRED_PACKAGES=(
     qt6-base-dev
-    qt6-webengine-dev
     qt6-gamepad-dev
     libsdl3-dev
     libwayland-dev
     libegl-dev
     libgl-dev
+    libzstd-dev
+    zlib1g-dev
     steam-devices
     lcov
     gcovr
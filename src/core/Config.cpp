@@ -1,7 +1,12 @@
 #include "Config.hpp"
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
 
 Config* Config::s_instance = nullptr;
 
@@ -40,6 +45,56 @@ bool Config::save(const QString& path) const {
     return true;
 }
 
+bool Config::loadOverrides(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (doc.isNull()) {
+        return false;
+    }
+
+    merge(m_data, doc.object().toVariantMap());
+    return true;
+}
+
+bool Config::saveOverrides(const QString& path, const QVariantMap& overrides) {
+    QVariantMap saved;
+    QFile existing(path);
+    if (existing.open(QIODevice::ReadOnly)) {
+        saved = QJsonDocument::fromJson(existing.readAll()).object().toVariantMap();
+        existing.close();
+    }
+    merge(saved, overrides);
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(QJsonObject::fromVariantMap(saved)).toJson());
+    return file.commit();
+}
+
+void Config::merge(QVariantMap& into, const QVariantMap& from) {
+    for (auto it = from.begin(); it != from.end(); ++it) {
+        QVariant& target = into[it.key()];
+        if (target.typeId() == QMetaType::QVariantMap && it.value().typeId() == QMetaType::QVariantMap) {
+            QVariantMap nested = target.toMap();
+            merge(nested, it.value().toMap());
+            target = nested;
+        } else {
+            target = it.value();
+        }
+    }
+}
+
+QString Config::userConfigPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation) + "/config.json";
+}
+
 QVariant Config::value(const QString& key, const QVariant& defaultValue) const {
     return m_data.value(key, defaultValue);
 }
@@ -59,4 +114,10 @@ void Config::remove(const QString& key) {
     if (m_data.remove(key) > 0) {
         emit configChanged(key);
     }
+}
+
+QByteArray Config::fingerprint() const {
+    // Object keys serialize sorted, so equal configs hash equally
+    const QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(m_data)).toJson(QJsonDocument::Compact);
+    return QCryptographicHash::hash(json, QCryptographicHash::Sha256);
 }
\ No newline at end of file
@@ -11,12 +11,23 @@ public:
     
     bool load(const QString& path);
     bool save(const QString& path) const;
+    // Lay a saved configuration over the loaded one; settings it does not
+    // have keep their loaded values
+    bool loadOverrides(const QString& path);
+    // Merge overrides into the saved configuration at path and nothing
+    // else, so settings the user never changed keep following the defaults
+    static bool saveOverrides(const QString& path, const QVariantMap& overrides);
+    // Where the launcher keeps what the user changed, e.g. tuned presets
+    static QString userConfigPath();
     
     QVariant value(const QString& key, const QVariant& defaultValue = QVariant()) const;
     void setValue(const QString& key, const QVariant& value);
     
     bool contains(const QString& key) const;
     void remove(const QString& key);
+
+    // Hash of the whole configuration, for caches derived from it
+    QByteArray fingerprint() const;
     
 signals:
     void configChanged(const QString& key);
@@ -26,5 +37,6 @@ private:
     ~Config() = default;
     
     static Config* s_instance;
+    static void merge(QVariantMap& into, const QVariantMap& from);
     QVariantMap m_data;
 };
\ No newline at end of file
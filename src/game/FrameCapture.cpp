@@ -0,0 +1,75 @@
+#include "FrameCapture.hpp"
+
+namespace {
+
+constexpr int PollIntervalMs = 250;
+constexpr int RecentWindowMs = 10000;
+
+} // namespace
+
+FrameCapture::FrameCapture(QObject* parent)
+    : QObject(parent)
+    , m_windowMs(RecentWindowMs) {
+    m_timer.setInterval(PollIntervalMs);
+    connect(&m_timer, &QTimer::timeout, this, &FrameCapture::poll);
+}
+
+void FrameCapture::start() {
+    if (isRunning()) {
+        return;
+    }
+    m_log.skipToEnd();
+    m_windowClock.start();
+    m_timer.start();
+}
+
+void FrameCapture::stop() {
+    m_timer.stop();
+}
+
+void FrameCapture::reset() {
+    m_session.clear();
+    m_current.clear();
+    m_previous.clear();
+    m_windowClock.start();
+}
+
+void FrameCapture::poll() {
+    const QVector<double> frameTimes = m_log.readNew();
+    const qint64 elapsed = m_windowClock.isValid() ? m_windowClock.elapsed() : m_windowMs;
+    if (elapsed >= m_windowMs) {
+        if (elapsed >= 2 * m_windowMs) {
+            m_previous.clear();  // Nothing recent in either generation
+        } else {
+            m_previous = m_current;
+        }
+        m_current.clear();
+        m_windowClock.start();
+    }
+    if (frameTimes.isEmpty()) {
+        return;
+    }
+
+    for (double frameTime : frameTimes) {
+        m_session.add(frameTime);
+        m_current.add(frameTime);
+    }
+    emit framesCaptured(frameTimes);
+}
+
+FrameTimeHistogram FrameCapture::recent() const {
+    FrameTimeHistogram recent = m_previous;
+    recent.merge(m_current);
+    return recent;
+}
+
+FrameCapture::Summary FrameCapture::summarize(const FrameTimeHistogram& histogram) {
+    Summary summary;
+    summary.frames = histogram.count();
+    summary.averageFps = histogram.averageFps();
+    summary.low1Fps = histogram.lowFps(0.01);
+    summary.low01Fps = histogram.lowFps(0.001);
+    summary.p99FrameTime = histogram.percentile(0.99);
+    summary.frameTimeStdDev = histogram.standardDeviation();
+    return summary;
+}
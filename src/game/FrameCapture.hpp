@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include "FrameTimeHistogram.hpp"
+#include "FrameTimeLog.hpp"
+
+// How the running game actually performs, tailed live from the overlay's
+// frame time log (see FrameTimeLog).
+//
+// Every frame goes into a histogram for the whole session and into one
+// for the recent past. The recent one keeps two generations of a window
+// each and drops the older one every window, so it covers between one
+// and two windows. Memory stays the same however long the session runs.
+class FrameCapture : public QObject {
+    Q_OBJECT
+
+public:
+    struct Summary {
+        quint64 frames = 0;
+        double averageFps = 0.0;
+        double low1Fps = 0.0;          // 1% low
+        double low01Fps = 0.0;         // 0.1% low
+        double p99FrameTime = 0.0;     // ms
+        double frameTimeStdDev = 0.0;  // ms
+    };
+
+    explicit FrameCapture(QObject* parent = nullptr);
+
+    void setPath(const QString& path) { m_log.setPath(path); }
+    QString path() const { return m_log.path(); }
+    void setInterval(int ms) { m_timer.setInterval(ms); }
+    void setWindow(int ms) { m_windowMs = ms; }
+
+    // Tail the log from what it holds now
+    void start();
+    void stop();
+    bool isRunning() const { return m_timer.isActive(); }
+    // Forget the statistics, e.g. when a new session starts
+    void reset();
+    // Read new frames now instead of at the next interval
+    void poll();
+
+    const FrameTimeHistogram& session() const { return m_session; }
+    FrameTimeHistogram recent() const;
+    Summary sessionSummary() const { return summarize(m_session); }
+    Summary recentSummary() const { return summarize(recent()); }
+    static Summary summarize(const FrameTimeHistogram& histogram);
+
+signals:
+    // Frames read by one poll, for controllers that follow the frame rate
+    void framesCaptured(const QVector<double>& frameTimes);
+
+private:
+    FrameTimeLog m_log;
+    QTimer m_timer;
+    QElapsedTimer m_windowClock;
+    int m_windowMs;
+    FrameTimeHistogram m_session;
+    FrameTimeHistogram m_current;
+    FrameTimeHistogram m_previous;
+};
@@ -0,0 +1,130 @@
+#include "FrameTimeHistogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+FrameTimeHistogram::FrameTimeHistogram() {
+    clear();
+}
+
+void FrameTimeHistogram::clear() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_totalMs = 0.0;
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_min = 0.0;
+    m_max = 0.0;
+}
+
+int FrameTimeHistogram::bucket(double ms) {
+    // Exponent and the top mantissa bits of a positive double are its
+    // octave and the position within it
+    if (!(ms >= std::ldexp(1.0, MinExponent))) {
+        return 0;
+    }
+    if (ms >= std::ldexp(1.0, MaxExponent)) {
+        return BucketCount - 1;
+    }
+    const quint64 bits = std::bit_cast<quint64>(ms);
+    const int exponent = int((bits >> 52) & 0x7ff) - 1023;
+    const int subBucket = int(bits >> (52 - SubBucketBits)) & ((1 << SubBucketBits) - 1);
+    return ((exponent - MinExponent) << SubBucketBits) | subBucket;
+}
+
+double FrameTimeHistogram::value(int index) const {
+    // The end buckets also hold everything out of range
+    if (index == 0) {
+        return m_min;
+    }
+    if (index == BucketCount - 1) {
+        return m_max;
+    }
+    return std::clamp(bucketValue(index), m_min, m_max);
+}
+
+double FrameTimeHistogram::bucketValue(int index) {
+    // Middle of the bucket
+    const int exponent = (index >> SubBucketBits) + MinExponent;
+    const double subBucket = (index & ((1 << SubBucketBits) - 1)) + 0.5;
+    return std::ldexp(1.0 + subBucket / (1 << SubBucketBits), exponent);
+}
+
+void FrameTimeHistogram::add(double ms) {
+    ++m_buckets[bucket(ms)];
+    if (m_count == 0) {
+        m_min = ms;
+        m_max = ms;
+    } else {
+        m_min = std::min(m_min, ms);
+        m_max = std::max(m_max, ms);
+    }
+    ++m_count;
+    m_totalMs += ms;
+    const double delta = ms - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (ms - m_mean);
+}
+
+void FrameTimeHistogram::merge(const FrameTimeHistogram& other) {
+    if (other.m_count == 0) {
+        return;
+    }
+    if (m_count == 0) {
+        *this = other;
+        return;
+    }
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+
+    // Chan et al. for combining the partial variances
+    const double total = double(m_count) + double(other.m_count);
+    const double delta = other.m_mean - m_mean;
+    m_m2 += other.m_m2 + delta * delta * m_count * other.m_count / total;
+    m_mean += delta * other.m_count / total;
+    m_count += other.m_count;
+    m_totalMs += other.m_totalMs;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+double FrameTimeHistogram::standardDeviation() const {
+    return std::sqrt(variance());
+}
+
+double FrameTimeHistogram::averageFps() const {
+    return m_totalMs > 0.0 ? m_count * 1000.0 / m_totalMs : 0.0;
+}
+
+double FrameTimeHistogram::percentile(double p) const {
+    if (m_count == 0) {
+        return 0.0;
+    }
+    const quint64 rank = std::clamp<quint64>(quint64(std::ceil(std::clamp(p, 0.0, 1.0) * m_count)),
+                                             1, m_count);
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return value(i);
+        }
+    }
+    return m_max;
+}
+
+double FrameTimeHistogram::lowFps(double fraction) const {
+    if (m_count == 0) {
+        return 0.0;
+    }
+    // Walk down from the slowest frames
+    const quint64 wanted = std::max<quint64>(1, quint64(std::clamp(fraction, 0.0, 1.0) * m_count));
+    quint64 taken = 0;
+    double timeMs = 0.0;
+    for (int i = BucketCount - 1; i >= 0 && taken < wanted; --i) {
+        const quint64 frames = std::min(m_buckets[i], wanted - taken);
+        timeMs += frames * value(i);
+        taken += frames;
+    }
+    return timeMs > 0.0 ? taken * 1000.0 / timeMs : 0.0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QtGlobal>
+#include <array>
+
+// Frame time distribution in constant memory, however long the session.
+//
+// Buckets are log-spaced, 128 per octave (under 0.8% wide) from 1/64 ms
+// to 16 s, and the bucket of a frame time is read straight from the bits
+// of the double, so adding a frame costs no logarithm. Percentiles and
+// lows are accurate to a bucket; mean, variance, minimum and maximum are
+// exact.
+class FrameTimeHistogram {
+public:
+    FrameTimeHistogram();
+
+    void add(double ms);
+    void merge(const FrameTimeHistogram& other);
+    void clear();
+
+    quint64 count() const { return m_count; }
+    double totalMs() const { return m_totalMs; }
+    double minimum() const { return m_count ? m_min : 0.0; }
+    double maximum() const { return m_count ? m_max : 0.0; }
+    double mean() const { return m_mean; }
+    // Of the frame time, in ms²
+    double variance() const { return m_count > 1 ? m_m2 / (m_count - 1) : 0.0; }
+    double standardDeviation() const;
+
+    // Frames over time, 0 without frames
+    double averageFps() const;
+    // Frame time (ms) that the fraction p of frames does not exceed
+    double percentile(double p) const;
+    // Average frame rate over the slowest fraction of frames: 0.01 for the
+    // 1% low, 0.001 for the 0.1% low
+    double lowFps(double fraction) const;
+
+private:
+    static constexpr int SubBucketBits = 7;
+    static constexpr int MinExponent = -6;  // 1/64 ms
+    static constexpr int MaxExponent = 14;  // 16 s
+    static constexpr int BucketCount = (MaxExponent - MinExponent) << SubBucketBits;
+
+    static int bucket(double ms);
+    static double bucketValue(int index);
+    double value(int index) const;
+
+    std::array<quint64, BucketCount> m_buckets;
+    quint64 m_count;
+    double m_totalMs;
+    double m_mean;
+    double m_m2;  // Sum of squared differences from the mean (Welford)
+    double m_min;
+    double m_max;
+};
@@ -0,0 +1,253 @@
+#include "FrameTimeLog.hpp"
+#include "FrameTimeHistogram.hpp"
+#include <QFile>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Some thousands of lines; also the longest line that is not skipped
+constexpr int ChunkSize = 256 * 1024;
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+void trim(const char*& begin, const char*& end) {
+    while (begin < end && isBlank(*begin)) {
+        ++begin;
+    }
+    while (end > begin && isBlank(end[-1])) {
+        --end;
+    }
+}
+
+bool parseNumber(const char* begin, const char* end, double& value) {
+    trim(begin, end);
+    const std::from_chars_result result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+} // namespace
+
+FrameTimeLog::FrameTimeLog()
+    : m_fd(-1)
+    , m_pipe(false)
+    , m_device(0)
+    , m_inode(0)
+    , m_offset(0)
+    , m_column(-1)
+    , m_pending(0)
+    , m_discarding(false) {
+}
+
+void FrameTimeLog::setPath(const QString& path) {
+    close();
+    m_path = path;
+    rewind();
+}
+
+void FrameTimeLog::rewind() {
+    m_offset = 0;
+    m_column = -1;
+    m_pending = 0;
+    m_discarding = false;
+}
+
+bool FrameTimeLog::open() {
+    if (m_path.isEmpty()) {
+        return false;
+    }
+    const QByteArray path = QFile::encodeName(m_path);
+    struct stat st;
+    if (::stat(path.constData(), &st) != 0) {
+        return false;
+    }
+
+    if (m_fd >= 0 && (quint64(st.st_dev) != m_device || quint64(st.st_ino) != m_inode)) {
+        // Replaced by a new session's log
+        close();
+        rewind();
+    }
+    if (m_fd < 0) {
+        m_fd = ::open(path.constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (m_fd < 0) {
+            return false;
+        }
+        m_pipe = S_ISFIFO(st.st_mode);
+        m_device = st.st_dev;
+        m_inode = st.st_ino;
+        if (m_buffer.size() != ChunkSize) {
+            m_buffer.resize(ChunkSize);
+        }
+    }
+
+    if (!m_pipe && st.st_size < m_offset) {
+        // Log was truncated by a new session
+        rewind();
+    }
+    return true;
+}
+
+void FrameTimeLog::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+template<typename Sink>
+qint64 FrameTimeLog::read(Sink&& sink) {
+    if (!open()) {
+        return 0;
+    }
+
+    qint64 frames = 0;
+    char* const data = m_buffer.data();
+    for (;;) {
+        const qint64 space = ChunkSize - m_pending;
+        const ssize_t length = m_pipe ? ::read(m_fd, data + m_pending, space)
+                                      : ::pread(m_fd, data + m_pending, space, m_offset);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;  // End of file, or nothing more in the pipe for now
+        }
+        m_offset += length;
+
+        const char* const end = data + m_pending + length;
+        const char* newline = static_cast<const char*>(::memrchr(data, '\n', end - data));
+        if (!newline) {
+            if (end - data < ChunkSize) {
+                m_pending = int(end - data);
+            } else {
+                // Not a frame time; drop it up to its end
+                m_pending = 0;
+                m_discarding = true;
+            }
+            continue;
+        }
+
+        const char* begin = data;
+        if (m_discarding) {
+            begin = static_cast<const char*>(std::memchr(data, '\n', end - data)) + 1;
+            m_discarding = false;
+        }
+        frames += parseLines(begin, newline, sink);
+
+        // Keep the unfinished line for the next chunk
+        m_pending = int(end - (newline + 1));
+        std::memmove(data, newline + 1, m_pending);
+    }
+    return frames;
+}
+
+template<typename Sink>
+qint64 FrameTimeLog::finish(Sink&& sink) {
+    // A finished log may lack a trailing newline
+    qint64 frames = read(sink);
+    if (m_pending > 0 && !m_discarding) {
+        frames += parseLines(m_buffer.constData(), m_buffer.constData() + m_pending, sink);
+    }
+    m_pending = 0;
+    return frames;
+}
+
+template<typename Sink>
+qint64 FrameTimeLog::parseLines(const char* begin, const char* end, Sink& sink) {
+    qint64 frames = 0;
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* lineEnd = newline ? newline : end;
+        double frameTime = 0.0;
+        if (parseLine(begin, lineEnd, frameTime)) {
+            sink(frameTime);
+            ++frames;
+        }
+        begin = lineEnd + 1;
+    }
+    return frames;
+}
+
+bool FrameTimeLog::parseLine(const char* begin, const char* end, double& frameTime) {
+    trim(begin, end);
+    if (begin == end) {
+        return false;
+    }
+
+    // Data lines start with a number; anything else may be the header.
+    // MangoHud's system-info preamble and malformed lines are skipped.
+    const char first = *begin;
+    if (!(first >= '0' && first <= '9') && first != '.' && first != '-') {
+        int column = 0;
+        for (const char* field = begin; field <= end; ++column) {
+            const char* comma = static_cast<const char*>(std::memchr(field, ',', end - field));
+            const char* fieldEnd = comma ? comma : end;
+            const char* name = field;
+            const char* nameEnd = fieldEnd;
+            trim(name, nameEnd);
+            if (nameEnd - name == 9 && std::memcmp(name, "frametime", 9) == 0) {
+                m_column = column;
+                return false;
+            }
+            field = fieldEnd + 1;
+        }
+        return false;
+    }
+
+    const char* field = begin;
+    const char* fieldEnd = end;
+    if (m_column >= 0) {
+        for (int column = 0; column < m_column; ++column) {
+            const char* comma = static_cast<const char*>(std::memchr(field, ',', end - field));
+            if (!comma) {
+                return false;
+            }
+            field = comma + 1;
+        }
+        const char* comma = static_cast<const char*>(std::memchr(field, ',', end - field));
+        fieldEnd = comma ? comma : end;
+    } else if (std::memchr(begin, ',', end - begin)) {
+        return false;  // Columns, but no header seen
+    }
+
+    return parseNumber(field, fieldEnd, frameTime) && frameTime > 0.0;
+}
+
+QVector<double> FrameTimeLog::readNew() {
+    QVector<double> frameTimes;
+    read([&frameTimes](double ms) { frameTimes.append(ms); });
+    return frameTimes;
+}
+
+qint64 FrameTimeLog::readNew(FrameTimeHistogram& histogram) {
+    return read([&histogram](double ms) { histogram.add(ms); });
+}
+
+void FrameTimeLog::skipToEnd() {
+    // Parsed rather than seeked past, so a CSV header is still seen
+    read([](double) {});
+}
+
+QVector<double> FrameTimeLog::readAll(const QString& path) {
+    FrameTimeLog log;
+    log.setPath(path);
+    QVector<double> frameTimes;
+    log.finish([&frameTimes](double ms) { frameTimes.append(ms); });
+    return frameTimes;
+}
+
+qint64 FrameTimeLog::readAll(const QString& path, FrameTimeHistogram& histogram) {
+    FrameTimeLog log;
+    log.setPath(path);
+    return log.finish([&histogram](double ms) { histogram.add(ms); });
+}
+
+FrameTimeLog::~FrameTimeLog() {
+    close();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class FrameTimeHistogram;
+
+// Incrementally reads frame times from a log written by the game's
+// overlay: a MangoHud/mangoapp CSV (any header with a "frametime"
+// column), or a plain file with one frame time in milliseconds per line
+// such as a gamescope stats dump. A FIFO, e.g. a gamescope stats pipe,
+// is read without blocking.
+//
+// The file is read in fixed chunks and lines are parsed in place in the
+// read buffer, so memory does not grow with the length of the log.
+class FrameTimeLog {
+public:
+    FrameTimeLog();
+    ~FrameTimeLog();
+
+    void setPath(const QString& path);
+    QString path() const { return m_path; }
+
+    // Frame times (ms) appended since the last call. A truncated or
+    // replaced file is read again from the start.
+    QVector<double> readNew();
+    // The same, straight into a histogram; returns the number of frames
+    qint64 readNew(FrameTimeHistogram& histogram);
+    // Pass over what the log holds now, e.g. an earlier session's frames
+    void skipToEnd();
+
+    // Every frame time in a finished log, e.g. for replaying a capture
+    static QVector<double> readAll(const QString& path);
+    static qint64 readAll(const QString& path, FrameTimeHistogram& histogram);
+
+private:
+    Q_DISABLE_COPY(FrameTimeLog)
+
+    template<typename Sink> qint64 read(Sink&& sink);
+    template<typename Sink> qint64 finish(Sink&& sink);
+    template<typename Sink> qint64 parseLines(const char* begin, const char* end, Sink& sink);
+    bool parseLine(const char* begin, const char* end, double& frameTime);
+    bool open();
+    void close();
+    void rewind();
+
+    QString m_path;
+    int m_fd;
+    bool m_pipe;
+    quint64 m_device;
+    quint64 m_inode;
+    qint64 m_offset;
+    int m_column;  // Index of the frametime column; -1 before a header is seen
+    QByteArray m_buffer;
+    int m_pending;     // Bytes of an unfinished line at the start of m_buffer
+    bool m_discarding; // Inside a line too long for the buffer
+};
@@ -1,10 +1,56 @@
 #include "GameManager.hpp"
+#include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QDir>
-#include <QProcess>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QThreadPool>
 #include <QSettings>
 #include <QDebug>
+#include <algorithm>
+#include "../core/Config.hpp"
+#include "GamescopeSupervisor.hpp"
 #include "../gamepad/AllySystemControl.hpp"
+#include "../steam/SteamIntegration.hpp"
+#include "../storage/ArchiveExtractor.hpp"
+
+namespace {
+
+QString expandHome(const QString& path) {
+    return path.startsWith("~/") ? QDir::homePath() + path.mid(1) : path;
+}
+
+// Where Mesa and the NVIDIA driver keep their shader caches
+const char* const ShaderCacheVariables[] = {
+    "MESA_SHADER_CACHE_DIR",
+    "MESA_GLSL_CACHE_DIR",
+    "__GL_SHADER_DISK_CACHE_PATH"
+};
+
+// Key of a preset in "graphics.userPresets"
+QString presetKey(GameManager::GraphicsPreset preset) {
+    switch (preset) {
+        case GameManager::GraphicsPreset::BATTERY_SAVER:
+            return "batterySaver";
+        case GameManager::GraphicsPreset::BALANCED:
+            return "balanced";
+        case GameManager::GraphicsPreset::PERFORMANCE:
+            return "performance";
+    }
+    return QString();
+}
+
+QVector<int> intList(const QVariant& value) {
+    QVector<int> list;
+    for (const QVariant& item : value.toList()) {
+        list.append(item.toInt());
+    }
+    return list;
+}
+
+} // namespace
 
 GameManager* GameManager::s_instance = nullptr;
 
@@ -20,7 +66,21 @@ GameManager::GameManager(QObject* parent)
     , m_currentPreset(GraphicsPreset::BALANCED)
     , m_currentAPI("vulkan")
     , m_targetFPS(60)
-    , m_fsrEnabled(true) {
+    , m_fsrEnabled(true)
+    , m_outputWidth(1920)
+    , m_outputHeight(1080)
+    , m_gameWidth(0)
+    , m_gameHeight(0)
+    , m_renderWidth(0)
+    , m_renderHeight(0)
+    , m_refreshRate(60)
+    , m_presetScale(1.0)
+    , m_userConfigPath(Config::userConfigPath())
+    , m_launchPipeline(nullptr)
+    , m_launchLatencyMs(-1)
+    , m_launchPlanCacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                           + "/launch-plans")
+    , m_keepSnapshots(20) {
     
     // Initialize Vulkan layers map
     m_vulkanLayers = {
@@ -28,106 +88,804 @@ GameManager::GameManager(QObject* parent)
         {"VK_LAYER_VALVE_steam_fossilize", "1"},
         {"VK_LAYER_MESA_device_select", "1"}
     };
+
+    const QVariantMap graphics = Config::instance()->value("graphics").toMap();
+    const QVariantMap resolution = graphics.value("resolution").toMap();
+    m_outputWidth = resolution.value("width", m_outputWidth).toInt();
+    m_outputHeight = resolution.value("height", m_outputHeight).toInt();
+    m_gameWidth = m_outputWidth;
+    m_gameHeight = m_outputHeight;
+    m_refreshRate = graphics.value("refreshRate", m_refreshRate).toInt();
+
+    const QVariantMap shaderCache = graphics.value("shaderCache").toMap();
+    if (shaderCache.value("enabled", true).toBool()) {
+        m_shaderCache.setBudget(shaderCache.value("maxSizeMB", 1024).toLongLong() * 1024 * 1024);
+        m_shaderCache.setMaxAge(shaderCache.value("cleanupIntervalDays", 7).toLongLong() * 24 * 3600);
+        // The budget covers the partitions the driver writes; the store's
+        // manifest and blobs and the Fossilize databases are not the
+        // manager's to delete, and blobs freed by eviction are collected
+        // with the next compaction
+        m_shaderCache.setExcluded(ShaderCacheStore::metadataPaths()
+                                  << QDir(shaderCachePath()).relativeFilePath(fossilizePath()));
+        m_shaderCache.open(shaderCachePath());
+        m_shaderStore.setRoot(shaderCachePath());
+        connect(&m_shaderCache, &ShaderCacheManager::evicted, this, [this](int files) {
+            if (files > 0) {
+                compactShaderCache();
+            }
+        });
+
+        // Never compete with the game for the disk
+        auto* gamescope = GamescopeSupervisor::instance();
+        connect(gamescope, &GamescopeSupervisor::started, this, [this]() {
+            m_shaderCache.setGameRunning(true);
+            m_prewarmer.setGameRunning(true);
+        });
+        connect(gamescope, &GamescopeSupervisor::stopped, this, [this]() {
+            m_shaderCache.setGameRunning(false);
+            m_prewarmer.setGameRunning(false);
+            compactShaderCache();
+        });
+
+        // Replay what Fossilize recorded while nothing else is going on
+        const QVariantMap prewarm = shaderCache.value("prewarm").toMap();
+        if (prewarm.value("enabled", true).toBool()) {
+            ShaderPrewarmer::Limits limits;
+            limits.minBatteryPercent = prewarm.value("minBatteryPercent", limits.minBatteryPercent).toInt();
+            limits.maxTemperature = prewarm.value("maxTemperature", limits.maxTemperature).toDouble();
+            limits.resumeTemperature = limits.maxTemperature - 5.0;
+            m_prewarmer.setLimits(limits);
+            m_prewarmer.setCommand(prewarm.value("command", "fossilize-replay").toString(),
+                                   prewarm.value("arguments").toStringList());
+            m_prewarmer.setDatabaseDirectory(fossilizePath());
+            m_prewarmer.setStatePath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                                     + "/shader-prewarm.json");
+            m_prewarmer.setIdleDelay(prewarm.value("idleDelaySeconds", 60).toInt() * 1000);
+            m_prewarmer.monitor(AllySystemControl::instance());
+            m_prewarmer.setGameRunning(false);
+            preparePrewarm();
+            connect(this, &GameManager::gameVersionChanged, this, &GameManager::preparePrewarm);
+        }
+    }
+
+    const QVariantMap game = Config::instance()->value("game").toMap();
+    m_installStore.setRoot(expandHome(game.value("versionStore").toString()));
+
+    const QVariantMap backup = game.value("backup").toMap();
+    m_worldBackup.setRepository(expandHome(game.value("backupPath").toString()));
+    m_worldBackup.setCompressionLevel(backup.value("compressionLevel", 3).toInt());
+    m_keepSnapshots = backup.value("keepSnapshots", m_keepSnapshots).toInt();
+    if (backup.value("onExit", true).toBool()) {
+        connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::stopped,
+                this, &GameManager::backupWorlds);
+    }
+
+    // Downloads keep going during a session, but leave it the bandwidth
+    const QVariantMap downloads = Config::instance()->value("downloads").toMap();
+    m_downloads.setMaxActiveJobs(downloads.value("maxActiveJobs", 2).toInt());
+    m_downloads.setSegmentCount(downloads.value("segments", 3).toInt());
+    m_downloads.setBandwidthLimit(downloads.value("bandwidthLimitKiB", 0).toLongLong() * 1024);
+    m_downloads.setGameBandwidthLimit(downloads.value("gameBandwidthLimitKiB", 0).toLongLong() * 1024);
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::started, this, [this]() {
+        m_downloads.setGameRunning(true);
+    });
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::stopped, this, [this]() {
+        m_downloads.setGameRunning(false);
+    });
+
+    // The launcher steps back for as long as the game runs
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::started, this, [this]() {
+        m_scheduler.lowerLauncher();
+    });
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::stopped, this, [this]() {
+        m_scheduler.restoreLauncher();
+    });
+
+    // Frame statistics for every session; the controllers below share them
+    m_frameCapture.setPath(expandHome(Config::instance()->value("hardware").toMap()
+        .value("governor").toMap().value("frameTimeLog").toString()));
+    connect(&m_frameCapture, &FrameCapture::framesCaptured, this, &GameManager::onFramesCaptured);
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::started, this, [this]() {
+        m_frameCapture.reset();
+        startFrameCapture();
+    });
+    connect(GamescopeSupervisor::instance(), &GamescopeSupervisor::stopped, this, [this]() {
+        if (!isGovernorEnabled() && !isDynamicResolutionEnabled()) {
+            m_frameCapture.stop();
+        }
+    });
+
+    m_governorTimer.setInterval(1000);
+    connect(&m_governorTimer, &QTimer::timeout, this, &GameManager::governorTick);
+    if (Config::instance()->value("hardware").toMap().value("governor").toMap()
+            .value("enabled", false).toBool()) {
+        setGovernorEnabled(true);
+    }
+
+    m_presetTuner.setApply([this](const PresetTuner::Point& point) {
+        return applyTuningPoint(point);
+    });
+    m_presetTuner.setSampler([](double& watts, double& temperature) {
+        const TelemetrySample sample = AllySystemControl::instance()->latestSample();
+        if (sample.acOnline) {
+            return false;
+        }
+        watts = sample.batteryPower;
+        temperature = std::max(sample.cpuTemperature, sample.gpuTemperature);
+        return true;
+    });
+    m_presetTuner.setWrapper(&GameManager::tuningCommand);
+    connect(&m_presetTuner, &PresetTuner::finished, this, &GameManager::onPresetTuningFinished);
+
+    m_scalerTimer.setInterval(250);
+    connect(&m_scalerTimer, &QTimer::timeout, this, &GameManager::scalerTick);
+    if (graphics.value("dynamicResolution").toMap().value("enabled", false).toBool()) {
+        setDynamicResolutionEnabled(true);
+    }
 }
 
 bool GameManager::applyROGAllyOptimizations() {
-    setupVulkanLayers();
-    configureGameScope();
-    setupControllerHints();
-    optimizeShaderCache();
-    
-    // Set environment variables for optimal performance
-    qputenv("MESA_VK_WSI_PRESENT_MODE", "mailbox");
-    qputenv("PROTON_FORCE_LARGE_ADDRESS_AWARE", "1");
-    qputenv("PROTON_HIDE_NVIDIA_GPU", "1");
-    
+    // Same preparation as a launch, minus the spawn, for callers that
+    // need it done before they continue
+    LaunchPipeline* pipeline = createLaunchPipeline(false);
+    pipeline->start();
+    const bool ok = pipeline->waitForFinished();
+    delete pipeline;
+    return ok;
+}
+
+bool GameManager::launchGame() {
+    if (m_launchPipeline && m_launchPipeline->isRunning()) {
+        return false;
+    }
+
+    m_launchClock.start();
+    m_launchLatencyMs = -1;
+    m_prewarmer.setGameRunning(true);
+    if (m_worldBackup.isCapturing()) {
+        // Without reflinks the worlds have to stay put for the whole
+        // backup; a half-captured snapshot is worse than none
+        qWarning() << "Game launched during a world backup; discarding it";
+        m_worldBackup.cancel();
+    }
+    if (m_launchPipeline) {
+        m_launchPipeline->deleteLater();
+    }
+    m_launchPipeline = createLaunchPipeline(true);
+    connect(m_launchPipeline, &LaunchPipeline::finished, this, &GameManager::onLaunchFinished);
+    if (!m_launchPipeline->start()) {
+        m_prewarmer.setGameRunning(false);
+        return false;
+    }
     return true;
 }
 
-void GameManager::setupVulkanLayers() {
-    QString layersPath = QDir::homePath() + "/.local/share/vulkan/implicit_layer.d/";
-    QDir().mkpath(layersPath);
-    
+LaunchPipeline* GameManager::createLaunchPipeline(bool spawnGame) {
+    auto* pipeline = new LaunchPipeline(this);
+    connect(pipeline, &LaunchPipeline::stageFinished, this, &GameManager::launchStageFinished);
+
+    // Reuse the cached plan when nothing it depends on changed, then write
+    // only the files that differ from it
+    pipeline->addStage("plan", [this]() {
+        return prepareLaunchPlan(m_launchPlan);
+    });
+    pipeline->addStage("materialize", [this]() {
+        return m_launchPlan.materialize() >= 0;
+    }, {"plan"});
+
+    // The Steam API is only used from the GUI thread. A missing config
+    // is not worth failing the launch over.
+    const QString inputConfig = Config::instance()->value("steam").toMap()
+        .value("controllerConfig").toString();
+    pipeline->addStage("steam-input", [inputConfig]() {
+        auto* steam = SteamIntegration::instance();
+        if (steam->isSteamRunning() && !steam->loadSteamInputConfig(inputConfig)) {
+            qWarning() << "Could not load Steam Input config" << inputConfig;
+        }
+        return true;
+    }, {}, LaunchPipeline::Affinity::OwnerThread);
+
+    // Switch to the cache partition of the installed driver and game; a
+    // cold cache only costs stutter, not the launch
+    pipeline->addStage("shader-cache", [this]() {
+        if (m_shaderStore.root().isEmpty()) {
+            return true;
+        }
+        if (m_shaderStore.activate(ShaderCacheStore::driverBuildId(), gameVersion()).isEmpty()) {
+            qWarning() << "Launching without a shader cache partition";
+        }
+        return true;
+    });
+
+    if (spawnGame) {
+        pipeline->addStage("spawn", [this]() {
+            auto* gamescope = GamescopeSupervisor::instance();
+            configureGameScope();
+            m_scheduler.setPolicy(schedulingPolicy());
+            if (!m_scheduler.prepare()) {
+                qWarning() << "Launching without a cgroup of the game's own";
+            }
+            gamescope->setChildProcessModifier(m_scheduler.childModifier());
+            gamescope->setCommand(m_launchPlan.program, m_launchPlan.arguments,
+                                  m_launchPlan.workingDirectory);
+            gamescope->setEnvironment(m_launchPlan.processEnvironment());
+            if (!gamescope->start()) {
+                return false;
+            }
+            m_launchLatencyMs = m_launchClock.elapsed();
+            return true;
+        }, {"materialize", "steam-input", "shader-cache"}, LaunchPipeline::Affinity::OwnerThread);
+    }
+    return pipeline;
+}
+
+QByteArray GameManager::launchPlanKey() const {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(Config::instance()->fingerprint());
+    hash.addData(QByteArray::number(static_cast<int>(m_currentPreset)) + ":"
+                 + QByteArray::number(m_targetFPS) + ":"
+                 + QByteArray::number(m_fsrEnabled) + ":" + m_currentAPI.toUtf8());
+    for (auto it = m_vulkanLayers.begin(); it != m_vulkanLayers.end(); ++it) {
+        hash.addData(":" + it.key().toUtf8() + "=" + it.value().toUtf8());
+    }
+    // The shader cache path depends on the driver and game version
+    hash.addData(":" + ShaderCacheStore::partitionKey(ShaderCacheStore::driverBuildId(),
+                                                      gameVersion()).toUtf8());
+    return hash.result();
+}
+
+bool GameManager::prepareLaunchPlan(LaunchPlan& plan, bool* cached) const {
+    const QByteArray key = launchPlanKey();
+    const QString cachePath = m_launchPlanCacheDir + "/" + QString::fromLatin1(key.toHex()) + ".json";
+
+    if (LaunchPlan::load(cachePath, plan) && plan.key == key && plan.isCurrent()) {
+        if (cached) {
+            *cached = true;
+        }
+        return true;
+    }
+
+    plan = compileLaunchPlan();
+    plan.key = key;
+    if (!plan.save(cachePath)) {
+        qWarning() << "Failed to cache launch plan at" << cachePath;
+    }
+    if (cached) {
+        *cached = false;
+    }
+    return true;
+}
+
+LaunchPlan GameManager::compileLaunchPlan() const {
+    LaunchPlan plan;
+
+    const QVariantMap game = Config::instance()->value("game").toMap();
+    const QString executable = game.value("executable", "mcpelauncher-client").toString();
+    const QString resolved = QStandardPaths::findExecutable(executable);
+    plan.program = resolved.isEmpty() ? executable : resolved;
+    plan.gameFingerprint = LaunchPlan::fileFingerprint(plan.program);
+    plan.workingDirectory = expandHome(game.value("dataPath").toString());
+    plan.arguments << "-dg" << installPath() << "-dd" << plan.workingDirectory;
+    plan.directories << plan.workingDirectory;
+
+    // Environment variables for optimal performance
+    plan.setEnvironment("MESA_VK_WSI_PRESENT_MODE", "mailbox");
+    plan.setEnvironment("PROTON_FORCE_LARGE_ADDRESS_AWARE", "1");
+    plan.setEnvironment("PROTON_HIDE_NVIDIA_GPU", "1");
+    const QMap<QString, QString> steamEnvironment = SteamIntegration::gamemodeEnvironment();
+    for (auto it = steamEnvironment.begin(); it != steamEnvironment.end(); ++it) {
+        plan.setEnvironment(it.key(), it.value());
+    }
+
+    setupVulkanLayers(plan);
+    setupControllerHints(plan);
+    optimizeShaderCache(plan);
+    return plan;
+}
+
+void GameManager::onLaunchFinished(bool ok) {
+    if (ok) {
+        emit gameLaunched(m_launchLatencyMs);
+    } else {
+        // No game to give way to after all
+        if (!GamescopeSupervisor::instance()->isRunning()) {
+            m_prewarmer.setGameRunning(false);
+        }
+        emit launchFailed();
+    }
+}
+
+void GameManager::setupVulkanLayers(LaunchPlan& plan) const {
+    plan.directories << QDir::homePath() + "/.local/share/vulkan/implicit_layer.d/";
+
     // Enable required Vulkan layers
     for (auto it = m_vulkanLayers.begin(); it != m_vulkanLayers.end(); ++it) {
-        qputenv(it.key().toUtf8(), it.value().toUtf8());
+        plan.setEnvironment(it.key(), it.value());
     }
 }
 
 void GameManager::configureGameScope() {
-    QProcess gamescope;
-    QStringList args;
-    
-    args << "--force-grab-cursor"
-         << "--adaptive-sync"
-         << "--expose-wayland"
-         << "--output-width" << "1920"
-         << "--output-height" << "1080"
-         << "--fps-limit" << QString::number(m_targetFPS);
-         
-    if (m_fsrEnabled) {
-        args << "--fsr";
+    // Bursts of changes (a preset switch) reach the running gamescope as a
+    // single update; only a new output size restarts it. A new render size
+    // is a mode change the game rides out.
+    const double scale = isDynamicResolutionEnabled() ? m_scaler.scale() : m_presetScale;
+    const ResolutionScaler::Size render = ResolutionScaler::scaledSize(m_gameWidth, m_gameHeight, scale);
+
+    auto* gamescope = GamescopeSupervisor::instance();
+    gamescope->setOutputSize(m_outputWidth, m_outputHeight);
+    gamescope->setRenderSize(render.width, render.height);
+    gamescope->setRefreshRate(m_refreshRate);
+    gamescope->setFpsLimit(fpsLimit());
+    gamescope->setFsrEnabled(m_fsrEnabled || isDynamicResolutionEnabled());
+
+    if (render.width != m_renderWidth || render.height != m_renderHeight) {
+        m_renderWidth = render.width;
+        m_renderHeight = render.height;
+        emit resolutionChanged(render.width, render.height);
     }
-    
-    gamescope.startDetached("gamescope", args);
+}
+
+int GameManager::fpsLimit() const {
+    return m_refreshRate > 0 ? std::min(m_targetFPS, m_refreshRate) : m_targetFPS;
+}
+
+bool GameManager::setGameResolution(int width, int height) {
+    if (width <= 0 || height <= 0 || width > m_outputWidth || height > m_outputHeight) {
+        qWarning() << "Game resolution" << width << "x" << height << "does not fit the"
+                   << m_outputWidth << "x" << m_outputHeight << "output";
+        return false;
+    }
+    m_gameWidth = width;
+    m_gameHeight = height;
+    configureGameScope();
+    return true;
+}
+
+bool GameManager::setRefreshRate(int hz) {
+    if (hz <= 0) {
+        return false;
+    }
+    m_refreshRate = hz;
+    m_scaler.setTargetFps(fpsLimit());
+    configureGameScope();
+    return true;
 }
 
 bool GameManager::setGraphicsPreset(GraphicsPreset preset) {
-    auto* systemControl = AllySystemControl::instance();
-    
+    // TDP and GPU clock are applied as one transaction so a failed write
+    // never leaves the device half-way between two presets. Refresh rate
+    // and render scale are those of performance_profiles.yml.
+    HardwareState state;
+    int targetFPS = m_targetFPS;
+    int refreshRate = m_refreshRate;
+    double scale = m_presetScale;
     switch (preset) {
         case GraphicsPreset::BATTERY_SAVER:
-            systemControl->setTDP(10);
-            systemControl->setGPUFreq(1200);
-            m_targetFPS = 30;
+            state.set(HardwareState::Tdp, 10).set(HardwareState::GpuClock, 1200);
+            targetFPS = 30;
+            refreshRate = 40;
+            scale = 0.75;
             break;
             
         case GraphicsPreset::BALANCED:
-            systemControl->setTDP(15);
-            systemControl->setGPUFreq(1600);
-            m_targetFPS = 60;
+            state.set(HardwareState::Tdp, 15).set(HardwareState::GpuClock, 1600);
+            targetFPS = 60;
+            refreshRate = 60;
+            scale = 1.0;
             break;
             
         case GraphicsPreset::PERFORMANCE:
-            systemControl->setTDP(25);
-            systemControl->setGPUFreq(2000);
-            m_targetFPS = 90;
+            state.set(HardwareState::Tdp, 25).set(HardwareState::GpuClock, 2000);
+            targetFPS = 90;
+            refreshRate = 90;
+            scale = 1.0;
             break;
     }
+
+    // Measured on this unit by startPresetTuning(), once it has been run
+    const QVariantMap tuned = Config::instance()->value("graphics").toMap()
+        .value("userPresets").toMap().value(presetKey(preset)).toMap();
+    if (!tuned.isEmpty()) {
+        state.set(HardwareState::Tdp, tuned.value("tdp").toInt())
+             .set(HardwareState::GpuClock, tuned.value("gpuClock").toInt());
+        targetFPS = tuned.value("fpsCap").toInt();
+        refreshRate = std::max(refreshRate, targetFPS);
+    }
+
+    if (!AllySystemControl::instance()->applyHardwareState(state)) {
+        return false;
+    }
     
     m_currentPreset = preset;
     emit graphicsPresetChanged(preset);
-    emit fpsLimitChanged(m_targetFPS);
-    
+
+    if (targetFPS != m_targetFPS || refreshRate != m_refreshRate || scale != m_presetScale) {
+        if (targetFPS != m_targetFPS) {
+            m_targetFPS = targetFPS;
+            m_governor.setTargetFps(m_targetFPS);
+            emit fpsLimitChanged(m_targetFPS);
+        }
+        m_refreshRate = refreshRate;
+        if (scale != m_presetScale) {
+            // The preset's scale is where dynamic resolution starts from
+            m_presetScale = scale;
+            ResolutionScaler::Settings scaling = m_scaler.settings();
+            scaling.maxScale = scale;
+            m_scaler.setSettings(scaling);
+            m_scaler.reset();
+        }
+        m_scaler.setTargetFps(fpsLimit());
+        configureGameScope();
+    }
+    if (isGovernorEnabled()) {
+        m_governor.reset(AllySystemControl::instance()->currentTDP(), m_governorClock.elapsed());
+    }
+    return true;
+}
+
+GameScheduler::Policy GameManager::schedulingPolicy() const {
+    const QVariantMap hardware = Config::instance()->value("hardware").toMap();
+    QString profile = hardware.value("defaultProfile", "balanced").toString();
+    switch (AllySystemControl::instance()->currentProfile()) {
+        case AllySystemControl::PerformanceProfile::SILENT:
+            profile = "silent";
+            break;
+        case AllySystemControl::PerformanceProfile::BALANCED:
+            profile = "balanced";
+            break;
+        case AllySystemControl::PerformanceProfile::TURBO:
+            profile = "turbo";
+            break;
+        case AllySystemControl::PerformanceProfile::MANUAL:
+            break;
+    }
+    return GameScheduler::Policy::fromConfig(hardware.value("profiles").toMap()
+        .value(profile).toMap().value("scheduling").toMap());
+}
+
+bool GameManager::startPresetTuning() {
+    if (m_presetTuner.isRunning()) {
+        return true;
+    }
+    if (GamescopeSupervisor::instance()->isRunning()) {
+        qWarning() << "Presets cannot be tuned while a game runs";
+        return false;
+    }
+    if (isGovernorEnabled() || isDynamicResolutionEnabled()) {
+        qWarning() << "Turn off the governor and dynamic resolution before tuning presets";
+        return false;
+    }
+    if (AllySystemControl::instance()->latestSample().acOnline) {
+        // Battery drain is the only power reading there is
+        qWarning() << "Presets are tuned on battery; unplug the charger";
+        return false;
+    }
+
+    const QVariantMap settings = Config::instance()->value("graphics").toMap()
+        .value("autoTune").toMap();
+    PresetTuner::Grid grid;
+    grid.tdps = intList(settings.value("tdps"));
+    grid.gpuClocks = intList(settings.value("gpuClocks"));
+    // gamescope caps at the refresh rate anyway
+    for (int cap : intList(settings.value("fpsCaps"))) {
+        if (cap > 0 && cap <= m_refreshRate) {
+            grid.fpsCaps.append(cap);
+        } else {
+            qWarning() << "Skipping frame cap" << cap << "above the" << m_refreshRate << "Hz refresh rate";
+        }
+    }
+    m_presetTuner.setGrid(grid);
+
+    PresetTuner::Settings tuning = m_presetTuner.settings();
+    tuning.warmupMs = settings.value("warmupSeconds", tuning.warmupMs / 1000).toInt() * 1000;
+    tuning.durationMs = settings.value("durationSeconds", tuning.durationMs / 1000).toInt() * 1000;
+    tuning.thermalLimit = Config::instance()->value("hardware").toMap().value("governor").toMap()
+        .value("thermalLimit", tuning.thermalLimit).toDouble();
+    m_presetTuner.setSettings(tuning);
+    m_presetTuner.setCommand(settings.value("command").toString(), settings.value("arguments").toStringList());
+    m_presetTuner.setFrameTimeLog(m_frameCapture.path());
+    return m_presetTuner.start();
+}
+
+bool GameManager::applyTuningPoint(const PresetTuner::Point& point) {
+    HardwareState state;
+    state.set(HardwareState::Tdp, point.tdp).set(HardwareState::GpuClock, point.gpuClock);
+    if (!AllySystemControl::instance()->applyHardwareState(state)) {
+        return false;
+    }
+    return true;
+}
+
+QStringList GameManager::tuningCommand(const PresetTuner::Point& point, const QStringList& command) {
+    // No running session to cap: the workload gets a gamescope of its own
+    auto* gamescope = GamescopeSupervisor::instance();
+    GamescopeSupervisor::Settings settings = gamescope->pendingSettings();
+    settings.fpsLimit = point.fpsCap;
+    return QStringList(gamescope->program()) + GamescopeSupervisor::arguments(settings, command);
+}
+
+void GameManager::onPresetTuningFinished(bool ok) {
+    const QVector<PresetTuner::Result> frontier = PresetTuner::paretoFrontier(m_presetTuner.results());
+    if (ok && !storeTunedPresets(PresetTuner::choosePresets(frontier))) {
+        qWarning() << "Preset tuning found no frame cap the workload holds";
+    }
+
+    // Back to the active preset, tuned or not
+    setGraphicsPreset(m_currentPreset);
+}
+
+bool GameManager::storeTunedPresets(const QVector<PresetTuner::Result>& chosen) {
+    if (chosen.isEmpty()) {
+        return false;
+    }
+
+    // Lowest cap saves the most battery, highest runs smoothest
+    auto preset = [](const PresetTuner::Result& result) {
+        QVariantMap values;
+        values["tdp"] = result.point.tdp;
+        values["gpuClock"] = result.point.gpuClock;
+        values["fpsCap"] = result.point.fpsCap;
+        values["watts"] = result.watts;
+        values["low1Fps"] = result.low1Fps;
+        values["p99FrameTime"] = result.p99FrameTime;
+        return values;
+    };
+    QVariantMap presets;
+    presets[presetKey(GraphicsPreset::BATTERY_SAVER)] = preset(chosen.first());
+    presets[presetKey(GraphicsPreset::BALANCED)] = preset(chosen[chosen.size() / 2]);
+    presets[presetKey(GraphicsPreset::PERFORMANCE)] = preset(chosen.last());
+
+    QVariantMap graphics = Config::instance()->value("graphics").toMap();
+    graphics["userPresets"] = presets;
+    Config::instance()->setValue("graphics", graphics);
+
+    if (!Config::saveOverrides(m_userConfigPath, {{"graphics", QVariantMap{{"userPresets", presets}}}})) {
+        qWarning() << "Failed to save tuned presets to" << m_userConfigPath;
+        return false;
+    }
+    return true;
+}
+
+bool GameManager::setGovernorEnabled(bool enabled) {
+    if (!enabled) {
+        m_governorTimer.stop();
+        return true;
+    }
+
+    if (!startFrameCapture()) {
+        return false;
+    }
+
+    const QVariantMap settings = Config::instance()->value("hardware").toMap()
+        .value("governor").toMap();
+    TdpGovernor::Limits limits;
+    limits.minTdp = settings.value("minTdp", limits.minTdp).toInt();
+    limits.maxTdp = settings.value("maxTdp", limits.maxTdp).toInt();
+    limits.thermalLimit = settings.value("thermalLimit", limits.thermalLimit).toDouble();
+    m_governor.setLimits(limits);
+    m_governor.setTargetFps(m_targetFPS);
+
+    m_governorClock.start();
+    m_governor.reset(AllySystemControl::instance()->currentTDP(), 0);
+    m_governorTimer.start();
+    return true;
+}
+
+bool GameManager::setDynamicResolutionEnabled(bool enabled) {
+    if (!enabled) {
+        m_scalerTimer.stop();
+        m_scaler.reset();
+        configureGameScope();
+        return true;
+    }
+    if (isDynamicResolutionEnabled()) {
+        return true;
+    }
+    if (!startFrameCapture()) {
+        return false;
+    }
+
+    const QVariantMap settings = Config::instance()->value("graphics").toMap()
+        .value("dynamicResolution").toMap();
+    ResolutionScaler::Settings scaling = m_scaler.settings();
+    scaling.maxScale = m_presetScale;
+    scaling.minScale = settings.value("minScale", scaling.minScale).toDouble();
+    scaling.percentile = settings.value("percentile", scaling.percentile * 100).toDouble() / 100.0;
+    m_scaler.setSettings(scaling);
+    m_scaler.setTargetFps(fpsLimit());
+    m_scaler.reset();
+
+    m_scalerClock.start();
+    m_scalerTimer.start();
     configureGameScope();
     return true;
 }
 
-void GameManager::setupControllerHints() {
-    // Create controller hint file
+bool GameManager::startFrameCapture() {
+    if (m_frameCapture.isRunning()) {
+        return true;
+    }
+    if (m_frameCapture.path().isEmpty()) {
+        qWarning() << "No frame time log configured";
+        return false;
+    }
+    m_frameCapture.start();
+    return true;
+}
+
+void GameManager::onFramesCaptured(const QVector<double>& frameTimes) {
+    for (double frameTime : frameTimes) {
+        if (isGovernorEnabled()) {
+            m_governor.addFrameTime(frameTime);
+        }
+        if (isDynamicResolutionEnabled()) {
+            m_scaler.addFrameTime(frameTime);
+        }
+    }
+    AllySystemControl::instance()->addFrames(frameTimes.size());
+}
+
+void GameManager::scalerTick() {
+    m_frameCapture.poll();
+    if (m_scaler.update(m_scalerClock.elapsed())) {
+        configureGameScope();
+    }
+}
+
+void GameManager::governorTick() {
+    m_frameCapture.poll();
+
+    auto* systemControl = AllySystemControl::instance();
+    const TdpGovernor::Output output = m_governor.update(m_governorClock.elapsed(),
+                                                         systemControl->getCurrentTemperature());
+    HardwareState state;
+    state.set(HardwareState::Tdp, output.tdp).set(HardwareState::GpuClock, output.gpuClock);
+    systemControl->applyHardwareState(state);
+}
+
+void GameManager::setupControllerHints(LaunchPlan& plan) const {
+    // Controller hint file
     QString hintPath = QDir::homePath() + "/.local/share/minecraft/controller_hints.json";
-    QFile hintFile(hintPath);
-    
-    if (hintFile.open(QIODevice::WriteOnly)) {
-        QJsonObject hints;
-        hints["controller_type"] = "xbox";
-        hints["show_button_prompts"] = true;
-        hints["vibration_enabled"] = true;
-        
-        QJsonDocument doc(hints);
-        hintFile.write(doc.toJson());
-        hintFile.close();
+
+    QJsonObject hints;
+    hints["controller_type"] = "xbox";
+    hints["show_button_prompts"] = true;
+    hints["vibration_enabled"] = true;
+
+    QJsonDocument doc(hints);
+    plan.addFile(hintPath, doc.toJson());
+}
+
+void GameManager::optimizeShaderCache(LaunchPlan& plan) const {
+    const QString cachePath = m_shaderStore.partitionPath(
+        ShaderCacheStore::partitionKey(ShaderCacheStore::driverBuildId(), gameVersion()));
+    plan.directories << cachePath;
+
+    // Environment variables for shader cache
+    for (const char* variable : ShaderCacheVariables) {
+        plan.setEnvironment(variable, cachePath);
     }
+    plan.setEnvironment("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+
+    // Where the Fossilize layer records pipelines for the pre-warm replay
+    plan.directories << fossilizePath();
+    plan.setEnvironment("FOSSILIZE_DUMP_PATH", fossilizePath() + "/minecraft");
 }
 
-void GameManager::optimizeShaderCache() {
-    QString cachePath = QDir::homePath() + "/.local/share/minecraft/shader_cache";
-    QDir().mkpath(cachePath);
-    
-    // Set environment variables for shader cache
-    qputenv("MESA_GLSL_CACHE_DIR", cachePath.toUtf8());
-    qputenv("__GL_SHADER_DISK_CACHE_PATH", cachePath.toUtf8());
-    qputenv("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+QString GameManager::shaderCachePath() {
+    return QDir::homePath() + "/.local/share/minecraft/shader_cache";
+}
+
+QString GameManager::fossilizePath() {
+    return shaderCachePath() + "/fossilize";
+}
+
+QString GameManager::installPath() const {
+    if (!m_installStore.activeVersion().isEmpty()) {
+        return m_installStore.currentPath();
+    }
+    return expandHome(Config::instance()->value("game").toMap().value("installPath").toString());
+}
+
+QString GameManager::gameVersion() const {
+    const QString active = m_installStore.activeVersion();
+    if (!active.isEmpty()) {
+        return active;
+    }
+
+    // Without an explicit version the game library identifies the build
+    const QString version = Config::instance()->value("game").toMap().value("version").toString();
+    if (!version.isEmpty()) {
+        return version;
+    }
+    const QByteArray fingerprint = LaunchPlan::fileFingerprint(installPath()
+                                                               + "/lib/x86_64/libminecraftpe.so");
+    return fingerprint.isEmpty() ? QString()
+                                 : QString::fromLatin1(LaunchPlan::contentHash(fingerprint).toHex().left(12));
+}
+
+QString GameManager::worldsPath() {
+    return expandHome(Config::instance()->value("game").toMap().value("dataPath").toString())
+        + "/games/com.mojang/minecraftWorlds";
+}
+
+bool GameManager::switchGameVersion(const QString& name) {
+    // The running game would keep the old files open while its next
+    // loads come from the new version
+    if (GamescopeSupervisor::instance()->isRunning()) {
+        qWarning() << "Not switching game version while the game is running";
+        return false;
+    }
+    if (!m_installStore.activate(name)) {
+        return false;
+    }
+    emit gameVersionChanged(name);
+    return true;
+}
+
+bool GameManager::installGameVersion(const QString& name, const QString& archive) {
+    // Unpacked into the same staging tree every time, so an update only
+    // writes the entries that changed
+    const QString staging = m_installStore.root() + "/staging";
+    ArchiveExtractor extractor;
+    const ArchiveExtractor::Result result = extractor.extract(archive, staging);
+    if (!result.ok) {
+        return false;
+    }
+    return m_installStore.addVersion(name, staging);
+}
+
+bool GameManager::backupWorlds() {
+    // Worlds are only consistent on disk while the game is not running
+    if (m_worldBackup.repository().isEmpty() || m_worldBackup.isRunning()
+        || GamescopeSupervisor::instance()->isRunning() || !QFileInfo::exists(worldsPath())) {
+        return false;
+    }
+
+    QThreadPool::globalInstance()->start([this]() {
+        const WorldBackup::Result result = m_worldBackup.backup(worldsPath());
+        if (!result.ok) {
+            qWarning() << "World backup failed or was cancelled";
+            return;
+        }
+        m_worldBackup.prune(m_keepSnapshots);
+    });
+    return true;
+}
+
+void GameManager::preparePrewarm() {
+    // The replay has to compile into the partition the next session reads,
+    // which activating makes sure the store keeps. Activation may copy a
+    // partition out of the blob store, so not on this thread.
+    const QString driver = ShaderCacheStore::driverBuildId();
+    const QString version = gameVersion();
+    QThreadPool::globalInstance()->start([this, driver, version]() {
+        const QString cachePath = m_shaderStore.activate(driver, version);
+        if (cachePath.isEmpty()) {
+            qWarning() << "Shader pre-warm has no cache partition to compile into";
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, cachePath, driver, version]() {
+            QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+            for (const char* variable : ShaderCacheVariables) {
+                environment.insert(variable, cachePath);
+            }
+            environment.insert("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1");
+            m_prewarmer.setEnvironment(environment);
+            m_prewarmer.setPartition(ShaderCacheStore::partitionKey(driver, version));
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GameManager::compactShaderCache() {
+    // Hashing a large cache takes a while; none of it is urgent. The
+    // install store is only read here, on its own thread.
+    const QString driver = ShaderCacheStore::driverBuildId();
+    const QStringList versions = m_installStore.versions();
+    QThreadPool::globalInstance()->start([this, driver, versions]() {
+        m_shaderStore.deduplicate();
+        m_shaderStore.collectGarbage(driver, versions);
+    });
 }
 
 bool GameManager::enableFSR(bool enabled) {
@@ -3,6 +3,21 @@
 #include <QObject>
 #include <QString>
 #include <QMap>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "FrameCapture.hpp"
+#include "GameScheduler.hpp"
+#include "LaunchPipeline.hpp"
+#include "LaunchPlan.hpp"
+#include "PresetTuner.hpp"
+#include "ResolutionScaler.hpp"
+#include "ShaderCacheManager.hpp"
+#include "ShaderCacheStore.hpp"
+#include "ShaderPrewarmer.hpp"
+#include "TdpGovernor.hpp"
+#include "../network/DownloadManager.hpp"
+#include "../storage/InstallStore.hpp"
+#include "../storage/WorldBackup.hpp"
 
 class GameManager : public QObject {
     Q_OBJECT
@@ -11,9 +26,51 @@ public:
     static GameManager* instance();
 
     bool applyROGAllyOptimizations();
+
+    // Prepare the environment and start the game without blocking the
+    // caller; completion is reported through gameLaunched()/launchFailed()
+    bool launchGame();
+    const LaunchPipeline* launchPipeline() const { return m_launchPipeline; }
+    // Time from launchGame() to the game process being spawned, -1 if none
+    qint64 lastLaunchLatencyMs() const { return m_launchLatencyMs; }
+
+    // Load the launch plan cached for the current config and profile, or
+    // compile and cache a new one. cached tells which happened.
+    bool prepareLaunchPlan(LaunchPlan& plan, bool* cached = nullptr) const;
+    LaunchPlan compileLaunchPlan() const;
+    void setLaunchPlanCacheDirectory(const QString& path) { m_launchPlanCacheDir = path; }
+
+    // Budgeted by "graphics.shaderCache"; evicts only while no game runs
+    ShaderCacheManager& shaderCache() { return m_shaderCache; }
+    // One partition per driver build and game version, deduplicated
+    // between sessions
+    ShaderCacheStore& shaderCacheStore() { return m_shaderStore; }
+    // Replays recorded pipelines while idle, from "graphics.shaderCache.prewarm"
+    ShaderPrewarmer& shaderPrewarmer() { return m_prewarmer; }
+
+    // Installed game versions in "game.versionStore"; the active one is
+    // launched instead of "game.installPath"
+    InstallStore& installStore() { return m_installStore; }
+    // Not while the game runs
+    bool switchGameVersion(const QString& name);
+    // Unpack an APK and add it to the store as name
+    bool installGameVersion(const QString& name, const QString& archive);
+
+    // Game and asset downloads, throttled by "downloads" while a game runs
+    DownloadManager& downloads() { return m_downloads; }
+
+    // Snapshot the worlds into "game.backupPath" in the background; also
+    // done whenever the game exits if "game.backup.onExit" is set
+    bool backupWorlds();
+    WorldBackup& worldBackup() { return m_worldBackup; }
+    static QString worldsPath();
+
     bool setupGamepadMapping();
     bool configureGraphicsAPI();
+    // Size the game renders at, before scaling, up to the panel's
+    // ("graphics.resolution"); gamescope upscales it to the panel
     bool setGameResolution(int width, int height);
+    // Also caps the frame limit
     bool setRefreshRate(int hz);
     bool enableFSR(bool enabled);
     
@@ -26,12 +83,53 @@ public:
     
     bool setGraphicsPreset(GraphicsPreset preset);
 
+    // Measure the workload of "graphics.autoTune" over its grid of TDP,
+    // GPU clock and frame cap, on battery, and keep what it finds as user
+    // presets; not while a game runs
+    bool startPresetTuning();
+    const PresetTuner& presetTuner() const { return m_presetTuner; }
+    // How the tuner runs its workload: in gamescope as the game would be,
+    // at the point's frame cap
+    static QStringList tuningCommand(const PresetTuner::Point& point, const QStringList& command);
+    // Store the chosen points, lowest frame cap first, as
+    // "graphics.userPresets" in the user's config; setGraphicsPreset()
+    // then uses them instead of its built-in values
+    bool storeTunedPresets(const QVector<PresetTuner::Result>& chosen);
+    void setUserConfigPath(const QString& path) { m_userConfigPath = path; }
+
+    // CPU and I/O weight, nice value and cores of the game, and how far
+    // the launcher steps back while it runs, from the active hardware
+    // profile's "scheduling"
+    GameScheduler::Policy schedulingPolicy() const;
+    GameScheduler& scheduler() { return m_scheduler; }
+
+    // Frame rate, lows and frame time spread of the running game, read
+    // from "hardware.governor.frameTimeLog"
+    const FrameCapture& frameCapture() const { return m_frameCapture; }
+
+    // Let TDP and GPU clock follow the frame rate instead of the preset's
+    // fixed values
+    bool setGovernorEnabled(bool enabled);
+    bool isGovernorEnabled() const { return m_governorTimer.isActive(); }
+    const TdpGovernor& governor() const { return m_governor; }
+
+    // Scale the render size with the load instead of using the preset's
+    // fixed scale, upscaled with FSR; reads the same frame time log as the
+    // governor and "graphics.dynamicResolution"
+    bool setDynamicResolutionEnabled(bool enabled);
+    bool isDynamicResolutionEnabled() const { return m_scalerTimer.isActive(); }
+    const ResolutionScaler& resolutionScaler() const { return m_scaler; }
+
 signals:
     void optimizationsChanged();
     void graphicsPresetChanged(GraphicsPreset preset);
     void fpsLimitChanged(int limit);
     void resolutionChanged(int width, int height);
     void graphicsAPIChanged(const QString& api);
+    void gameVersionChanged(const QString& name);
+    void launchStageFinished(const QString& stage, qint64 durationMs, bool ok);
+    void gameLaunched(qint64 latencyMs);
+    void launchFailed();
 
 private:
     explicit GameManager(QObject* parent = nullptr);
@@ -39,15 +137,70 @@ private:
 
     static GameManager* s_instance;
     
-    void setupVulkanLayers();
+    void setupVulkanLayers(LaunchPlan& plan) const;
     void configureGameScope();
-    void setupControllerHints();
-    void optimizeShaderCache();
+    void setupControllerHints(LaunchPlan& plan) const;
+    void optimizeShaderCache(LaunchPlan& plan) const;
+    QByteArray launchPlanKey() const;
+    static QString shaderCachePath();
+    static QString fossilizePath();
+    QString gameVersion() const;
+    QString installPath() const;
+    void compactShaderCache();
+    void preparePrewarm();
+    LaunchPipeline* createLaunchPipeline(bool spawnGame);
+    void onLaunchFinished(bool ok);
+    void governorTick();
+    void scalerTick();
+    bool startFrameCapture();
+    void onFramesCaptured(const QVector<double>& frameTimes);
+    bool applyTuningPoint(const PresetTuner::Point& point);
+    void onPresetTuningFinished(bool ok);
+    int fpsLimit() const;
     
     // Current settings
     GraphicsPreset m_currentPreset;
     QString m_currentAPI;
     int m_targetFPS;
     bool m_fsrEnabled;
+    int m_outputWidth;
+    int m_outputHeight;
+    int m_gameWidth;
+    int m_gameHeight;
+    int m_renderWidth;   // Last sent to gamescope
+    int m_renderHeight;
+    int m_refreshRate;
+    double m_presetScale;
     QMap<QString, QString> m_vulkanLayers;
+
+    FrameCapture m_frameCapture;
+    GameScheduler m_scheduler;
+
+    // FPS-targeting power governor
+    TdpGovernor m_governor;
+    QTimer m_governorTimer;
+    QElapsedTimer m_governorClock;
+
+    // Dynamic resolution
+    ResolutionScaler m_scaler;
+    QTimer m_scalerTimer;
+    QElapsedTimer m_scalerClock;
+
+    PresetTuner m_presetTuner;
+    QString m_userConfigPath;
+
+    // Staged launch
+    LaunchPipeline* m_launchPipeline;
+    QElapsedTimer m_launchClock;
+    qint64 m_launchLatencyMs;
+    LaunchPlan m_launchPlan;
+    QString m_launchPlanCacheDir;
+
+    ShaderCacheManager m_shaderCache;
+    ShaderCacheStore m_shaderStore;
+    ShaderPrewarmer m_prewarmer;
+    WorldBackup m_worldBackup;
+    InstallStore m_installStore;
+    DownloadManager m_downloads;
+    int m_keepSnapshots;
 };
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "GameScheduler.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* CgroupMount = "/sys/fs/cgroup";
+constexpr int MaxWeight = 10000;
+
+// From linux/ioprio.h, which glibc does not wrap
+constexpr int IoprioWhoProcess = 1;
+constexpr int IoprioClassNone = 0;
+constexpr int IoprioClassIdle = 3;
+constexpr int IoprioClassShift = 13;
+
+} // namespace
+
+GameScheduler::Policy GameScheduler::Policy::fromConfig(const QVariantMap& settings) {
+    Policy policy;
+    policy.cgroup = settings.value("cgroup", policy.cgroup).toString();
+    policy.cpuWeight = settings.value("cpuWeight", policy.cpuWeight).toInt();
+    policy.ioWeight = settings.value("ioWeight", policy.ioWeight).toInt();
+
+    const QString affinity = settings.value("affinity", "none").toString();
+    if (affinity == "pin") {
+        policy.affinity = Affinity::Pin;
+    } else if (affinity == "prefer") {
+        policy.affinity = Affinity::Prefer;
+    } else if (affinity != "none") {
+        qWarning() << "Unknown CPU affinity mode" << affinity << "- leaving affinity alone";
+    }
+    for (const QVariant& cpu : settings.value("cpus").toList()) {
+        policy.cpus.append(cpu.toInt());
+    }
+    if (policy.cpus.isEmpty()) {
+        policy.affinity = Affinity::None;
+    }
+
+    policy.gameNice = settings.value("gameNice", policy.gameNice).toInt();
+    policy.launcherNice = settings.value("launcherNice", policy.launcherNice).toInt();
+    policy.idleBackgroundIo = settings.value("idleBackgroundIo", policy.idleBackgroundIo).toBool();
+    return policy;
+}
+
+GameScheduler::GameScheduler()
+    : m_cgroupRoot(ownCgroupParent())
+    , m_prepared(false)
+    , m_lowered(false)
+    , m_launcherNice(0) {
+    CPU_ZERO(&m_launcherCpus);
+}
+
+QString GameScheduler::cgroupPath() const {
+    return m_cgroupRoot + "/" + m_policy.cgroup;
+}
+
+bool GameScheduler::prepare() {
+    // The child cannot report it, so say up front that the game will not
+    // get its priority raised
+    struct rlimit limit;
+    if (m_policy.gameNice < 0 && ::geteuid() != 0 && ::getrlimit(RLIMIT_NICE, &limit) == 0
+        && limit.rlim_cur != RLIM_INFINITY && 20 - int(limit.rlim_cur) > m_policy.gameNice) {
+        qWarning() << "RLIMIT_NICE allows nice" << 20 - int(limit.rlim_cur) << "at best; the game stays at"
+                   << ::getpriority(PRIO_PROCESS, 0) << "instead of" << m_policy.gameNice;
+    }
+
+    m_prepared = false;
+    if (m_policy.cgroup.isEmpty()) {
+        return true;
+    }
+    if (m_cgroupRoot.isEmpty()) {
+        qWarning() << "No cgroup v2 hierarchy to run the game in";
+        return false;
+    }
+
+    // The weights only exist once their controllers are enabled for the
+    // parent's children; either may already be, or not be delegated
+    const QString subtreeControl = m_cgroupRoot + "/cgroup.subtree_control";
+    if (m_policy.cpuWeight > 0) {
+        writeValue(subtreeControl, "+cpu");
+    }
+    if (m_policy.ioWeight > 0) {
+        writeValue(subtreeControl, "+io");
+    }
+
+    const QString path = cgroupPath();
+    if (!QDir().mkpath(path)) {
+        qWarning() << "Failed to create cgroup" << path;
+        return false;
+    }
+    if (m_policy.cpuWeight > 0
+        && !writeValue(path + "/cpu.weight", QByteArray::number(std::clamp(m_policy.cpuWeight, 1, MaxWeight)))) {
+        qWarning() << "Failed to set the game's CPU weight in" << path;
+    }
+    if (m_policy.ioWeight > 0
+        && !writeValue(path + "/io.weight", QByteArray::number(std::clamp(m_policy.ioWeight, 1, MaxWeight)))) {
+        qWarning() << "Failed to set the game's I/O weight in" << path;
+    }
+    m_prepared = true;
+    return true;
+}
+
+std::function<void()> GameScheduler::childModifier() const {
+    // Everything is worked out here; the child may only make
+    // async-signal-safe calls
+    const QByteArray procs = m_prepared ? QFile::encodeName(cgroupPath() + "/cgroup.procs") : QByteArray();
+    const int nice = m_policy.gameNice;
+    const bool pin = m_policy.affinity == Affinity::Pin;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : m_policy.cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+
+    return [procs, nice, pin, cpus]() {
+        if (!procs.isEmpty()) {
+            const int fd = ::open(procs.constData(), O_WRONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                char digits[16];
+                char* end = digits + sizeof(digits);
+                char* begin = end;
+                for (pid_t pid = ::getpid(); pid > 0; pid /= 10) {
+                    *--begin = char('0' + pid % 10);
+                }
+                ::write(fd, begin, end - begin);
+                ::close(fd);
+            }
+        }
+        if (nice != 0) {
+            ::setpriority(PRIO_PROCESS, 0, nice);
+        }
+        if (pin) {
+            ::sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+    };
+}
+
+void GameScheduler::lowerLauncher() {
+    if (m_lowered) {
+        return;
+    }
+
+    errno = 0;
+    const int nice = ::getpriority(PRIO_PROCESS, 0);
+    m_launcherNice = errno == 0 ? nice : 0;
+    ::sched_getaffinity(0, sizeof(m_launcherCpus), &m_launcherCpus);
+
+    // Off the game's cores, unless that leaves none
+    cpu_set_t others = m_launcherCpus;
+    for (int cpu : m_policy.cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_CLR(cpu, &others);
+        }
+    }
+    const bool moveOff = m_policy.affinity != Affinity::None && CPU_COUNT(&others) > 0;
+
+    // Nice values, affinity and I/O priority are all per thread
+    for (int tid : threadIds()) {
+        if (m_policy.launcherNice != 0) {
+            ::setpriority(PRIO_PROCESS, tid, m_policy.launcherNice);
+        }
+        if (moveOff) {
+            ::sched_setaffinity(tid, sizeof(others), &others);
+        }
+        if (m_policy.idleBackgroundIo) {
+            ::syscall(SYS_ioprio_set, IoprioWhoProcess, tid, IoprioClassIdle << IoprioClassShift);
+        }
+    }
+    m_lowered = true;
+}
+
+void GameScheduler::restoreLauncher() {
+    if (!m_lowered) {
+        return;
+    }
+
+    bool reniced = true;
+    for (int tid : threadIds()) {
+        if (m_policy.launcherNice != 0 && ::setpriority(PRIO_PROCESS, tid, m_launcherNice) != 0) {
+            reniced = false;
+        }
+        if (m_policy.affinity != Affinity::None) {
+            ::sched_setaffinity(tid, sizeof(m_launcherCpus), &m_launcherCpus);
+        }
+        if (m_policy.idleBackgroundIo) {
+            // Back to following the nice value
+            ::syscall(SYS_ioprio_set, IoprioWhoProcess, tid, IoprioClassNone << IoprioClassShift);
+        }
+    }
+    if (!reniced) {
+        qWarning() << "Could not raise the launcher back to nice" << m_launcherNice
+                   << "- RLIMIT_NICE does not allow it";
+    }
+    m_lowered = false;
+}
+
+QString GameScheduler::ownCgroupParent() {
+    // Only the unified hierarchy has weights; a hybrid one mounts it
+    // elsewhere, if at all
+    struct statfs fs;
+    if (::statfs(CgroupMount, &fs) != 0 || fs.f_type != CGROUP2_SUPER_MAGIC) {
+        return QString();
+    }
+
+    // "0::/user.slice/.../app.slice/launcher.scope"
+    QFile file("/proc/self/cgroup");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        if (line.startsWith("0::/")) {
+            const QString path = QString::fromUtf8(line.mid(3));
+            return CgroupMount + path.left(std::max<qsizetype>(path.lastIndexOf('/'), 0));
+        }
+    }
+    return QString();
+}
+
+QVector<int> GameScheduler::threadIds() {
+    QVector<int> tids;
+    for (const QString& name : QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        tids.append(name.toInt());
+    }
+    return tids;
+}
+
+bool GameScheduler::writeValue(const QString& path, const QByteArray& value) {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(value) == value.size() && file.flush();
+}
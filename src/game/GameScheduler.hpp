@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+#include <functional>
+#include <sched.h>
+
+// Keeps the launcher, Steam and background jobs out of the game's way.
+//
+// The game (gamescope and everything it runs) is started in a cgroup v2
+// group of its own with its own CPU and I/O weight, at its own nice
+// value, and optionally restricted to a set of cores. While it runs the
+// launcher's threads are niced, moved off those cores and put in the
+// idle I/O class, so the launcher's own background work only gets the
+// disk when the game leaves it idle.
+//
+// "Prefer" leaves the game free to run anywhere and only clears its
+// cores of the launcher; "pin" also keeps the game on them.
+class GameScheduler {
+public:
+    enum class Affinity {
+        None,
+        Prefer,
+        Pin
+    };
+
+    struct Policy {
+        QString cgroup;        // Group of the game's; empty: do not create one
+        int cpuWeight = 0;     // cpu.weight, 1-10000; 0 leaves the default 100
+        int ioWeight = 0;      // io.weight, 1-10000; 0 leaves the default 100
+        Affinity affinity = Affinity::None;
+        QVector<int> cpus;     // The game's cores
+        int gameNice = 0;
+        int launcherNice = 0;  // For the launcher while the game runs
+        bool idleBackgroundIo = false;
+
+        // From a profile's "scheduling" settings
+        static Policy fromConfig(const QVariantMap& settings);
+    };
+
+    GameScheduler();
+
+    void setPolicy(const Policy& policy) { m_policy = policy; }
+    const Policy& policy() const { return m_policy; }
+
+    // cgroup v2 directory the game's group is created in. Defaults to the
+    // parent of the launcher's own group, which systemd delegates to the
+    // user along with the launcher's.
+    void setCgroupRoot(const QString& path) { m_cgroupRoot = path; }
+    QString cgroupRoot() const { return m_cgroupRoot; }
+    QString cgroupPath() const;
+
+    // Create the game's group and set its weights; before every spawn
+    bool prepare();
+    // For QProcess::setChildProcessModifier(): moves the forked child into
+    // the group with the game's nice value and affinity, which everything
+    // it runs inherits
+    std::function<void()> childModifier() const;
+
+    // While the game runs
+    void lowerLauncher();
+    void restoreLauncher();
+    bool isLauncherLowered() const { return m_lowered; }
+
+private:
+    static QString ownCgroupParent();
+    static QVector<int> threadIds();
+    static bool writeValue(const QString& path, const QByteArray& value);
+
+    Policy m_policy;
+    QString m_cgroupRoot;
+    bool m_prepared;
+    bool m_lowered;
+    int m_launcherNice;      // Before lowering
+    cpu_set_t m_launcherCpus;
+};
@@ -0,0 +1,331 @@
+#include "GamescopeSupervisor.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QProcessEnvironment>
+
+namespace {
+
+// Long enough to fold a preset switch (FPS limit, FSR, resolution) into
+// one reconfiguration, short enough not to be noticed
+constexpr int DebounceMs = 150;
+constexpr int StopTimeoutMs = 3000;
+// Crash restarts back off 1 s, 2 s, 4 s and then give up; a run longer
+// than StableRunMs counts as healthy again
+constexpr int CrashBackoffMs = 1000;
+constexpr int MaxCrashRestarts = 3;
+constexpr qint64 StableRunMs = 30000;
+
+const char* const X11SocketDir = "/tmp/.X11-unix";
+// Where gamescope's Xwayland usually lands inside a desktop session
+const char* const FallbackDisplay = ":1";
+
+QStringList x11Displays() {
+    QStringList displays;
+    const QStringList sockets = QDir(X11SocketDir).entryList(QDir::System | QDir::NoDotAndDotDot);
+    for (const QString& socket : sockets) {
+        if (socket.startsWith('X')) {
+            displays.append(":" + socket.mid(1));
+        }
+    }
+    return displays;
+}
+
+} // namespace
+
+GamescopeSupervisor* GamescopeSupervisor::s_instance = nullptr;
+
+GamescopeSupervisor* GamescopeSupervisor::instance() {
+    if (!s_instance) {
+        s_instance = new GamescopeSupervisor();
+    }
+    return s_instance;
+}
+
+GamescopeSupervisor::GamescopeSupervisor(QObject* parent)
+    : QObject(parent)
+    , m_program("gamescope")
+    , m_controlProgram("xprop")
+    , m_environment(QProcessEnvironment::systemEnvironment())
+    , m_wanted(false)
+    , m_stopping(false)
+    , m_inSession(false)
+    , m_crashRestarts(0)
+    , m_launchCount(0)
+    , m_runtimeUpdateCount(0) {
+
+    m_debounceTimer.setSingleShot(true);
+    m_debounceTimer.setInterval(DebounceMs);
+    connect(&m_debounceTimer, &QTimer::timeout, this, &GamescopeSupervisor::applyPending);
+
+    m_restartTimer.setSingleShot(true);
+    connect(&m_restartTimer, &QTimer::timeout, this, [this]() {
+        if (m_wanted && !isRunning()) {
+            launch();
+        }
+    });
+
+    m_process.setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(&m_process, &QProcess::finished, this, &GamescopeSupervisor::onFinished);
+}
+
+QStringList GamescopeSupervisor::arguments(const Settings& settings) const {
+    return arguments(settings, m_command);
+}
+
+QStringList GamescopeSupervisor::arguments(const Settings& settings, const QStringList& command) {
+    QStringList args;
+    args << "--force-grab-cursor"
+         << "--expose-wayland"
+         << "--output-width" << QString::number(settings.outputWidth)
+         << "--output-height" << QString::number(settings.outputHeight)
+         << "--fps-limit" << QString::number(settings.fpsLimit);
+
+    if (settings.renderWidth > 0 && settings.renderHeight > 0) {
+        args << "--nested-width" << QString::number(settings.renderWidth)
+             << "--nested-height" << QString::number(settings.renderHeight);
+    }
+    if (settings.refreshRate > 0) {
+        args << "--nested-refresh" << QString::number(settings.refreshRate);
+    }
+
+    if (settings.adaptiveSync) {
+        args << "--adaptive-sync";
+    }
+    if (settings.fsr) {
+        args << "--fsr";
+    }
+    if (!command.isEmpty()) {
+        args << "--" << command;
+    }
+    return args;
+}
+
+bool GamescopeSupervisor::start() {
+    m_wanted = true;
+    m_crashRestarts = 0;
+    if (isRunning()) {
+        if (m_process.arguments() == arguments(m_applied)
+            && m_process.processEnvironment() == m_environment
+            && m_process.workingDirectory() == m_workingDirectory) {
+            return true;
+        }
+        terminate();
+    }
+    m_debounceTimer.stop();
+    return launch();
+}
+
+bool GamescopeSupervisor::launch() {
+    m_displaysBefore = x11Displays();
+    m_display.clear();
+
+    m_process.setProgram(m_program);
+    m_process.setArguments(arguments(m_pending));
+    m_process.setProcessEnvironment(m_environment);
+    m_process.setWorkingDirectory(m_workingDirectory);
+    m_process.start();
+    if (!m_process.waitForStarted()) {
+        qWarning() << "Failed to start" << m_program << m_process.errorString();
+        // A restart that fails ends the session it was part of
+        m_wanted = false;
+        endSession();
+        return false;
+    }
+
+    m_uptime.start();
+    m_applied = m_pending;
+    ++m_launchCount;
+    if (m_inSession) {
+        emit restarted(m_process.processId());
+    } else {
+        m_inSession = true;
+        emit started(m_process.processId());
+    }
+    return true;
+}
+
+void GamescopeSupervisor::endSession() {
+    if (m_inSession) {
+        m_inSession = false;
+        emit stopped();
+    }
+}
+
+void GamescopeSupervisor::setCommand(const QString& program, const QStringList& arguments,
+                                     const QString& workingDirectory) {
+    m_command = QStringList(program) + arguments;
+    m_workingDirectory = workingDirectory;
+}
+
+void GamescopeSupervisor::stop() {
+    m_wanted = false;
+    m_debounceTimer.stop();
+    m_restartTimer.stop();
+    terminate();
+    // Also when waiting to restart after a crash
+    endSession();
+}
+
+void GamescopeSupervisor::terminate() {
+    if (!isRunning()) {
+        return;
+    }
+
+    m_stopping = true;
+    m_process.terminate();
+    if (!m_process.waitForFinished(StopTimeoutMs)) {
+        m_process.kill();
+        m_process.waitForFinished(StopTimeoutMs);
+    }
+    m_stopping = false;
+}
+
+void GamescopeSupervisor::setOutputSize(int width, int height) {
+    m_pending.outputWidth = width;
+    m_pending.outputHeight = height;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::setRenderSize(int width, int height) {
+    m_pending.renderWidth = width;
+    m_pending.renderHeight = height;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::setRefreshRate(int hz) {
+    m_pending.refreshRate = hz;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::setFpsLimit(int fps) {
+    m_pending.fpsLimit = fps;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::setFsrEnabled(bool enabled) {
+    m_pending.fsr = enabled;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::setAdaptiveSync(bool enabled) {
+    m_pending.adaptiveSync = enabled;
+    scheduleApply();
+}
+
+void GamescopeSupervisor::scheduleApply() {
+    // Every change pushes the deadline out, so a burst applies once
+    if (isRunning()) {
+        m_debounceTimer.start();
+    }
+}
+
+void GamescopeSupervisor::flush() {
+    m_debounceTimer.stop();
+    applyPending();
+}
+
+void GamescopeSupervisor::applyPending() {
+    // Without a running instance the settings are used at the next start
+    if (!isRunning() || m_pending == m_applied) {
+        return;
+    }
+
+    if (m_pending.requiresRestart(m_applied)) {
+        terminate();
+        launch();
+        emit settingsApplied(true);
+        return;
+    }
+
+    if (m_pending.fpsLimit != m_applied.fpsLimit) {
+        setRootProperty("GAMESCOPE_FPS_LIMIT", {m_pending.fpsLimit});
+    }
+    if (m_pending.fsr != m_applied.fsr) {
+        setRootProperty("GAMESCOPE_FSR_UPSCALE", {m_pending.fsr ? 1 : 0});
+    }
+    if (m_pending.adaptiveSync != m_applied.adaptiveSync) {
+        setRootProperty("GAMESCOPE_VRR_ENABLED", {m_pending.adaptiveSync ? 1 : 0});
+    }
+    if (m_pending.renderWidth != m_applied.renderWidth
+        || m_pending.renderHeight != m_applied.renderHeight) {
+        // Resizes the game's X screen the way Steam's per-game resolution
+        // does: Xwayland server 0, width, height, no super resolution. The
+        // game sees a mode change, not a new compositor.
+        const bool full = m_pending.renderWidth <= 0 || m_pending.renderHeight <= 0;
+        setRootProperty("GAMESCOPE_XWAYLAND_MODE_CONTROL",
+                        {0, full ? m_pending.outputWidth : m_pending.renderWidth,
+                         full ? m_pending.outputHeight : m_pending.renderHeight, 0});
+    }
+    // A new refresh rate only goes into the arguments of the next start
+    m_applied = m_pending;
+    ++m_runtimeUpdateCount;
+    emit settingsApplied(false);
+}
+
+void GamescopeSupervisor::setRootProperty(const QString& atom, const QList<int>& values) {
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("DISPLAY", display());
+
+    // Fire and forget; xprop returns immediately and nothing waits on it
+    QProcess xprop;
+    xprop.setProgram(m_controlProgram);
+    QStringList fields;
+    for (int value : values) {
+        fields.append(QString::number(value));
+    }
+    xprop.setArguments({"-root", "-f", atom, "32c", "-set", atom, fields.join(',')});
+    xprop.setProcessEnvironment(environment);
+    if (!xprop.startDetached()) {
+        qWarning() << "Failed to set gamescope property" << atom;
+    }
+}
+
+QString GamescopeSupervisor::display() {
+    // gamescope's Xwayland is the X socket that appeared after it started
+    if (m_display.isEmpty()) {
+        for (const QString& display : x11Displays()) {
+            if (!m_displaysBefore.contains(display)) {
+                m_display = display;
+                break;
+            }
+        }
+    }
+    return m_display.isEmpty() ? QString(FallbackDisplay) : m_display;
+}
+
+void GamescopeSupervisor::onFinished(int exitCode, QProcess::ExitStatus status) {
+    if (!m_wanted) {
+        endSession();
+        return;
+    }
+    if (m_stopping) {
+        // Restarted by us; the session goes on
+        return;
+    }
+    if (status == QProcess::NormalExit && exitCode == 0) {
+        // gamescope quits with the game it runs; the player is done
+        m_wanted = false;
+        endSession();
+        return;
+    }
+
+    qWarning() << "gamescope exited unexpectedly with code" << exitCode
+               << (status == QProcess::CrashExit ? "(crashed)" : "");
+    emit crashed(exitCode);
+
+    if (m_uptime.elapsed() >= StableRunMs) {
+        m_crashRestarts = 0;
+    }
+    if (m_crashRestarts >= MaxCrashRestarts) {
+        qWarning() << "gamescope keeps exiting; giving up after" << MaxCrashRestarts << "restarts";
+        m_wanted = false;
+        endSession();
+        return;
+    }
+    m_restartTimer.start(CrashBackoffMs << m_crashRestarts);
+    ++m_crashRestarts;
+}
+
+GamescopeSupervisor::~GamescopeSupervisor() {
+    stop();
+}
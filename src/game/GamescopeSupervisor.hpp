@@ -0,0 +1,141 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <functional>
+
+// Owns the one gamescope instance the launcher runs the game in.
+//
+// Setting changes are collected for a short debounce interval and then
+// applied together: the frame limit, FSR, adaptive sync and the size the
+// game renders at are changed on the running compositor through its root
+// window properties, and only changes gamescope cannot pick up at runtime
+// (the output size) restart it. The refresh rate is used from the next
+// start. An instance that crashes is restarted with backoff; one that
+// exits cleanly, because the game it ran did, is not.
+//
+// started() and stopped() bracket a session: restarts within it, for a
+// new output size or command or after a crash, are only reported by
+// restarted().
+class GamescopeSupervisor : public QObject {
+    Q_OBJECT
+
+public:
+    struct Settings {
+        int outputWidth = 1920;
+        int outputHeight = 1080;
+        int renderWidth = 0;   // 0: the output size
+        int renderHeight = 0;
+        int refreshRate = 0;   // 0: the display's own
+        int fpsLimit = 60;
+        bool fsr = true;
+        bool adaptiveSync = true;
+
+        bool requiresRestart(const Settings& other) const {
+            return outputWidth != other.outputWidth || outputHeight != other.outputHeight;
+        }
+        bool operator==(const Settings& other) const {
+            return !requiresRestart(other) && renderWidth == other.renderWidth
+                && renderHeight == other.renderHeight && refreshRate == other.refreshRate
+                && fpsLimit == other.fpsLimit && fsr == other.fsr
+                && adaptiveSync == other.adaptiveSync;
+        }
+        bool operator!=(const Settings& other) const { return !(*this == other); }
+    };
+
+    static GamescopeSupervisor* instance();
+
+    // Start gamescope with the pending settings; returns once the process
+    // has been spawned. Does nothing if it is already running.
+    bool start();
+    void stop();
+    bool isRunning() const { return m_process.state() != QProcess::NotRunning; }
+    qint64 pid() const { return m_process.processId(); }
+
+    // Changes are applied after the debounce interval
+    void setOutputSize(int width, int height);
+    // Upscaled to the output size, with FSR if enabled
+    void setRenderSize(int width, int height);
+    void setRefreshRate(int hz);
+    void setFpsLimit(int fps);
+    void setFsrEnabled(bool enabled);
+    void setAdaptiveSync(bool enabled);
+    const Settings& pendingSettings() const { return m_pending; }
+    const Settings& appliedSettings() const { return m_applied; }
+
+    // What gamescope runs and in which environment. Takes effect at the
+    // next start(), which restarts an instance running something else.
+    void setCommand(const QString& program, const QStringList& arguments,
+                    const QString& workingDirectory = QString());
+    void setEnvironment(const QProcessEnvironment& environment) { m_environment = environment; }
+    // Runs in the forked gamescope before it executes, e.g. to place it in
+    // a cgroup; also from the next start()
+    void setChildProcessModifier(const std::function<void()>& modifier) {
+        m_process.setChildProcessModifier(modifier);
+    }
+
+    // Apply pending changes now instead of waiting for the debounce
+    void flush();
+
+    // gamescope's arguments to run command with settings, for running
+    // something other than the game the way the game would be
+    static QStringList arguments(const Settings& settings, const QStringList& command);
+
+    // gamescope and xprop are looked up in PATH unless overridden (tests)
+    void setProgram(const QString& program) { m_program = program; }
+    QString program() const { return m_program; }
+    void setControlProgram(const QString& program) { m_controlProgram = program; }
+    void setDebounceInterval(int ms) { m_debounceTimer.setInterval(ms); }
+
+    int launchCount() const { return m_launchCount; }
+    int runtimeUpdateCount() const { return m_runtimeUpdateCount; }
+
+signals:
+    void started(qint64 pid);
+    void restarted(qint64 pid);
+    void stopped();
+    void crashed(int exitCode);
+    void settingsApplied(bool restarted);
+
+private:
+    explicit GamescopeSupervisor(QObject* parent = nullptr);
+    ~GamescopeSupervisor();
+
+    static GamescopeSupervisor* s_instance;
+
+    QStringList arguments(const Settings& settings) const;
+    bool launch();
+    void terminate();
+    void scheduleApply();
+    void applyPending();
+    void setRootProperty(const QString& atom, const QList<int>& values);
+    QString display();
+    void endSession();
+    void onFinished(int exitCode, QProcess::ExitStatus status);
+
+    QProcess m_process;
+    QTimer m_debounceTimer;
+    QTimer m_restartTimer;
+    QElapsedTimer m_uptime;
+    QString m_program;
+    QString m_controlProgram;
+    QStringList m_command;
+    QString m_workingDirectory;
+    QProcessEnvironment m_environment;
+    Settings m_pending;
+    Settings m_applied;
+    QStringList m_displaysBefore;
+    QString m_display;
+    bool m_wanted;
+    bool m_stopping;
+    bool m_inSession;  // Between started() and stopped()
+    int m_crashRestarts;
+    int m_launchCount;
+    int m_runtimeUpdateCount;
+};
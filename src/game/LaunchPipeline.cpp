@@ -0,0 +1,196 @@
+#include "LaunchPipeline.hpp"
+#include <QDebug>
+#include <QEventLoop>
+#include <QMetaObject>
+#include <QTimer>
+
+LaunchPipeline::LaunchPipeline(QObject* parent)
+    : QObject(parent)
+    , m_outstanding(0)
+    , m_running(false)
+    , m_succeeded(false)
+    , m_elapsedMs(0) {
+}
+
+int LaunchPipeline::indexOf(const QString& name) const {
+    for (int i = 0; i < m_stages.size(); ++i) {
+        if (m_stages[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool LaunchPipeline::addStage(const QString& name, Action action, const QStringList& dependencies,
+                              Affinity affinity) {
+    if (m_running || indexOf(name) >= 0) {
+        qWarning() << "Cannot add launch stage" << name;
+        return false;
+    }
+
+    Stage stage;
+    stage.name = name;
+    stage.action = std::move(action);
+    stage.affinity = affinity;
+    stage.state = State::Pending;
+    stage.timing.name = name;
+    for (const QString& dependency : dependencies) {
+        // Requiring dependencies to exist already rules out cycles
+        const int index = indexOf(dependency);
+        if (index < 0) {
+            qWarning() << "Launch stage" << name << "depends on unknown stage" << dependency;
+            return false;
+        }
+        stage.dependencies.append(index);
+    }
+    m_stages.append(stage);
+    return true;
+}
+
+bool LaunchPipeline::start() {
+    if (m_running || m_stages.isEmpty()) {
+        return false;
+    }
+
+    for (Stage& stage : m_stages) {
+        stage.state = State::Pending;
+        stage.timing = StageTiming();
+        stage.timing.name = stage.name;
+    }
+    m_running = true;
+    m_succeeded = true;
+    m_outstanding = 0;
+    m_elapsedMs = 0;
+    m_clock.start();
+    scheduleReady();
+    return true;
+}
+
+void LaunchPipeline::scheduleReady() {
+    for (int i = 0; i < m_stages.size(); ++i) {
+        Stage& stage = m_stages[i];
+        if (stage.state != State::Pending) {
+            continue;
+        }
+
+        bool ready = true;
+        bool blocked = false;
+        for (int dependency : stage.dependencies) {
+            const State state = m_stages[dependency].state;
+            ready = ready && state == State::Done;
+            blocked = blocked || state == State::Failed || state == State::Skipped;
+        }
+
+        if (blocked) {
+            stage.state = State::Skipped;
+            // Dependents of this stage were added later and will be
+            // skipped further down this loop
+        } else if (ready) {
+            stage.state = State::Running;
+            ++m_outstanding;
+            run(i);
+        }
+    }
+
+    if (m_outstanding == 0 && m_running) {
+        m_running = false;
+        m_elapsedMs = m_clock.elapsed();
+        emit finished(m_succeeded);
+    }
+}
+
+void LaunchPipeline::run(int index) {
+    const Action action = m_stages[index].action;
+    auto task = [this, index, action]() {
+        const qint64 startMs = m_clock.elapsed();
+        QElapsedTimer timer;
+        timer.start();
+        const bool ok = action();
+        const qint64 durationMs = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, index, startMs, durationMs, ok]() {
+            onStageFinished(index, startMs, durationMs, ok);
+        }, Qt::QueuedConnection);
+    };
+
+    if (m_stages[index].affinity == Affinity::OwnerThread) {
+        // Still deferred, so the rest of this scheduling pass goes out first
+        QMetaObject::invokeMethod(this, task, Qt::QueuedConnection);
+    } else {
+        m_pool.start(task);
+    }
+}
+
+void LaunchPipeline::onStageFinished(int index, qint64 startMs, qint64 durationMs, bool ok) {
+    Stage& stage = m_stages[index];
+    stage.state = ok ? State::Done : State::Failed;
+    stage.timing.startMs = startMs;
+    stage.timing.durationMs = durationMs;
+    stage.timing.ok = ok;
+    --m_outstanding;
+
+    if (!ok) {
+        qWarning() << "Launch stage" << stage.name << "failed after" << durationMs << "ms";
+        m_succeeded = false;
+    }
+    emit stageFinished(stage.name, durationMs, ok);
+    scheduleReady();
+}
+
+bool LaunchPipeline::waitForFinished(int timeoutMs) {
+    if (m_running) {
+        QEventLoop loop;
+        QTimer timeout;
+        timeout.setSingleShot(true);
+        connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+        connect(this, &LaunchPipeline::finished, &loop, &QEventLoop::quit);
+        timeout.start(timeoutMs);
+        loop.exec();
+    }
+    return !m_running && m_succeeded;
+}
+
+LaunchPipeline::StageTiming LaunchPipeline::timing(const QString& name) const {
+    const int index = indexOf(name);
+    return index >= 0 ? m_stages[index].timing : StageTiming();
+}
+
+QVector<LaunchPipeline::StageTiming> LaunchPipeline::timings() const {
+    QVector<StageTiming> result;
+    for (const Stage& stage : m_stages) {
+        result.append(stage.timing);
+    }
+    return result;
+}
+
+QStringList LaunchPipeline::criticalPath() const {
+    // Longest chain of measured durations through the dependency graph.
+    // Stages are stored in dependency order, so one forward pass suffices.
+    QVector<qint64> finish(m_stages.size(), 0);
+    QVector<int> previous(m_stages.size(), -1);
+    int last = -1;
+    for (int i = 0; i < m_stages.size(); ++i) {
+        if (m_stages[i].timing.startMs < 0) {
+            continue;
+        }
+        for (int dependency : m_stages[i].dependencies) {
+            if (previous[i] < 0 || finish[dependency] > finish[previous[i]]) {
+                previous[i] = dependency;
+            }
+        }
+        finish[i] = (previous[i] >= 0 ? finish[previous[i]] : 0) + m_stages[i].timing.durationMs;
+        if (last < 0 || finish[i] > finish[last]) {
+            last = i;
+        }
+    }
+
+    QStringList path;
+    for (int i = last; i >= 0; i = previous[i]) {
+        path.prepend(m_stages[i].name);
+    }
+    return path;
+}
+
+LaunchPipeline::~LaunchPipeline() {
+    // Workers post their results back to this object
+    m_pool.waitForDone();
+}
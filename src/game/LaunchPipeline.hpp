@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+// Runs the steps of a game launch as a dependency graph.
+//
+// Each stage starts as soon as all of its dependencies have succeeded;
+// independent stages run concurrently on a worker pool so the GUI thread
+// stays free. Stages that must touch GUI-thread-only APIs can be pinned
+// to the thread that owns the pipeline. A failed stage skips everything
+// that depends on it. Every stage is timed, and the critical path of the
+// last run can be queried afterwards.
+class LaunchPipeline : public QObject {
+    Q_OBJECT
+
+public:
+    using Action = std::function<bool()>;
+
+    enum class Affinity {
+        Worker,
+        OwnerThread
+    };
+
+    struct StageTiming {
+        QString name;
+        qint64 startMs = -1;     // Since start(); -1 if the stage never ran
+        qint64 durationMs = 0;
+        bool ok = false;
+    };
+
+    explicit LaunchPipeline(QObject* parent = nullptr);
+    ~LaunchPipeline();
+
+    // Stages must be added before start(); dependencies refer to stages
+    // added earlier
+    bool addStage(const QString& name, Action action, const QStringList& dependencies = {},
+                  Affinity affinity = Affinity::Worker);
+
+    bool start();
+    bool isRunning() const { return m_running; }
+
+    // Block until the run finishes, processing events meanwhile
+    bool waitForFinished(int timeoutMs = 30000);
+    bool succeeded() const { return m_succeeded; }
+
+    // Results of the last run
+    StageTiming timing(const QString& name) const;
+    QVector<StageTiming> timings() const;
+    qint64 elapsedMs() const { return m_elapsedMs; }
+    QStringList criticalPath() const;
+
+    void setMaxThreadCount(int count) { m_pool.setMaxThreadCount(count); }
+
+signals:
+    void stageFinished(const QString& name, qint64 durationMs, bool ok);
+    void finished(bool ok);
+
+private:
+    enum class State {
+        Pending,
+        Running,
+        Done,
+        Failed,
+        Skipped
+    };
+
+    struct Stage {
+        QString name;
+        Action action;
+        QVector<int> dependencies;
+        Affinity affinity;
+        State state;
+        StageTiming timing;
+    };
+
+    int indexOf(const QString& name) const;
+    void scheduleReady();
+    void run(int index);
+    void onStageFinished(int index, qint64 startMs, qint64 durationMs, bool ok);
+
+    QVector<Stage> m_stages;
+    QThreadPool m_pool;
+    QElapsedTimer m_clock;
+    int m_outstanding;
+    bool m_running;
+    bool m_succeeded;
+    qint64 m_elapsedMs;
+};
@@ -0,0 +1,152 @@
+#include "LaunchPlan.hpp"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+
+// Bumped whenever the serialized layout changes; older caches are ignored
+constexpr int FormatVersion = 1;
+
+} // namespace
+
+void LaunchPlan::addFile(const QString& path, const QByteArray& content) {
+    files.append({path, content, contentHash(content)});
+}
+
+QProcessEnvironment LaunchPlan::processEnvironment() const {
+    QProcessEnvironment result = QProcessEnvironment::systemEnvironment();
+    for (auto it = environment.begin(); it != environment.end(); ++it) {
+        result.insert(it.key(), it.value());
+    }
+    return result;
+}
+
+int LaunchPlan::materialize() const {
+    for (const QString& directory : directories) {
+        if (!QDir().mkpath(directory)) {
+            qWarning() << "Failed to create" << directory;
+            return -1;
+        }
+    }
+
+    int written = 0;
+    for (const File& file : files) {
+        QFile existing(file.path);
+        if (existing.open(QIODevice::ReadOnly) && contentHash(existing.readAll()) == file.hash) {
+            continue;
+        }
+        existing.close();
+
+        QDir().mkpath(QFileInfo(file.path).absolutePath());
+        QSaveFile output(file.path);
+        if (!output.open(QIODevice::WriteOnly) || output.write(file.content) != file.content.size()
+            || !output.commit()) {
+            qWarning() << "Failed to write" << file.path;
+            return -1;
+        }
+        ++written;
+    }
+    return written;
+}
+
+QByteArray LaunchPlan::serialize() const {
+    QJsonObject environmentObject;
+    for (auto it = environment.begin(); it != environment.end(); ++it) {
+        environmentObject[it.key()] = it.value();
+    }
+
+    QJsonArray fileArray;
+    for (const File& file : files) {
+        QJsonObject fileObject;
+        fileObject["path"] = file.path;
+        fileObject["content"] = QString::fromLatin1(file.content.toBase64());
+        fileObject["hash"] = QString::fromLatin1(file.hash.toHex());
+        fileArray.append(fileObject);
+    }
+
+    QJsonObject root;
+    root["version"] = FormatVersion;
+    root["key"] = QString::fromLatin1(key.toHex());
+    root["gameFingerprint"] = QString::fromLatin1(gameFingerprint);
+    root["program"] = program;
+    root["arguments"] = QJsonArray::fromStringList(arguments);
+    root["workingDirectory"] = workingDirectory;
+    root["environment"] = environmentObject;
+    root["directories"] = QJsonArray::fromStringList(directories);
+    root["files"] = fileArray;
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool LaunchPlan::deserialize(const QByteArray& data, LaunchPlan& plan) {
+    const QJsonObject root = QJsonDocument::fromJson(data).object();
+    if (root.value("version").toInt() != FormatVersion) {
+        return false;
+    }
+
+    plan = LaunchPlan();
+    plan.key = QByteArray::fromHex(root.value("key").toString().toLatin1());
+    plan.gameFingerprint = root.value("gameFingerprint").toString().toLatin1();
+    plan.program = root.value("program").toString();
+    plan.workingDirectory = root.value("workingDirectory").toString();
+    for (const QJsonValue& argument : root.value("arguments").toArray()) {
+        plan.arguments.append(argument.toString());
+    }
+    const QJsonObject environmentObject = root.value("environment").toObject();
+    for (auto it = environmentObject.begin(); it != environmentObject.end(); ++it) {
+        plan.environment.insert(it.key(), it.value().toString());
+    }
+    for (const QJsonValue& directory : root.value("directories").toArray()) {
+        plan.directories.append(directory.toString());
+    }
+    for (const QJsonValue& value : root.value("files").toArray()) {
+        const QJsonObject fileObject = value.toObject();
+        File file;
+        file.path = fileObject.value("path").toString();
+        file.content = QByteArray::fromBase64(fileObject.value("content").toString().toLatin1());
+        file.hash = QByteArray::fromHex(fileObject.value("hash").toString().toLatin1());
+        if (file.path.isEmpty() || file.hash != contentHash(file.content)) {
+            return false;
+        }
+        plan.files.append(file);
+    }
+    return !plan.program.isEmpty();
+}
+
+bool LaunchPlan::save(const QString& path) const {
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(serialize());
+    return file.commit();
+}
+
+bool LaunchPlan::load(const QString& path, LaunchPlan& plan) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return deserialize(file.readAll(), plan);
+}
+
+QByteArray LaunchPlan::contentHash(const QByteArray& content) {
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha256);
+}
+
+QByteArray LaunchPlan::fileFingerprint(const QString& path) {
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        return QByteArray();
+    }
+    return QByteArray::number(info.size()) + ":"
+        + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+}
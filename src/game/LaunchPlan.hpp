@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QProcessEnvironment>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Everything needed to start the game, worked out once: the environment
+// on top of the system one, the command line, and the files that have to
+// exist beforehand. A plan is plain data, so it can be cached on disk and
+// reused as long as its inputs do not change.
+struct LaunchPlan {
+    struct File {
+        QString path;
+        QByteArray content;
+        QByteArray hash;  // SHA-256 of content
+    };
+
+    QString program;
+    QStringList arguments;
+    QString workingDirectory;
+    QMap<QString, QString> environment;
+    QStringList directories;
+    QVector<File> files;
+
+    // Identifies the inputs the plan was compiled from
+    QByteArray key;
+    // Size and modification time of program when the plan was compiled
+    QByteArray gameFingerprint;
+
+    void setEnvironment(const QString& name, const QString& value) { environment.insert(name, value); }
+    void addFile(const QString& path, const QByteArray& content);
+
+    // System environment with the plan's variables applied
+    QProcessEnvironment processEnvironment() const;
+
+    // Create the directories and write every file whose content differs
+    // from what is on disk. Returns the number of files written, -1 on
+    // failure.
+    int materialize() const;
+
+    // False once the game binary changed since the plan was compiled
+    bool isCurrent() const { return gameFingerprint == fileFingerprint(program); }
+
+    QByteArray serialize() const;
+    static bool deserialize(const QByteArray& data, LaunchPlan& plan);
+
+    bool save(const QString& path) const;
+    static bool load(const QString& path, LaunchPlan& plan);
+
+    static QByteArray contentHash(const QByteArray& content);
+    static QByteArray fileFingerprint(const QString& path);
+};
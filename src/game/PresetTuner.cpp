@@ -0,0 +1,248 @@
+#include "PresetTuner.hpp"
+#include <QDebug>
+#include <algorithm>
+#include <csignal>
+#include <unistd.h>
+
+namespace {
+
+constexpr int KillTimeoutMs = 1000;
+// A frame cap is held while the 1% low stays this close to it
+constexpr double HoldRatio = 0.9;
+
+} // namespace
+
+PresetTuner::PresetTuner(QObject* parent)
+    : QObject(parent)
+    , m_phase(Phase::Warmup)
+    , m_stopping(false)
+    , m_index(-1)
+    , m_wattsSum(0.0)
+    , m_samples(0)
+    , m_maxTemperature(0.0) {
+    m_phaseTimer.setSingleShot(true);
+    connect(&m_phaseTimer, &QTimer::timeout, this, [this]() {
+        if (m_phase == Phase::Warmup) {
+            beginMeasurement();
+        } else {
+            finishPoint();
+        }
+    });
+    connect(&m_sampleTimer, &QTimer::timeout, this, &PresetTuner::sample);
+
+    // A process group of its own, so whatever the workload forks ends
+    // with it
+    m_process.setChildProcessModifier([]() {
+        ::setpgid(0, 0);
+    });
+    connect(&m_process, &QProcess::finished, this, &PresetTuner::onWorkloadFinished);
+}
+
+void PresetTuner::setCommand(const QString& program, const QStringList& arguments) {
+    m_program = program;
+    m_arguments = arguments;
+}
+
+bool PresetTuner::start() {
+    if (isRunning()) {
+        return false;
+    }
+    if (m_program.isEmpty() || !m_apply || !m_sample || !m_wrap) {
+        qWarning() << "Preset tuning needs a workload, a frame limiter to run it under, a way to apply"
+                   << "settings and a power reading";
+        return false;
+    }
+
+    m_points.clear();
+    for (int tdp : m_grid.tdps) {
+        for (int gpuClock : m_grid.gpuClocks) {
+            for (int fpsCap : m_grid.fpsCaps) {
+                m_points.append({tdp, gpuClock, fpsCap});
+            }
+        }
+    }
+    if (m_points.isEmpty()) {
+        qWarning() << "Preset tuning grid is empty";
+        return false;
+    }
+
+    m_results.clear();
+    m_index = -1;
+    next();
+    return true;
+}
+
+void PresetTuner::cancel() {
+    if (!isRunning()) {
+        return;
+    }
+    m_phaseTimer.stop();
+    m_sampleTimer.stop();
+    stopWorkload();
+    m_index = -1;
+    emit finished(false);
+}
+
+void PresetTuner::next() {
+    while (++m_index < m_points.size()) {
+        const Point& point = m_points[m_index];
+        if (!m_apply(point)) {
+            qWarning() << "Could not apply" << point.tdp << "W," << point.gpuClock << "MHz,"
+                       << point.fpsCap << "fps; skipping it";
+            Result result;
+            result.point = point;
+            m_results.append(result);
+            emit pointMeasured(result);
+            continue;
+        }
+
+        const QStringList command = m_wrap(point, QStringList(m_program) + m_arguments);
+        m_process.setProgram(command.value(0));
+        m_process.setArguments(command.mid(1));
+        m_process.start();
+        if (!m_process.waitForStarted()) {
+            qWarning() << "Failed to start tuning workload" << m_program << m_process.errorString();
+            m_index = -1;
+            emit finished(false);
+            return;
+        }
+        m_phase = Phase::Warmup;
+        m_phaseTimer.start(m_settings.warmupMs);
+        return;
+    }
+
+    m_index = -1;
+    emit finished(true);
+}
+
+void PresetTuner::beginMeasurement() {
+    // Frames of the warm-up, and of earlier points if the workload
+    // appends to its log, are passed over
+    m_log.skipToEnd();
+    m_frames.clear();
+    m_wattsSum = 0.0;
+    m_samples = 0;
+    m_maxTemperature = 0.0;
+
+    m_phase = Phase::Measure;
+    m_sampleTimer.start(m_settings.sampleIntervalMs);
+    m_phaseTimer.start(m_settings.durationMs);
+}
+
+void PresetTuner::sample() {
+    m_log.readNew(m_frames);
+    double watts = 0.0;
+    double temperature = 0.0;
+    if (m_sample(watts, temperature)) {
+        m_wattsSum += watts;
+        ++m_samples;
+        m_maxTemperature = std::max(m_maxTemperature, temperature);
+    }
+}
+
+void PresetTuner::finishPoint() {
+    m_phaseTimer.stop();
+    sample();
+    m_sampleTimer.stop();
+    stopWorkload();
+
+    Result result;
+    result.point = m_points[m_index];
+    result.frames = m_frames.count();
+    result.averageFps = m_frames.averageFps();
+    result.low1Fps = m_frames.lowFps(0.01);
+    result.p50FrameTime = m_frames.percentile(0.5);
+    result.p99FrameTime = m_frames.percentile(0.99);
+    result.watts = m_samples > 0 ? m_wattsSum / m_samples : 0.0;
+    result.temperature = m_maxTemperature;
+    result.throttled = m_maxTemperature > m_settings.thermalLimit;
+    result.valid = result.frames >= quint64(m_settings.minFrames) && m_samples > 0;
+    m_results.append(result);
+    emit pointMeasured(result);
+    next();
+}
+
+void PresetTuner::stopWorkload() {
+    if (m_process.state() == QProcess::NotRunning) {
+        return;
+    }
+
+    // Asked first, so a game gets to save its settings
+    m_stopping = true;
+    const pid_t group = -static_cast<pid_t>(m_process.processId());
+    ::kill(group, SIGTERM);
+    if (!m_process.waitForFinished(KillTimeoutMs)) {
+        ::kill(group, SIGKILL);
+        m_process.waitForFinished(KillTimeoutMs);
+    }
+    m_stopping = false;
+}
+
+void PresetTuner::onWorkloadFinished() {
+    if (m_stopping || !isRunning()) {
+        return;
+    }
+
+    if (m_phase == Phase::Measure) {
+        // The scene ended early; what it ran still counts
+        finishPoint();
+        return;
+    }
+    qWarning() << "Tuning workload exited during warm-up with code" << m_process.exitCode();
+    m_phaseTimer.stop();
+    Result result;
+    result.point = m_points[m_index];
+    m_results.append(result);
+    emit pointMeasured(result);
+    next();
+}
+
+QVector<PresetTuner::Result> PresetTuner::paretoFrontier(const QVector<Result>& results) {
+    QVector<Result> candidates;
+    for (const Result& result : results) {
+        if (result.valid && !result.throttled) {
+            candidates.append(result);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Result& a, const Result& b) {
+        return a.watts != b.watts ? a.watts < b.watts : a.low1Fps > b.low1Fps;
+    });
+
+    // Going up in watts, a point is only worth it if it is smoother than
+    // everything cheaper
+    QVector<Result> frontier;
+    double smoothest = -1.0;
+    for (const Result& candidate : candidates) {
+        if (candidate.low1Fps > smoothest) {
+            frontier.append(candidate);
+            smoothest = candidate.low1Fps;
+        }
+    }
+    return frontier;
+}
+
+QVector<PresetTuner::Result> PresetTuner::choosePresets(const QVector<Result>& frontier) {
+    QVector<int> caps;
+    for (const Result& result : frontier) {
+        if (!caps.contains(result.point.fpsCap)) {
+            caps.append(result.point.fpsCap);
+        }
+    }
+    std::sort(caps.begin(), caps.end());
+
+    QVector<Result> chosen;
+    for (int cap : caps) {
+        for (const Result& result : frontier) {
+            if (result.point.fpsCap == cap && result.low1Fps >= cap * HoldRatio) {
+                chosen.append(result);
+                break;
+            }
+        }
+    }
+    return chosen;
+}
+
+PresetTuner::~PresetTuner() {
+    m_index = -1;
+    stopWorkload();
+}
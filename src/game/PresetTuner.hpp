@@ -0,0 +1,137 @@
+#pragma once
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include "FrameTimeHistogram.hpp"
+#include "FrameTimeLog.hpp"
+
+// Measures a fixed workload, such as a benchmark scene or a recorded
+// replay, at every combination of TDP, GPU clock and frame cap in a grid,
+// to find the settings worth keeping as presets on this unit.
+//
+// The workload is started afresh for each point, so every point sees the
+// same scene. Frames of a warm-up period are ignored; over the rest the
+// frame time distribution is read from the workload's frame time log and
+// power and temperature are sampled. Points are then compared by
+// smoothness, the 1% low frame rate, against the watts they draw.
+//
+// Applying a point to the hardware and reading power and temperature are
+// left to the caller, so a sweep can be run against a simulated device.
+// The frame cap has to reach the workload itself: a wrapper turns the
+// workload's command line into one that runs it under a frame limiter.
+class PresetTuner : public QObject {
+    Q_OBJECT
+
+public:
+    struct Point {
+        int tdp = 0;       // W
+        int gpuClock = 0;  // MHz
+        int fpsCap = 0;
+    };
+
+    struct Grid {
+        QVector<int> tdps;
+        QVector<int> gpuClocks;
+        QVector<int> fpsCaps;
+    };
+
+    struct Settings {
+        int warmupMs = 10000;
+        int durationMs = 30000;
+        int sampleIntervalMs = 500;
+        int minFrames = 30;         // Fewer and the point is not measured
+        double thermalLimit = 90;   // °C; hotter points are throttled
+    };
+
+    struct Result {
+        Point point;
+        bool valid = false;      // Enough frames measured
+        bool throttled = false;  // Ran past the thermal limit
+        quint64 frames = 0;
+        double averageFps = 0.0;
+        double low1Fps = 0.0;
+        double p50FrameTime = 0.0;  // ms
+        double p99FrameTime = 0.0;  // ms
+        double watts = 0.0;          // Average over the measurement
+        double temperature = 0.0;    // Highest, °C
+    };
+
+    using Apply = std::function<bool(const Point& point)>;
+    using Sample = std::function<bool(double& watts, double& temperature)>;
+    // Command line (program first) that runs command capped at the
+    // point's frame rate
+    using Wrapper = std::function<QStringList(const Point& point, const QStringList& command)>;
+
+    explicit PresetTuner(QObject* parent = nullptr);
+    ~PresetTuner();
+
+    // Invoked as "<program> <arguments...>" for every point
+    void setCommand(const QString& program, const QStringList& arguments = {});
+    // Where the workload writes its frame times
+    void setFrameTimeLog(const QString& path) { m_log.setPath(path); }
+    void setGrid(const Grid& grid) { m_grid = grid; }
+    void setSettings(const Settings& settings) { m_settings = settings; }
+    const Settings& settings() const { return m_settings; }
+    void setApply(Apply apply) { m_apply = std::move(apply); }
+    void setSampler(Sample sample) { m_sample = std::move(sample); }
+    void setWrapper(Wrapper wrap) { m_wrap = std::move(wrap); }
+
+    bool start();
+    void cancel();
+    bool isRunning() const { return m_index >= 0; }
+    // Points of the grid in the order they are measured
+    const QVector<Point>& points() const { return m_points; }
+    const QVector<Result>& results() const { return m_results; }
+
+    // Valid points no other point beats on both smoothness and watts,
+    // cheapest first
+    static QVector<Result> paretoFrontier(const QVector<Result>& results);
+    // For each frame cap, the cheapest frontier point that holds it;
+    // lowest cap first
+    static QVector<Result> choosePresets(const QVector<Result>& frontier);
+
+signals:
+    void pointMeasured(const PresetTuner::Result& result);
+    void finished(bool ok);
+
+private:
+    enum class Phase {
+        Warmup,
+        Measure
+    };
+
+    void next();
+    void beginMeasurement();
+    void sample();
+    void finishPoint();
+    void stopWorkload();
+    void onWorkloadFinished();
+
+    QString m_program;
+    QStringList m_arguments;
+    Grid m_grid;
+    Settings m_settings;
+    Apply m_apply;
+    Sample m_sample;
+    Wrapper m_wrap;
+
+    QProcess m_process;
+    FrameTimeLog m_log;
+    QTimer m_phaseTimer;
+    QTimer m_sampleTimer;
+    Phase m_phase;
+    bool m_stopping;
+
+    QVector<Point> m_points;
+    QVector<Result> m_results;
+    int m_index;  // Point being measured, -1 when idle
+    FrameTimeHistogram m_frames;
+    double m_wattsSum;
+    int m_samples;
+    double m_maxTemperature;
+};
@@ -0,0 +1,159 @@
+#include "ResolutionScaler.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// A retried step up is held back at most this many times the base hold
+constexpr int MaxRetryBackoff = 4;
+// A median this close to the budget means the frame limiter holds the
+// game back, hiding how much headroom there is
+constexpr double LimiterBand = 0.95;
+
+} // namespace
+
+ResolutionScaler::ResolutionScaler()
+    : m_targetFps(60)
+    , m_step(0)
+    , m_changes(0)
+    , m_next(0)
+    , m_count(0)
+    , m_percentile(0.0)
+    , m_overSinceMs(-1)
+    , m_underSinceMs(-1)
+    , m_lastUpMs(-1)
+    , m_ceiling(0)
+    , m_ceilingUntilMs(0)
+    , m_retryHoldMs(m_settings.retryHoldMs) {
+    setSettings(m_settings);
+}
+
+void ResolutionScaler::setSettings(const Settings& settings) {
+    m_settings = settings;
+    m_settings.maxScale = std::clamp(m_settings.maxScale, 0.1, 1.0);
+    m_settings.minScale = std::clamp(m_settings.minScale, 0.1, m_settings.maxScale);
+    m_settings.stepRatio = std::clamp(m_settings.stepRatio, 0.5, 0.98);
+    m_settings.window = std::max(m_settings.window, 8);
+
+    m_steps.clear();
+    for (double scale = m_settings.maxScale; scale > m_settings.minScale * 1.01;
+         scale *= m_settings.stepRatio) {
+        m_steps.append(scale);
+    }
+    m_steps.append(m_settings.minScale);
+
+    m_step = std::min(m_step, int(m_steps.size()) - 1);
+    m_frameTimes.fill(0.0, m_settings.window);
+    m_next = 0;
+    m_count = 0;
+}
+
+void ResolutionScaler::reset() {
+    setStep(0);
+    m_ceilingUntilMs = 0;
+    m_retryHoldMs = m_settings.retryHoldMs;
+}
+
+void ResolutionScaler::addFrameTime(double ms) {
+    m_frameTimes[m_next] = ms;
+    m_next = (m_next + 1) % m_frameTimes.size();
+    m_count = std::min(m_count + 1, int(m_frameTimes.size()));
+}
+
+bool ResolutionScaler::update(qint64 nowMs) {
+    // Half a window is enough to act on; a paused or loading game gives
+    // too few frames to say anything
+    if (m_count < m_frameTimes.size() / 2 || m_targetFps <= 0) {
+        m_percentile = 0.0;
+        return false;
+    }
+
+    QVector<double> window = m_frameTimes.mid(0, m_count);
+    const int rank = std::clamp(int(std::ceil(m_settings.percentile * m_count)) - 1, 0, m_count - 1);
+    std::nth_element(window.begin(), window.begin() + rank, window.end());
+    m_percentile = window[rank];
+    // The frames below the percentile are in front of it now
+    const int middle = std::min(m_count / 2, rank);
+    std::nth_element(window.begin(), window.begin() + middle, window.begin() + rank);
+    const double median = window[middle];
+
+    // GPU time is taken to follow the pixel count
+    auto predicted = [this](int step) {
+        const double ratio = m_steps[step] / scale();
+        return m_percentile * ratio * ratio;
+    };
+
+    if (m_lastUpMs >= 0 && nowMs - m_lastUpMs >= m_retryHoldMs) {
+        // The last step up held; forget earlier failed ones
+        m_retryHoldMs = m_settings.retryHoldMs;
+    }
+
+    const double budget = 1000.0 / m_targetFps;
+    const int lowest = int(m_steps.size()) - 1;
+    const int highest = nowMs < m_ceilingUntilMs ? m_ceiling : 0;
+
+    if (m_percentile > budget * m_settings.downThreshold) {
+        m_underSinceMs = -1;
+        if (m_overSinceMs < 0) {
+            m_overSinceMs = nowMs;
+        }
+        if (m_step >= lowest || nowMs - m_overSinceMs < m_settings.downHoldMs) {
+            return false;
+        }
+
+        if (m_lastUpMs >= 0 && nowMs - m_lastUpMs < m_retryHoldMs) {
+            // This step did not hold up; stay below it for a while
+            m_ceiling = m_step + 1;
+            m_ceilingUntilMs = nowMs + m_retryHoldMs;
+            m_retryHoldMs = std::min(m_retryHoldMs * 2, m_settings.retryHoldMs * MaxRetryBackoff);
+        }
+
+        // Far over budget: go straight to the step predicted to fit
+        int step = m_step + 1;
+        while (step < lowest && predicted(step) > budget) {
+            ++step;
+        }
+        setStep(step);
+        return true;
+    }
+
+    // Behind the limiter a step up can only be tried
+    const bool limited = median >= budget * LimiterBand;
+    if (m_step > highest && (limited || predicted(m_step - 1) < budget * m_settings.upThreshold)) {
+        m_overSinceMs = -1;
+        if (m_underSinceMs < 0) {
+            m_underSinceMs = nowMs;
+        }
+        if (nowMs - m_underSinceMs < m_settings.upHoldMs) {
+            return false;
+        }
+        setStep(m_step - 1);
+        m_lastUpMs = nowMs;
+        return true;
+    }
+
+    m_overSinceMs = -1;
+    m_underSinceMs = -1;
+    return false;
+}
+
+void ResolutionScaler::setStep(int step) {
+    if (step != m_step) {
+        ++m_changes;
+    }
+    m_step = step;
+    m_lastUpMs = -1;
+    m_overSinceMs = -1;
+    m_underSinceMs = -1;
+
+    // Frames rendered at the old size say nothing about the new one
+    m_next = 0;
+    m_count = 0;
+}
+
+ResolutionScaler::Size ResolutionScaler::scaledSize(int width, int height, double scale) {
+    auto even = [scale](int length) {
+        return std::max(2, static_cast<int>(std::lround(length * scale / 2.0)) * 2);
+    };
+    return {even(width), even(height)};
+}
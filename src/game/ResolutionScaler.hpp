@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+// Dynamic resolution: picks the scale the game renders at, relative to
+// its full render size, so a percentile of recent frame times stays
+// within the frame budget. gamescope upscales the result to the panel.
+//
+// The scale moves between fixed steps, each about a fifth fewer pixels
+// than the one above, down to a floor. A step down needs the budget to be
+// exceeded for a while and may skip steps when far over; a step up needs
+// the frame times measured at the current step, scaled by pixel count,
+// to predict comfortable headroom at the next one; behind a frame limiter,
+// which hides the headroom, it is simply tried. A step up that had to
+// be taken back is not retried for a while, twice as long each time it
+// happens again, so a load that sits between two steps settles on the
+// lower one instead of flipping between them. Frames from before a
+// change are discarded.
+//
+// Time is passed in by the caller so the controller can be replayed
+// against recorded traces.
+class ResolutionScaler {
+public:
+    struct Settings {
+        double minScale = 0.5;
+        double maxScale = 1.0;
+        double stepRatio = 0.9;     // Scale of one step relative to the one above
+        double percentile = 0.9;    // Of the frames in the window
+        int window = 90;            // Frames
+        double downThreshold = 1.05;  // Of the frame budget
+        double upThreshold = 0.9;     // Predicted at the next step up
+        qint64 downHoldMs = 500;
+        qint64 upHoldMs = 3000;
+        qint64 retryHoldMs = 15000;   // After a step up that was taken back
+    };
+
+    struct Size {
+        int width;
+        int height;
+    };
+
+    ResolutionScaler();
+
+    void setSettings(const Settings& settings);
+    const Settings& settings() const { return m_settings; }
+    void setTargetFps(int fps) { m_targetFps = fps; }
+    int targetFps() const { return m_targetFps; }
+
+    // Back to the largest scale, forgetting everything measured
+    void reset();
+
+    void addFrameTime(double ms);
+
+    // Run one control step, a few times a second; true if the scale changed
+    bool update(qint64 nowMs);
+
+    double scale() const { return m_steps.value(m_step, m_settings.maxScale); }
+    int step() const { return m_step; }
+    const QVector<double>& steps() const { return m_steps; }
+    // Frame time at the configured percentile as of the last update(), 0
+    // while too few frames were seen
+    double frameTimePercentile() const { return m_percentile; }
+    int changeCount() const { return m_changes; }
+
+    // Even dimensions, never below 2x2
+    static Size scaledSize(int width, int height, double scale);
+
+private:
+    void setStep(int step);
+
+    Settings m_settings;
+    int m_targetFps;
+    QVector<double> m_steps;  // Largest first
+    int m_step;
+    int m_changes;
+
+    QVector<double> m_frameTimes;  // Ring buffer of the window
+    int m_next;
+    int m_count;
+    double m_percentile;
+
+    qint64 m_overSinceMs;
+    qint64 m_underSinceMs;
+    qint64 m_lastUpMs;        // -1 unless the last change was a step up
+    int m_ceiling;            // Lowest step index allowed until m_ceilingUntilMs
+    qint64 m_ceilingUntilMs;
+    qint64 m_retryHoldMs;
+};
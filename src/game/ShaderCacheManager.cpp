@@ -0,0 +1,578 @@
+#include "ShaderCacheManager.hpp"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMetaObject>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr quint32 IndexMagic = 0x53434958;  // "SCIX"
+constexpr quint32 IndexVersion = 2;
+
+// Evict down to this fraction of the budget so the next few shaders do
+// not immediately trigger another pass
+constexpr double LowWatermark = 0.9;
+constexpr int DefaultEvictionDelayMs = 10000;
+
+constexpr uint32_t WatchMask = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE
+    | IN_MOVED_FROM | IN_OPEN | IN_DELETE_SELF | IN_ONLYDIR;
+
+// From linux/ioprio.h, which glibc does not wrap
+constexpr int IoprioWhoProcess = 1;
+constexpr int IoprioClassIdle = 3;
+constexpr int IoprioClassShift = 13;
+
+qint64 mtimeNs(const struct stat& st) {
+    return qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+void lowerThreadPriority() {
+    // SCHED_IDLE and the idle I/O class both apply to the calling thread
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    ::syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift);
+}
+
+} // namespace
+
+ShaderCacheManager::ShaderCacheManager(QObject* parent)
+    : QObject(parent)
+    , m_totalSize(0)
+    , m_fileCount(0)
+    , m_directoriesRead(0)
+    , m_budget(1024LL * 1024 * 1024)
+    , m_maxAgeSeconds(0)
+    , m_gameRunning(false)
+    , m_evictionPending(false)
+    , m_abortEviction(false)
+    , m_inotifyFd(-1)
+    , m_notifier(nullptr) {
+    m_evictionTimer.setSingleShot(true);
+    m_evictionTimer.setInterval(DefaultEvictionDelayMs);
+    connect(&m_evictionTimer, &QTimer::timeout, this, &ShaderCacheManager::evict);
+}
+
+bool ShaderCacheManager::open(const QString& cacheDir, const QString& indexPath) {
+    close();
+    if (!QDir().mkpath(cacheDir)) {
+        qWarning() << "Failed to create shader cache" << cacheDir;
+        return false;
+    }
+
+    m_root = QDir(cacheDir).absolutePath().toUtf8();
+    m_indexPath = indexPath.isEmpty() ? cacheDir + ".index" : indexPath;
+    if (!loadIndex()) {
+        m_dirs.clear();
+        m_inodeLinks.clear();
+        m_totalSize = 0;
+        m_fileCount = 0;
+    }
+    rescan();
+
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qWarning() << "Failed to watch shader cache; changes are picked up at the next start";
+    } else {
+        addWatches(QByteArray());
+        m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &ShaderCacheManager::readEvents);
+    }
+
+    if (m_maxAgeSeconds > 0 && !m_gameRunning) {
+        // Expired entries are only found by a pass, budget or not
+        m_evictionTimer.start();
+    }
+    scheduleEviction();
+    return true;
+}
+
+void ShaderCacheManager::close() {
+    if (!isOpen()) {
+        return;
+    }
+
+    m_abortEviction = true;
+    joinEviction();
+    if (m_notifier) {
+        // Apply what is queued so the saved directory times stay honest
+        readEvents();
+    }
+    m_evictionTimer.stop();
+    delete m_notifier;
+    m_notifier = nullptr;
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+    m_watches.clear();
+
+    saveIndex();
+    m_root.clear();
+    m_dirs.clear();
+    m_inodeLinks.clear();
+    m_totalSize = 0;
+    m_fileCount = 0;
+}
+
+void ShaderCacheManager::setExcluded(const QStringList& paths) {
+    m_excluded.clear();
+    for (const QString& path : paths) {
+        m_excluded.insert("/" + path.toUtf8());
+    }
+}
+
+void ShaderCacheManager::retainInode(const File& file) {
+    if (m_inodeLinks[file.inode]++ == 0) {
+        m_totalSize += file.size;
+    }
+}
+
+void ShaderCacheManager::releaseInode(const File& file) {
+    auto links = m_inodeLinks.find(file.inode);
+    if (links == m_inodeLinks.end()) {
+        return;
+    }
+    if (--*links == 0) {
+        m_totalSize -= file.size;
+        m_inodeLinks.erase(links);
+    }
+}
+
+void ShaderCacheManager::setBudget(qint64 bytes) {
+    m_budget = bytes;
+    scheduleEviction();
+}
+
+void ShaderCacheManager::rescan() {
+    m_directoriesRead = 0;
+    scanDirectory(QByteArray(), false);
+}
+
+void ShaderCacheManager::scanDirectory(const QByteArray& relative, bool force) {
+    struct stat st;
+    if (::stat((m_root + relative).constData(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        removeDirectory(relative);
+        return;
+    }
+
+    Directory& dir = m_dirs[relative];
+    if (!force && dir.mtimeNs == mtimeNs(st)) {
+        // Same entries as when indexed; only subdirectories can differ
+        const QVector<QByteArray> subdirs = dir.subdirs;
+        for (const QByteArray& subdir : subdirs) {
+            scanDirectory(relative + "/" + subdir, false);
+        }
+        return;
+    }
+
+    DIR* handle = ::opendir((m_root + relative).constData());
+    if (!handle) {
+        return;
+    }
+    ++m_directoriesRead;
+
+    QHash<QByteArray, File> files;
+    QVector<QByteArray> subdirs;
+    while (dirent* entry = ::readdir(handle)) {
+        const QByteArray name(entry->d_name);
+        if (name == "." || name == ".." || isExcluded(relative, name)) {
+            continue;
+        }
+        struct stat fileStat;
+        if (::fstatat(::dirfd(handle), entry->d_name, &fileStat, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (S_ISDIR(fileStat.st_mode)) {
+            subdirs.append(name);
+        } else if (S_ISREG(fileStat.st_mode)) {
+            // Keep access times seen through inotify; relatime lags behind
+            const File previous = dir.files.value(name, File{0, 0, 0});
+            const qint64 atime = std::max<qint64>(previous.atime, fileStat.st_atim.tv_sec);
+            files.insert(name, File{fileStat.st_size, atime, fileStat.st_ino});
+        }
+    }
+    ::closedir(handle);
+
+    for (const File& file : std::as_const(dir.files)) {
+        releaseInode(file);
+    }
+    for (const File& file : std::as_const(files)) {
+        retainInode(file);
+    }
+    m_fileCount += files.size() - dir.files.size();
+    const QVector<QByteArray> previousSubdirs = dir.subdirs;
+    dir.files = files;
+    dir.subdirs = subdirs;
+    dir.mtimeNs = mtimeNs(st);
+
+    // dir is not used past this point; recursion may rehash m_dirs
+    for (const QByteArray& subdir : previousSubdirs) {
+        if (!subdirs.contains(subdir)) {
+            removeDirectory(relative + "/" + subdir);
+        }
+    }
+    for (const QByteArray& subdir : subdirs) {
+        scanDirectory(relative + "/" + subdir, force);
+    }
+}
+
+void ShaderCacheManager::removeDirectory(const QByteArray& relative) {
+    auto it = m_dirs.find(relative);
+    if (it == m_dirs.end()) {
+        return;
+    }
+    const QVector<QByteArray> subdirs = it->subdirs;
+    for (const File& file : std::as_const(it->files)) {
+        releaseInode(file);
+    }
+    m_fileCount -= it->files.size();
+    m_dirs.erase(it);
+    for (const QByteArray& subdir : subdirs) {
+        removeDirectory(relative + "/" + subdir);
+    }
+}
+
+void ShaderCacheManager::updateFile(const QByteArray& directory, const QByteArray& name) {
+    auto dir = m_dirs.find(directory);
+    struct stat st;
+    if (dir == m_dirs.end() || ::stat((m_root + directory + "/" + name).constData(), &st) != 0
+        || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    auto file = dir->files.find(name);
+    if (file == dir->files.end()) {
+        file = dir->files.insert(name, File{0, 0, 0});
+        ++m_fileCount;
+    } else {
+        releaseInode(*file);
+    }
+    file->size = st.st_size;
+    file->inode = st.st_ino;
+    file->atime = QDateTime::currentSecsSinceEpoch();
+    retainInode(*file);
+}
+
+void ShaderCacheManager::removeFile(const QByteArray& directory, const QByteArray& name) {
+    auto dir = m_dirs.find(directory);
+    if (dir == m_dirs.end()) {
+        return;
+    }
+    auto file = dir->files.find(name);
+    if (file == dir->files.end()) {
+        return;
+    }
+    releaseInode(*file);
+    --m_fileCount;
+    dir->files.erase(file);
+}
+
+void ShaderCacheManager::touchFile(const QByteArray& directory, const QByteArray& name) {
+    auto dir = m_dirs.find(directory);
+    if (dir == m_dirs.end()) {
+        return;
+    }
+    auto file = dir->files.find(name);
+    if (file != dir->files.end()) {
+        file->atime = QDateTime::currentSecsSinceEpoch();
+    }
+}
+
+void ShaderCacheManager::refreshDirectoryTime(const QByteArray& relative) {
+    // Called once events for a directory are applied: the index now
+    // matches its listing
+    auto dir = m_dirs.find(relative);
+    struct stat st;
+    if (dir != m_dirs.end() && ::stat((m_root + relative).constData(), &st) == 0) {
+        dir->mtimeNs = mtimeNs(st);
+    }
+}
+
+void ShaderCacheManager::addWatches(const QByteArray& relative) {
+    const int wd = ::inotify_add_watch(m_inotifyFd, (m_root + relative).constData(), WatchMask);
+    if (wd < 0) {
+        qWarning() << "Failed to watch" << m_root + relative;
+        return;
+    }
+    m_watches.insert(wd, relative);
+    const QVector<QByteArray> subdirs = m_dirs.value(relative).subdirs;
+    for (const QByteArray& subdir : subdirs) {
+        addWatches(relative + "/" + subdir);
+    }
+}
+
+void ShaderCacheManager::readEvents() {
+    alignas(inotify_event) char buf[16384];
+    QVector<QByteArray> touched;
+    bool overflowed = false;
+
+    for (;;) {
+        const ssize_t n = ::read(m_inotifyFd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < n; ) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buf + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+                continue;
+            }
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end()) {
+                continue;
+            }
+            const QByteArray directory = watch.value();
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+                m_watches.erase(watch);
+                continue;
+            }
+
+            const QByteArray name(event->name);
+            if (isExcluded(directory, name)) {
+                continue;
+            }
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    auto dir = m_dirs.find(directory);
+                    if (dir != m_dirs.end() && !dir->subdirs.contains(name)) {
+                        dir->subdirs.append(name);
+                    }
+                    scanDirectory(directory + "/" + name, true);
+                    addWatches(directory + "/" + name);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    auto dir = m_dirs.find(directory);
+                    if (dir != m_dirs.end()) {
+                        dir->subdirs.removeAll(name);
+                    }
+                    removeDirectory(directory + "/" + name);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)) {
+                updateFile(directory, name);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                removeFile(directory, name);
+            } else if (event->mask & IN_OPEN) {
+                touchFile(directory, name);
+            }
+            if (!touched.contains(directory)) {
+                touched.append(directory);
+            }
+        }
+    }
+
+    if (overflowed) {
+        // Events were lost; fall back to comparing directory mtimes
+        rescan();
+    } else {
+        for (const QByteArray& directory : touched) {
+            refreshDirectoryTime(directory);
+        }
+    }
+    scheduleEviction();
+}
+
+void ShaderCacheManager::scheduleEviction() {
+    if (!isOpen() || m_totalSize <= m_budget) {
+        return;
+    }
+    if (m_gameRunning) {
+        m_evictionPending = true;
+    } else if (!m_evictionTimer.isActive() && !isEvicting()) {
+        m_evictionTimer.start();
+    }
+}
+
+void ShaderCacheManager::setGameRunning(bool running) {
+    m_gameRunning = running;
+    if (running) {
+        // Stop deleting as soon as the game needs the disk
+        m_evictionTimer.stop();
+        m_abortEviction = true;
+        if (isEvicting()) {
+            m_evictionPending = true;
+        }
+    } else if (m_evictionPending) {
+        m_evictionPending = false;
+        m_evictionTimer.start();
+    } else {
+        scheduleEviction();
+    }
+}
+
+bool ShaderCacheManager::evict() {
+    if (!isOpen() || isEvicting()) {
+        return false;
+    }
+    if (m_gameRunning) {
+        m_evictionPending = true;
+        return false;
+    }
+
+    struct Candidate {
+        qint64 atime;
+        qint64 size;
+        quint64 inode;
+        const QByteArray* directory;
+        const QByteArray* name;
+    };
+    QVector<Candidate> candidates;
+    candidates.reserve(m_fileCount);
+    for (auto dir = m_dirs.cbegin(); dir != m_dirs.cend(); ++dir) {
+        for (auto file = dir->files.cbegin(); file != dir->files.cend(); ++file) {
+            candidates.append({file->atime, file->size, file->inode, &dir.key(), &file.key()});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.atime < b.atime;
+    });
+
+    const qint64 expiry = m_maxAgeSeconds > 0
+        ? QDateTime::currentSecsSinceEpoch() - m_maxAgeSeconds : 0;
+    const qint64 target = m_totalSize > m_budget ? qint64(m_budget * LowWatermark) : m_totalSize;
+    qint64 remaining = m_totalSize;
+    QHash<quint64, int> links = m_inodeLinks;
+    QVector<Victim> victims;
+    for (const Candidate& candidate : candidates) {
+        if (remaining <= target && candidate.atime >= expiry) {
+            break;
+        }
+        // Space only comes back with the last link
+        const bool lastLink = --links[candidate.inode] == 0;
+        victims.append({*candidate.directory + "/" + *candidate.name, lastLink ? candidate.size : 0});
+        if (lastLink) {
+            remaining -= candidate.size;
+        }
+    }
+    if (victims.isEmpty()) {
+        return false;
+    }
+
+    m_abortEviction = false;
+    const QByteArray root = m_root;
+    m_evictionThread = std::thread([this, root, victims]() {
+        lowerThreadPriority();
+        QVector<QByteArray> removed;
+        qint64 bytes = 0;
+        for (const Victim& victim : victims) {
+            if (m_abortEviction) {
+                break;
+            }
+            if (::unlink((root + victim.path).constData()) == 0) {
+                removed.append(victim.path);
+                bytes += victim.size;
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, removed, bytes]() {
+            onEvictionFinished(removed, bytes);
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+void ShaderCacheManager::onEvictionFinished(const QVector<QByteArray>& removed, qint64 bytes) {
+    joinEviction();
+    for (const QByteArray& path : removed) {
+        const int slash = path.lastIndexOf('/');
+        removeFile(path.left(slash), path.mid(slash + 1));
+    }
+    saveIndex();
+    emit evicted(removed.size(), bytes);
+
+    if (!m_gameRunning) {
+        scheduleEviction();
+    }
+}
+
+void ShaderCacheManager::joinEviction() {
+    if (m_evictionThread.joinable()) {
+        m_evictionThread.join();
+    }
+}
+
+bool ShaderCacheManager::saveIndex() const {
+    if (!isOpen()) {
+        return false;
+    }
+
+    QSaveFile file(m_indexPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream out(&file);
+    out << IndexMagic << IndexVersion << m_root << quint32(m_dirs.size());
+    for (auto dir = m_dirs.cbegin(); dir != m_dirs.cend(); ++dir) {
+        out << dir.key() << dir->mtimeNs << quint32(dir->files.size());
+        for (auto it = dir->files.cbegin(); it != dir->files.cend(); ++it) {
+            out << it.key() << it->size << it->atime << it->inode;
+        }
+        out << quint32(dir->subdirs.size());
+        for (const QByteArray& subdir : dir->subdirs) {
+            out << subdir;
+        }
+    }
+    return file.commit();
+}
+
+bool ShaderCacheManager::loadIndex() {
+    QFile file(m_indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray root;
+    quint32 dirCount = 0;
+    in >> magic >> version >> root >> dirCount;
+    if (magic != IndexMagic || version != IndexVersion || root != m_root) {
+        return false;
+    }
+
+    m_dirs.clear();
+    m_dirs.reserve(dirCount);
+    m_inodeLinks.clear();
+    m_totalSize = 0;
+    m_fileCount = 0;
+    for (quint32 i = 0; i < dirCount && in.status() == QDataStream::Ok; ++i) {
+        QByteArray path;
+        Directory dir;
+        quint32 fileCount = 0;
+        in >> path >> dir.mtimeNs >> fileCount;
+        dir.files.reserve(fileCount);
+        for (quint32 j = 0; j < fileCount && in.status() == QDataStream::Ok; ++j) {
+            QByteArray name;
+            File entry;
+            in >> name >> entry.size >> entry.atime >> entry.inode;
+            dir.files.insert(name, entry);
+            retainInode(entry);
+        }
+        quint32 subdirCount = 0;
+        in >> subdirCount;
+        for (quint32 j = 0; j < subdirCount && in.status() == QDataStream::Ok; ++j) {
+            QByteArray subdir;
+            in >> subdir;
+            dir.subdirs.append(subdir);
+        }
+        m_fileCount += dir.files.size();
+        m_dirs.insert(path, dir);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+ShaderCacheManager::~ShaderCacheManager() {
+    close();
+}
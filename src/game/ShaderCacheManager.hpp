@@ -0,0 +1,135 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <thread>
+
+class QSocketNotifier;
+
+// Keeps the game's shader cache within a size budget.
+//
+// An index of every cache file (size and last access) is kept in memory,
+// updated from inotify while the launcher runs and persisted next to the
+// cache between runs. On start only directories whose mtime moved since
+// the index was saved are listed again, so a large unchanged cache costs
+// one stat per directory rather than one per file. Mesa and Fossilize
+// already name entries by content hash, so paths double as keys.
+//
+// Hardlinks are counted once: a file's size is only added for the first
+// indexed path of its inode, and deleting a path only frees space once no
+// other indexed path links to it.
+//
+// When the cache grows past its budget the least recently used files are
+// deleted on a background thread at idle CPU and I/O priority, and never
+// while the game is running.
+class ShaderCacheManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ShaderCacheManager(QObject* parent = nullptr);
+    ~ShaderCacheManager();
+
+    // Load the index (defaults to "<cacheDir>.index"), bring it up to date
+    // and start watching the cache
+    bool open(const QString& cacheDir, const QString& indexPath = QString());
+    void close();
+    bool isOpen() const { return !m_root.isEmpty(); }
+    // Paths relative to the cache root that are neither counted nor
+    // evicted, e.g. another component's metadata; set before open()
+    void setExcluded(const QStringList& paths);
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+    // Files not accessed for this long are evicted regardless of budget;
+    // 0 disables
+    void setMaxAge(qint64 seconds) { m_maxAgeSeconds = seconds; }
+    // Delay between the cache going over budget and eviction starting, so
+    // a burst of new shaders is handled in one pass
+    void setEvictionDelay(int ms) { m_evictionTimer.setInterval(ms); }
+
+    // Eviction waits while the game runs and an eviction in progress stops
+    void setGameRunning(bool running);
+    bool isGameRunning() const { return m_gameRunning; }
+
+    // Evict now if over budget (or holding expired files); returns false
+    // if nothing is due or eviction has to wait
+    bool evict();
+    bool isEvicting() const { return m_evictionThread.joinable(); }
+
+    // Re-list directories whose mtime changed since they were indexed
+    void rescan();
+    bool saveIndex() const;
+
+    qint64 totalSize() const { return m_totalSize; }
+    int fileCount() const { return m_fileCount; }
+    // Directories listed by the last open()/rescan()
+    int directoriesRead() const { return m_directoriesRead; }
+
+signals:
+    void evicted(int files, qint64 bytes);
+
+private:
+    struct File {
+        qint64 size;
+        qint64 atime;  // Seconds since the epoch
+        quint64 inode;
+    };
+
+    struct Directory {
+        qint64 mtimeNs = -1;
+        QHash<QByteArray, File> files;
+        QVector<QByteArray> subdirs;
+    };
+
+    struct Victim {
+        QByteArray path;  // Relative to the cache root
+        qint64 size;
+    };
+
+    bool isExcluded(const QByteArray& directory, const QByteArray& name) const {
+        return m_excluded.contains(directory + "/" + name);
+    }
+    void retainInode(const File& file);
+    void releaseInode(const File& file);
+
+    bool loadIndex();
+    void scanDirectory(const QByteArray& relative, bool force);
+    void removeDirectory(const QByteArray& relative);
+    void updateFile(const QByteArray& directory, const QByteArray& name);
+    void removeFile(const QByteArray& directory, const QByteArray& name);
+    void touchFile(const QByteArray& directory, const QByteArray& name);
+    void refreshDirectoryTime(const QByteArray& relative);
+    void addWatches(const QByteArray& relative);
+    void readEvents();
+    void scheduleEviction();
+    void onEvictionFinished(const QVector<QByteArray>& removed, qint64 bytes);
+    void joinEviction();
+
+    QByteArray m_root;
+    QString m_indexPath;
+    QSet<QByteArray> m_excluded;
+    QHash<QByteArray, Directory> m_dirs;
+    QHash<quint64, int> m_inodeLinks;  // Indexed paths per inode
+    qint64 m_totalSize;
+    int m_fileCount;
+    int m_directoriesRead;
+
+    qint64 m_budget;
+    qint64 m_maxAgeSeconds;
+    bool m_gameRunning;
+    bool m_evictionPending;
+    QTimer m_evictionTimer;
+    std::thread m_evictionThread;
+    std::atomic<bool> m_abortEviction;
+
+    int m_inotifyFd;
+    QSocketNotifier* m_notifier;
+    QHash<int, QByteArray> m_watches;
+};
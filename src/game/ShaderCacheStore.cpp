@@ -0,0 +1,517 @@
+#include "ShaderCacheStore.hpp"
+#include "LaunchPlan.hpp"
+#include "../storage/Reflink.hpp"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSet>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int ManifestVersion = 1;
+const char* const ManifestName = "partitions.json";
+const char* const PartitionDir = "partitions";
+const char* const BlobDir = "blobs";
+// Half-written links and copies; never indexed
+const char* const TempPrefix = ".scs-";
+
+const char* const DefaultIcdDirectories[] = {
+    "/etc/vulkan/icd.d",
+    "/usr/local/share/vulkan/icd.d",
+    "/usr/share/vulkan/icd.d",
+};
+const char* const LibraryDirectories[] = {
+    "/usr/lib64",
+    "/usr/lib/x86_64-linux-gnu",
+    "/usr/lib",
+};
+
+QString sanitize(const QString& value) {
+    QString result = value;
+    for (QChar& c : result) {
+        if (!c.isLetterOrNumber() && c != '.' && c != '_') {
+            c = '_';
+        }
+    }
+    return result;
+}
+
+// Changes whenever the file is rewritten or replaced by a link
+QByteArray fingerprint(const QString& path) {
+    struct stat st;
+    if (::lstat(QFile::encodeName(path).constData(), &st) != 0) {
+        return QByteArray();
+    }
+    return QByteArray::number(qint64(st.st_size)) + ":"
+        + QByteArray::number(qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec) + ":"
+        + QByteArray::number(quint64(st.st_ino));
+}
+
+bool sameInode(const QString& a, const QString& b) {
+    struct stat stA, stB;
+    return ::stat(QFile::encodeName(a).constData(), &stA) == 0
+        && ::stat(QFile::encodeName(b).constData(), &stB) == 0
+        && stA.st_dev == stB.st_dev && stA.st_ino == stB.st_ino;
+}
+
+nlink_t linkCount(const QString& path) {
+    struct stat st;
+    return ::stat(QFile::encodeName(path).constData(), &st) == 0 ? st.st_nlink : 0;
+}
+
+QByteArray hashFile(const QString& path) {
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result().toHex();
+}
+
+QStringList filesBelow(const QString& directory) {
+    QStringList files;
+    QDirIterator it(directory, QDir::Files | QDir::Hidden | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        if (!it.fileName().startsWith(TempPrefix)) {
+            files.append(path);
+        }
+    }
+    return files;
+}
+
+QByteArray elfBuildId(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(Elf64_Ehdr))) {
+        return QByteArray();
+    }
+    const uchar* data = file.map(0, file.size());
+    if (!data) {
+        return QByteArray();
+    }
+    const quint64 size = quint64(file.size());
+
+    const auto* header = reinterpret_cast<const Elf64_Ehdr*>(data);
+    if (std::memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64
+        || header->e_phoff + quint64(header->e_phnum) * sizeof(Elf64_Phdr) > size) {
+        return QByteArray();
+    }
+
+    const auto* programHeaders = reinterpret_cast<const Elf64_Phdr*>(data + header->e_phoff);
+    for (int i = 0; i < header->e_phnum; ++i) {
+        const Elf64_Phdr& ph = programHeaders[i];
+        if (ph.p_type != PT_NOTE || ph.p_offset + ph.p_filesz > size) {
+            continue;
+        }
+        quint64 offset = ph.p_offset;
+        const quint64 end = ph.p_offset + ph.p_filesz;
+        while (offset + sizeof(Elf64_Nhdr) <= end) {
+            const auto* note = reinterpret_cast<const Elf64_Nhdr*>(data + offset);
+            const quint64 nameOffset = offset + sizeof(Elf64_Nhdr);
+            const quint64 descOffset = nameOffset + ((note->n_namesz + 3) & ~3u);
+            const quint64 next = descOffset + ((note->n_descsz + 3) & ~3u);
+            if (next > end) {
+                break;
+            }
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+                && std::memcmp(data + nameOffset, "GNU", 4) == 0) {
+                return QByteArray(reinterpret_cast<const char*>(data + descOffset),
+                                  int(note->n_descsz)).toHex();
+            }
+            offset = next;
+        }
+    }
+    return QByteArray();
+}
+
+QString resolveLibrary(const QString& libraryPath, const QString& manifestDir) {
+    if (libraryPath.contains('/')) {
+        return QDir(manifestDir).absoluteFilePath(libraryPath);
+    }
+    for (const char* directory : LibraryDirectories) {
+        const QString candidate = QString(directory) + "/" + libraryPath;
+        if (QFileInfo::exists(candidate)) {
+            return candidate;
+        }
+    }
+    return QString();
+}
+
+} // namespace
+
+ShaderCacheStore::ShaderCacheStore(const QString& root)
+    : m_mode(LinkMode::Auto) {
+    if (!root.isEmpty()) {
+        setRoot(root);
+    }
+}
+
+void ShaderCacheStore::setRoot(const QString& root) {
+    QMutexLocker locker(&m_mutex);
+    m_root = root;
+    m_partitions.clear();
+    m_active.clear();
+    load();
+}
+
+QString ShaderCacheStore::root() const {
+    QMutexLocker locker(&m_mutex);
+    return m_root;
+}
+
+void ShaderCacheStore::setLinkMode(LinkMode mode) {
+    QMutexLocker locker(&m_mutex);
+    m_mode = mode;
+}
+
+ShaderCacheStore::LinkMode ShaderCacheStore::linkMode() const {
+    QMutexLocker locker(&m_mutex);
+    return m_mode;
+}
+
+QStringList ShaderCacheStore::metadataPaths() {
+    return {ManifestName, BlobDir};
+}
+
+QString ShaderCacheStore::partitionKey(const QString& driverBuildId, const QString& gameVersion) {
+    return sanitize(driverBuildId).left(16) + "-"
+        + (gameVersion.isEmpty() ? QString("unknown") : sanitize(gameVersion));
+}
+
+QString ShaderCacheStore::partitionPath(const QString& key) const {
+    return m_root + "/" + PartitionDir + "/" + key;
+}
+
+QString ShaderCacheStore::blobPath(const QByteArray& hash) const {
+    return m_root + "/" + BlobDir + "/" + QString::fromLatin1(hash.left(2)) + "/" + QString::fromLatin1(hash);
+}
+
+QString ShaderCacheStore::activate(const QString& driverBuildId, const QString& gameVersion) {
+    QMutexLocker locker(&m_mutex);
+    const QString key = partitionKey(driverBuildId, gameVersion);
+    const QString path = partitionPath(key);
+
+    if (!m_partitions.contains(key)) {
+        // The partition in use is the most recent one by definition
+        QString seed = m_partitions.value(m_active).driver == driverBuildId ? m_active : QString();
+        for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it) {
+            if (it->driver == driverBuildId
+                && (seed.isEmpty() || it->lastUsed > m_partitions.value(seed).lastUsed)) {
+                seed = it.key();
+            }
+        }
+        if (!QDir().mkpath(path)) {
+            qWarning() << "Failed to create shader cache partition" << path;
+            return QString();
+        }
+        if (!seed.isEmpty()) {
+            seedPartition(seed, key);
+        }
+    } else if (!QDir().mkpath(path)) {
+        qWarning() << "Failed to create shader cache partition" << path;
+        return QString();
+    }
+
+    Partition& partition = m_partitions[key];
+    partition.driver = driverBuildId;
+    partition.game = gameVersion;
+    partition.lastUsed = QDateTime::currentSecsSinceEpoch();
+    m_active = key;
+    breakLinks(key, partition);
+    save();
+    return path;
+}
+
+QString ShaderCacheStore::activePartition() const {
+    QMutexLocker locker(&m_mutex);
+    return m_active;
+}
+
+QStringList ShaderCacheStore::partitions() const {
+    QMutexLocker locker(&m_mutex);
+    return m_partitions.keys();
+}
+
+void ShaderCacheStore::seedPartition(const QString& from, const QString& to) {
+    // The new partition is about to be written to, so it gets private
+    // copies unless the filesystem can share extents copy-on-write
+    const QDir source(partitionPath(from));
+    const QString target = partitionPath(to);
+    for (const QString& path : filesBelow(source.path())) {
+        const QString destination = target + "/" + source.relativeFilePath(path);
+        QDir().mkpath(QFileInfo(destination).absolutePath());
+        linkFile(path, destination, false);
+    }
+}
+
+void ShaderCacheStore::breakLinks(const QString& key, Partition& partition) {
+    // A hardlinked file written in place would change every partition
+    // sharing it, and the blob with them
+    const QDir directory(partitionPath(key));
+    for (const QString& path : filesBelow(directory.path())) {
+        if (linkCount(path) > 1 && linkFile(path, path, false)) {
+            partition.files.remove(directory.relativeFilePath(path));
+        }
+    }
+}
+
+bool ShaderCacheStore::linkFile(const QString& source, const QString& target, bool shared) {
+    // Built next to the target and renamed over it, so a reader never
+    // sees a partial file
+    const QFileInfo info(target);
+    const QString temp = info.absolutePath() + "/" + TempPrefix + info.fileName();
+    const QByteArray tempName = QFile::encodeName(temp);
+    ::unlink(tempName.constData());
+
+    bool ok = false;
+    if (m_mode != LinkMode::Hardlink) {
+        ok = Reflink::clone(source, temp);
+        if (ok) {
+            m_mode = LinkMode::Reflink;
+        } else if (m_mode == LinkMode::Auto && Reflink::isUnsupported(errno)) {
+            m_mode = LinkMode::Hardlink;
+        }
+    }
+    if (!ok && m_mode == LinkMode::Hardlink) {
+        ok = shared ? ::link(QFile::encodeName(source).constData(), tempName.constData()) == 0
+                    : QFile::copy(source, temp);
+    }
+
+    if (!ok || ::rename(tempName.constData(), QFile::encodeName(target).constData()) != 0) {
+        qWarning() << "Failed to link" << source << "to" << target << std::strerror(errno);
+        ::unlink(tempName.constData());
+        return false;
+    }
+    return true;
+}
+
+ShaderCacheStore::Stats ShaderCacheStore::deduplicate() {
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it) {
+        // Until reflinks are known to work the active partition is left
+        // alone, see breakLinks()
+        if (it.key() == m_active && m_mode != LinkMode::Reflink) {
+            continue;
+        }
+        deduplicatePartition(it.key(), it.value());
+    }
+    save();
+    return computeStats();
+}
+
+void ShaderCacheStore::deduplicatePartition(const QString& key, Partition& partition) {
+    const QDir directory(partitionPath(key));
+    QSet<QString> present;
+
+    for (const QString& path : filesBelow(directory.path())) {
+        const QString relative = directory.relativeFilePath(path);
+        present.insert(relative);
+        const auto known = partition.files.constFind(relative);
+        if (known != partition.files.constEnd() && known->fingerprint == fingerprint(path)) {
+            continue;
+        }
+
+        const QByteArray hash = hashFile(path);
+        if (hash.isEmpty()) {
+            continue;
+        }
+        const QString blob = blobPath(hash);
+        if (!QFileInfo::exists(blob)) {
+            QDir().mkpath(QFileInfo(blob).absolutePath());
+            if (!linkFile(path, blob, true)) {
+                continue;
+            }
+        } else if (!sameInode(path, blob) && !linkFile(blob, path, true)) {
+            continue;
+        }
+        partition.files.insert(relative, {fingerprint(path), hash});
+    }
+
+    for (auto it = partition.files.begin(); it != partition.files.end();) {
+        it = present.contains(it.key()) ? std::next(it) : partition.files.erase(it);
+    }
+}
+
+qint64 ShaderCacheStore::collectGarbage(const QString& driverBuildId, const QStringList& installedVersions) {
+    QMutexLocker locker(&m_mutex);
+    const qint64 before = computeStats().storedBytes;
+
+    for (auto it = m_partitions.begin(); it != m_partitions.end();) {
+        const bool unreachable = it->driver != driverBuildId
+            || (!installedVersions.isEmpty() && !installedVersions.contains(it->game));
+        if (it.key() == m_active || !unreachable) {
+            ++it;
+            continue;
+        }
+        QDir(partitionPath(it.key())).removeRecursively();
+        it = m_partitions.erase(it);
+    }
+
+    QSet<QByteArray> referenced;
+    for (const Partition& partition : m_partitions) {
+        for (const Entry& entry : partition.files) {
+            referenced.insert(entry.hash);
+        }
+    }
+    for (const QString& blob : filesBelow(m_root + "/" + BlobDir)) {
+        // A blob still linked from a partition is kept even if the
+        // manifest lost track of it
+        if (!referenced.contains(QFileInfo(blob).fileName().toLatin1()) && linkCount(blob) == 1) {
+            QFile::remove(blob);
+        }
+    }
+
+    save();
+    return before - computeStats().storedBytes;
+}
+
+ShaderCacheStore::Stats ShaderCacheStore::stats() const {
+    QMutexLocker locker(&m_mutex);
+    return computeStats();
+}
+
+ShaderCacheStore::Stats ShaderCacheStore::computeStats() const {
+    Stats stats;
+    stats.partitions = m_partitions.size();
+    for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it) {
+        const QDir directory(partitionPath(it.key()));
+        for (const QString& path : filesBelow(directory.path())) {
+            const qint64 size = QFileInfo(path).size();
+            const auto known = it->files.constFind(directory.relativeFilePath(path));
+            ++stats.files;
+            stats.logicalBytes += size;
+            if (known != it->files.constEnd() && known->fingerprint == fingerprint(path)) {
+                ++stats.sharedFiles;
+            } else {
+                stats.storedBytes += size;
+            }
+        }
+    }
+    for (const QString& blob : filesBelow(m_root + "/" + BlobDir)) {
+        stats.storedBytes += QFileInfo(blob).size();
+    }
+    return stats;
+}
+
+bool ShaderCacheStore::load() {
+    QFile file(m_root + "/" + ManifestName);
+    if (file.open(QIODevice::ReadOnly)) {
+        const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+        if (root.value("version").toInt() == ManifestVersion) {
+            m_active = root.value("active").toString();
+            const QJsonObject partitions = root.value("partitions").toObject();
+            for (auto it = partitions.begin(); it != partitions.end(); ++it) {
+                const QJsonObject object = it.value().toObject();
+                Partition& partition = m_partitions[it.key()];
+                partition.driver = object.value("driver").toString();
+                partition.game = object.value("game").toString();
+                partition.lastUsed = object.value("lastUsed").toInteger();
+                const QJsonObject files = object.value("files").toObject();
+                for (auto f = files.begin(); f != files.end(); ++f) {
+                    const QJsonArray entry = f.value().toArray();
+                    partition.files.insert(f.key(), {entry.at(0).toString().toLatin1(),
+                                                     entry.at(1).toString().toLatin1()});
+                }
+            }
+        }
+    }
+
+    // Partitions left behind without a manifest entry belong to no known
+    // driver, so the next collection removes them
+    const QStringList found = QDir(m_root + "/" + PartitionDir)
+        .entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& key : found) {
+        if (!m_partitions.contains(key)) {
+            m_partitions.insert(key, Partition());
+        }
+    }
+    return true;
+}
+
+bool ShaderCacheStore::save() const {
+    QJsonObject partitions;
+    for (auto it = m_partitions.begin(); it != m_partitions.end(); ++it) {
+        QJsonObject files;
+        for (auto f = it->files.begin(); f != it->files.end(); ++f) {
+            files[f.key()] = QJsonArray{QString::fromLatin1(f->fingerprint), QString::fromLatin1(f->hash)};
+        }
+        QJsonObject object;
+        object["driver"] = it->driver;
+        object["game"] = it->game;
+        object["lastUsed"] = it->lastUsed;
+        object["files"] = files;
+        partitions[it.key()] = object;
+    }
+
+    QJsonObject root;
+    root["version"] = ManifestVersion;
+    root["active"] = m_active;
+    root["partitions"] = partitions;
+
+    QSaveFile file(m_root + "/" + ManifestName);
+    if (!QDir().mkpath(m_root) || !file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to save shader cache manifest in" << m_root;
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+QString ShaderCacheStore::driverBuildId(const QStringList& icdDirectories) {
+    QStringList directories = icdDirectories;
+    if (directories.isEmpty()) {
+        for (const char* directory : DefaultIcdDirectories) {
+            directories << directory;
+        }
+    }
+
+    // The Radeon manifest first; anything else only if there is none
+    QStringList manifests;
+    for (const QString& directory : directories) {
+        const QDir dir(directory);
+        for (const QString& name : dir.entryList({"*.json"}, QDir::Files, QDir::Name)) {
+            if (name.contains("radeon")) {
+                manifests.prepend(dir.filePath(name));
+            } else {
+                manifests.append(dir.filePath(name));
+            }
+        }
+    }
+
+    for (const QString& manifest : manifests) {
+        QFile file(manifest);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        const QString libraryPath = QJsonDocument::fromJson(file.readAll()).object()
+            .value("ICD").toObject().value("library_path").toString();
+        const QString library = resolveLibrary(libraryPath, QFileInfo(manifest).absolutePath());
+        if (library.isEmpty() || !QFileInfo::exists(library)) {
+            continue;
+        }
+
+        const QByteArray buildId = elfBuildId(library);
+        if (!buildId.isEmpty()) {
+            return QString::fromLatin1(buildId);
+        }
+        // Stripped of its build ID; size and mtime still change with it
+        return QString::fromLatin1(QCryptographicHash::hash(LaunchPlan::fileFingerprint(library),
+                                                            QCryptographicHash::Sha1).toHex());
+    }
+    return QString("unknown");
+}
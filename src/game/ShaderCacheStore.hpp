@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+// Splits the driver shader cache into one partition per (driver build,
+// game version), so a Mesa update or a game patch gets a cache of its own
+// and switching back to another installed version finds its cache warm.
+//
+// Partitions share identical files through a content-addressed blob store
+// ("blobs/<sha256>"). Where the filesystem supports it files are reflinked
+// to their blob, otherwise hardlinked. Hardlinks share the inode, so in
+// that mode the active partition, which the driver writes to, is never
+// linked: its files are copied back out when it becomes active and only
+// inactive partitions are deduplicated.
+//
+// Safe to call from any thread; calls are serialized.
+class ShaderCacheStore {
+public:
+    enum class LinkMode {
+        Auto,     // Reflink if the filesystem can, hardlink otherwise
+        Reflink,
+        Hardlink
+    };
+
+    struct Stats {
+        int partitions = 0;
+        int files = 0;
+        int sharedFiles = 0;      // Files backed by a blob
+        qint64 logicalBytes = 0;  // Sum over every partition
+        qint64 storedBytes = 0;   // Blobs plus files not backed by one
+
+        double dedupRatio() const { return storedBytes > 0 ? double(logicalBytes) / storedBytes : 1.0; }
+        qint64 savedBytes() const { return logicalBytes - storedBytes; }
+    };
+
+    explicit ShaderCacheStore(const QString& root = QString());
+
+    void setRoot(const QString& root);
+    QString root() const;
+    void setLinkMode(LinkMode mode);
+    // The mode in use; Auto until the first link was attempted
+    LinkMode linkMode() const;
+
+    // The manifest and blob store, relative to the root; everything else
+    // below it is partitions
+    static QStringList metadataPaths();
+
+    static QString partitionKey(const QString& driverBuildId, const QString& gameVersion);
+    QString partitionPath(const QString& key) const;
+
+    // Make the partition for driverBuildId and gameVersion the one the
+    // game writes to and return its path. A new partition is seeded from
+    // the most recently used one of the same driver, since a game update
+    // keeps most of its shaders.
+    QString activate(const QString& driverBuildId, const QString& gameVersion);
+    QString activePartition() const;
+    QStringList partitions() const;
+
+    // Back identical files by a shared blob; only files changed since the
+    // last pass are hashed
+    Stats deduplicate();
+
+    // Remove partitions built by another driver or for a game version not
+    // in installedVersions (empty keeps every version), then the blobs no
+    // partition uses. The active partition is always kept. Returns the
+    // number of bytes freed.
+    qint64 collectGarbage(const QString& driverBuildId, const QStringList& installedVersions = {});
+
+    Stats stats() const;
+
+    // GNU build ID of the Radeon Vulkan driver the loader would pick, from
+    // its ICD manifest; Mesa keys its own cache entries on the same ID
+    static QString driverBuildId(const QStringList& icdDirectories = {});
+
+private:
+    struct Entry {
+        QByteArray fingerprint;  // Size, mtime and inode when linked
+        QByteArray hash;
+    };
+
+    struct Partition {
+        QString driver;
+        QString game;
+        qint64 lastUsed = 0;
+        QHash<QString, Entry> files;  // Relative path -> blob
+    };
+
+    bool load();
+    bool save() const;
+    void deduplicatePartition(const QString& key, Partition& partition);
+    void breakLinks(const QString& key, Partition& partition);
+    void seedPartition(const QString& from, const QString& to);
+    bool linkFile(const QString& source, const QString& target, bool shared);
+    QString blobPath(const QByteArray& hash) const;
+    Stats computeStats() const;
+
+    mutable QMutex m_mutex;
+    QString m_root;
+    LinkMode m_mode;
+    QMap<QString, Partition> m_partitions;
+    QString m_active;
+};
@@ -0,0 +1,233 @@
+#include "ShaderPrewarmer.hpp"
+#include "LaunchPlan.hpp"
+#include "../gamepad/AllySystemControl.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int DefaultIdleDelayMs = 60000;
+constexpr int KillTimeoutMs = 1000;
+
+// From linux/ioprio.h, which glibc does not wrap
+constexpr int IoprioWhoProcess = 1;
+constexpr int IoprioClassIdle = 3;
+constexpr int IoprioClassShift = 13;
+
+} // namespace
+
+ShaderPrewarmer::ShaderPrewarmer(QObject* parent)
+    : QObject(parent)
+    , m_program("fossilize-replay")
+    , m_state(State::Idle)
+    , m_active(false)
+    , m_hot(false)
+    , m_lowBattery(false)
+    , m_stopped(false)
+    , m_killing(false) {
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(DefaultIdleDelayMs);
+    connect(&m_idleTimer, &QTimer::timeout, this, &ShaderPrewarmer::begin);
+
+    // Runs in the forked child: lowest CPU and I/O priority, and a
+    // process group of its own so workers it forks are paused and killed
+    // along with it
+    m_process.setChildProcessModifier([]() {
+        ::setpgid(0, 0);
+        ::setpriority(PRIO_PROCESS, 0, 19);
+        ::syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift);
+    });
+    connect(&m_process, &QProcess::finished, this, &ShaderPrewarmer::onFinished);
+}
+
+void ShaderPrewarmer::setCommand(const QString& program, const QStringList& arguments) {
+    m_program = program;
+    m_arguments = arguments;
+}
+
+void ShaderPrewarmer::setPartition(const QString& key) {
+    if (key == m_partition) {
+        return;
+    }
+    m_partition = key;
+    if (m_active) {
+        // The running database compiles into the old partition
+        stopReplay();
+        begin();
+    }
+}
+
+void ShaderPrewarmer::monitor(AllySystemControl* control) {
+    auto update = [this, control]() {
+        updateConditions(control->getCurrentTemperature(), control->getBatteryLevel(),
+                         control->isCharging());
+    };
+    connect(control, &AllySystemControl::temperatureChanged, this, update);
+    connect(control, &AllySystemControl::batteryLevelChanged, this, update);
+    connect(control, &AllySystemControl::chargingStateChanged, this, update);
+    update();
+}
+
+void ShaderPrewarmer::updateConditions(double temperature, int batteryLevel, bool charging) {
+    // Hysteresis so a temperature hovering at the limit does not flap
+    m_hot = temperature >= (m_hot ? m_limits.resumeTemperature : m_limits.maxTemperature);
+    m_lowBattery = !charging && batteryLevel >= 0 && batteryLevel < m_limits.minBatteryPercent;
+    reconcile();
+}
+
+void ShaderPrewarmer::setGameRunning(bool running) {
+    if (running) {
+        m_idleTimer.stop();
+        m_active = false;
+        stopReplay();
+        setState(State::Idle);
+    } else if (!m_active && !m_idleTimer.isActive()) {
+        m_idleTimer.start();
+    }
+}
+
+void ShaderPrewarmer::begin() {
+    m_active = true;
+    m_queue = pendingDatabases();
+    reconcile();
+}
+
+void ShaderPrewarmer::reconcile() {
+    if (!m_active) {
+        return;
+    }
+
+    const bool blocked = m_hot || m_lowBattery;
+    if (isReplaying()) {
+        if (blocked != m_stopped) {
+            signalReplay(blocked ? SIGSTOP : SIGCONT);
+            m_stopped = blocked;
+        }
+        setState(blocked ? State::Paused : State::Running);
+    } else if (blocked) {
+        setState(State::Paused);
+    } else {
+        startNext();
+    }
+}
+
+void ShaderPrewarmer::startNext() {
+    if (m_queue.isEmpty()) {
+        setState(State::Finished);
+        return;
+    }
+
+    m_current = m_queue.takeFirst();
+    m_currentPartition = m_partition;
+    m_stopped = false;
+    m_process.setProgram(m_program);
+    m_process.setArguments(m_arguments + QStringList(m_current));
+    m_process.start();
+    if (!m_process.waitForStarted()) {
+        qWarning() << "Failed to start shader replay" << m_program << m_process.errorString();
+        m_queue.clear();
+        setState(State::Finished);
+        return;
+    }
+    setState(State::Running);
+}
+
+void ShaderPrewarmer::signalReplay(int signal) {
+    const qint64 pid = m_process.processId();
+    if (pid > 0) {
+        ::kill(-static_cast<pid_t>(pid), signal);
+    }
+}
+
+void ShaderPrewarmer::stopReplay() {
+    if (!isReplaying()) {
+        return;
+    }
+
+    // The interrupted database goes back to the front of the queue; what
+    // it already compiled is in the driver cache and replays quickly
+    m_killing = true;
+    signalReplay(SIGKILL);
+    m_process.waitForFinished(KillTimeoutMs);
+    m_killing = false;
+    m_queue.prepend(m_current);
+    m_current.clear();
+    m_stopped = false;
+}
+
+void ShaderPrewarmer::onFinished(int exitCode, QProcess::ExitStatus status) {
+    if (m_killing) {
+        return;
+    }
+
+    const bool ok = status == QProcess::NormalExit && exitCode == 0;
+    if (ok) {
+        markReplayed(m_current);
+    } else {
+        // Left unmarked, so it is tried again next time
+        qWarning() << "Shader replay of" << m_current << "failed with code" << exitCode;
+    }
+    emit databaseReplayed(m_current, ok);
+    m_current.clear();
+    reconcile();
+}
+
+void ShaderPrewarmer::setState(State state) {
+    if (state != m_state) {
+        m_state = state;
+        emit stateChanged(state);
+    }
+}
+
+QStringList ShaderPrewarmer::pendingDatabases() const {
+    const QVariantMap replayed = loadState().value(m_partition).toMap();
+    QStringList pending;
+    const QDir dir(m_databaseDir);
+    for (const QString& name : dir.entryList({"*.foz"}, QDir::Files, QDir::Name)) {
+        const QString path = dir.filePath(name);
+        if (replayed.value(name).toByteArray() != LaunchPlan::fileFingerprint(path)) {
+            pending.append(path);
+        }
+    }
+    return pending;
+}
+
+QVariantMap ShaderPrewarmer::loadState() const {
+    QFile file(m_statePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QVariantMap();
+    }
+    return QJsonDocument::fromJson(file.readAll()).object().value("replayed").toObject().toVariantMap();
+}
+
+void ShaderPrewarmer::markReplayed(const QString& path) {
+    QVariantMap replayed = loadState();
+    QVariantMap partition = replayed.value(m_currentPartition).toMap();
+    partition.insert(QFileInfo(path).fileName(), QString::fromLatin1(LaunchPlan::fileFingerprint(path)));
+    replayed.insert(m_currentPartition, partition);
+
+    QJsonObject root;
+    root["replayed"] = QJsonObject::fromVariantMap(replayed);
+    QDir().mkpath(QFileInfo(m_statePath).absolutePath());
+    QSaveFile file(m_statePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to record shader replay state at" << m_statePath;
+        return;
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.commit();
+}
+
+ShaderPrewarmer::~ShaderPrewarmer() {
+    m_active = false;
+    stopReplay();
+}
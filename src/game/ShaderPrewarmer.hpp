@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QObject>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
+
+class AllySystemControl;
+
+// Replays recorded Fossilize pipeline databases while the launcher sits
+// idle, so the first session after a driver or game update does not
+// compile its shaders mid-game.
+//
+// The replay tool runs at nice 19 in the idle I/O class, in its own
+// process group. It is stopped (SIGSTOP) while on battery below a
+// threshold or while the APU runs hot, and killed the moment a game
+// launches. Replayed databases are remembered per cache partition by
+// size and mtime, so an interrupted run picks up where it left off after
+// a restart, and a new driver or game version replays everything again.
+class ShaderPrewarmer : public QObject {
+    Q_OBJECT
+
+public:
+    enum class State {
+        Idle,      // Game running or not idle long enough yet
+        Running,
+        Paused,    // Too hot or battery too low
+        Finished   // Nothing left to replay
+    };
+    Q_ENUM(State)
+
+    struct Limits {
+        int minBatteryPercent = 40;     // Ignored while charging
+        double maxTemperature = 75.0;
+        double resumeTemperature = 70.0;
+    };
+
+    explicit ShaderPrewarmer(QObject* parent = nullptr);
+    ~ShaderPrewarmer();
+
+    // Invoked as "<program> <arguments...> <database>"
+    void setCommand(const QString& program, const QStringList& arguments = {});
+    // Of the replay tool: the driver's cache variables must match the
+    // game's for the replay to warm the cache the game reads. Used from
+    // the next database.
+    void setEnvironment(const QProcessEnvironment& environment) { m_process.setProcessEnvironment(environment); }
+    QProcessEnvironment environment() const { return m_process.processEnvironment(); }
+    // Shader cache partition the environment points the replay at, as
+    // ShaderCacheStore::partitionKey(). A partition that has not seen a
+    // database yet gets it replayed, whatever other partitions have.
+    void setPartition(const QString& key);
+    QString partition() const { return m_partition; }
+    // Directory holding the *.foz databases to replay
+    void setDatabaseDirectory(const QString& path) { m_databaseDir = path; }
+    // Where replayed databases are recorded between runs
+    void setStatePath(const QString& path) { m_statePath = path; }
+    void setLimits(const Limits& limits) { m_limits = limits; }
+    void setIdleDelay(int ms) { m_idleTimer.setInterval(ms); }
+
+    // Follow temperature and battery as reported by control
+    void monitor(AllySystemControl* control);
+    void updateConditions(double temperature, int batteryLevel, bool charging);
+
+    // Start counting idle time when the game exits; cancel immediately
+    // when it launches
+    void setGameRunning(bool running);
+
+    State state() const { return m_state; }
+    bool isReplaying() const { return m_process.state() != QProcess::NotRunning; }
+    qint64 replayPid() const { return m_process.processId(); }
+    int pendingCount() const { return m_queue.size() + (isReplaying() ? 1 : 0); }
+
+signals:
+    void stateChanged(ShaderPrewarmer::State state);
+    void databaseReplayed(const QString& path, bool ok);
+
+private:
+    void begin();
+    void reconcile();
+    void startNext();
+    void stopReplay();
+    void signalReplay(int signal);
+    void onFinished(int exitCode, QProcess::ExitStatus status);
+    void setState(State state);
+    QStringList pendingDatabases() const;
+    QVariantMap loadState() const;
+    void markReplayed(const QString& path);
+
+    QString m_program;
+    QStringList m_arguments;
+    QString m_databaseDir;
+    QString m_statePath;
+    QString m_partition;
+    Limits m_limits;
+
+    QTimer m_idleTimer;
+    QProcess m_process;
+    QString m_current;
+    QString m_currentPartition;  // Of m_current, in case it changes mid-replay
+    QStringList m_queue;
+    State m_state;
+    bool m_active;     // Idle delay passed and no game running
+    bool m_hot;
+    bool m_lowBattery;
+    bool m_stopped;    // Replay is SIGSTOPped
+    bool m_killing;
+};
@@ -0,0 +1,98 @@
+#include "TdpGovernor.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Below target by more than this: add power
+constexpr double RaiseThreshold = 0.02;
+// Within this of target: probe power down
+constexpr double ProbeThreshold = 0.01;
+
+constexpr double Kp = 2.0;             // Fraction of the TDP span per second per unit error
+constexpr double Ki = 0.5;
+constexpr double MaxRaiseRate = 3.0;   // W/s
+constexpr double ProbeRate = 0.25;     // W/s
+constexpr double ThermalShedRate = 2.0;  // W/s
+constexpr qint64 FloorHoldMs = 60000;
+constexpr int MinFrames = 5;           // Fewer means the game is paused or loading
+
+} // namespace
+
+TdpGovernor::TdpGovernor()
+    : m_targetFps(60)
+    , m_tdp(15.0)
+    , m_integral(0.0)
+    , m_floor(0.0)
+    , m_floorUntilMs(0)
+    , m_lastUpdateMs(-1)
+    , m_frameTimeSum(0.0)
+    , m_frameCount(0)
+    , m_measuredFps(0.0) {
+}
+
+void TdpGovernor::setLimits(const Limits& limits) {
+    m_limits = limits;
+    m_tdp = std::clamp<double>(m_tdp, m_limits.minTdp, m_limits.maxTdp);
+}
+
+void TdpGovernor::reset(int tdp, qint64 nowMs) {
+    m_tdp = std::clamp(tdp, m_limits.minTdp, m_limits.maxTdp);
+    m_integral = 0.0;
+    m_floorUntilMs = 0;
+    m_lastUpdateMs = nowMs;
+    m_frameTimeSum = 0.0;
+    m_frameCount = 0;
+    m_measuredFps = 0.0;
+}
+
+void TdpGovernor::addFrameTime(double ms) {
+    m_frameTimeSum += ms;
+    ++m_frameCount;
+}
+
+TdpGovernor::Output TdpGovernor::update(qint64 nowMs, double temperature) {
+    const double seconds = m_lastUpdateMs < 0 ? 0.0
+        : std::clamp((nowMs - m_lastUpdateMs) / 1000.0, 0.0, 5.0);
+    m_lastUpdateMs = nowMs;
+
+    m_measuredFps = m_frameCount >= MinFrames ? m_frameCount * 1000.0 / m_frameTimeSum : 0.0;
+    m_frameTimeSum = 0.0;
+    m_frameCount = 0;
+
+    if (temperature > m_limits.thermalLimit) {
+        m_tdp -= ThermalShedRate * seconds;
+        m_integral = 0.0;
+    } else if (m_measuredFps > 0.0 && m_targetFps > 0) {
+        const double error = (m_targetFps - m_measuredFps) / m_targetFps;
+        if (error > RaiseThreshold) {
+            // This TDP was not enough; don't probe below it again for a while
+            m_floor = m_tdp + 1.0;
+            m_floorUntilMs = nowMs + FloorHoldMs;
+
+            m_integral = std::min(m_integral + error * seconds, 1.0);
+            const double span = m_limits.maxTdp - m_limits.minTdp;
+            const double rate = (Kp * error + Ki * m_integral) * span;
+            m_tdp += std::min(rate, MaxRaiseRate) * seconds;
+        } else {
+            m_integral *= 0.5;
+            if (error < ProbeThreshold) {
+                const double floor = nowMs < m_floorUntilMs ? m_floor : m_limits.minTdp;
+                if (m_tdp > floor) {
+                    m_tdp = std::max(floor, m_tdp - ProbeRate * seconds);
+                }
+            }
+        }
+    }
+
+    m_tdp = std::clamp<double>(m_tdp, m_limits.minTdp, m_limits.maxTdp);
+    return output();
+}
+
+TdpGovernor::Output TdpGovernor::output() const {
+    const int tdp = static_cast<int>(std::lround(m_tdp));
+    const double span = m_limits.maxTdp - m_limits.minTdp;
+    const double t = span > 0 ? (tdp - m_limits.minTdp) / span : 1.0;
+    const double clock = m_limits.minGpuClock + t * (m_limits.maxGpuClock - m_limits.minGpuClock);
+    return {tdp, static_cast<int>(std::lround(clock / 100.0)) * 100};
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Closed-loop controller that holds a target frame rate at the lowest
+// sustained power.
+//
+// While the game keeps up with the target the TDP is probed down slowly;
+// when it falls behind, a PI term raises it, bounded by a slew rate. A
+// TDP that was too low is remembered as a floor for a while so the loop
+// does not keep re-probing the same step. Above the thermal limit power
+// is shed regardless of frame rate. The GPU clock follows the TDP.
+//
+// Time is passed in by the caller so the controller can be replayed
+// against recorded traces.
+class TdpGovernor {
+public:
+    struct Limits {
+        int minTdp = 5;            // W
+        int maxTdp = 30;           // W
+        int minGpuClock = 800;     // MHz
+        int maxGpuClock = 2700;    // MHz
+        double thermalLimit = 85;  // °C
+    };
+
+    struct Output {
+        int tdp;       // W
+        int gpuClock;  // MHz
+    };
+
+    TdpGovernor();
+
+    void setLimits(const Limits& limits);
+    const Limits& limits() const { return m_limits; }
+    void setTargetFps(int fps) { m_targetFps = fps; }
+    int targetFps() const { return m_targetFps; }
+
+    // Start from a known TDP, e.g. the active preset's
+    void reset(int tdp, qint64 nowMs);
+
+    // Frame times presented since the last update()
+    void addFrameTime(double ms);
+
+    // Run one control step; call about once a second
+    Output update(qint64 nowMs, double temperature);
+    Output output() const;
+
+    // Frame rate measured over the last update window, 0 if none
+    double measuredFps() const { return m_measuredFps; }
+
+private:
+    Limits m_limits;
+    int m_targetFps;
+
+    double m_tdp;
+    double m_integral;
+    double m_floor;
+    qint64 m_floorUntilMs;
+    qint64 m_lastUpdateMs;
+
+    double m_frameTimeSum;
+    int m_frameCount;
+    double m_measuredFps;
+};
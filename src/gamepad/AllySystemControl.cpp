@@ -1,15 +1,10 @@
 #include "AllySystemControl.hpp"
-#include <QFile>
+#include <QDateTime>
 #include <QDebug>
-#include <QProcess>
-
-// System file paths for ROG Ally
-const QString AllySystemControl::POWER_PROFILE_PATH = "/sys/devices/platform/asus-nb-wmi/profile";
-const QString AllySystemControl::TDP_PATH = "/sys/class/powercap/powercap0/tdp";
-const QString AllySystemControl::GPU_FREQ_PATH = "/sys/class/drm/card0/device/pp_dpm_sclk";
-const QString AllySystemControl::TEMP_PATH = "/sys/class/hwmon/hwmon*/temp1_input";
-const QString AllySystemControl::FAN_PATH = "/sys/devices/platform/asus-nb-wmi/fan_speed";
-const QString AllySystemControl::BATTERY_PATH = "/sys/class/power_supply/BAT1/";
+#include <QStandardPaths>
+#include "../core/Config.hpp"
+#include "../game/GamescopeSupervisor.hpp"
+#include <cmath>
 
 AllySystemControl* AllySystemControl::s_instance = nullptr;
 
@@ -22,6 +17,12 @@ AllySystemControl* AllySystemControl::instance() {
 
 AllySystemControl::AllySystemControl(QObject* parent)
     : QObject(parent)
+    , m_pollingPaused(false)
+    , m_supervising(false)
+    , m_autoDownshift(false)
+    , m_targetPlaytimeMinutes(120)
+    , m_lastDownshiftMs(-1)
+    , m_remainingPlaytime(-1)
     , m_currentProfile(PerformanceProfile::BALANCED)
     , m_currentTDP(15)
     , m_currentGPUFreq(1600)
@@ -29,44 +30,238 @@ AllySystemControl::AllySystemControl(QObject* parent)
     , m_currentTemp(0.0f)
     , m_batteryLevel(100)
     , m_isCharging(false)
-    , m_fanSpeed(0) {
+    , m_fanSpeed(0)
+    , m_gpuClock([this](Sensor sensor) { return readText(sensor); },
+                 [this](Sensor sensor, const QByteArray& value) {
+                     SysfsAttribute* attr = attribute(sensor);
+                     return attr && attr->write(value);
+                 })
+    , m_transaction([this](HardwareState::Knob knob, int& value) { return readKnob(knob, value); },
+                    [this](HardwareState::Knob knob, int value) { return writeKnob(knob, value); }) {
     
-    // Set up monitoring timer
-    connect(&m_monitorTimer, &QTimer::timeout, this, [this]() {
-        monitorTemperature();
-        monitorBattery();
-        adjustFanCurve();
+    auto* registry = SensorRegistry::instance();
+    registry->scan();
+    if (Sysfs::root() == "/sys") {
+        registry->enableHotplugMonitoring();
+    }
+    openSysfsAttributes();
+    m_sampler.setSensors(registry->handles());
+    connect(registry, &SensorRegistry::sensorsChanged, this, [this, registry]() {
+        openSysfsAttributes();
+        m_sampler.setSensors(registry->handles());
+    });
+    connect(registry, &SensorRegistry::powerSupplyChanged, this, [this]() {
+        m_sampler.requestPoll(PollScheduler::groupBit(PollScheduler::Battery)
+                              | PollScheduler::groupBit(PollScheduler::Power));
     });
-    m_monitorTimer.start(2000); // Check every 2 seconds
+
+    // Keep session history on disk so it survives a crash or relaunch
+    const QVariantMap telemetry = Config::instance()->value("hardware").toMap()
+        .value("telemetry").toMap();
+    if (telemetry.value("persistHistory", true).toBool()) {
+        m_history.openFile(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                           + "/telemetry.bin");
+    }
+
+    const QVariantMap energy = Config::instance()->value("hardware").toMap()
+        .value("energy").toMap();
+    m_energy.setProfile(static_cast<int>(m_currentProfile));
+    setAutoDownshift(energy.value("autoDownshift", false).toBool(),
+                     energy.value("targetPlaytimeMinutes", 120).toInt());
+
+    // Sensors are read off the GUI thread at a rate that adapts to how
+    // fast they change; only changed values are emitted
+    connect(&m_sampler, &TelemetrySampler::sampleAvailable,
+            this, &AllySystemControl::consumeTelemetry);
+    loadFanCurve(m_currentProfile);
+    m_sampler.start();
+}
+
+void AllySystemControl::openSysfsAttributes() {
+    auto* registry = SensorRegistry::instance();
+    for (int i = 0; i < SensorRegistry::SensorCount; ++i) {
+        const auto& handle = registry->handle(static_cast<Sensor>(i));
+        if (!handle.isValid()) {
+            m_attributes[i].reset();
+        } else if (!m_attributes[i] || m_attributes[i]->path() != handle.path) {
+            m_attributes[i] = std::make_unique<SysfsAttribute>(handle.path,
+                handle.writable ? SysfsAttribute::Mode::ReadWrite : SysfsAttribute::Mode::ReadOnly);
+        }
+    }
+    m_gpuClock.refresh();
+}
+
+void AllySystemControl::setSysfsRoot(const QString& root) {
+    Sysfs::setRoot(root);
+    for (auto& attr : m_attributes) {
+        attr.reset();
+    }
+    m_appliedState = HardwareState();  // Read back from the new tree on first write
+    m_energy.reset();
+    m_energy.setProfile(static_cast<int>(m_currentProfile));
+    m_remainingPlaytime = -1;
+    SensorRegistry::instance()->scan();
+    openSysfsAttributes();
+    m_sampler.setSensors(SensorRegistry::instance()->handles());
+}
+
+void AllySystemControl::setPollingPaused(bool paused) {
+    m_pollingPaused = paused;
+    updatePolledGroups();
+}
+
+void AllySystemControl::setSupervising(bool supervising) {
+    m_supervising = supervising;
+    updatePolledGroups();
+}
+
+void AllySystemControl::updatePolledGroups() {
+    quint32 groups = PollScheduler::AllGroups;
+    if (m_supervising) {
+        // Fan speed and GPU clock only ever reach the window
+        groups = PollScheduler::groupBit(PollScheduler::Temperature)
+               | PollScheduler::groupBit(PollScheduler::Battery)
+               | PollScheduler::groupBit(PollScheduler::Power);
+    } else if (m_pollingPaused) {
+        groups = PollScheduler::groupBit(PollScheduler::Temperature);
+    }
+    m_sampler.setActiveGroups(groups);
+}
+
+SysfsAttribute* AllySystemControl::attribute(Sensor sensor) const {
+    return m_attributes[static_cast<int>(sensor)].get();
+}
+
+bool AllySystemControl::readSensor(Sensor sensor, double& value) const {
+    SysfsAttribute* attr = attribute(sensor);
+    qint64 raw;
+    if (!attr || !attr->readInt(raw)) {
+        return false;
+    }
+    value = raw * SensorRegistry::instance()->handle(sensor).scale;
+    return true;
+}
+
+QByteArray AllySystemControl::readText(Sensor sensor) const {
+    SysfsAttribute* attr = attribute(sensor);
+    char buf[4096];
+    const int n = attr ? attr->read(buf, sizeof(buf)) : -1;
+    return n > 0 ? QByteArray(buf, n) : QByteArray();
+}
+
+bool AllySystemControl::writeSensor(Sensor sensor, double value) {
+    SysfsAttribute* attr = attribute(sensor);
+    if (!attr) {
+        qWarning() << "No sysfs node for" << sensor;
+        return false;
+    }
+    return attr->writeInt(std::llround(value / SensorRegistry::instance()->handle(sensor).scale));
+}
+
+bool AllySystemControl::readKnob(HardwareState::Knob knob, int& value) {
+    double raw = 0.0;
+    bool ok = false;
+    switch (knob) {
+        case HardwareState::PowerProfile:
+            ok = readSensor(Sensor::PowerProfile, raw);
+            break;
+        case HardwareState::Tdp:
+            ok = readSensor(Sensor::TdpLimit, raw);
+            break;
+        case HardwareState::GpuClock:
+            return m_gpuClock.currentClock(value);
+        case HardwareState::FanSpeed:
+            ok = readSensor(Sensor::FanControl, raw);
+            break;
+        case HardwareState::KnobCount:
+            break;
+    }
+    if (ok) {
+        value = static_cast<int>(std::lround(raw));
+    }
+    return ok;
+}
+
+bool AllySystemControl::writeKnob(HardwareState::Knob knob, int value) {
+    switch (knob) {
+        case HardwareState::PowerProfile:
+            return writeSensor(Sensor::PowerProfile, value);
+        case HardwareState::Tdp:
+            return writeSensor(Sensor::TdpLimit, value);
+        case HardwareState::GpuClock:
+            return m_gpuClock.setClock(value);
+        case HardwareState::FanSpeed:
+            return writeSensor(Sensor::FanControl, value);
+        case HardwareState::KnobCount:
+            break;
+    }
+    return false;
+}
+
+bool AllySystemControl::applyHardwareState(const HardwareState& desired) {
+    if (!m_transaction.apply(desired, m_appliedState)) {
+        qWarning() << "Failed to apply hardware knob" << m_transaction.failedKnob()
+                   << "- previous values restored";
+        return false;
+    }
+
+    const quint32 changed = m_transaction.changedKnobs();
+    if (changed == 0) {
+        return true;
+    }
+    // Listeners of a single knob hear about it however it was changed,
+    // a profile switch included
+    if ((changed & HardwareState::knobBit(HardwareState::Tdp))
+        && m_appliedState.value(HardwareState::Tdp) != m_currentTDP) {
+        m_currentTDP = m_appliedState.value(HardwareState::Tdp);
+        emit tdpChanged(m_currentTDP);
+    }
+    if ((changed & HardwareState::knobBit(HardwareState::GpuClock))
+        && m_appliedState.value(HardwareState::GpuClock) != m_currentGPUFreq) {
+        m_currentGPUFreq = m_appliedState.value(HardwareState::GpuClock);
+        emit gpuFreqChanged(m_currentGPUFreq);
+    }
+    if ((changed & HardwareState::knobBit(HardwareState::FanSpeed))
+        && m_appliedState.value(HardwareState::FanSpeed) != m_fanSpeed) {
+        m_fanSpeed = m_appliedState.value(HardwareState::FanSpeed);
+        emit fanSpeedChanged(m_fanSpeed);
+    }
+    emit hardwareStateChanged(changed);
+    return true;
 }
 
 bool AllySystemControl::setPerformanceProfile(PerformanceProfile profile) {
-    QString profileValue;
+    HardwareState state;
     switch (profile) {
         case PerformanceProfile::SILENT:
-            profileValue = "0";
-            setTDP(10);  // Lower TDP for battery savings
+            state.set(HardwareState::PowerProfile, 0);
+            state.set(HardwareState::Tdp, 10);  // Lower TDP for battery savings
             break;
         case PerformanceProfile::BALANCED:
-            profileValue = "1";
-            setTDP(15);  // Default TDP
+            state.set(HardwareState::PowerProfile, 1);
+            state.set(HardwareState::Tdp, 15);  // Default TDP
             break;
         case PerformanceProfile::TURBO:
-            profileValue = "2";
-            setTDP(25);  // Higher TDP for maximum performance
+            state.set(HardwareState::PowerProfile, 2);
+            state.set(HardwareState::Tdp, 25);  // Higher TDP for maximum performance
             break;
         case PerformanceProfile::MANUAL:
-            profileValue = "3";
+            state.set(HardwareState::PowerProfile, 3);
             // Keep current TDP
             break;
     }
 
-    if (writeToSysfs(POWER_PROFILE_PATH, profileValue)) {
-        m_currentProfile = profile;
+    const bool profileChanged = state.diff(m_appliedState) & HardwareState::knobBit(HardwareState::PowerProfile);
+    if (!applyHardwareState(state)) {
+        return false;
+    }
+    m_currentProfile = profile;
+    m_energy.setProfile(static_cast<int>(profile));
+    if (profileChanged) {
+        loadFanCurve(profile);
         emit performanceProfileChanged(profile);
-        return true;
     }
-    return false;
+    return true;
 }
 
 bool AllySystemControl::setTDP(int watts) {
@@ -75,128 +270,180 @@ bool AllySystemControl::setTDP(int watts) {
         return false;
     }
 
-    if (writeToSysfs(TDP_PATH, QString::number(watts * 1000000))) {
-        m_currentTDP = watts;
-        emit tdpChanged(watts);
-        return true;
-    }
-    return false;
+    return applyHardwareState(HardwareState().set(HardwareState::Tdp, watts));
 }
 
 bool AllySystemControl::setGPUFreq(int mhz) {
-    QString freqStr = QString::number(mhz);
-    if (writeToSysfs(GPU_FREQ_PATH, freqStr)) {
-        m_currentGPUFreq = mhz;
-        emit gpuFreqChanged(mhz);
-        return true;
-    }
-    return false;
+    return applyHardwareState(HardwareState().set(HardwareState::GpuClock, mhz));
 }
 
 bool AllySystemControl::enableFreeSync(bool enabled) {
-    QProcess process;
-    process.start("gamescope", QStringList() 
-        << "--force-adaptive-sync" 
-        << (enabled ? "1" : "0"));
-    
-    if (process.waitForFinished()) {
+    // Reaches a running gamescope without restarting it, otherwise it is
+    // picked up when gamescope starts
+    GamescopeSupervisor::instance()->setAdaptiveSync(enabled);
+    if (enabled != m_freeSyncEnabled) {
         m_freeSyncEnabled = enabled;
         emit freeSyncStatusChanged(enabled);
-        return true;
     }
-    return false;
+    return true;
 }
 
-void AllySystemControl::monitorTemperature() {
-    QString temp = readFromSysfs(TEMP_PATH);
-    if (!temp.isEmpty()) {
-        float tempValue = temp.toFloat() / 1000.0f; // Convert from millidegrees to degrees
-        if (tempValue != m_currentTemp) {
-            m_currentTemp = tempValue;
-            emit temperatureChanged(tempValue);
-        }
+void AllySystemControl::consumeTelemetry() {
+    m_lastSample = m_sampler.latest();
+    m_history.append(QDateTime::currentMSecsSinceEpoch(), {
+        m_lastSample.cpuTemperature,
+        static_cast<float>(m_fanSpeed),
+        static_cast<float>(m_currentTDP),
+        static_cast<float>(m_lastSample.gpuClock > 0 ? m_lastSample.gpuClock : m_currentGPUFreq),
+        static_cast<float>(m_lastSample.batteryLevel),
+        m_lastSample.batteryPower
+    });
+    monitorTemperature(m_lastSample);
+    monitorBattery(m_lastSample);
+    updateEnergy(m_lastSample);
+    adjustFanCurve(m_lastSample);
+}
+
+void AllySystemControl::monitorTemperature(const TelemetrySample& sample) {
+    float tempValue = sample.cpuTemperature;
+    if (tempValue != m_currentTemp) {
+        m_currentTemp = tempValue;
+        emit temperatureChanged(tempValue);
     }
 }
 
-void AllySystemControl::monitorBattery() {
-    QString capacityStr = readFromSysfs(BATTERY_PATH + "capacity");
-    QString statusStr = readFromSysfs(BATTERY_PATH + "status");
-    
-    if (!capacityStr.isEmpty()) {
-        int level = capacityStr.toInt();
-        if (level != m_batteryLevel) {
-            m_batteryLevel = level;
-            emit batteryLevelChanged(level);
-        }
+void AllySystemControl::monitorBattery(const TelemetrySample& sample) {
+    int level = sample.batteryLevel;
+    if (level != m_batteryLevel) {
+        m_batteryLevel = level;
+        emit batteryLevelChanged(level);
     }
     
-    bool charging = (statusStr.contains("Charging"));
+    bool charging = sample.charging;
     if (charging != m_isCharging) {
         m_isCharging = charging;
         emit chargingStateChanged(charging);
     }
 }
 
-void AllySystemControl::adjustFanCurve() {
-    // Implement dynamic fan curve based on temperature
-    int targetSpeed;
-    
-    if (m_currentTemp >= 80.0f) {
-        targetSpeed = 100;
-    } else if (m_currentTemp >= 70.0f) {
-        targetSpeed = 80;
-    } else if (m_currentTemp >= 60.0f) {
-        targetSpeed = 60;
-    } else if (m_currentTemp >= 50.0f) {
-        targetSpeed = 40;
-    } else {
-        targetSpeed = 20;
+void AllySystemControl::loadFanCurve(PerformanceProfile profile) {
+    QString profileName;
+    switch (profile) {
+        case PerformanceProfile::SILENT:
+            profileName = "silent";
+            break;
+        case PerformanceProfile::BALANCED:
+            profileName = "balanced";
+            break;
+        case PerformanceProfile::TURBO:
+            profileName = "turbo";
+            break;
+        case PerformanceProfile::MANUAL:
+            return;  // Keep whatever curve is active
     }
-    
-    setFanSpeed(targetSpeed);
+
+    const QVariantMap hardware = Config::instance()->value("hardware").toMap();
+    const QString curveName = hardware.value("profiles").toMap()
+        .value(profileName).toMap().value("fanCurve").toString();
+    const QVariantMap table = hardware.value("fanCurves").toMap().value(curveName).toMap();
+    if (table.isEmpty() || !m_fanCurve.load(table)) {
+        qWarning() << "No usable fan curve for profile" << profileName << "- keeping current curve";
+    }
+
+    // Make sure the sampler reads often enough around the curve's knees
+    m_sampler.setThresholds(PollScheduler::Temperature, m_fanCurve.thresholds());
 }
 
-bool AllySystemControl::setFanSpeed(int percentage) {
-    if (percentage < 0 || percentage > 100) {
-        return false;
+double AllySystemControl::remainingPlaytimeMinutes(PerformanceProfile profile) const {
+    return m_energy.remainingMinutes(static_cast<int>(profile));
+}
+
+void AllySystemControl::setAutoDownshift(bool enabled, int targetMinutes) {
+    m_autoDownshift = enabled;
+    m_targetPlaytimeMinutes = targetMinutes;
+}
+
+void AllySystemControl::updateEnergy(const TelemetrySample& sample) {
+    const bool discharging = !sample.charging && !sample.acOnline;
+    m_energy.addSample(sample.timestampMs, sample.batteryPower, sample.batteryEnergy, discharging);
+
+    const double remaining = m_energy.remainingMinutes(static_cast<int>(m_currentProfile));
+    const int minutes = remaining < 0.0 ? -1 : static_cast<int>(remaining);
+    if (minutes != m_remainingPlaytime) {
+        m_remainingPlaytime = minutes;
+        emit remainingPlaytimeChanged(minutes);
     }
-    
-    if (writeToSysfs(FAN_PATH, QString::number(percentage))) {
-        m_fanSpeed = percentage;
-        emit fanSpeedChanged(percentage);
-        return true;
+
+    if (!m_autoDownshift || !discharging || minutes < 0 || minutes >= m_targetPlaytimeMinutes) {
+        return;
     }
-    return false;
+    // Give the new profile's estimate time to settle before stepping again
+    if (m_lastDownshiftMs >= 0 && sample.timestampMs - m_lastDownshiftMs < 5 * 60 * 1000) {
+        return;
+    }
+
+    PerformanceProfile lower;
+    switch (m_currentProfile) {
+        case PerformanceProfile::TURBO:
+            lower = PerformanceProfile::BALANCED;
+            break;
+        case PerformanceProfile::BALANCED:
+            lower = PerformanceProfile::SILENT;
+            break;
+        case PerformanceProfile::SILENT:
+        case PerformanceProfile::MANUAL:
+            return;  // Nothing lower, or the user is in control
+    }
+
+    m_lastDownshiftMs = sample.timestampMs;
+    setPerformanceProfile(lower);
 }
 
-bool AllySystemControl::writeToSysfs(const QString& path, const QString& value) {
-    QFile file(path);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qWarning() << "Failed to open" << path << "for writing";
-        return false;
+void AllySystemControl::adjustFanCurve(const TelemetrySample& sample) {
+    // The curve output is quantized, so this only writes when the fan
+    // actually needs to change
+    const int targetSpeed = m_fanCurve.update(sample.timestampMs, m_currentTemp);
+    if (targetSpeed != m_fanSpeed) {
+        setFanSpeed(targetSpeed);
     }
-    
-    if (file.write(value.toUtf8()) == -1) {
-        qWarning() << "Failed to write to" << path;
+}
+
+bool AllySystemControl::setFanSpeed(int percentage) {
+    if (percentage < 0 || percentage > 100) {
         return false;
     }
-    
-    file.close();
-    return true;
+
+    return applyHardwareState(HardwareState().set(HardwareState::FanSpeed, percentage));
 }
 
-QString AllySystemControl::readFromSysfs(const QString& path) {
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qWarning() << "Failed to open" << path << "for reading";
-        return QString();
-    }
-    
-    QString value = QString::fromUtf8(file.readAll()).trimmed();
-    file.close();
-    return value;
+AllySystemControl::PerformanceProfile AllySystemControl::currentProfile() const {
+    return m_currentProfile;
+}
+
+int AllySystemControl::currentTDP() const {
+    return m_currentTDP;
+}
+
+int AllySystemControl::currentGPUFreq() const {
+    return m_currentGPUFreq;
+}
+
+bool AllySystemControl::isFreeSyncEnabled() const {
+    return m_freeSyncEnabled;
+}
+
+float AllySystemControl::getCurrentTemperature() const {
+    return m_currentTemp;
+}
+
+int AllySystemControl::getBatteryLevel() const {
+    return m_batteryLevel;
+}
+
+bool AllySystemControl::isCharging() const {
+    return m_isCharging;
 }
 
 AllySystemControl::~AllySystemControl() {
-    m_monitorTimer.stop();
+    m_sampler.stop();
 }
\ No newline at end of file
@@ -3,7 +3,16 @@
 #include <QObject>
 #include <QTimer>
 #include <QString>
+#include <array>
 #include <memory>
+#include "../hardware/EnergyMeter.hpp"
+#include "../hardware/FanCurve.hpp"
+#include "../hardware/GpuClockControl.hpp"
+#include "../hardware/HardwareState.hpp"
+#include "../hardware/SysfsAttribute.hpp"
+#include "../hardware/SensorRegistry.hpp"
+#include "../hardware/TelemetrySampler.hpp"
+#include "../hardware/TelemetryStore.hpp"
 
 class AllySystemControl : public QObject {
     Q_OBJECT
@@ -25,14 +34,49 @@ public:
     bool enableFreeSync(bool enabled);
     bool setFanSpeed(int percentage);  // Range: 0-100
 
+    // Write several knobs as one transaction: unchanged knobs are skipped
+    // and a failed write rolls back the others. Emits the signal of each
+    // knob whose value changed, then hardwareStateChanged once.
+    bool applyHardwareState(const HardwareState& desired);
+    const HardwareState& appliedState() const { return m_appliedState; }
+    qint64 knobLatencyNs(HardwareState::Knob knob) const { return m_transaction.latencyNs(knob); }
+
+    // Point all hardware accessors at a different sysfs tree (tests)
+    void setSysfsRoot(const QString& root);
+
+    // Stop polling sensors nobody is looking at while the launcher is
+    // hidden; temperature keeps being read for the fan curve
+    void setPollingPaused(bool paused);
+    // While the game runs without the launcher's window: what the fan
+    // curve, energy accounting and downshift need keeps being read,
+    // whether or not a window is shown
+    void setSupervising(bool supervising);
+    bool isSupervising() const { return m_supervising; }
+    const TelemetrySampler& sampler() const { return m_sampler; }
+
     // Getters
     PerformanceProfile currentProfile() const;
     int currentTDP() const;
     int currentGPUFreq() const;
+    int effectiveGPUFreq() const { return m_lastSample.gpuClock; }
+    const GpuClockControl& gpuClock() const { return m_gpuClock; }
     bool isFreeSyncEnabled() const;
     float getCurrentTemperature() const;
     int getBatteryLevel() const;
     bool isCharging() const;
+    TelemetrySample latestSample() const { return m_lastSample; }
+    const TelemetryStore& history() const { return m_history; }
+    const FanCurve& fanCurve() const { return m_fanCurve; }
+
+    // Battery drain per profile; frames are reported by whoever reads
+    // the game's frame times
+    const EnergyMeter& energy() const { return m_energy; }
+    void addFrames(qint64 frames) { m_energy.addFrames(frames); }
+    double remainingPlaytimeMinutes(PerformanceProfile profile) const;
+
+    // Step the profile down when the projected playtime on battery falls
+    // below targetMinutes
+    void setAutoDownshift(bool enabled, int targetMinutes);
 
 signals:
     void temperatureChanged(float temp);
@@ -43,6 +87,8 @@ signals:
     void gpuFreqChanged(int mhz);
     void freeSyncStatusChanged(bool enabled);
     void fanSpeedChanged(int percentage);
+    void hardwareStateChanged(quint32 changedKnobs);
+    void remainingPlaytimeChanged(int minutes);
 
 private:
     explicit AllySystemControl(QObject* parent = nullptr);
@@ -50,19 +96,30 @@ private:
 
     static AllySystemControl* s_instance;
 
-    // Hardware monitoring
-    QTimer m_monitorTimer;
-    void monitorTemperature();
-    void monitorBattery();
-    void adjustFanCurve();
-    
-    // System file paths
-    static const QString POWER_PROFILE_PATH;
-    static const QString TDP_PATH;
-    static const QString GPU_FREQ_PATH;
-    static const QString TEMP_PATH;
-    static const QString FAN_PATH;
-    static const QString BATTERY_PATH;
+    // Hardware monitoring; sensors are read on the sampler thread and
+    // consumed here whenever a new sample has been published
+    TelemetrySampler m_sampler;
+    TelemetrySample m_lastSample;
+    TelemetryStore m_history;
+    void consumeTelemetry();
+    void monitorTemperature(const TelemetrySample& sample);
+    void monitorBattery(const TelemetrySample& sample);
+    void adjustFanCurve(const TelemetrySample& sample);
+    bool m_pollingPaused;
+    bool m_supervising;
+    void updatePolledGroups();
+
+    // Fan curve of the active profile, from "hardware.fanCurves"
+    FanCurve m_fanCurve;
+    void loadFanCurve(PerformanceProfile profile);
+
+    // Energy accounting and opt-in automatic downshift
+    EnergyMeter m_energy;
+    bool m_autoDownshift;
+    int m_targetPlaytimeMinutes;
+    qint64 m_lastDownshiftMs;
+    int m_remainingPlaytime;
+    void updateEnergy(const TelemetrySample& sample);
     
     // Current state
     PerformanceProfile m_currentProfile;
@@ -74,6 +131,23 @@ private:
     bool m_isCharging;
     int m_fanSpeed;
 
-    bool writeToSysfs(const QString& path, const QString& value);
-    QString readFromSysfs(const QString& path);
+    // Persistent sysfs handles indexed by SensorRegistry::Sensor,
+    // opened once and reused every tick
+    using Sensor = SensorRegistry::Sensor;
+    std::array<std::unique_ptr<SysfsAttribute>, SensorRegistry::SensorCount> m_attributes;
+    void openSysfsAttributes();
+    SysfsAttribute* attribute(Sensor sensor) const;
+    bool readSensor(Sensor sensor, double& value) const;
+    bool writeSensor(Sensor sensor, double value);
+    QByteArray readText(Sensor sensor) const;
+
+    // amdgpu DPM/OD tables behind the GPU clock knob
+    GpuClockControl m_gpuClock;
+
+    // What the hardware is known to be set to: written by us, or read
+    // back before a knob's first write
+    HardwareState m_appliedState;
+    HardwareTransaction m_transaction;
+    bool readKnob(HardwareState::Knob knob, int& value);
+    bool writeKnob(HardwareState::Knob knob, int value);
 };
\ No newline at end of file
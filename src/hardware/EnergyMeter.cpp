@@ -0,0 +1,102 @@
+#include "EnergyMeter.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Older drain carries half the weight after ten minutes of play
+constexpr double HalfLifeSeconds = 600.0;
+// Gaps longer than this (suspend, sampler paused) are not integrated
+constexpr double MaxGapSeconds = 120.0;
+// Seconds of data before a drain estimate is trusted
+constexpr double MinSeconds = 1.0;
+
+} // namespace
+
+EnergyMeter::EnergyMeter() {
+    reset();
+}
+
+void EnergyMeter::reset() {
+    m_profiles.fill(ProfileStats());
+    m_profile = 0;
+    m_lastMs = -1;
+    m_lastPower = 0.0;
+    m_lastEnergyWh = -1.0;
+    m_energyWh = -1.0;
+    m_pendingFrames = 0;
+}
+
+void EnergyMeter::setProfile(int profile) {
+    m_profile = std::clamp(profile, 0, MaxProfiles - 1);
+}
+
+void EnergyMeter::addSample(qint64 nowMs, double powerWatts, double energyWh, bool discharging) {
+    const double seconds = m_lastMs < 0 ? 0.0 : (nowMs - m_lastMs) / 1000.0;
+    const bool integrate = discharging && seconds > 0.0 && seconds <= MaxGapSeconds;
+
+    if (integrate) {
+        // Trapezoidal power integral. Batteries that report no power fall
+        // back to energy_now deltas; those arrive in coarse steps, but the
+        // weighted sums below even them out.
+        double joules = 0.0;
+        if (powerWatts > 0.0 || m_lastPower > 0.0) {
+            joules = 0.5 * (m_lastPower + powerWatts) * seconds;
+        } else if (energyWh >= 0.0 && m_lastEnergyWh >= 0.0) {
+            joules = std::max(0.0, (m_lastEnergyWh - energyWh) * 3600.0);
+        }
+
+        ProfileStats& stats = m_profiles[m_profile];
+        const double decay = std::exp2(-seconds / HalfLifeSeconds);
+        stats.joules += joules;
+        stats.frames += m_pendingFrames;
+        stats.weightedJoules = stats.weightedJoules * decay + joules;
+        stats.weightedSeconds = stats.weightedSeconds * decay + seconds;
+    }
+
+    // Frames from a charging or unaccounted interval would make the
+    // energy per frame look cheaper than it is
+    m_pendingFrames = 0;
+    m_lastMs = nowMs;
+    m_lastPower = powerWatts;
+    m_lastEnergyWh = energyWh;
+    m_energyWh = energyWh;
+}
+
+void EnergyMeter::addFrames(qint64 frames) {
+    m_pendingFrames += frames;
+}
+
+double EnergyMeter::sessionJoules() const {
+    double joules = 0.0;
+    for (const ProfileStats& stats : m_profiles) {
+        joules += stats.joules;
+    }
+    return joules;
+}
+
+qint64 EnergyMeter::sessionFrames() const {
+    qint64 frames = 0;
+    for (const ProfileStats& stats : m_profiles) {
+        frames += stats.frames;
+    }
+    return frames;
+}
+
+double EnergyMeter::joulesPerFrame(int profile) const {
+    const ProfileStats& stats = m_profiles[std::clamp(profile, 0, MaxProfiles - 1)];
+    return stats.frames > 0 ? stats.joules / stats.frames : -1.0;
+}
+
+double EnergyMeter::drainWatts(int profile) const {
+    const ProfileStats& stats = m_profiles[std::clamp(profile, 0, MaxProfiles - 1)];
+    return stats.weightedSeconds >= MinSeconds ? stats.weightedJoules / stats.weightedSeconds : -1.0;
+}
+
+double EnergyMeter::remainingMinutes(int profile) const {
+    const double watts = drainWatts(profile);
+    if (watts <= 0.0 || m_energyWh < 0.0) {
+        return -1.0;
+    }
+    return m_energyWh * 3600.0 / watts / 60.0;
+}
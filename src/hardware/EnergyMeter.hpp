@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QtGlobal>
+#include <array>
+
+// Integrates battery drain over a play session and estimates how long the
+// battery will last under each performance profile.
+//
+// Energy is attributed to whichever profile is active when it is drawn.
+// Each profile keeps an exponentially weighted regression of energy drawn
+// over time on battery, so its drain rate tracks recent play rather than
+// the whole session. Frame counts give joules per frame.
+class EnergyMeter {
+public:
+    static constexpr int MaxProfiles = 8;
+
+    EnergyMeter();
+
+    // Profile that subsequent samples and frames are attributed to
+    void setProfile(int profile);
+    int profile() const { return m_profile; }
+
+    // A battery reading. energyWh is the remaining energy (energy_now),
+    // or negative if the battery does not report it, in which case the
+    // power reading is integrated instead.
+    void addSample(qint64 nowMs, double powerWatts, double energyWh, bool discharging);
+    // Frames rendered since the last sample. They are counted with the
+    // next sample's energy, and dropped with it if that is not integrated.
+    void addFrames(qint64 frames);
+
+    // Session totals across all profiles
+    double sessionJoules() const;
+    qint64 sessionFrames() const;
+
+    // Per-profile estimates; negative when there is no data yet
+    double joulesPerFrame(int profile) const;
+    double drainWatts(int profile) const;
+    double remainingMinutes(int profile) const;
+
+    double energyWh() const { return m_energyWh; }
+    void reset();
+
+private:
+    struct ProfileStats {
+        double joules = 0.0;
+        qint64 frames = 0;
+        // Weighted sums of energy drawn and time spent on battery
+        double weightedJoules = 0.0;
+        double weightedSeconds = 0.0;
+    };
+
+    std::array<ProfileStats, MaxProfiles> m_profiles;
+    int m_profile;
+    qint64 m_lastMs;
+    double m_lastPower;
+    double m_lastEnergyWh;
+    double m_energyWh;
+    qint64 m_pendingFrames;  // Since the last sample
+};
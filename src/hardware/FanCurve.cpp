@@ -0,0 +1,116 @@
+#include "FanCurve.hpp"
+#include <QDebug>
+#include <QVariantList>
+#include <algorithm>
+#include <cmath>
+
+FanCurve::FanCurve()
+    : m_hysteresis(3.0)
+    , m_rampUp(25.0)
+    , m_rampDown(5.0)
+    , m_quantum(5)
+    , m_effectiveTemperature(0.0)
+    , m_output(0.0)
+    , m_lastUpdateMs(-1)
+    , m_primed(false) {
+    // Same steps as the original hardcoded ladder
+    setPoints({{40, 20}, {50, 40}, {60, 60}, {70, 80}, {80, 100}});
+}
+
+bool FanCurve::load(const QVariantMap& table) {
+    const QVariantList temperatures = table.value("temp_thresholds").toList();
+    const QVariantList speeds = table.value("speeds").toList();
+    if (temperatures.isEmpty() || temperatures.size() != speeds.size()) {
+        qWarning() << "Invalid fan curve: thresholds and speeds must be non-empty and the same length";
+        return false;
+    }
+
+    QVector<Point> points;
+    for (int i = 0; i < temperatures.size(); ++i) {
+        const Point point = {temperatures[i].toDouble(), speeds[i].toInt()};
+        if (point.speed < 0 || point.speed > 100
+            || (!points.isEmpty() && point.temperature <= points.last().temperature)) {
+            qWarning() << "Invalid fan curve point" << i;
+            return false;
+        }
+        points.append(point);
+    }
+
+    setPoints(points);
+    return true;
+}
+
+void FanCurve::setPoints(const QVector<Point>& points) {
+    m_points = points;
+}
+
+QVector<double> FanCurve::thresholds() const {
+    QVector<double> thresholds;
+    for (const Point& point : m_points) {
+        thresholds.append(point.temperature);
+    }
+    return thresholds;
+}
+
+void FanCurve::setRampRate(double upPerSecond, double downPerSecond) {
+    m_rampUp = upPerSecond;
+    m_rampDown = downPerSecond;
+}
+
+double FanCurve::interpolate(double temperature) const {
+    if (m_points.isEmpty()) {
+        return 100.0;  // No curve: fail safe
+    }
+    if (temperature <= m_points.first().temperature) {
+        return m_points.first().speed;
+    }
+    if (temperature >= m_points.last().temperature) {
+        return m_points.last().speed;
+    }
+
+    auto upper = std::upper_bound(m_points.begin(), m_points.end(), temperature,
+        [](double t, const Point& point) { return t < point.temperature; });
+    const Point& hi = *upper;
+    const Point& lo = *(upper - 1);
+    const double t = (temperature - lo.temperature) / (hi.temperature - lo.temperature);
+    return lo.speed + t * (hi.speed - lo.speed);
+}
+
+void FanCurve::reset(int currentSpeed) {
+    m_output = currentSpeed;
+    m_lastUpdateMs = -1;
+    m_primed = true;
+    m_effectiveTemperature = 0.0;
+}
+
+int FanCurve::update(qint64 nowMs, double temperature) {
+    // Follow rises immediately; only come down once the temperature has
+    // dropped clear of the hysteresis band below the last peak
+    if (m_lastUpdateMs < 0 || temperature > m_effectiveTemperature) {
+        m_effectiveTemperature = temperature;
+    } else if (temperature < m_effectiveTemperature - m_hysteresis) {
+        m_effectiveTemperature = temperature + m_hysteresis;
+    }
+
+    const double target = interpolate(m_effectiveTemperature);
+    if (!m_primed) {
+        // Nothing known about the fan yet: go straight to the target
+        m_output = target;
+        m_primed = true;
+    } else if (m_lastUpdateMs >= 0) {
+        const double seconds = std::max<qint64>(nowMs - m_lastUpdateMs, 0) / 1000.0;
+        if (target > m_output) {
+            m_output = std::min(target, m_output + m_rampUp * seconds);
+        } else {
+            m_output = std::max(target, m_output - m_rampDown * seconds);
+        }
+    }
+    m_lastUpdateMs = nowMs;
+
+    return quantize(m_output);
+}
+
+int FanCurve::quantize(double speed) const {
+    const int steps = static_cast<int>(std::lround(speed / m_quantum));
+    return std::clamp(steps * m_quantum, 0, 100);
+}
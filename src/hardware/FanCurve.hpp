@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QVariantMap>
+#include <QVector>
+#include <QtGlobal>
+
+// Maps temperature to a fan duty cycle.
+//
+// The curve is piecewise linear between its points and flat outside
+// them. Falling temperatures only lower the fan once they drop more than
+// the hysteresis below the last peak, the output slews at a limited rate,
+// and it is quantized so callers can skip writes when it does not change.
+class FanCurve {
+public:
+    struct Point {
+        double temperature;  // °C
+        int speed;           // %
+    };
+
+    FanCurve();
+
+    // Reads a "hardware.fanCurves" table: {"temp_thresholds": [...],
+    // "speeds": [...]}. Returns false and leaves the curve unchanged if
+    // the table is malformed.
+    bool load(const QVariantMap& table);
+    void setPoints(const QVector<Point>& points);
+    const QVector<Point>& points() const { return m_points; }
+    QVector<double> thresholds() const;
+
+    void setHysteresis(double celsius) { m_hysteresis = celsius; }
+    void setRampRate(double upPerSecond, double downPerSecond);
+    void setQuantum(int percent) { m_quantum = qMax(1, percent); }
+
+    // Speed straight off the curve, without hysteresis or ramping
+    double interpolate(double temperature) const;
+
+    // Feed a reading and return the quantized speed to apply. The first
+    // call after reset() starts ramping from the given speed.
+    int update(qint64 nowMs, double temperature);
+    void reset(int currentSpeed);
+
+    int output() const { return quantize(m_output); }
+
+private:
+    int quantize(double speed) const;
+
+    QVector<Point> m_points;
+    double m_hysteresis;
+    double m_rampUp;    // %/s
+    double m_rampDown;  // %/s
+    int m_quantum;
+
+    double m_effectiveTemperature;
+    double m_output;
+    qint64 m_lastUpdateMs;
+    bool m_primed;
+};
@@ -0,0 +1,254 @@
+#include "GpuClockControl.hpp"
+#include <QDebug>
+#include <QList>
+#include <cstdlib>
+
+namespace {
+
+// "1600Mhz" / "1600MHz" -> 1600, or -1
+int parseMhz(const QByteArray& token) {
+    const QByteArray lower = token.trimmed().toLower();
+    if (!lower.endsWith("mhz")) {
+        return -1;
+    }
+    bool ok = false;
+    const int mhz = lower.chopped(3).toInt(&ok);
+    return ok ? mhz : -1;
+}
+
+QList<QByteArray> tokens(const QByteArray& line) {
+    return line.simplified().split(' ');
+}
+
+// Nearest clock to mhz counts as a match; the SMU rounds to its own steps
+constexpr int ReadBackToleranceMhz = 25;
+
+} // namespace
+
+bool GpuDpmTable::parse(const QByteArray& text) {
+    levelsMhz.clear();
+    currentLevel = -1;
+    sleepMhz = 0;
+    sleeping = false;
+
+    for (const QByteArray& line : text.split('\n')) {
+        const QList<QByteArray> fields = tokens(line);
+        if (fields.size() < 2 || !fields[0].endsWith(':')) {
+            continue;
+        }
+
+        const QByteArray index = fields[0].chopped(1);
+        const int mhz = parseMhz(fields[1]);
+        if (mhz < 0) {
+            return false;
+        }
+        const bool active = fields.size() > 2 && fields[2] == "*";
+
+        if (index == "S") {
+            sleepMhz = mhz;
+            sleeping = active;
+            continue;
+        }
+        bool ok = false;
+        const int level = index.toInt(&ok);
+        if (!ok || level != levelsMhz.size()) {
+            return false;
+        }
+        levelsMhz.append(mhz);
+        if (active) {
+            currentLevel = level;
+        }
+    }
+    return isValid();
+}
+
+int GpuDpmTable::nearestLevel(int mhz) const {
+    int best = -1;
+    for (int i = 0; i < levelsMhz.size(); ++i) {
+        if (best < 0 || std::abs(levelsMhz[i] - mhz) < std::abs(levelsMhz[best] - mhz)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int GpuDpmTable::currentMhz() const {
+    if (sleeping) {
+        return sleepMhz;
+    }
+    return currentLevel >= 0 ? levelsMhz[currentLevel] : -1;
+}
+
+int GpuDpmTable::parseCurrentMhz(const char* text) {
+    // Scan for "<n>Mhz *" without building any containers
+    for (const char* line = text; line && *line; ) {
+        const char* end = line;
+        while (*end && *end != '\n') {
+            ++end;
+        }
+
+        const char* colon = line;
+        while (colon < end && *colon != ':') {
+            ++colon;
+        }
+        const char* star = colon;
+        while (star < end && *star != '*') {
+            ++star;
+        }
+        if (colon < end && star < end) {
+            return static_cast<int>(std::strtol(colon + 1, nullptr, 10));
+        }
+
+        line = *end ? end + 1 : end;
+    }
+    return -1;
+}
+
+bool GpuOdTable::parse(const QByteArray& text) {
+    *this = GpuOdTable();
+
+    enum { None, Sclk, Range, Other } section = None;
+    for (const QByteArray& rawLine : text.split('\n')) {
+        const QByteArray line = rawLine.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        if (line.startsWith("OD_")) {
+            section = line == "OD_SCLK:" ? Sclk : (line == "OD_RANGE:" ? Range : Other);
+            continue;
+        }
+
+        const QList<QByteArray> fields = tokens(line);
+        if (section == Sclk && fields.size() >= 2) {
+            if (fields[0] == "0:") {
+                sclkMin = parseMhz(fields[1]);
+            } else if (fields[0] == "1:") {
+                sclkMax = parseMhz(fields[1]);
+            }
+        } else if (section == Range && fields.size() >= 3 && fields[0] == "SCLK:") {
+            rangeMin = parseMhz(fields[1]);
+            rangeMax = parseMhz(fields[2]);
+        }
+    }
+    return isValid();
+}
+
+GpuClockControl::GpuClockControl(Reader reader, Writer writer)
+    : m_reader(std::move(reader))
+    , m_writer(std::move(writer))
+    , m_loaded(false)
+    , m_appliedMhz(0) {
+}
+
+bool GpuClockControl::refresh() {
+    m_dpm.parse(m_reader(Sensor::GpuClock));
+    m_od.parse(m_reader(Sensor::GpuOverdriveTable));
+    m_loaded = true;
+    return m_dpm.isValid() || m_od.isValid();
+}
+
+bool GpuClockControl::setClock(int mhz) {
+    if (mhz == 0) {
+        const QByteArray level = m_savedLevel.isEmpty() ? QByteArray("auto") : m_savedLevel;
+        if (!m_writer(Sensor::GpuPerformanceLevel, level)) {
+            return false;
+        }
+        m_savedLevel.clear();
+        m_appliedMhz = 0;
+        return true;
+    }
+    if (!m_loaded) {
+        refresh();
+    }
+
+    // Both paths need the SMU out of automatic mode first
+    const QByteArray previous = m_reader(Sensor::GpuPerformanceLevel).trimmed();
+    if (!m_writer(Sensor::GpuPerformanceLevel, "manual")) {
+        return false;
+    }
+
+    bool ok = false;
+    if (m_od.isValid()) {
+        ok = setOverdriveClock(mhz);
+    } else if (m_dpm.isValid()) {
+        ok = setDpmLevel(m_dpm.nearestLevel(mhz));
+    } else {
+        qWarning() << "No usable GPU clock table";
+    }
+
+    if (previous.isEmpty() || previous == "manual") {
+        return ok;
+    }
+    if (ok) {
+        m_savedLevel = previous;
+    } else if (!m_writer(Sensor::GpuPerformanceLevel, previous)) {
+        qWarning() << "Failed to restore GPU performance level" << previous;
+    }
+    return ok;
+}
+
+bool GpuClockControl::currentClock(int& mhz) {
+    const QByteArray level = m_reader(Sensor::GpuPerformanceLevel).trimmed();
+    if (level.isEmpty()) {
+        return false;
+    }
+    if (level != "manual") {
+        mhz = 0;
+        return true;
+    }
+
+    GpuOdTable od;
+    if (od.parse(m_reader(Sensor::GpuOverdriveTable))) {
+        mhz = od.sclkMax;
+        return true;
+    }
+    GpuDpmTable dpm;
+    if (dpm.parse(m_reader(Sensor::GpuClock)) && dpm.currentLevel >= 0) {
+        mhz = dpm.levelsMhz[dpm.currentLevel];
+        return true;
+    }
+    return false;
+}
+
+bool GpuClockControl::setOverdriveClock(int mhz) {
+    const int target = qBound(m_od.rangeMin, mhz, m_od.rangeMax);
+    const int floor = qMin(m_od.sclkMin, target);
+
+    if (!m_writer(Sensor::GpuOverdriveTable, "s 0 " + QByteArray::number(floor))
+        || !m_writer(Sensor::GpuOverdriveTable, "s 1 " + QByteArray::number(target))
+        || !m_writer(Sensor::GpuOverdriveTable, "c")) {
+        return false;
+    }
+
+    // Read back what the driver actually committed
+    if (!m_od.parse(m_reader(Sensor::GpuOverdriveTable))
+        || std::abs(m_od.sclkMax - target) > ReadBackToleranceMhz) {
+        qWarning() << "GPU overdrive clock did not read back: wanted" << target << "got" << m_od.sclkMax;
+        return false;
+    }
+    m_appliedMhz = m_od.sclkMax;
+    return true;
+}
+
+bool GpuClockControl::setDpmLevel(int level) {
+    if (level < 0 || !m_writer(Sensor::GpuClock, QByteArray::number(level))) {
+        return false;
+    }
+
+    GpuDpmTable readBack;
+    if (!readBack.parse(m_reader(Sensor::GpuClock)) || readBack.currentLevel != level) {
+        qWarning() << "GPU DPM level did not read back: wanted" << level << "got" << readBack.currentLevel;
+        return false;
+    }
+    m_dpm = readBack;
+    m_appliedMhz = m_dpm.levelsMhz[level];
+    return true;
+}
+
+int GpuClockControl::effectiveClock() {
+    GpuDpmTable table;
+    if (!table.parse(m_reader(Sensor::GpuClock))) {
+        return -1;
+    }
+    return table.currentMhz();
+}
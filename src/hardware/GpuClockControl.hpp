@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+#include "SensorRegistry.hpp"
+
+// Parsed amdgpu pp_dpm_sclk: one line per DPM level, "N: <clock>Mhz",
+// with '*' marking the active one. Newer kernels add an "S:" deep-sleep
+// line.
+struct GpuDpmTable {
+    QVector<int> levelsMhz;
+    int currentLevel = -1;  // -1 if the GPU is in deep sleep or unknown
+    int sleepMhz = 0;
+    bool sleeping = false;
+
+    bool parse(const QByteArray& text);
+    bool isValid() const { return !levelsMhz.isEmpty(); }
+    int nearestLevel(int mhz) const;
+    int currentMhz() const;
+
+    // Active clock straight from a pp_dpm_sclk read buffer, without
+    // allocating; -1 if no line is marked
+    static int parseCurrentMhz(const char* text);
+};
+
+// Parsed amdgpu pp_od_clk_voltage: the OD_SCLK min/max that are in
+// effect and the OD_RANGE limits they may be set to.
+struct GpuOdTable {
+    int sclkMin = 0;
+    int sclkMax = 0;
+    int rangeMin = 0;
+    int rangeMax = 0;
+
+    bool parse(const QByteArray& text);
+    bool isValid() const { return sclkMax > 0 && rangeMax > 0; }
+};
+
+// Sets the GPU core clock through amdgpu's manual mode.
+//
+// With overdrive available the OD_SCLK upper bound is moved to the
+// requested clock ("s 1 <mhz>", then "c" to commit); otherwise the
+// nearest DPM level is forced. Either way the tables are read back to
+// verify the change actually took.
+class GpuClockControl {
+public:
+    using Sensor = SensorRegistry::Sensor;
+    using Reader = std::function<QByteArray(Sensor sensor)>;
+    using Writer = std::function<bool(Sensor sensor, const QByteArray& value)>;
+
+    GpuClockControl(Reader reader, Writer writer);
+
+    // Re-read and cache both tables, e.g. after a driver rebind
+    bool refresh();
+    const GpuDpmTable& dpmTable() const { return m_dpm; }
+    const GpuOdTable& odTable() const { return m_od; }
+
+    // Returns false if the clock could not be set or did not read back;
+    // the performance level is then left as it was found. 0 hands the
+    // GPU back to the performance level found before manual mode.
+    bool setClock(int mhz);
+
+    // Clock in effect right now in setClock() terms: 0 while the driver
+    // picks the clock, otherwise the OD upper bound or the forced level
+    bool currentClock(int& mhz);
+
+    // Clock the last successful setClock() settled on, 0 if none
+    int appliedClock() const { return m_appliedMhz; }
+
+    // Clock the GPU is running at right now
+    int effectiveClock();
+
+private:
+    bool setOverdriveClock(int mhz);
+    bool setDpmLevel(int level);
+
+    Reader m_reader;
+    Writer m_writer;
+    GpuDpmTable m_dpm;
+    GpuOdTable m_od;
+    bool m_loaded;
+    int m_appliedMhz;
+    QByteArray m_savedLevel;  // Before manual mode, empty if unknown
+};
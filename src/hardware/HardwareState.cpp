@@ -0,0 +1,85 @@
+#include "HardwareState.hpp"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QVector>
+
+HardwareState::HardwareState()
+    : m_mask(0) {
+    m_values.fill(0);
+}
+
+HardwareState& HardwareState::set(Knob knob, int value) {
+    m_values[knob] = value;
+    m_mask |= knobBit(knob);
+    return *this;
+}
+
+void HardwareState::unset(Knob knob) {
+    m_mask &= ~knobBit(knob);
+}
+
+quint32 HardwareState::diff(const HardwareState& applied) const {
+    quint32 changed = 0;
+    for (int k = 0; k < KnobCount; ++k) {
+        const auto knob = static_cast<Knob>(k);
+        if (has(knob) && (!applied.has(knob) || applied.value(knob) != value(knob))) {
+            changed |= knobBit(knob);
+        }
+    }
+    return changed;
+}
+
+HardwareTransaction::HardwareTransaction(Reader reader, Writer writer)
+    : m_reader(std::move(reader))
+    , m_writer(std::move(writer))
+    , m_changed(0)
+    , m_failed(-1) {
+    m_latencyNs.fill(0);
+}
+
+bool HardwareTransaction::apply(const HardwareState& desired, HardwareState& applied) {
+    m_changed = desired.diff(applied);
+    m_failed = -1;
+    m_latencyNs.fill(0);
+
+    QVector<Knob> written;
+    QElapsedTimer timer;
+    for (int k = 0; k < HardwareState::KnobCount; ++k) {
+        const auto knob = static_cast<Knob>(k);
+        if (!(m_changed & HardwareState::knobBit(knob))) {
+            continue;
+        }
+
+        timer.start();
+        int previous = 0;
+        const bool known = applied.has(knob) || m_reader(knob, previous);
+        if (known && !applied.has(knob)) {
+            applied.set(knob, previous);
+        }
+        const bool ok = known && m_writer(knob, desired.value(knob));
+        m_latencyNs[knob] = timer.nsecsElapsed();
+        if (!ok) {
+            m_failed = knob;
+            break;
+        }
+        written.append(knob);
+    }
+
+    if (m_failed < 0) {
+        for (Knob knob : written) {
+            applied.set(knob, desired.value(knob));
+        }
+        return true;
+    }
+
+    // Whatever the failed write left behind is unknown until it is read again
+    applied.unset(static_cast<Knob>(m_failed));
+    for (auto it = written.crbegin(); it != written.crend(); ++it) {
+        if (!m_writer(*it, applied.value(*it))) {
+            qWarning() << "Failed to roll back hardware knob" << *it;
+            applied.unset(*it);
+        }
+    }
+    m_changed = 0;
+    return false;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtGlobal>
+#include <array>
+#include <functional>
+
+// A set of values for the writable hardware knobs. Knobs that are not set
+// are left alone when the state is applied.
+class HardwareState {
+public:
+    // Declared in dependency order: the platform profile resets the
+    // firmware power limits, so it has to go before the TDP, and the GPU
+    // clock range depends on the power budget
+    enum Knob {
+        PowerProfile,
+        Tdp,         // W
+        GpuClock,    // MHz
+        FanSpeed,    // %
+        KnobCount
+    };
+
+    HardwareState();
+
+    HardwareState& set(Knob knob, int value);
+    void unset(Knob knob);
+    bool has(Knob knob) const { return m_mask & knobBit(knob); }
+    int value(Knob knob) const { return m_values[knob]; }
+    quint32 knobs() const { return m_mask; }
+    bool isEmpty() const { return m_mask == 0; }
+
+    // Knobs set here that are missing from, or differ in, `applied`
+    quint32 diff(const HardwareState& applied) const;
+
+    static constexpr quint32 knobBit(Knob knob) { return 1u << knob; }
+
+private:
+    std::array<int, KnobCount> m_values;
+    quint32 m_mask;
+};
+
+// Applies a desired HardwareState on top of the last-applied one as a
+// single transaction: only changed knobs are written, in dependency
+// order, and if any write fails the knobs already written are restored
+// in reverse order. A knob with no applied value is read from the
+// hardware before its first write, so there is always one to restore.
+class HardwareTransaction {
+public:
+    using Knob = HardwareState::Knob;
+    using Reader = std::function<bool(Knob knob, int& value)>;
+    using Writer = std::function<bool(Knob knob, int value)>;
+
+    HardwareTransaction(Reader reader, Writer writer);
+
+    // On success `applied` holds the desired values. On failure it holds
+    // what the rolled-back knobs were restored to; the failed knob, and
+    // any knob that could not be restored, is unset.
+    bool apply(const HardwareState& desired, HardwareState& applied);
+
+    // Results of the last apply()
+    quint32 changedKnobs() const { return m_changed; }
+    int failedKnob() const { return m_failed; }  // -1 if none
+    qint64 latencyNs(Knob knob) const { return m_latencyNs[knob]; }
+
+private:
+    Reader m_reader;
+    Writer m_writer;
+    quint32 m_changed;
+    int m_failed;
+    std::array<qint64, HardwareState::KnobCount> m_latencyNs;
+};
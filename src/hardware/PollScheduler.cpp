@@ -0,0 +1,123 @@
+#include "PollScheduler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+PollScheduler::PollScheduler()
+    : m_fixedIntervalMs(0)
+    , m_activeMask(AllGroups) {
+    for (GroupState& state : m_groups) {
+        state = GroupState();
+        state.deadlineMs = 0;
+        state.lastReadMs = 0;
+        state.lastValue = 0.0;
+        state.rate = 0.0;
+        state.hasValue = false;
+    }
+
+    // Temperature needs to react within a second when it moves; battery
+    // capacity changes by 1% every few minutes at most
+    setPolicy(Temperature, {250, 4000, 1.0});
+    setPolicy(Battery, {10000, 120000, 1.0});
+    setPolicy(Power, {1000, 10000, 0.5});
+    setPolicy(Fan, {2000, 10000, 200.0});
+    setPolicy(Gpu, {1000, 10000, 5.0});
+}
+
+void PollScheduler::setPolicy(Group group, const Policy& policy) {
+    m_groups[group].policy = policy;
+    m_groups[group].intervalMs = policy.minIntervalMs;
+}
+
+void PollScheduler::setThresholds(Group group, const QVector<double>& thresholds) {
+    m_groups[group].thresholds = thresholds;
+}
+
+void PollScheduler::reset(qint64 nowMs) {
+    for (GroupState& state : m_groups) {
+        state.deadlineMs = nowMs;
+    }
+}
+
+void PollScheduler::expedite(quint32 mask, qint64 nowMs) {
+    for (int g = 0; g < GroupCount; ++g) {
+        if (mask & groupBit(static_cast<Group>(g))) {
+            m_groups[g].deadlineMs = std::min(m_groups[g].deadlineMs, nowMs);
+        }
+    }
+}
+
+quint32 PollScheduler::due(qint64 nowMs) const {
+    quint32 mask = 0;
+    for (int g = 0; g < GroupCount; ++g) {
+        const GroupState& state = m_groups[g];
+        if ((m_activeMask & groupBit(static_cast<Group>(g)))
+            && state.deadlineMs <= nowMs + state.intervalMs / 4) {
+            mask |= groupBit(static_cast<Group>(g));
+        }
+    }
+    return mask;
+}
+
+qint64 PollScheduler::nextDeadline() const {
+    qint64 deadline = -1;
+    for (int g = 0; g < GroupCount; ++g) {
+        if ((m_activeMask & groupBit(static_cast<Group>(g)))
+            && (deadline < 0 || m_groups[g].deadlineMs < deadline)) {
+            deadline = m_groups[g].deadlineMs;
+        }
+    }
+    return deadline;
+}
+
+void PollScheduler::update(Group group, qint64 nowMs, double value) {
+    GroupState& state = m_groups[group];
+    state.intervalMs = m_fixedIntervalMs > 0 ? m_fixedIntervalMs
+                                             : adaptiveInterval(state, nowMs, value);
+    state.deadlineMs = nowMs + state.intervalMs;
+}
+
+qint64 PollScheduler::adaptiveInterval(GroupState& state, qint64 nowMs, double value) const {
+    const Policy& policy = state.policy;
+    if (!state.hasValue) {
+        state.hasValue = true;
+        state.lastValue = value;
+        state.lastReadMs = nowMs;
+        return policy.minIntervalMs;
+    }
+
+    const double delta = value - state.lastValue;
+    const double seconds = std::max(nowMs - state.lastReadMs, qint64(1)) / 1000.0;
+    double interval;
+
+    if (std::abs(delta) < policy.resolution) {
+        // Stable: back off geometrically and let the rate estimate decay.
+        // The reference value is kept so slow drifts still accumulate.
+        interval = state.intervalMs * 1.5;
+        state.rate *= 0.5;
+    } else {
+        // Moving: poll about once per resolution step
+        const double rate = delta / seconds;
+        state.rate = state.rate == 0.0 ? rate : 0.5 * (state.rate + rate);
+        interval = 1000.0 * policy.resolution / std::abs(rate);
+        state.lastValue = value;
+        state.lastReadMs = nowMs;
+    }
+
+    for (double threshold : state.thresholds) {
+        const double distance = threshold - value;
+
+        // Hovering next to a threshold: never back off fully
+        if (std::abs(distance) < 2.0 * policy.resolution) {
+            interval = std::min(interval, policy.maxIntervalMs / 2.0);
+        }
+
+        // Heading towards it: make sure at least two reads land before
+        // the projected crossing
+        if (distance * state.rate > 0.0) {
+            interval = std::min(interval, 500.0 * distance / state.rate);
+        }
+    }
+
+    return std::clamp(static_cast<qint64>(interval), policy.minIntervalMs, policy.maxIntervalMs);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QVector>
+#include <array>
+
+// Decides when each group of sensors needs to be read next.
+//
+// Each group adapts between a minimum and maximum interval: it backs off
+// while readings are stable and tightens when the value moves by more
+// than its resolution, or when it is heading towards a registered
+// threshold (e.g. a fan-curve step). Groups that come due close together
+// are read in one wakeup. Times are plain milliseconds so the scheduler
+// can be driven by a simulated clock.
+class PollScheduler {
+public:
+    enum Group {
+        Temperature,
+        Battery,
+        Power,
+        Fan,
+        Gpu,
+        GroupCount
+    };
+
+    struct Policy {
+        qint64 minIntervalMs;
+        qint64 maxIntervalMs;
+        double resolution;  // Smallest change worth reacting to
+    };
+
+    PollScheduler();
+
+    void setPolicy(Group group, const Policy& policy);
+    const Policy& policy(Group group) const { return m_groups[group].policy; }
+
+    // Values the caller must not miss a crossing of
+    void setThresholds(Group group, const QVector<double>& thresholds);
+
+    // Poll every group at a fixed interval instead (0 = adaptive)
+    void setFixedInterval(qint64 ms) { m_fixedIntervalMs = ms; }
+
+    // Restrict polling to a subset of groups, e.g. while the launcher is hidden
+    void setActiveGroups(quint32 mask) { m_activeMask = mask; }
+    quint32 activeGroups() const { return m_activeMask; }
+
+    // Make every group due at nowMs
+    void reset(qint64 nowMs);
+
+    // Make the given groups due at nowMs, e.g. after a power_supply uevent
+    void expedite(quint32 mask, qint64 nowMs);
+
+    // Groups due at nowMs, including ones due within a quarter of their
+    // interval so nearby reads share a wakeup
+    quint32 due(qint64 nowMs) const;
+
+    // Record a reading and schedule the group's next poll
+    void update(Group group, qint64 nowMs, double value);
+
+    // Earliest deadline among active groups, or -1 if none are active
+    qint64 nextDeadline() const;
+    qint64 interval(Group group) const { return m_groups[group].intervalMs; }
+
+    static constexpr quint32 groupBit(Group group) { return 1u << group; }
+    static constexpr quint32 AllGroups = (1u << GroupCount) - 1;
+
+private:
+    struct GroupState {
+        Policy policy;
+        QVector<double> thresholds;
+        qint64 intervalMs;
+        qint64 deadlineMs;
+        qint64 lastReadMs;
+        double lastValue;
+        double rate;  // Units per second, smoothed
+        bool hasValue;
+    };
+
+    qint64 adaptiveInterval(GroupState& state, qint64 nowMs, double value) const;
+
+    std::array<GroupState, GroupCount> m_groups;
+    qint64 m_fixedIntervalMs;
+    quint32 m_activeMask;
+};
@@ -0,0 +1,274 @@
+#include "SensorRegistry.hpp"
+#include "SysfsAttribute.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SensorRegistry* SensorRegistry::s_instance = nullptr;
+
+SensorRegistry* SensorRegistry::instance() {
+    if (!s_instance) {
+        s_instance = new SensorRegistry();
+    }
+    return s_instance;
+}
+
+SensorRegistry::SensorRegistry(QObject* parent)
+    : QObject(parent)
+    , m_ueventSocket(-1)
+    , m_ueventNotifier(nullptr) {
+}
+
+namespace {
+
+// One-shot read used during discovery only; the hot path goes through
+// SysfsAttribute.
+QString readAttribute(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    return QString::fromUtf8(file.readAll()).trimmed();
+}
+
+QStringList classEntries(const QString& className) {
+    QDir dir(Sysfs::path("class/" + className));
+    return dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::System, QDir::Name);
+}
+
+} // namespace
+
+SensorRegistry::Subsystem SensorRegistry::subsystemOf(Sensor sensor) {
+    switch (sensor) {
+        case Sensor::CpuTemperature:
+        case Sensor::GpuTemperature:
+        case Sensor::FanRpm:
+            return Subsystem::Hwmon;
+        case Sensor::FanControl:
+        case Sensor::PowerProfile:
+            return Subsystem::Platform;
+        case Sensor::TdpLimit:
+            return Subsystem::Powercap;
+        case Sensor::GpuClock:
+        case Sensor::GpuPerformanceLevel:
+        case Sensor::GpuOverdriveTable:
+        case Sensor::GpuBusy:
+            return Subsystem::Drm;
+        case Sensor::BatteryCapacity:
+        case Sensor::BatteryStatus:
+        case Sensor::BatteryPowerNow:
+        case Sensor::BatteryEnergyNow:
+        case Sensor::BatteryCurrentNow:
+        case Sensor::BatteryVoltageNow:
+        case Sensor::AcOnline:
+        case Sensor::Count:
+            break;
+    }
+    return Subsystem::PowerSupply;
+}
+
+void SensorRegistry::scan() {
+    m_handles.fill(SensorHandle());
+    scanHwmon();
+    scanPowerSupply();
+    scanPowercap();
+    scanDrm();
+    scanPlatform();
+}
+
+void SensorRegistry::rescan(Subsystem subsystem) {
+    for (int i = 0; i < SensorCount; ++i) {
+        if (subsystemOf(static_cast<Sensor>(i)) == subsystem) {
+            m_handles[i] = SensorHandle();
+        }
+    }
+
+    switch (subsystem) {
+        case Subsystem::Hwmon:
+            scanHwmon();
+            break;
+        case Subsystem::PowerSupply:
+            scanPowerSupply();
+            break;
+        case Subsystem::Powercap:
+            scanPowercap();
+            break;
+        case Subsystem::Drm:
+            scanDrm();
+            break;
+        case Subsystem::Platform:
+            scanPlatform();
+            break;
+    }
+    emit sensorsChanged(subsystem);
+}
+
+void SensorRegistry::setHandle(Sensor sensor, const QString& path, double scale, bool writable) {
+    SensorHandle& handle = m_handles[static_cast<int>(sensor)];
+    if (handle.isValid() || !QFileInfo::exists(path)) {
+        return;  // First match wins
+    }
+    handle.path = path;
+    handle.scale = scale;
+    handle.writable = writable;
+}
+
+void SensorRegistry::scanHwmon() {
+    for (const QString& entry : classEntries("hwmon")) {
+        const QString dir = Sysfs::path("class/hwmon/" + entry + '/');
+        const QString name = readAttribute(dir + "name");
+
+        if (name == "k10temp" || name == "zenpower") {
+            setHandle(Sensor::CpuTemperature, dir + "temp1_input", 0.001);
+        } else if (name == "amdgpu") {
+            setHandle(Sensor::GpuTemperature, dir + "temp1_input", 0.001);
+        } else if (name == "asus" || name == "asus_nb_wmi" || name == "asus-nb-wmi") {
+            setHandle(Sensor::FanRpm, dir + "fan1_input");
+        }
+    }
+}
+
+void SensorRegistry::scanPowerSupply() {
+    for (const QString& entry : classEntries("power_supply")) {
+        const QString dir = Sysfs::path("class/power_supply/" + entry + '/');
+        const QString type = readAttribute(dir + "type");
+
+        if (type == "Battery" || (type.isEmpty() && entry.startsWith("BAT"))) {
+            setHandle(Sensor::BatteryCapacity, dir + "capacity");
+            setHandle(Sensor::BatteryStatus, dir + "status");
+            setHandle(Sensor::BatteryPowerNow, dir + "power_now", 1e-6);
+            setHandle(Sensor::BatteryEnergyNow, dir + "energy_now", 1e-6);
+            setHandle(Sensor::BatteryCurrentNow, dir + "current_now", 1e-6);
+            setHandle(Sensor::BatteryVoltageNow, dir + "voltage_now", 1e-6);
+        } else if (type == "Mains") {
+            setHandle(Sensor::AcOnline, dir + "online");
+        }
+    }
+}
+
+void SensorRegistry::scanPowercap() {
+    for (const QString& entry : classEntries("powercap")) {
+        const QString dir = Sysfs::path("class/powercap/" + entry + '/');
+        const QString name = readAttribute(dir + "name");
+
+        // The Ally's own APU limit node, or a top-level RAPL package
+        // zone. Its subzones and the intel-rapl-mmio mirror of it are
+        // not the package limit.
+        const bool allyNode = entry == "powercap0";
+        const bool packageZone = name == "package-0"
+            && entry.startsWith("intel-rapl:") && entry.count(':') == 1;
+        if (allyNode || packageZone) {
+            setHandle(Sensor::TdpLimit, dir + "tdp", 1e-6, true);
+            setHandle(Sensor::TdpLimit, dir + "constraint_0_power_limit_uw", 1e-6, true);
+        }
+    }
+}
+
+void SensorRegistry::scanDrm() {
+    for (const QString& entry : classEntries("drm")) {
+        // Skip connectors such as card0-eDP-1 and render nodes
+        if (!entry.startsWith("card") || entry.contains('-')) {
+            continue;
+        }
+
+        const QString device = Sysfs::path("class/drm/" + entry + "/device/");
+        if (readAttribute(device + "vendor") != "0x1002") {
+            continue;
+        }
+
+        setHandle(Sensor::GpuClock, device + "pp_dpm_sclk", 1.0, true);
+        setHandle(Sensor::GpuPerformanceLevel, device + "power_dpm_force_performance_level", 1.0, true);
+        setHandle(Sensor::GpuOverdriveTable, device + "pp_od_clk_voltage", 1.0, true);
+        setHandle(Sensor::GpuBusy, device + "gpu_busy_percent");
+    }
+}
+
+void SensorRegistry::scanPlatform() {
+    const QString dir = Sysfs::path("devices/platform/asus-nb-wmi/");
+    setHandle(Sensor::PowerProfile, dir + "profile", 1.0, true);
+    setHandle(Sensor::FanControl, dir + "fan_speed", 1.0, true);
+}
+
+bool SensorRegistry::enableHotplugMonitoring() {
+    if (m_ueventSocket >= 0) {
+        return true;
+    }
+
+    m_ueventSocket = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                              NETLINK_KOBJECT_UEVENT);
+    if (m_ueventSocket < 0) {
+        qWarning() << "Failed to open uevent socket";
+        return false;
+    }
+
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;  // Kernel uevent multicast group
+    if (::bind(m_ueventSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        qWarning() << "Failed to bind uevent socket";
+        ::close(m_ueventSocket);
+        m_ueventSocket = -1;
+        return false;
+    }
+
+    m_ueventNotifier = new QSocketNotifier(m_ueventSocket, QSocketNotifier::Read, this);
+    connect(m_ueventNotifier, &QSocketNotifier::activated, this, &SensorRegistry::readUevents);
+    return true;
+}
+
+void SensorRegistry::readUevents() {
+    char buf[8192];
+    for (;;) {
+        const ssize_t n = ::recv(m_ueventSocket, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n <= 0) {
+            break;
+        }
+        handleUevent(QByteArray::fromRawData(buf, static_cast<int>(n)));
+    }
+}
+
+void SensorRegistry::handleUevent(const QByteArray& message) {
+    // "add@/devices/...\0ACTION=add\0DEVPATH=...\0SUBSYSTEM=hwmon\0..."
+    QByteArray action;
+    QByteArray subsystem;
+    for (const QByteArray& field : message.split('\0')) {
+        if (field.startsWith("ACTION=")) {
+            action = field.mid(7);
+        } else if (field.startsWith("SUBSYSTEM=")) {
+            subsystem = field.mid(10);
+        }
+    }
+
+    // Battery and hwmon "change" events fire constantly and never move
+    // nodes, but a power_supply change is worth an early battery read
+    if (action == "change" && subsystem == "power_supply") {
+        emit powerSupplyChanged();
+        return;
+    }
+    if (action != "add" && action != "remove") {
+        return;
+    }
+
+    if (subsystem == "hwmon") {
+        rescan(Subsystem::Hwmon);
+    } else if (subsystem == "power_supply") {
+        rescan(Subsystem::PowerSupply);
+    } else if (subsystem == "powercap") {
+        rescan(Subsystem::Powercap);
+    } else if (subsystem == "drm") {
+        rescan(Subsystem::Drm);
+    } else if (subsystem == "platform") {
+        rescan(Subsystem::Platform);
+    }
+}
+
+SensorRegistry::~SensorRegistry() {
+    if (m_ueventSocket >= 0) {
+        ::close(m_ueventSocket);
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <array>
+
+class QSocketNotifier;
+
+// Discovers the hwmon, power_supply, powercap and drm nodes the launcher
+// needs by their name/type attributes instead of hardcoded hwmonN/cardN
+// paths. Discovery runs once at startup; afterwards only the subsystem
+// named in a kernel uevent is rescanned.
+class SensorRegistry : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Sensor {
+        CpuTemperature,      // k10temp Tctl
+        GpuTemperature,      // amdgpu edge
+        FanRpm,
+        FanControl,
+        PowerProfile,
+        TdpLimit,
+        GpuClock,            // pp_dpm_sclk
+        GpuPerformanceLevel, // power_dpm_force_performance_level
+        GpuOverdriveTable,   // pp_od_clk_voltage
+        GpuBusy,
+        BatteryCapacity,
+        BatteryStatus,
+        BatteryPowerNow,
+        BatteryEnergyNow,
+        BatteryCurrentNow,
+        BatteryVoltageNow,
+        AcOnline,
+        Count
+    };
+    Q_ENUM(Sensor)
+
+    enum class Subsystem {
+        Hwmon,
+        PowerSupply,
+        Powercap,
+        Drm,
+        Platform
+    };
+    Q_ENUM(Subsystem)
+
+    static constexpr int SensorCount = static_cast<int>(Sensor::Count);
+
+    struct SensorHandle {
+        QString path;         // Absolute attribute path, empty if not present
+        double scale = 1.0;   // Raw value * scale = °C, W, Wh, A, V, %
+        bool writable = false;
+
+        bool isValid() const { return !path.isEmpty(); }
+    };
+
+    static SensorRegistry* instance();
+
+    // Full discovery of every subsystem under Sysfs::root()
+    void scan();
+    void rescan(Subsystem subsystem);
+
+    const SensorHandle& handle(Sensor sensor) const {
+        return m_handles[static_cast<int>(sensor)];
+    }
+    bool has(Sensor sensor) const { return handle(sensor).isValid(); }
+    const std::array<SensorHandle, SensorCount>& handles() const { return m_handles; }
+    static Subsystem subsystemOf(Sensor sensor);
+
+    // Listen for kernel add/remove uevents on NETLINK_KOBJECT_UEVENT
+    bool enableHotplugMonitoring();
+    void handleUevent(const QByteArray& message);
+
+signals:
+    void sensorsChanged(SensorRegistry::Subsystem subsystem);
+    // A battery or AC adapter reported new values (charger plugged in, etc.)
+    void powerSupplyChanged();
+
+private:
+    explicit SensorRegistry(QObject* parent = nullptr);
+    ~SensorRegistry();
+
+    static SensorRegistry* s_instance;
+
+    void scanHwmon();
+    void scanPowerSupply();
+    void scanPowercap();
+    void scanDrm();
+    void scanPlatform();
+    void setHandle(Sensor sensor, const QString& path, double scale = 1.0, bool writable = false);
+    void readUevents();
+
+    std::array<SensorHandle, SensorCount> m_handles;
+    int m_ueventSocket;
+    QSocketNotifier* m_ueventNotifier;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer sequence lock for small trivially copyable values.
+//
+// The writer never blocks and readers never block the writer; a reader
+// that races with a store simply retries. The payload is held in atomic
+// words so concurrent access is well defined.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock payload must be trivially copyable");
+
+public:
+    SeqLock() {
+        store(T());
+        m_sequence.store(0, std::memory_order_relaxed);
+    }
+
+    void store(const T& value) {
+        std::array<std::uint64_t, Words> words = {};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        const std::uint64_t seq = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < Words; ++i) {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+        m_sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Returns false if a store was in progress; the caller may retry
+    bool tryLoad(T& value) const {
+        std::array<std::uint64_t, Words> words;
+        const std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        for (std::size_t i = 0; i < Words; ++i) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return true;
+    }
+
+    T load() const {
+        T value;
+        while (!tryLoad(value)) {
+        }
+        return value;
+    }
+
+    // Number of completed stores
+    std::uint64_t version() const {
+        return m_sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static constexpr std::size_t Words = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    std::atomic<std::uint64_t> m_sequence{0};
+    std::array<std::atomic<std::uint64_t>, Words> m_words = {};
+};
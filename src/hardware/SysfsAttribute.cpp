@@ -0,0 +1,196 @@
+#include "SysfsAttribute.hpp"
+#include <QDebug>
+#include <QFile>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#ifndef SYSFS_MAGIC
+#define SYSFS_MAGIC 0x62656572
+#endif
+
+QString Sysfs::s_root = qEnvironmentVariable("ALLY_SYSFS_ROOT", "/sys");
+
+QString Sysfs::root() {
+    return s_root;
+}
+
+void Sysfs::setRoot(const QString& root) {
+    s_root = root.endsWith('/') ? root.chopped(1) : root;
+}
+
+QString Sysfs::path(const QString& relativePath) {
+    return s_root + '/' + relativePath;
+}
+
+namespace {
+
+bool isStaleError(int error) {
+    return error == ENODEV || error == ESTALE;
+}
+
+} // namespace
+
+SysfsAttribute::SysfsAttribute(const QString& path, Mode mode)
+    : m_path(path)
+    , m_nativePath(QFile::encodeName(path))
+    , m_mode(mode)
+    , m_fd(-1)
+    , m_onSysfs(false)
+    , m_warned(false) {
+}
+
+bool SysfsAttribute::exists() const {
+    struct stat st;
+    return ::stat(m_nativePath.constData(), &st) == 0;
+}
+
+bool SysfsAttribute::open() {
+    int flags = O_CLOEXEC;
+    switch (m_mode) {
+        case Mode::ReadOnly:
+            flags |= O_RDONLY;
+            break;
+        case Mode::WriteOnly:
+            flags |= O_WRONLY;
+            break;
+        case Mode::ReadWrite:
+            flags |= O_RDWR;
+            break;
+    }
+
+    do {
+        m_fd = ::open(m_nativePath.constData(), flags);
+    } while (m_fd < 0 && errno == EINTR);
+
+    if (m_fd < 0) {
+        warnOnce("open", errno);
+        return false;
+    }
+
+    // Real sysfs attributes replace their value on every write; regular
+    // files in a fake tree need an explicit truncate after pwrite().
+    struct statfs fs;
+    m_onSysfs = ::fstatfs(m_fd, &fs) == 0 && fs.f_type == SYSFS_MAGIC;
+    m_warned = false;
+    return true;
+}
+
+void SysfsAttribute::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void SysfsAttribute::warnOnce(const char* what, int error) {
+    if (!m_warned) {
+        qWarning() << "Failed to" << what << m_path << ':' << strerror(error);
+        m_warned = true;
+    }
+}
+
+int SysfsAttribute::read(char* buf, int size) {
+    if (size <= 0) {
+        return -1;
+    }
+
+    // Second pass only happens after the descriptor went stale
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (m_fd < 0 && !open()) {
+            return -1;
+        }
+
+        ssize_t n;
+        do {
+            n = ::pread(m_fd, buf, size - 1, 0);
+        } while (n < 0 && errno == EINTR);
+
+        if (n >= 0) {
+            while (n > 0 && std::isspace(static_cast<unsigned char>(buf[n - 1]))) {
+                --n;
+            }
+            buf[n] = '\0';
+            return static_cast<int>(n);
+        }
+
+        const int error = errno;
+        if (!isStaleError(error)) {
+            warnOnce("read", error);
+            return -1;
+        }
+        close();
+    }
+    return -1;
+}
+
+bool SysfsAttribute::readInt(qint64& value) {
+    char buf[32];
+    const int n = read(buf, sizeof(buf));
+    if (n <= 0) {
+        return false;
+    }
+
+    const char* begin = buf;
+    while (*begin == ' ') {
+        ++begin;
+    }
+    auto result = std::from_chars(begin, buf + n, value);
+    return result.ec == std::errc();
+}
+
+QString SysfsAttribute::readString() {
+    char buf[4096];
+    const int n = read(buf, sizeof(buf));
+    if (n < 0) {
+        return QString();
+    }
+    return QString::fromUtf8(buf, n).trimmed();
+}
+
+bool SysfsAttribute::write(const char* data, int length) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (m_fd < 0 && !open()) {
+            return false;
+        }
+
+        ssize_t n;
+        do {
+            n = ::pwrite(m_fd, data, length, 0);
+        } while (n < 0 && errno == EINTR);
+
+        if (n == length) {
+            if (!m_onSysfs && ::ftruncate(m_fd, length) != 0) {
+                warnOnce("truncate", errno);
+            }
+            return true;
+        }
+
+        const int error = n < 0 ? errno : EIO;
+        if (!isStaleError(error)) {
+            warnOnce("write", error);
+            return false;
+        }
+        close();
+    }
+    return false;
+}
+
+bool SysfsAttribute::write(const QByteArray& value) {
+    return write(value.constData(), static_cast<int>(value.size()));
+}
+
+bool SysfsAttribute::writeInt(qint64 value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    return write(buf, static_cast<int>(result.ptr - buf));
+}
+
+SysfsAttribute::~SysfsAttribute() {
+    close();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+
+// Root of the sysfs tree used by every hardware accessor. Defaults to /sys
+// and can be overridden with ALLY_SYSFS_ROOT or setRoot() so the launcher
+// and its tests can run against a fake tree.
+class Sysfs {
+public:
+    static QString root();
+    static void setRoot(const QString& root);
+
+    // Resolve a path relative to the sysfs root, e.g. "class/hwmon"
+    static QString path(const QString& relativePath);
+
+private:
+    static QString s_root;
+};
+
+// Persistent handle on a single sysfs attribute.
+//
+// The descriptor is opened on first use and kept open; reads use pread()
+// from offset 0 into a caller-supplied buffer so polling an attribute does
+// not allocate. The descriptor is only reopened when the kernel reports it
+// stale (ENODEV/ESTALE), e.g. after a driver rebind.
+class SysfsAttribute {
+public:
+    enum class Mode {
+        ReadOnly,
+        WriteOnly,
+        ReadWrite
+    };
+
+    explicit SysfsAttribute(const QString& path, Mode mode = Mode::ReadOnly);
+    ~SysfsAttribute();
+
+    SysfsAttribute(const SysfsAttribute&) = delete;
+    SysfsAttribute& operator=(const SysfsAttribute&) = delete;
+
+    // Read the attribute into buf, NUL-terminated with trailing whitespace
+    // stripped. Returns the number of bytes read or -1 on failure.
+    int read(char* buf, int size);
+    bool readInt(qint64& value);
+    QString readString();
+
+    bool write(const char* data, int length);
+    bool write(const QByteArray& value);
+    bool writeInt(qint64 value);
+
+    const QString& path() const { return m_path; }
+    bool isOpen() const { return m_fd >= 0; }
+    bool exists() const;
+
+private:
+    bool open();
+    void close();
+    void warnOnce(const char* what, int error);
+
+    QString m_path;
+    QByteArray m_nativePath;
+    Mode m_mode;
+    int m_fd;
+    bool m_onSysfs;
+    bool m_warned;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QtGlobal>
+
+// One immutable snapshot of all hardware sensors, published by
+// TelemetrySampler. Fields keep their previous value when a read fails.
+struct TelemetrySample {
+    qint64 timestampMs = 0;        // CLOCK_MONOTONIC
+    float cpuTemperature = 0.0f;   // °C
+    float gpuTemperature = 0.0f;   // °C
+    float batteryPower = 0.0f;     // W, discharge rate
+    float batteryEnergy = -1.0f;   // Wh remaining, -1 if not reported
+    int batteryLevel = 100;        // %
+    int fanRpm = 0;
+    int gpuBusy = 0;               // %
+    int gpuClock = 0;              // MHz, active DPM level
+    bool charging = false;
+    bool acOnline = false;
+};
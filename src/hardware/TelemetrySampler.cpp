@@ -0,0 +1,328 @@
+#include "TelemetrySampler.hpp"
+#include "GpuClockControl.hpp"
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+TelemetrySampler::TelemetrySampler(QObject* parent)
+    : QObject(parent)
+    , m_timerFd(::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK))
+    , m_eventFd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , m_notifyPending(false)
+    , m_wakeups(0)
+    , m_startedMs(0)
+    , m_stopRequested(false)
+    , m_sensorsChanged(false) {
+    for (auto& reads : m_reads) {
+        reads.store(0);
+    }
+    if (m_timerFd < 0 || m_eventFd < 0) {
+        qWarning() << "Failed to create telemetry sampler descriptors:" << strerror(errno);
+    }
+}
+
+qint64 TelemetrySampler::monotonicMs() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TelemetrySampler::setSensors(const SensorTable& sensors) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingSensors = sensors;
+        m_sensorsChanged = true;
+    }
+    requestPoll(PollScheduler::AllGroups);
+}
+
+void TelemetrySampler::setSource(Source source) {
+    Q_ASSERT(!isRunning());
+    m_source = std::move(source);
+}
+
+void TelemetrySampler::configure(std::function<void(PollScheduler&, qint64)> command) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_commands.push_back(std::move(command));
+    }
+    wake();
+}
+
+void TelemetrySampler::setFixedInterval(int ms) {
+    configure([ms](PollScheduler& scheduler, qint64 nowMs) {
+        scheduler.setFixedInterval(ms);
+        scheduler.reset(nowMs);
+    });
+}
+
+void TelemetrySampler::setThresholds(Group group, const QVector<double>& thresholds) {
+    configure([group, thresholds](PollScheduler& scheduler, qint64) {
+        scheduler.setThresholds(group, thresholds);
+    });
+}
+
+void TelemetrySampler::setActiveGroups(quint32 mask) {
+    configure([mask](PollScheduler& scheduler, qint64 nowMs) {
+        // Groups coming back from a pause are read straight away
+        const quint32 resumed = mask & ~scheduler.activeGroups();
+        scheduler.setActiveGroups(mask);
+        scheduler.expedite(resumed, nowMs);
+    });
+}
+
+void TelemetrySampler::requestPoll(quint32 groups) {
+    configure([groups](PollScheduler& scheduler, qint64 nowMs) {
+        scheduler.expedite(groups, nowMs);
+    });
+}
+
+void TelemetrySampler::wake() {
+    const quint64 one = 1;
+    if (::write(m_eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        qWarning() << "Failed to wake telemetry sampler:" << strerror(errno);
+    }
+}
+
+void TelemetrySampler::start() {
+    if (isRunning()) {
+        return;
+    }
+    m_stopRequested = false;
+    m_startedMs = monotonicMs();
+    m_wakeups.store(0);
+    for (auto& reads : m_reads) {
+        reads.store(0);
+    }
+    m_scheduler.reset(m_startedMs);
+    m_thread = std::thread(&TelemetrySampler::run, this);
+}
+
+void TelemetrySampler::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+    wake();
+    m_thread.join();
+}
+
+TelemetrySample TelemetrySampler::latest() {
+    // Clear before loading so a sample published in between re-arms the
+    // notification instead of being lost
+    m_notifyPending.store(false);
+    return m_published.load();
+}
+
+double TelemetrySampler::wakeupsPerMinute() const {
+    const qint64 elapsed = monotonicMs() - m_startedMs;
+    return elapsed > 0 ? m_wakeups.load() * 60000.0 / elapsed : 0.0;
+}
+
+void TelemetrySampler::armTimer(qint64 deadlineMs) {
+    itimerspec spec = {};
+    if (deadlineMs >= 0) {
+        // An all-zero it_value disarms the timer, so never pass 0
+        deadlineMs = std::max<qint64>(deadlineMs, 1);
+        spec.it_value.tv_sec = deadlineMs / 1000;
+        spec.it_value.tv_nsec = (deadlineMs % 1000) * 1000000;
+    }
+    ::timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+double TelemetrySampler::groupValue(const TelemetrySample& sample, Group group) {
+    switch (group) {
+        case PollScheduler::Temperature:
+            return std::max(sample.cpuTemperature, sample.gpuTemperature);
+        case PollScheduler::Battery:
+            return sample.batteryLevel;
+        case PollScheduler::Power:
+            return sample.batteryPower;
+        case PollScheduler::Fan:
+            return sample.fanRpm;
+        case PollScheduler::Gpu:
+            return sample.gpuBusy;
+        case PollScheduler::GroupCount:
+            break;
+    }
+    return 0.0;
+}
+
+void TelemetrySampler::run() {
+    TelemetrySample sample = m_published.load();
+    std::vector<std::function<void(PollScheduler&, qint64)>> commands;
+
+    pollfd fds[2] = {
+        {m_timerFd, POLLIN, 0},
+        {m_eventFd, POLLIN, 0}
+    };
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopRequested) {
+                break;
+            }
+            if (m_sensorsChanged) {
+                m_sensors = m_pendingSensors;
+                m_sensorsChanged = false;
+                for (int i = 0; i < SensorRegistry::SensorCount; ++i) {
+                    if (m_attributes[i] && m_attributes[i]->path() != m_sensors[i].path) {
+                        m_attributes[i].reset();
+                    }
+                }
+            }
+            commands.swap(m_commands);
+        }
+
+        const qint64 now = monotonicMs();
+        for (auto& command : commands) {
+            command(m_scheduler, now);
+        }
+        commands.clear();
+
+        const quint32 groups = m_scheduler.due(now);
+        if (groups) {
+            sample.timestampMs = now;
+            if (m_source) {
+                m_source(sample, groups);
+            } else {
+                readSysfs(sample, groups);
+            }
+
+            for (int g = 0; g < PollScheduler::GroupCount; ++g) {
+                const auto group = static_cast<Group>(g);
+                if (groups & PollScheduler::groupBit(group)) {
+                    m_scheduler.update(group, now, groupValue(sample, group));
+                    m_reads[g].fetch_add(1);
+                }
+            }
+
+            m_published.store(sample);
+            if (!m_notifyPending.exchange(true)) {
+                emit sampleAvailable();
+            }
+        }
+
+        armTimer(m_scheduler.nextDeadline());
+
+        int ready;
+        do {
+            ready = ::poll(fds, 2, -1);
+        } while (ready < 0 && errno == EINTR);
+        m_wakeups.fetch_add(1);
+
+        quint64 counter;
+        if (fds[0].revents & POLLIN) {
+            (void)!::read(m_timerFd, &counter, sizeof(counter));
+        }
+        if (fds[1].revents & POLLIN) {
+            (void)!::read(m_eventFd, &counter, sizeof(counter));
+        }
+    }
+}
+
+SysfsAttribute* TelemetrySampler::attribute(SensorRegistry::Sensor sensor) {
+    const int index = static_cast<int>(sensor);
+    if (!m_sensors[index].isValid()) {
+        return nullptr;
+    }
+    if (!m_attributes[index]) {
+        m_attributes[index] = std::make_unique<SysfsAttribute>(m_sensors[index].path);
+    }
+    return m_attributes[index].get();
+}
+
+bool TelemetrySampler::readSensor(SensorRegistry::Sensor sensor, double& value) {
+    SysfsAttribute* attr = attribute(sensor);
+    qint64 raw;
+    if (!attr || !attr->readInt(raw)) {
+        return false;
+    }
+    value = raw * m_sensors[static_cast<int>(sensor)].scale;
+    return true;
+}
+
+void TelemetrySampler::readSysfs(TelemetrySample& sample, quint32 groups) {
+    using Sensor = SensorRegistry::Sensor;
+    double value;
+
+    if (groups & PollScheduler::groupBit(PollScheduler::Temperature)) {
+        if (readSensor(Sensor::CpuTemperature, value)) {
+            sample.cpuTemperature = static_cast<float>(value);
+        }
+        if (readSensor(Sensor::GpuTemperature, value)) {
+            sample.gpuTemperature = static_cast<float>(value);
+        }
+    }
+
+    if (groups & PollScheduler::groupBit(PollScheduler::Fan)) {
+        if (readSensor(Sensor::FanRpm, value)) {
+            sample.fanRpm = static_cast<int>(value);
+        }
+    }
+
+    if (groups & PollScheduler::groupBit(PollScheduler::Gpu)) {
+        if (readSensor(Sensor::GpuBusy, value)) {
+            sample.gpuBusy = static_cast<int>(value);
+        }
+        if (SysfsAttribute* attr = attribute(Sensor::GpuClock)) {
+            char table[512];
+            if (attr->read(table, sizeof(table)) > 0) {
+                const int mhz = GpuDpmTable::parseCurrentMhz(table);
+                if (mhz > 0) {
+                    sample.gpuClock = mhz;
+                }
+            }
+        }
+    }
+
+    if (groups & PollScheduler::groupBit(PollScheduler::Power)) {
+        double current;
+        double voltage;
+        if (readSensor(Sensor::BatteryPowerNow, value)) {
+            sample.batteryPower = static_cast<float>(value);
+        } else if (readSensor(Sensor::BatteryCurrentNow, current)
+                   && readSensor(Sensor::BatteryVoltageNow, voltage)) {
+            sample.batteryPower = static_cast<float>(current * voltage);
+        }
+        if (readSensor(Sensor::BatteryEnergyNow, value)) {
+            sample.batteryEnergy = static_cast<float>(value);
+        }
+    }
+
+    if (groups & PollScheduler::groupBit(PollScheduler::Battery)) {
+        if (readSensor(Sensor::BatteryCapacity, value)) {
+            sample.batteryLevel = static_cast<int>(value);
+        }
+        if (readSensor(Sensor::AcOnline, value)) {
+            sample.acOnline = value != 0.0;
+        }
+
+        if (SysfsAttribute* attr = attribute(Sensor::BatteryStatus)) {
+            char status[32];
+            if (attr->read(status, sizeof(status)) > 0) {
+                sample.charging = std::strstr(status, "Charging") != nullptr;
+            }
+        }
+    }
+}
+
+TelemetrySampler::~TelemetrySampler() {
+    stop();
+    if (m_timerFd >= 0) {
+        ::close(m_timerFd);
+    }
+    if (m_eventFd >= 0) {
+        ::close(m_eventFd);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QObject>
+#include <QVector>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "PollScheduler.hpp"
+#include "SensorRegistry.hpp"
+#include "SeqLock.hpp"
+#include "SysfsAttribute.hpp"
+#include "TelemetrySample.hpp"
+
+// Reads sensors on a dedicated thread so slow EC-backed sysfs attributes
+// never block the GUI thread. Samples are published through a seqlock;
+// sampleAvailable() is coalesced so at most one notification is queued
+// no matter how far behind the consumer is.
+//
+// Polling is driven by a PollScheduler: each sensor group is read only
+// when it is due, and all due groups share a single timerfd wakeup.
+class TelemetrySampler : public QObject {
+    Q_OBJECT
+
+public:
+    using SensorTable = std::array<SensorRegistry::SensorHandle, SensorRegistry::SensorCount>;
+    using Group = PollScheduler::Group;
+    using Source = std::function<void(TelemetrySample& sample, quint32 groups)>;
+
+    explicit TelemetrySampler(QObject* parent = nullptr);
+    ~TelemetrySampler();
+
+    // Sensor paths used by the default sysfs source; picked up on the
+    // next wakeup when called while running
+    void setSensors(const SensorTable& sensors);
+
+    // Replace the sysfs source, e.g. with a fake in tests. Must be
+    // called before start().
+    void setSource(Source source);
+
+    // Scheduler settings; applied on the sampler thread at its next wakeup
+    void setFixedInterval(int ms);
+    void setThresholds(Group group, const QVector<double>& thresholds);
+    void setActiveGroups(quint32 mask);
+    void requestPoll(quint32 groups);
+
+    void start();
+    void stop();
+    bool isRunning() const { return m_thread.joinable(); }
+
+    // Latest published sample; lock-free, callable from any thread
+    TelemetrySample latest();
+    quint64 version() const { return m_published.version(); }
+
+    // Wakeup and read counters since start()
+    quint64 wakeups() const { return m_wakeups.load(); }
+    quint64 reads(Group group) const { return m_reads[group].load(); }
+    double wakeupsPerMinute() const;
+
+signals:
+    void sampleAvailable();
+
+private:
+    void run();
+    void configure(std::function<void(PollScheduler&, qint64 nowMs)> command);
+    void wake();
+    void armTimer(qint64 deadlineMs);
+    void readSysfs(TelemetrySample& sample, quint32 groups);
+    bool readSensor(SensorRegistry::Sensor sensor, double& value);
+    SysfsAttribute* attribute(SensorRegistry::Sensor sensor);
+    static double groupValue(const TelemetrySample& sample, Group group);
+    static qint64 monotonicMs();
+
+    std::thread m_thread;
+    int m_timerFd;
+    int m_eventFd;
+    std::atomic<bool> m_notifyPending;
+    std::atomic<quint64> m_wakeups;
+    std::array<std::atomic<quint64>, PollScheduler::GroupCount> m_reads;
+    qint64 m_startedMs;
+
+    Source m_source;
+    SeqLock<TelemetrySample> m_published;
+
+    // Handed over from the GUI thread under m_mutex
+    std::mutex m_mutex;
+    bool m_stopRequested;
+    SensorTable m_pendingSensors;
+    bool m_sensorsChanged;
+    std::vector<std::function<void(PollScheduler&, qint64)>> m_commands;
+
+    // Owned by the sampler thread
+    PollScheduler m_scheduler;
+    SensorTable m_sensors;
+    std::array<std::unique_ptr<SysfsAttribute>, SensorRegistry::SensorCount> m_attributes;
+};
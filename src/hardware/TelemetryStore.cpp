@@ -0,0 +1,245 @@
+#include "TelemetryStore.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+constexpr quint32 STORE_MAGIC = 0x414c5453;  // "ALTS"
+constexpr quint32 STORE_VERSION = 1;
+}
+
+TelemetryStore::TelemetryStore()
+    : m_heap(std::make_unique<Storage>())
+    , m_storage(m_heap.get())
+    , m_mappedSize(0) {
+    initialize();
+}
+
+void TelemetryStore::initialize() {
+    std::memset(static_cast<void*>(m_storage), 0, sizeof(Storage));
+    m_storage->magic = STORE_MAGIC;
+    m_storage->version = STORE_VERSION;
+    m_storage->size = sizeof(Storage);
+    for (TierState& tier : m_storage->tiers) {
+        tier.openBucket = -1;
+    }
+}
+
+void TelemetryStore::clear() {
+    initialize();
+}
+
+bool TelemetryStore::openFile(const QString& path) {
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        qWarning() << "Failed to open telemetry history" << path;
+        return false;
+    }
+
+    if (::ftruncate(fd, sizeof(Storage)) != 0) {
+        qWarning() << "Failed to size telemetry history" << path;
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = ::mmap(nullptr, sizeof(Storage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        qWarning() << "Failed to map telemetry history" << path;
+        return false;
+    }
+
+    closeFile();
+    m_storage = static_cast<Storage*>(mapped);
+    m_mappedSize = sizeof(Storage);
+    m_heap.reset();
+
+    // A new file, or one written by a different layout, starts empty
+    if (m_storage->magic != STORE_MAGIC || m_storage->version != STORE_VERSION
+        || m_storage->size != sizeof(Storage)) {
+        initialize();
+    }
+    return true;
+}
+
+void TelemetryStore::closeFile() {
+    if (m_mappedSize > 0) {
+        ::munmap(m_storage, m_mappedSize);
+        m_mappedSize = 0;
+        m_storage = nullptr;
+    }
+}
+
+void TelemetryStore::append(qint64 timestampMs, const Values& values) {
+    for (int t = 0; t < TierCount; ++t) {
+        TierState& tier = m_storage->tiers[t];
+        const qint64 bucket = timestampMs / TierPeriodMs[t];
+
+        if (bucket != tier.openBucket) {
+            if (tier.openCount > 0 && bucket < tier.openBucket) {
+                continue;  // Clock went backwards; drop rather than reorder
+            }
+            flush(static_cast<Tier>(t));
+            tier.openBucket = bucket;
+        }
+
+        if (tier.openCount == 0) {
+            tier.openMin = values;
+            tier.openMax = values;
+            tier.openSum.fill(0.0);
+        }
+        for (int c = 0; c < ChannelCount; ++c) {
+            tier.openMin[c] = std::min(tier.openMin[c], values[c]);
+            tier.openMax[c] = std::max(tier.openMax[c], values[c]);
+            tier.openSum[c] += values[c];
+        }
+        ++tier.openCount;
+    }
+}
+
+void TelemetryStore::flush(Tier t) {
+    TierState& tier = m_storage->tiers[t];
+    if (tier.openCount == 0) {
+        return;
+    }
+
+    const int slot = TierOffset[t] + tier.head;
+    m_storage->timestamps[slot] = tier.openBucket * TierPeriodMs[t];
+    m_storage->samples[slot] = tier.openCount;
+    for (int c = 0; c < ChannelCount; ++c) {
+        m_storage->minimum[c][slot] = tier.openMin[c];
+        m_storage->maximum[c][slot] = tier.openMax[c];
+        m_storage->average[c][slot] = static_cast<float>(tier.openSum[c] / tier.openCount);
+    }
+
+    tier.head = (tier.head + 1) % TierCapacity[t];
+    tier.count = std::min(tier.count + 1, TierCapacity[t]);
+    tier.openCount = 0;
+}
+
+int TelemetryStore::slotFor(Tier t, int index) const {
+    const TierState& tier = m_storage->tiers[t];
+    const int oldest = (tier.head - tier.count + TierCapacity[t]) % TierCapacity[t];
+    return TierOffset[t] + (oldest + index) % TierCapacity[t];
+}
+
+int TelemetryStore::size(Tier tier) const {
+    const TierState& state = m_storage->tiers[tier];
+    return state.count + (state.openCount > 0 ? 1 : 0);
+}
+
+int TelemetryStore::query(Tier t, Channel channel, qint64 fromMs, qint64 toMs,
+                          Point* out, int maxPoints) const {
+    const TierState& tier = m_storage->tiers[t];
+    const qint64 period = TierPeriodMs[t];
+
+    // Closed buckets are time-ordered, so binary search for the first one
+    // that ends after fromMs
+    int lo = 0;
+    int hi = tier.count;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (m_storage->timestamps[slotFor(t, mid)] + period <= fromMs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int written = 0;
+    for (int i = lo; i < tier.count && written < maxPoints; ++i) {
+        const int slot = slotFor(t, i);
+        const qint64 timestamp = m_storage->timestamps[slot];
+        if (timestamp > toMs) {
+            return written;
+        }
+        out[written++] = {timestamp,
+                          m_storage->minimum[channel][slot],
+                          m_storage->maximum[channel][slot],
+                          m_storage->average[channel][slot]};
+    }
+
+    if (tier.openCount > 0 && written < maxPoints) {
+        const qint64 timestamp = tier.openBucket * period;
+        if (timestamp <= toMs && timestamp + period > fromMs) {
+            out[written++] = {timestamp,
+                              tier.openMin[channel],
+                              tier.openMax[channel],
+                              static_cast<float>(tier.openSum[channel] / tier.openCount)};
+        }
+    }
+    return written;
+}
+
+QVector<TelemetryStore::Point> TelemetryStore::query(Tier tier, Channel channel,
+                                                     qint64 fromMs, qint64 toMs) const {
+    QVector<Point> points(size(tier));
+    points.resize(query(tier, channel, fromMs, toMs, points.data(), static_cast<int>(points.size())));
+    return points;
+}
+
+TelemetryStore::Tier TelemetryStore::tierFor(qint64 fromMs) const {
+    for (int t = 0; t < TierCount - 1; ++t) {
+        const TierState& tier = m_storage->tiers[t];
+        if (tier.count < TierCapacity[t] || m_storage->timestamps[slotFor(static_cast<Tier>(t), 0)] <= fromMs) {
+            return static_cast<Tier>(t);
+        }
+    }
+    return Minutes;
+}
+
+TelemetryStore::Point TelemetryStore::summarize(Channel channel, qint64 fromMs, qint64 toMs) const {
+    const Tier t = tierFor(fromMs);
+    const TierState& tier = m_storage->tiers[t];
+
+    Point result;
+    result.timestampMs = fromMs;
+    result.min = std::numeric_limits<float>::max();
+    result.max = std::numeric_limits<float>::lowest();
+    double sum = 0.0;
+    qint64 samples = 0;
+
+    auto accumulate = [&](float min, float max, double total, int count) {
+        result.min = std::min(result.min, min);
+        result.max = std::max(result.max, max);
+        sum += total;
+        samples += count;
+    };
+
+    for (int i = 0; i < tier.count; ++i) {
+        const int slot = slotFor(t, i);
+        const qint64 timestamp = m_storage->timestamps[slot];
+        if (timestamp + TierPeriodMs[t] <= fromMs || timestamp > toMs) {
+            continue;
+        }
+        const int count = m_storage->samples[slot];
+        accumulate(m_storage->minimum[channel][slot], m_storage->maximum[channel][slot],
+                   double(m_storage->average[channel][slot]) * count, count);
+    }
+    if (tier.openCount > 0) {
+        const qint64 timestamp = tier.openBucket * TierPeriodMs[t];
+        if (timestamp <= toMs && timestamp + TierPeriodMs[t] > fromMs) {
+            accumulate(tier.openMin[channel], tier.openMax[channel],
+                       tier.openSum[channel], tier.openCount);
+        }
+    }
+
+    if (samples == 0) {
+        return Point();
+    }
+    result.avg = static_cast<float>(sum / samples);
+    return result;
+}
+
+TelemetryStore::~TelemetryStore() {
+    closeFile();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <array>
+#include <memory>
+
+// Fixed-size history of hardware telemetry for diagnosing throttling and
+// battery drain over a play session.
+//
+// Every appended sample is rolled up into three tiers (1 s, 10 s, 60 s
+// buckets) holding min/max/avg per channel. Each tier is a ring stored
+// column-wise, so memory never grows with session length. The store can
+// be backed by an mmap'd file so history survives a crash or relaunch.
+class TelemetryStore {
+public:
+    enum Channel {
+        Temperature,  // °C
+        FanSpeed,     // %
+        Tdp,          // W
+        GpuClock,     // MHz
+        Battery,      // %
+        PowerDraw,    // W
+        ChannelCount
+    };
+
+    enum Tier {
+        Seconds,      // 1 s buckets, last 15 minutes
+        TenSeconds,   // 10 s buckets, last 3 hours
+        Minutes,      // 60 s buckets, last 8 hours
+        TierCount
+    };
+
+    struct Point {
+        qint64 timestampMs = 0;  // Start of the bucket
+        float min = 0.0f;
+        float max = 0.0f;
+        float avg = 0.0f;
+    };
+
+    using Values = std::array<float, ChannelCount>;
+
+    static constexpr std::array<int, TierCount> TierCapacity = {900, 1080, 480};
+    static constexpr std::array<qint64, TierCount> TierPeriodMs = {1000, 10000, 60000};
+
+    TelemetryStore();
+    ~TelemetryStore();
+
+    TelemetryStore(const TelemetryStore&) = delete;
+    TelemetryStore& operator=(const TelemetryStore&) = delete;
+
+    // Switch to a file-backed store, keeping whatever history the file
+    // already holds. Falls back to memory if the file cannot be mapped.
+    bool openFile(const QString& path);
+    bool isFileBacked() const { return m_mappedSize > 0; }
+
+    // timestampMs is wall-clock time so history stays ordered across relaunches
+    void append(qint64 timestampMs, const Values& values);
+    void clear();
+
+    // Buckets overlapping [fromMs, toMs], oldest first, including the
+    // bucket still being filled
+    QVector<Point> query(Tier tier, Channel channel, qint64 fromMs, qint64 toMs) const;
+    int query(Tier tier, Channel channel, qint64 fromMs, qint64 toMs, Point* out, int maxPoints) const;
+
+    // Finest tier that still holds data back to fromMs
+    Tier tierFor(qint64 fromMs) const;
+
+    // Min/max/avg of a channel over a range, weighted by bucket sample count
+    Point summarize(Channel channel, qint64 fromMs, qint64 toMs) const;
+
+    int size(Tier tier) const;
+    static constexpr std::size_t storageBytes();
+
+private:
+    static constexpr int TotalSlots = TierCapacity[0] + TierCapacity[1] + TierCapacity[2];
+    static constexpr std::array<int, TierCount> TierOffset = {
+        0, TierCapacity[0], TierCapacity[0] + TierCapacity[1]
+    };
+
+    struct TierState {
+        qint64 openBucket;  // Bucket number being accumulated, -1 if none
+        qint32 head;        // Next slot to write
+        qint32 count;
+        qint32 openCount;
+        qint32 reserved;
+        std::array<float, ChannelCount> openMin;
+        std::array<float, ChannelCount> openMax;
+        std::array<double, ChannelCount> openSum;
+    };
+
+    // Plain-old-data layout shared by the heap and mmap backings
+    struct Storage {
+        quint32 magic;
+        quint32 version;
+        quint64 size;
+        std::array<TierState, TierCount> tiers;
+        std::array<qint32, TotalSlots> samples;
+        std::array<qint64, TotalSlots> timestamps;
+        std::array<std::array<float, TotalSlots>, ChannelCount> minimum;
+        std::array<std::array<float, TotalSlots>, ChannelCount> maximum;
+        std::array<std::array<float, TotalSlots>, ChannelCount> average;
+    };
+
+    void initialize();
+    void flush(Tier tier);
+    int slotFor(Tier tier, int index) const;  // index 0 = oldest
+    void closeFile();
+
+    std::unique_ptr<Storage> m_heap;
+    Storage* m_storage;
+    std::size_t m_mappedSize;
+};
+
+constexpr std::size_t TelemetryStore::storageBytes() {
+    return sizeof(Storage);
+}
@@ -1,6 +1,8 @@
 #include <QApplication>
 #include "ui/LauncherWindow.hpp"
+#include "ui/SupervisorMode.hpp"
 #include "core/Config.hpp"
+#include "game/GamescopeSupervisor.hpp"
 #include "steam/SteamIntegration.hpp"
 
 int main(int argc, char *argv[]) {
@@ -11,14 +13,19 @@ int main(int argc, char *argv[]) {
     
     // Initialize configuration
     Config::instance()->load("/etc/ally-mc-launcher/config/default_config.json");
+    Config::instance()->loadOverrides(Config::userConfigPath());
     
     // Initialize Steam integration
     if (!SteamIntegration::instance()->initialize()) {
         qWarning() << "Failed to initialize Steam integration";
     }
     
-    LauncherWindow window;
-    window.show();
+    // Torn down to a bare event loop for as long as the game runs
+    SupervisorMode supervisor([]() { return new LauncherWindow; });
+    if (Config::instance()->value("game").toMap().value("closeLauncherWhileRunning", true).toBool()) {
+        supervisor.follow(GamescopeSupervisor::instance());
+    }
+    supervisor.showLauncher();
     
     return app.exec();
 }
\ No newline at end of file
@@ -0,0 +1,795 @@
+#include "DownloadManager.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int StateVersion = 1;
+constexpr int TickMs = 50;
+constexpr int SaveIntervalMs = 1000;
+constexpr qint64 ReadBufferSize = 256 * 1024;
+constexpr qint64 HashChunkSize = 256 * 1024;
+constexpr qint64 MaxRetryDelayMs = 30000;
+
+constexpr int DefaultMaxActiveJobs = 2;
+constexpr int DefaultSegmentCount = 3;
+constexpr qint64 DefaultMinSegmentSize = 4 * 1024 * 1024;
+constexpr int DefaultMaxRetries = 8;
+constexpr int DefaultRetryDelayMs = 500;
+constexpr int DefaultStallTimeoutMs = 20000;
+
+// The map must never claim bytes that are not on disk yet
+bool writeState(int fd, const QString& path, const QByteArray& state) {
+    if (::fdatasync(fd) != 0) {
+        return false;
+    }
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(state);
+    return file.commit();
+}
+
+QNetworkRequest makeRequest(const QUrl& url) {
+    QNetworkRequest request(url);
+    // Ranges count bytes as sent; asking for identity also stops Qt from
+    // requesting gzip and inflating it behind our back
+    request.setRawHeader("Accept-Encoding", "identity");
+    return request;
+}
+
+qint64 backoff(int baseMs, int failures) {
+    return std::min<qint64>(qint64(baseMs) << std::min(failures - 1, 16), MaxRetryDelayMs);
+}
+
+// Higher priority first, then in the order queued
+template <typename Job>
+bool runsBefore(const Job* a, const Job* b) {
+    if (a->request.priority != b->request.priority) {
+        return a->request.priority > b->request.priority;
+    }
+    return a->order < b->order;
+}
+
+} // namespace
+
+DownloadManager::DownloadManager(QObject* parent)
+    : QObject(parent)
+    , m_lastRefill(0)
+    , m_tokens(0)
+    , m_nextId(1)
+    , m_nextOrder(0)
+    , m_suspended(false)
+    , m_reapPending(false)
+    , m_maxActiveJobs(DefaultMaxActiveJobs)
+    , m_segmentCount(DefaultSegmentCount)
+    , m_minSegmentSize(DefaultMinSegmentSize)
+    , m_bandwidthLimit(0)
+    , m_gameBandwidthLimit(0)
+    , m_gameRunning(false)
+    , m_maxRetries(DefaultMaxRetries)
+    , m_retryDelayMs(DefaultRetryDelayMs)
+    , m_stallTimeoutMs(DefaultStallTimeoutMs) {
+    // One writer keeps a job's maps in the order they were taken
+    m_stateWriter.setMaxThreadCount(1);
+    m_clock.start();
+    m_timer.setInterval(TickMs);
+    connect(&m_timer, &QTimer::timeout, this, &DownloadManager::tick);
+}
+
+int DownloadManager::enqueue(const Request& request) {
+    auto job = std::make_unique<Job>();
+    job->id = m_nextId++;
+    job->order = m_nextOrder++;
+    job->request = request;
+    const int id = job->id;
+    m_jobs.push_back(std::move(job));
+    schedule();
+    return id;
+}
+
+void DownloadManager::cancel(int id) {
+    Job* job = findJob(id);
+    if (!job || job->done) {
+        return;
+    }
+    finish(*job, false, "Cancelled");
+    QFile::remove(partPath(*job));
+    QFile::remove(statePath(*job));
+}
+
+void DownloadManager::suspend() {
+    m_suspended = true;
+    for (const auto& job : m_jobs) {
+        if (job->running && !job->done) {
+            pauseJob(*job);
+        }
+    }
+    m_timer.stop();
+}
+
+void DownloadManager::resume() {
+    m_suspended = false;
+    schedule();
+}
+
+void DownloadManager::setMaxActiveJobs(int count) {
+    m_maxActiveJobs = std::max(1, count);
+    schedule();
+}
+
+bool DownloadManager::isActive(int id) const {
+    const Job* job = findJob(id);
+    return job && job->running;
+}
+
+DownloadManager::Job* DownloadManager::findJob(int id) const {
+    for (const auto& job : m_jobs) {
+        if (job->id == id) {
+            return job.get();
+        }
+    }
+    return nullptr;
+}
+
+DownloadManager::Job* DownloadManager::jobForReply(QNetworkReply* reply, int* segment) const {
+    for (const auto& job : m_jobs) {
+        for (int i = 0; i < job->segments.size(); ++i) {
+            if (job->segments[i].reply == reply) {
+                *segment = i;
+                return job.get();
+            }
+        }
+    }
+    return nullptr;
+}
+
+void DownloadManager::schedule() {
+    if (m_suspended) {
+        return;
+    }
+
+    std::vector<Job*> queue;
+    for (const auto& job : m_jobs) {
+        if (!job->done) {
+            queue.push_back(job.get());
+        }
+    }
+    std::sort(queue.begin(), queue.end(), runsBefore<Job>);
+
+    // Pause first, so the connections are free before new ones open
+    const size_t slots = std::min(queue.size(), size_t(m_maxActiveJobs));
+    for (size_t i = slots; i < queue.size(); ++i) {
+        if (queue[i]->running) {
+            pauseJob(*queue[i]);
+        }
+    }
+    for (size_t i = 0; i < slots; ++i) {
+        if (!queue[i]->running && !queue[i]->done) {
+            startJob(*queue[i]);
+        }
+    }
+
+    const bool active = std::any_of(queue.begin(), queue.end(), [](const Job* job) {
+        return job->running;
+    });
+    if (active && !m_timer.isActive()) {
+        m_lastRefill = m_clock.elapsed();
+        m_tokens = bandwidthLimit() * TickMs / 1000;
+        m_timer.start();
+    } else if (!active) {
+        m_timer.stop();
+    }
+}
+
+void DownloadManager::startJob(Job& job) {
+    job.running = true;
+    if (job.segments.isEmpty()) {
+        if (!loadState(job)) {
+            sendProbe(job);
+            return;
+        }
+    }
+    if (!job.file.isOpen() && !openPartFile(job, false)) {
+        return;
+    }
+    // Only does work after a restart, when the prefix is on disk already
+    advanceHash(job);
+    startSegments(job);
+}
+
+void DownloadManager::pauseJob(Job& job) {
+    detach(job.probe);
+    for (Segment& segment : job.segments) {
+        detach(segment.reply);
+        segment.retryAt = 0;
+    }
+    saveState(job);
+    job.running = false;
+}
+
+void DownloadManager::sendProbe(Job& job) {
+    job.probeRetryAt = 0;
+    QNetworkReply* reply = m_network.head(makeRequest(job.request.url));
+    job.probe = reply;
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        onProbeFinished(reply);
+    });
+}
+
+void DownloadManager::onProbeFinished(QNetworkReply* reply) {
+    reply->deleteLater();
+    Job* job = nullptr;
+    for (const auto& candidate : m_jobs) {
+        if (candidate->probe == reply) {
+            job = candidate.get();
+        }
+    }
+    if (!job) {
+        return;
+    }
+    job->probe = nullptr;
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    // Some servers refuse HEAD; the file is then fetched in one piece
+    const bool noHead = status == 405 || status == 501;
+    if (!noHead && (reply->error() != QNetworkReply::NoError || status != 200)) {
+        if (status >= 400 && status < 500 && status != 408 && status != 429) {
+            finish(*job, false, reply->errorString());
+        } else if (++job->probeFailures > m_maxRetries) {
+            finish(*job, false, reply->errorString());
+        } else {
+            job->probeRetryAt = m_clock.elapsed() + backoff(m_retryDelayMs, job->probeFailures);
+        }
+        return;
+    }
+    job->probeFailures = 0;
+
+    const QVariant length = reply->header(QNetworkRequest::ContentLengthHeader);
+    job->size = !noHead && length.isValid() ? length.toLongLong() : -1;
+    // If-Range needs a strong validator
+    job->validator = reply->rawHeader("ETag");
+    if (job->validator.isEmpty() || job->validator.startsWith("W/")) {
+        job->validator = reply->rawHeader("Last-Modified");
+    }
+    // A server that ignored ranges twice gets one plain request
+    job->ranges = !noHead && job->size > 0 && reply->rawHeader("Accept-Ranges").contains("bytes")
+        && job->restarts < 2;
+
+    job->segments.clear();
+    if (job->ranges) {
+        const int count = int(std::clamp<qint64>(job->size / std::max<qint64>(m_minSegmentSize, 1),
+                                                 1, std::max(1, m_segmentCount)));
+        const qint64 step = job->size / count;
+        for (int i = 0; i < count; ++i) {
+            Segment segment;
+            segment.start = i * step;
+            segment.end = i == count - 1 ? job->size : (i + 1) * step;
+            job->segments.append(segment);
+        }
+    } else {
+        Segment segment;
+        segment.end = job->size;
+        job->segments.append(segment);
+    }
+    job->hash.reset();
+    job->hashed = 0;
+
+    if (!openPartFile(*job, true)) {
+        return;
+    }
+    saveStateLater(*job);
+    startSegments(*job);
+}
+
+bool DownloadManager::openPartFile(Job& job, bool truncate) {
+    job.file.close();
+    job.file.setFileName(partPath(job));
+    QDir().mkpath(QFileInfo(job.file.fileName()).absolutePath());
+    QIODevice::OpenMode mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+    if (truncate) {
+        mode |= QIODevice::Truncate;
+    }
+    if (!job.file.open(mode) || (truncate && job.size > 0 && !job.file.resize(job.size))) {
+        finish(job, false, "Cannot write " + job.file.fileName());
+        return false;
+    }
+    return true;
+}
+
+void DownloadManager::startSegments(Job& job) {
+    if (std::all_of(job.segments.begin(), job.segments.end(), [](const Segment& segment) {
+            return segment.isDone();
+        })) {
+        complete(job);
+        return;
+    }
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < job.segments.size(); ++i) {
+        const Segment& segment = job.segments[i];
+        if (!segment.reply && !segment.isDone() && segment.retryAt <= now) {
+            requestSegment(job, i);
+        }
+    }
+}
+
+void DownloadManager::requestSegment(Job& job, int index) {
+    Segment& segment = job.segments[index];
+    QNetworkRequest request = makeRequest(job.request.url);
+    if (job.ranges) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(segment.position()) + "-"
+                                          + QByteArray::number(segment.end - 1));
+        if (!job.validator.isEmpty()) {
+            request.setRawHeader("If-Range", job.validator);
+        }
+    } else if (segment.received > 0) {
+        // Without ranges the only way to continue is from the start
+        segment.received = 0;
+        job.hash.reset();
+        job.hashed = 0;
+    }
+
+    segment.accepted = false;
+    segment.retryAt = 0;
+    segment.attemptReceived = segment.received;
+    segment.lastDataAt = m_clock.elapsed();
+    QNetworkReply* reply = m_network.get(request);
+    // Unread data stays in the socket, so the bandwidth cap reaches TCP
+    reply->setReadBufferSize(ReadBufferSize);
+    segment.reply = reply;
+    connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+        onMetaData(reply);
+    });
+    connect(reply, &QNetworkReply::readyRead, this, &DownloadManager::pump);
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        int index = -1;
+        if (Job* job = jobForReply(reply, &index)) {
+            settle(*job, index);
+        }
+    });
+}
+
+void DownloadManager::onMetaData(QNetworkReply* reply) {
+    int index = -1;
+    Job* job = jobForReply(reply, &index);
+    if (!job || job->segments[index].accepted) {
+        return;
+    }
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 0 || (status >= 300 && status < 400)) {
+        return;  // Redirect being followed
+    }
+    if (job->ranges && status == 200) {
+        // If-Range did not match: the file on the server is no longer the
+        // one the segments were cut from
+        qWarning() << "Download" << job->request.url.toString() << "changed on the server; restarting";
+        restart(*job);
+        return;
+    }
+    if (status >= 400 && status < 500 && status != 408 && status != 429) {
+        finish(*job, false, QString("HTTP %1 for %2").arg(status).arg(job->request.url.toString()));
+        return;
+    }
+    if (status != (job->ranges ? 206 : 200)) {
+        // An error page is not part of the file
+        segmentFailed(*job, index, QString("HTTP %1").arg(status));
+        return;
+    }
+    job->segments[index].accepted = true;
+}
+
+void DownloadManager::pump() {
+    std::vector<Job*> jobs;
+    for (const auto& job : m_jobs) {
+        if (job->running && !job->done) {
+            jobs.push_back(job.get());
+        }
+    }
+    // Under a cap, higher priorities are served first
+    std::sort(jobs.begin(), jobs.end(), runsBefore<Job>);
+
+    const qint64 limit = bandwidthLimit();
+    for (Job* job : jobs) {
+        bool moved = false;
+        for (int i = 0; i < job->segments.size() && !job->done; ++i) {
+            Segment& segment = job->segments[i];
+            QNetworkReply* reply = segment.reply;
+            if (!reply || !segment.accepted) {
+                continue;
+            }
+
+            qint64 available = reply->bytesAvailable();
+            if (segment.end >= 0) {
+                // Less than was asked for if the segment has since been split
+                available = std::min(available, segment.end - segment.position());
+            }
+            if (limit > 0) {
+                available = std::min(available, m_tokens);
+            }
+            if (available > 0) {
+                const QByteArray data = reply->read(available);
+                const qint64 position = segment.position();
+                if (!job->file.seek(position) || job->file.write(data) != data.size()) {
+                    finish(*job, false, "Failed to write " + partPath(*job));
+                    break;
+                }
+                segment.received += data.size();
+                segment.lastDataAt = m_clock.elapsed();
+                if (limit > 0) {
+                    m_tokens -= data.size();
+                }
+                if (position == job->hashed) {
+                    job->hash.addData(data);
+                    job->hashed += data.size();
+                }
+                moved = true;
+            }
+            if (segment.isDone() || reply->isFinished()) {
+                settle(*job, i);
+            }
+        }
+        if (moved && !job->done) {
+            advanceHash(*job);
+            emit progress(job->id, receivedBytes(*job), job->size);
+        }
+    }
+}
+
+void DownloadManager::settle(Job& job, int index) {
+    Segment& segment = job.segments[index];
+    QNetworkReply* reply = segment.reply;
+    if (!reply) {
+        return;
+    }
+
+    if (segment.isDone()) {
+        // The connection may still be carrying bytes that now belong to a
+        // segment split off this one
+        detach(segment.reply);
+    } else if (!reply->isFinished() || (segment.accepted && reply->bytesAvailable() > 0)) {
+        return;
+    } else if (reply->error() != QNetworkReply::NoError || !segment.accepted) {
+        segmentFailed(job, index, reply->errorString());
+        return;
+    } else if (segment.end < 0) {
+        // The length was not known until the server closed the connection
+        segment.end = segment.position();
+        job.size = segment.end;
+        detach(segment.reply);
+    } else {
+        segmentFailed(job, index, "Connection closed early");
+        return;
+    }
+
+    segment.failures = 0;
+    splitLargest(job);
+    startSegments(job);
+}
+
+void DownloadManager::segmentFailed(Job& job, int index, const QString& error) {
+    Segment& segment = job.segments[index];
+    detach(segment.reply);
+    // A connection that delivered something before it dropped is the
+    // flaky network this is meant to ride out; only dead ones count
+    segment.failures = segment.received > segment.attemptReceived ? 1 : segment.failures + 1;
+    if (segment.failures > m_maxRetries) {
+        finish(job, false, error);
+        return;
+    }
+    segment.retryAt = m_clock.elapsed() + backoff(m_retryDelayMs, segment.failures);
+    saveStateLater(job);
+}
+
+void DownloadManager::detach(QNetworkReply*& reply) {
+    if (!reply) {
+        return;
+    }
+    QNetworkReply* detached = reply;
+    reply = nullptr;
+    disconnect(detached, nullptr, this, nullptr);
+    detached->abort();
+    detached->deleteLater();
+}
+
+void DownloadManager::splitLargest(Job& job) {
+    if (!job.ranges) {
+        return;
+    }
+
+    int open = 0;
+    int largest = -1;
+    qint64 remaining = 0;
+    for (int i = 0; i < job.segments.size(); ++i) {
+        const Segment& segment = job.segments[i];
+        if (segment.isDone()) {
+            continue;
+        }
+        ++open;
+        if (segment.end - segment.position() > remaining) {
+            largest = i;
+            remaining = segment.end - segment.position();
+        }
+    }
+    // Halves smaller than a segment are not worth a new connection
+    if (largest < 0 || open >= m_segmentCount || remaining < m_minSegmentSize) {
+        return;
+    }
+
+    Segment tail;
+    tail.start = job.segments[largest].position() + remaining / 2;
+    tail.end = job.segments[largest].end;
+    job.segments[largest].end = tail.start;
+    job.segments.append(tail);
+}
+
+void DownloadManager::advanceHash(Job& job) {
+    QByteArray buffer;
+    for (;;) {
+        const Segment* next = nullptr;
+        for (const Segment& segment : job.segments) {
+            if (segment.start <= job.hashed && (segment.end < 0 || job.hashed < segment.end)) {
+                next = &segment;
+                break;
+            }
+        }
+        if (!next || next->position() <= job.hashed) {
+            return;
+        }
+
+        // Written moments ago, so this comes from the page cache
+        const qint64 length = std::min(next->position() - job.hashed, HashChunkSize);
+        buffer.resize(length);
+        const ssize_t count = ::pread(job.file.handle(), buffer.data(), size_t(length), off_t(job.hashed));
+        if (count <= 0) {
+            return;
+        }
+        job.hash.addData(QByteArrayView(buffer.constData(), count));
+        job.hashed += count;
+    }
+}
+
+void DownloadManager::restart(Job& job) {
+    for (Segment& segment : job.segments) {
+        detach(segment.reply);
+    }
+    job.segments.clear();
+    job.size = -1;
+    job.validator.clear();
+    job.hash.reset();
+    job.hashed = 0;
+    ++job.restarts;
+    m_stateWriter.waitForDone();
+    QFile::remove(statePath(job));
+    sendProbe(job);
+}
+
+void DownloadManager::complete(Job& job) {
+    advanceHash(job);
+    if (job.hashed != job.size) {
+        finish(job, false, "Incomplete download of " + job.request.url.toString());
+        return;
+    }
+
+    const QByteArray digest = job.hash.result().toHex();
+    if (!job.request.sha256.isEmpty() && digest != job.request.sha256.toLower()) {
+        qWarning() << "Checksum mismatch for" << job.request.url.toString() << "- got" << digest;
+        job.file.close();
+        m_stateWriter.waitForDone();
+        QFile::remove(partPath(job));
+        QFile::remove(statePath(job));
+        finish(job, false, "SHA-256 mismatch");
+        return;
+    }
+
+    ::fdatasync(job.file.handle());
+    job.file.close();
+    m_stateWriter.waitForDone();
+    if (std::rename(QFile::encodeName(partPath(job)).constData(),
+                    QFile::encodeName(job.request.destination).constData()) != 0) {
+        finish(job, false, "Cannot move the download to " + job.request.destination);
+        return;
+    }
+    QFile::remove(statePath(job));
+    finish(job, true, QString());
+}
+
+void DownloadManager::finish(Job& job, bool ok, const QString& error) {
+    if (job.done) {
+        return;
+    }
+    detach(job.probe);
+    for (Segment& segment : job.segments) {
+        detach(segment.reply);
+    }
+    // What a failed job got is kept; queueing it again resumes
+    if (!ok) {
+        saveState(job);
+        qWarning() << "Download of" << job.request.url.toString() << "failed:" << error;
+    }
+    job.file.close();
+    job.running = false;
+    job.done = true;
+    job.ok = ok;
+    job.error = error;
+
+    // Jobs are removed outside of the reply handlers that finish them
+    if (!m_reapPending) {
+        m_reapPending = true;
+        QMetaObject::invokeMethod(this, &DownloadManager::reap, Qt::QueuedConnection);
+    }
+}
+
+void DownloadManager::reap() {
+    m_reapPending = false;
+    std::vector<std::unique_ptr<Job>> done;
+    for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+        if ((*it)->done) {
+            done.push_back(std::move(*it));
+            it = m_jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    schedule();
+    for (const auto& job : done) {
+        emit finished(job->id, job->ok, job->error);
+    }
+}
+
+void DownloadManager::tick() {
+    const qint64 now = m_clock.elapsed();
+    const qint64 limit = bandwidthLimit();
+    if (limit > 0) {
+        // At most a quarter second's worth in one burst
+        m_tokens = std::min(m_tokens + limit * (now - m_lastRefill) / 1000, limit / 4);
+    }
+    m_lastRefill = now;
+    pump();
+
+    for (size_t j = 0; j < m_jobs.size(); ++j) {
+        Job& job = *m_jobs[j];
+        if (!job.running || job.done) {
+            continue;
+        }
+        if (job.segments.isEmpty()) {
+            if (!job.probe && job.probeRetryAt > 0 && now >= job.probeRetryAt) {
+                sendProbe(job);
+            }
+            continue;
+        }
+
+        for (int i = 0; i < job.segments.size() && !job.done; ++i) {
+            Segment& segment = job.segments[i];
+            if (!segment.reply) {
+                continue;
+            }
+            // Data held back by the bandwidth cap is not a stall
+            if (segment.reply->bytesAvailable() > 0) {
+                segment.lastDataAt = now;
+            } else if (now - segment.lastDataAt > m_stallTimeoutMs) {
+                segmentFailed(job, i, "Connection stalled");
+            }
+        }
+        if (!job.done) {
+            startSegments(job);
+        }
+        if (!job.done && now - job.savedAt >= SaveIntervalMs) {
+            saveStateLater(job);
+        }
+    }
+}
+
+qint64 DownloadManager::receivedBytes(const Job& job) const {
+    qint64 received = 0;
+    for (const Segment& segment : job.segments) {
+        received += segment.received;
+    }
+    return received;
+}
+
+QByteArray DownloadManager::stateData(const Job& job) const {
+    QJsonArray segments;
+    for (const Segment& segment : job.segments) {
+        segments.append(QJsonArray{segment.start, segment.end, segment.received});
+    }
+    QJsonObject root;
+    root["version"] = StateVersion;
+    root["url"] = job.request.url.toString();
+    root["size"] = job.size;
+    root["validator"] = QString::fromUtf8(job.validator);
+    root["segments"] = segments;
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool DownloadManager::saveState(Job& job) {
+    job.savedAt = m_clock.elapsed();
+    // A map still queued must not land after this one
+    m_stateWriter.waitForDone();
+    // Only ranged downloads can continue where they stopped
+    if (!job.ranges || !job.file.isOpen()) {
+        return false;
+    }
+    return writeState(job.file.handle(), statePath(job), stateData(job));
+}
+
+void DownloadManager::saveStateLater(Job& job) {
+    job.savedAt = m_clock.elapsed();
+    if (!job.ranges || !job.file.isOpen()) {
+        return;
+    }
+    // The writer gets its own descriptor, as the job may close the file
+    // or be gone by the time the sync returns
+    const int fd = ::fcntl(job.file.handle(), F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        return;
+    }
+    const QString path = statePath(job);
+    const QByteArray state = stateData(job);
+    m_stateWriter.start([fd, path, state]() {
+        if (!writeState(fd, path, state)) {
+            qWarning() << "Failed to save download progress to" << path;
+        }
+        ::close(fd);
+    });
+}
+
+bool DownloadManager::loadState(Job& job) {
+    QFile file(statePath(job));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    const qint64 size = root.value("size").toInteger(-1);
+    if (root.value("version").toInt() != StateVersion
+        || root.value("url").toString() != job.request.url.toString()
+        || size <= 0 || QFileInfo(partPath(job)).size() != size) {
+        return false;
+    }
+
+    QVector<Segment> segments;
+    for (const QJsonValue& value : root.value("segments").toArray()) {
+        const QJsonArray fields = value.toArray();
+        Segment segment;
+        segment.start = fields.at(0).toInteger();
+        segment.end = fields.at(1).toInteger();
+        segment.received = fields.at(2).toInteger();
+        if (segment.start < 0 || segment.end > size || segment.received < 0
+            || segment.position() > segment.end) {
+            return false;
+        }
+        segments.append(segment);
+    }
+    if (segments.isEmpty()) {
+        return false;
+    }
+
+    job.size = size;
+    job.validator = root.value("validator").toString().toUtf8();
+    job.ranges = true;
+    job.segments = segments;
+    job.hash.reset();
+    job.hashed = 0;
+    return true;
+}
+
+DownloadManager::~DownloadManager() {
+    // Progress is kept for the next run
+    for (const auto& job : m_jobs) {
+        if (job->running && !job->done) {
+            pauseJob(*job);
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+class QNetworkReply;
+
+// Downloads game builds and assets over HTTP, through sleep, flaky Wi-Fi
+// and restarts.
+//
+// When the server accepts range requests, a file is fetched as several
+// segments in parallel and written in place into "<destination>.part".
+// The segment map is saved beside it ("<destination>.part.json") after
+// the data it describes is on disk: every second by a writer thread, so
+// the sync never stalls the GUI, and before returning whenever transfers
+// stop. A later run resumes from it as long as the server's ETag still
+// matches (If-Range). A segment that fails or stalls is reconnected from
+// where it stopped. A segment that finishes takes over the second half
+// of the largest one left, so one slow connection does not hold up the
+// end of the download.
+//
+// The SHA-256 is computed as bytes arrive, in file order: data that
+// continues the hashed prefix is hashed straight from the network
+// buffer, data further ahead once the gap before it is filled, read back
+// from the page cache. Completion costs no extra pass over the file.
+//
+// Jobs run by priority, then in the order queued; a higher-priority job
+// takes the slot of a lower one, which pauses and resumes later.
+// Bandwidth can be capped, with a separate cap while a game runs.
+class DownloadManager : public QObject {
+    Q_OBJECT
+
+public:
+    struct Request {
+        QUrl url;
+        QString destination;
+        QByteArray sha256;  // Hex; empty skips verification
+        int priority = 0;   // Higher first
+    };
+
+    explicit DownloadManager(QObject* parent = nullptr);
+    ~DownloadManager();
+
+    // Returns the job id
+    int enqueue(const Request& request);
+    // Stop the job and delete what it downloaded
+    void cancel(int id);
+
+    // Stop every transfer and save its progress, e.g. before the system
+    // sleeps. Nothing starts again until resume().
+    void suspend();
+    void resume();
+    bool isSuspended() const { return m_suspended; }
+
+    void setMaxActiveJobs(int count);
+    void setSegmentCount(int count) { m_segmentCount = count; }
+    // Files smaller than two of these are fetched in one piece
+    void setMinSegmentSize(qint64 bytes) { m_minSegmentSize = bytes; }
+    // Bytes per second across all jobs, 0 for no limit
+    void setBandwidthLimit(qint64 bytesPerSecond) { m_bandwidthLimit = bytesPerSecond; }
+    void setGameBandwidthLimit(qint64 bytesPerSecond) { m_gameBandwidthLimit = bytesPerSecond; }
+    void setGameRunning(bool running) { m_gameRunning = running; }
+    qint64 bandwidthLimit() const { return m_gameRunning ? m_gameBandwidthLimit : m_bandwidthLimit; }
+    // Failures of one segment in a row, without progress, before the job fails
+    void setMaxRetries(int count) { m_maxRetries = count; }
+    // First retry delay; doubles with each failure in a row
+    void setRetryDelay(int ms) { m_retryDelayMs = ms; }
+    // A connection that delivers nothing for this long is replaced
+    void setStallTimeout(int ms) { m_stallTimeoutMs = ms; }
+
+    bool contains(int id) const { return findJob(id) != nullptr; }
+    bool isActive(int id) const;
+    int jobCount() const { return int(m_jobs.size()); }
+
+signals:
+    // total is -1 while the size is not known
+    void progress(int id, qint64 received, qint64 total);
+    void finished(int id, bool ok, const QString& error);
+
+private:
+    struct Segment {
+        qint64 start = 0;
+        qint64 end = -1;          // Exclusive; -1 while the size is unknown
+        qint64 received = 0;
+        QNetworkReply* reply = nullptr;
+        bool accepted = false;    // Response status checked
+        qint64 attemptReceived = 0;
+        int failures = 0;
+        qint64 retryAt = 0;
+        qint64 lastDataAt = 0;
+
+        qint64 position() const { return start + received; }
+        bool isDone() const { return end >= 0 && position() >= end; }
+    };
+
+    struct Job {
+        int id = 0;
+        quint64 order = 0;
+        Request request;
+        qint64 size = -1;
+        QByteArray validator;     // ETag, else Last-Modified
+        bool ranges = false;
+        bool running = false;
+        bool done = false;
+        bool ok = false;
+        QString error;
+        int restarts = 0;
+        int probeFailures = 0;
+        qint64 probeRetryAt = 0;
+        QNetworkReply* probe = nullptr;
+        QVector<Segment> segments;
+        QFile file;
+        QCryptographicHash hash{QCryptographicHash::Sha256};
+        qint64 hashed = 0;        // Length of the prefix fed to hash
+        qint64 savedAt = 0;
+    };
+
+    Job* findJob(int id) const;
+    Job* jobForReply(QNetworkReply* reply, int* segment) const;
+    void schedule();
+    void startJob(Job& job);
+    void pauseJob(Job& job);
+    void sendProbe(Job& job);
+    void onProbeFinished(QNetworkReply* reply);
+    bool openPartFile(Job& job, bool truncate);
+    void startSegments(Job& job);
+    void requestSegment(Job& job, int index);
+    void onMetaData(QNetworkReply* reply);
+    void pump();
+    void settle(Job& job, int index);
+    void segmentFailed(Job& job, int index, const QString& error);
+    void detach(QNetworkReply*& reply);
+    void splitLargest(Job& job);
+    void advanceHash(Job& job);
+    void restart(Job& job);
+    void complete(Job& job);
+    void finish(Job& job, bool ok, const QString& error);
+    void reap();
+    void tick();
+    qint64 receivedBytes(const Job& job) const;
+    QString partPath(const Job& job) const { return job.request.destination + ".part"; }
+    QString statePath(const Job& job) const { return job.request.destination + ".part.json"; }
+    QByteArray stateData(const Job& job) const;
+    bool saveState(Job& job);
+    void saveStateLater(Job& job);
+    bool loadState(Job& job);
+
+    QNetworkAccessManager m_network;
+    std::vector<std::unique_ptr<Job>> m_jobs;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_lastRefill;
+    qint64 m_tokens;
+    int m_nextId;
+    quint64 m_nextOrder;
+    bool m_suspended;
+    bool m_reapPending;
+
+    int m_maxActiveJobs;
+    int m_segmentCount;
+    qint64 m_minSegmentSize;
+    qint64 m_bandwidthLimit;
+    qint64 m_gameBandwidthLimit;
+    bool m_gameRunning;
+    int m_maxRetries;
+    int m_retryDelayMs;
+    int m_stallTimeoutMs;
+
+    // Syncs and saves segment maps off the GUI thread
+    QThreadPool m_stateWriter;
+};
@@ -33,7 +33,6 @@ bool SteamIntegration::initialize() {
     }
 
     m_steamRunning = true;
-    setupGamemodeEnvironment();
     configureControllerLayout();
     
     // Register callback
@@ -47,17 +46,17 @@ bool SteamIntegration::initialize() {
     return true;
 }
 
-bool SteamIntegration::setupGamemodeEnvironment() {
-    // Set required environment variables for Steam Gamemode
-    qputenv("SDL_VIDEODRIVER", "wayland");
-    qputenv("STEAM_RUNTIME_PREFER_HOST_LIBRARIES", "1");
-    qputenv("STEAM_GAMEPAD_CONFIG", "1");
-    qputenv("STEAM_USE_MANGOAPP", "1");
-    
-    // Enable FSR if available
-    qputenv("STEAM_GAMESCOPE_FSR", "1");
-    
-    return true;
+QMap<QString, QString> SteamIntegration::gamemodeEnvironment() {
+    // Required environment variables for Steam Gamemode, applied to the
+    // game's environment only
+    return {
+        {"SDL_VIDEODRIVER", "wayland"},
+        {"STEAM_RUNTIME_PREFER_HOST_LIBRARIES", "1"},
+        {"STEAM_GAMEPAD_CONFIG", "1"},
+        {"STEAM_USE_MANGOAPP", "1"},
+        // Enable FSR if available
+        {"STEAM_GAMESCOPE_FSR", "1"}
+    };
 }
 
 bool SteamIntegration::configureControllerLayout() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <QMap>
 #include <QObject>
 #include <QString>
 #include <steam/steam_api.h>
@@ -21,7 +22,7 @@ public:
 
     bool loadSteamInputConfig(const QString& configPath);
     bool launchInBigPicture();
-    bool setupGamemodeEnvironment();
+    static QMap<QString, QString> gamemodeEnvironment();
     bool configureControllerLayout();
 
 signals:
@@ -0,0 +1,361 @@
+#include "ArchiveExtractor.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+constexpr int DefaultBufferSize = 256 * 1024;
+
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndSignature = 0x06054b50;
+constexpr quint32 Zip64EndSignature = 0x06064b50;
+constexpr quint32 Zip64LocatorSignature = 0x07064b50;
+constexpr qint64 EndRecordSize = 22;
+constexpr qint64 CentralHeaderSize = 46;
+constexpr qint64 LocalHeaderSize = 30;
+constexpr quint16 Zip64ExtraId = 0x0001;
+constexpr quint16 MethodStored = 0;
+constexpr quint16 MethodDeflated = 8;
+constexpr quint16 FlagEncrypted = 0x0001;
+constexpr int HostUnix = 3;
+
+quint16 le16(const uchar* p) { return qFromLittleEndian<quint16>(p); }
+quint32 le32(const uchar* p) { return qFromLittleEndian<quint32>(p); }
+quint64 le64(const uchar* p) { return qFromLittleEndian<quint64>(p); }
+
+// Rejects absolute paths and "..", which would write outside the target
+bool isSafePath(const QString& name) {
+    if (name.isEmpty() || name.startsWith('/') || name.contains('\\')) {
+        return false;
+    }
+    const QStringList parts = name.split('/');
+    return !parts.contains("..");
+}
+
+qint64 mtimeNs(const QString& path, qint64* size) {
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    return qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool writeAll(int fd, const uchar* data, qint64 length) {
+    while (length > 0) {
+        const ssize_t written = ::write(fd, data, size_t(std::min<qint64>(length, INT_MAX)));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+ArchiveExtractor::ArchiveExtractor()
+    : m_bufferSize(DefaultBufferSize) {
+}
+
+bool ArchiveExtractor::readCentralDirectory(const uchar* data, qint64 size, QVector<Entry>& entries) {
+    // The end record sits behind an optional comment of up to 64 KiB
+    qint64 end = -1;
+    for (qint64 pos = size - EndRecordSize; pos >= std::max<qint64>(0, size - EndRecordSize - 0xffff); --pos) {
+        if (le32(data + pos) == EndSignature) {
+            end = pos;
+            break;
+        }
+    }
+    if (end < 0) {
+        return false;
+    }
+
+    quint64 count = le16(data + end + 10);
+    quint64 directorySize = le32(data + end + 12);
+    quint64 directoryOffset = le32(data + end + 16);
+    if (end >= 20 && le32(data + end - 20) == Zip64LocatorSignature) {
+        const quint64 record = le64(data + end - 20 + 8);
+        if (record + 56 <= quint64(size) && le32(data + record) == Zip64EndSignature) {
+            count = le64(data + record + 32);
+            directorySize = le64(data + record + 40);
+            directoryOffset = le64(data + record + 48);
+        }
+    }
+    if (directoryOffset + directorySize > quint64(size)) {
+        return false;
+    }
+
+    quint64 pos = directoryOffset;
+    const quint64 directoryEnd = directoryOffset + directorySize;
+    entries.reserve(int(std::min<quint64>(count, 1 << 20)));
+    for (quint64 i = 0; i < count; ++i) {
+        if (pos + CentralHeaderSize > directoryEnd || le32(data + pos) != CentralHeaderSignature) {
+            return false;
+        }
+        const uchar* header = data + pos;
+        const quint16 madeBy = le16(header + 4);
+        const quint16 flags = le16(header + 8);
+        const quint16 nameLength = le16(header + 28);
+        const quint16 extraLength = le16(header + 30);
+        const quint16 commentLength = le16(header + 32);
+        if (pos + CentralHeaderSize + nameLength + extraLength + commentLength > directoryEnd) {
+            return false;
+        }
+
+        Entry entry;
+        entry.name = QString::fromUtf8(reinterpret_cast<const char*>(header + CentralHeaderSize), nameLength);
+        entry.method = le16(header + 10);
+        entry.crc = le32(header + 16);
+        quint64 compressedSize = le32(header + 20);
+        quint64 uncompressedSize = le32(header + 24);
+        quint64 offset = le32(header + 42);
+        entry.mode = (madeBy >> 8) == HostUnix ? le32(header + 38) >> 16 : 0;
+        if (flags & FlagEncrypted) {
+            qWarning() << "Encrypted archive entry" << entry.name;
+            return false;
+        }
+
+        // 64-bit values replace the 32-bit fields that overflowed, in order
+        const uchar* extra = header + CentralHeaderSize + nameLength;
+        const uchar* extraEnd = extra + extraLength;
+        while (extra + 4 <= extraEnd) {
+            const quint16 id = le16(extra);
+            const quint16 length = le16(extra + 2);
+            const uchar* field = extra + 4;
+            const uchar* fieldEnd = std::min(field + length, extraEnd);
+            if (id == Zip64ExtraId) {
+                if (uncompressedSize == 0xffffffff && field + 8 <= fieldEnd) {
+                    uncompressedSize = le64(field);
+                    field += 8;
+                }
+                if (compressedSize == 0xffffffff && field + 8 <= fieldEnd) {
+                    compressedSize = le64(field);
+                    field += 8;
+                }
+                if (offset == 0xffffffff && field + 8 <= fieldEnd) {
+                    offset = le64(field);
+                }
+            }
+            extra += 4 + length;
+        }
+        entry.compressedSize = qint64(compressedSize);
+        entry.size = qint64(uncompressedSize);
+        entry.localHeaderOffset = qint64(offset);
+        entries.append(entry);
+
+        pos += CentralHeaderSize + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+ArchiveExtractor::Result ArchiveExtractor::extract(const QString& archive, const QString& target,
+                                                   const QString& manifestPath) {
+    QElapsedTimer timer;
+    timer.start();
+    Result result;
+
+    QFile file(archive);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open archive" << archive;
+        return result;
+    }
+    const qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    QVector<Entry> entries;
+    if (!data || !readCentralDirectory(data, size, entries)) {
+        qWarning() << "Not a valid ZIP archive:" << archive;
+        return result;
+    }
+    result.entries = entries.size();
+
+    const QString manifestFile = manifestPath.isEmpty() ? target + ".manifest.json" : manifestPath;
+    QJsonObject previous;
+    QFile manifestIn(manifestFile);
+    if (manifestIn.open(QIODevice::ReadOnly)) {
+        previous = QJsonDocument::fromJson(manifestIn.readAll()).object().value("entries").toObject();
+    }
+
+    // Directories are created up front so workers never race on them
+    QJsonObject manifest;
+    QVector<const Entry*> pending;
+    QDir().mkpath(target);
+    for (const Entry& entry : entries) {
+        if (!isSafePath(entry.name)) {
+            qWarning() << "Refusing archive entry outside the target:" << entry.name;
+            return result;
+        }
+        const QString path = target + "/" + entry.name;
+        if (entry.name.endsWith('/')) {
+            QDir().mkpath(path);
+            continue;
+        }
+        QDir().mkpath(QFileInfo(path).absolutePath());
+
+        // Same content in the archive, and the file is as it was left
+        const QJsonArray known = previous.value(entry.name).toArray();
+        qint64 diskSize = -1;
+        const qint64 diskMtime = mtimeNs(path, &diskSize);
+        if (!known.isEmpty() && quint32(known.at(0).toInteger()) == entry.crc
+            && known.at(1).toInteger() == entry.size && diskSize == entry.size
+            && known.at(2).toString().toLongLong() == diskMtime) {
+            manifest[entry.name] = known;
+            ++result.skipped;
+            continue;
+        }
+        pending.append(&entry);
+    }
+
+    // Largest first, so one big library does not finish last on its own
+    std::sort(pending.begin(), pending.end(), [](const Entry* a, const Entry* b) {
+        return a->size > b->size;
+    });
+
+    QMutex mutex;
+    std::atomic<bool> failed(false);
+    for (const Entry* entry : pending) {
+        m_pool.start([&, entry]() {
+            if (failed) {
+                return;
+            }
+            const QString path = target + "/" + entry->name;
+            if (!extractEntry(data, size, *entry, path)) {
+                failed = true;
+                return;
+            }
+            qint64 diskSize = 0;
+            const qint64 diskMtime = mtimeNs(path, &diskSize);
+            QMutexLocker locker(&mutex);
+            manifest[entry->name] = QJsonArray{qint64(entry->crc), entry->size, QString::number(diskMtime)};
+            ++result.extracted;
+            result.bytesWritten += entry->size;
+        });
+    }
+    m_pool.waitForDone();
+
+    // Files the previous archive had and this one does not
+    if (!failed) {
+        for (auto it = previous.begin(); it != previous.end(); ++it) {
+            if (!manifest.contains(it.key()) && isSafePath(it.key())) {
+                QFile::remove(target + "/" + it.key());
+            }
+        }
+    }
+
+    // Saved even after a failure, so a retry skips what did complete
+    QJsonObject root;
+    root["entries"] = manifest;
+    QSaveFile manifestOut(manifestFile);
+    if (manifestOut.open(QIODevice::WriteOnly)) {
+        manifestOut.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+        manifestOut.commit();
+    }
+
+    result.ok = !failed;
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
+
+bool ArchiveExtractor::extractEntry(const uchar* data, qint64 size, const Entry& entry,
+                                    const QString& path) const {
+    const qint64 header = entry.localHeaderOffset;
+    if (header + LocalHeaderSize > size || le32(data + header) != LocalHeaderSignature) {
+        qWarning() << "Bad local header for" << entry.name;
+        return false;
+    }
+    const qint64 offset = header + LocalHeaderSize + le16(data + header + 26) + le16(data + header + 28);
+    if (offset + entry.compressedSize > size) {
+        qWarning() << "Archive entry" << entry.name << "is truncated";
+        return false;
+    }
+    if (entry.method != MethodStored && entry.method != MethodDeflated) {
+        qWarning() << "Unsupported compression method" << entry.method << "for" << entry.name;
+        return false;
+    }
+
+    const QByteArray name = QFile::encodeName(path);
+    const mode_t mode = entry.mode & 0777 ? mode_t(entry.mode & 0777) : 0644;
+    const int fd = ::open(name.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0) {
+        qWarning() << "Failed to create" << path;
+        return false;
+    }
+    // Lets the filesystem lay the file out in one piece; not every one can
+    if (entry.size > 0) {
+        ::posix_fallocate(fd, 0, entry.size);
+    }
+
+    const uchar* input = data + offset;
+    uLong crc = crc32_z(0, nullptr, 0);
+    qint64 written = 0;
+    bool ok = true;
+
+    if (entry.method == MethodStored) {
+        ok = entry.compressedSize == entry.size && writeAll(fd, input, entry.size);
+        crc = crc32_z(crc, input, size_t(entry.size));
+        written = entry.size;
+    } else {
+        z_stream stream = {};
+        ok = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+        QByteArray buffer(m_bufferSize, Qt::Uninitialized);
+        qint64 remaining = entry.compressedSize;
+        int status = Z_OK;
+        while (ok && status != Z_STREAM_END) {
+            if (stream.avail_in == 0 && remaining > 0) {
+                stream.next_in = const_cast<Bytef*>(input + (entry.compressedSize - remaining));
+                stream.avail_in = uInt(std::min<qint64>(remaining, UINT_MAX));
+                remaining -= stream.avail_in;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+            stream.avail_out = uInt(buffer.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            const qint64 produced = buffer.size() - stream.avail_out;
+            if ((status != Z_OK && status != Z_STREAM_END) || (status == Z_OK && produced == 0
+                                                               && stream.avail_in == 0 && remaining == 0)) {
+                ok = false;
+                break;
+            }
+            crc = crc32_z(crc, reinterpret_cast<const Bytef*>(buffer.constData()), size_t(produced));
+            ok = writeAll(fd, reinterpret_cast<const uchar*>(buffer.constData()), produced);
+            written += produced;
+        }
+        inflateEnd(&stream);
+    }
+
+    if (ok && entry.mode & 0777) {
+        ::fchmod(fd, mode);
+    }
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || written != entry.size || quint32(crc) != entry.crc) {
+        qWarning() << "Failed to extract" << entry.name << (ok ? "(CRC or size mismatch)" : "");
+        ::unlink(name.constData());
+        return false;
+    }
+    return true;
+}
+
+ArchiveExtractor::~ArchiveExtractor() {
+    m_pool.waitForDone();
+}
@@ -0,0 +1,367 @@
+#include "InstallStore.hpp"
+#include "Reflink.hpp"
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSet>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int ManifestVersion = 1;
+const char* const ObjectDir = "objects";
+const char* const VersionDir = "versions";
+const char* const TreeDir = "trees";
+const char* const PreviousFile = "previous";
+// Suffix of trees still being built
+const char* const PartialSuffix = ".partial";
+
+QByteArray hashFile(const QString& path) {
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result().toHex();
+}
+
+QString readLink(const QString& path) {
+    char target[PATH_MAX];
+    const ssize_t length = ::readlink(QFile::encodeName(path).constData(), target, sizeof(target));
+    return length > 0 ? QFile::decodeName(QByteArray(target, int(length))) : QString();
+}
+
+bool validName(const QString& name) {
+    return !name.isEmpty() && !name.contains('/') && !name.startsWith('.')
+        && !name.endsWith(PartialSuffix);
+}
+
+} // namespace
+
+InstallStore::InstallStore(const QString& root)
+    : m_root(root) {
+}
+
+bool InstallStore::addVersion(const QString& name, const QString& source) {
+    if (!validName(name) || hasVersion(name)) {
+        qWarning() << "Cannot add game version" << name;
+        return false;
+    }
+
+    const QString tree = versionPath(name);
+    const QString partial = tree + PartialSuffix;
+    QDir(partial).removeRecursively();
+
+    Manifest manifest;
+    manifest.name = name;
+    const QDir sourceDir(source);
+    QDirIterator it(source, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot | QDir::System,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QFileInfo info = it.fileInfo();
+        const QString relative = sourceDir.relativeFilePath(path);
+
+        if (info.isSymLink()) {
+            // Kept as written, relative targets included
+            const QString target = readLink(path);
+            manifest.symlinks.append({relative, target});
+            const QString link = partial + "/" + relative;
+            QDir().mkpath(QFileInfo(link).absolutePath());
+            ::symlink(QFile::encodeName(target).constData(), QFile::encodeName(link).constData());
+            continue;
+        }
+        if (info.isDir()) {
+            manifest.directories.append(relative);
+            QDir().mkpath(partial + "/" + relative);
+            continue;
+        }
+
+        File file{relative, QByteArray(), info.size(), info.isExecutable()};
+        if (!storeObject(path, file)) {
+            QDir(partial).removeRecursively();
+            return false;
+        }
+        const QString target = partial + "/" + relative;
+        QDir().mkpath(QFileInfo(target).absolutePath());
+        if (!linkObject(objectPath(file.hash, file.executable), target)) {
+            QDir(partial).removeRecursively();
+            return false;
+        }
+        manifest.files.append(file);
+    }
+
+    // The manifest is written last, after the tree is in place, so a
+    // version either exists completely or not at all
+    QDir().mkpath(m_root + "/" + VersionDir);
+    if (::rename(QFile::encodeName(partial).constData(), QFile::encodeName(tree).constData()) != 0
+        || !saveManifest(manifest)) {
+        qWarning() << "Failed to install game version" << name << std::strerror(errno);
+        QDir(partial).removeRecursively();
+        QDir(tree).removeRecursively();
+        return false;
+    }
+    return true;
+}
+
+bool InstallStore::storeObject(const QString& source, File& file) {
+    file.hash = hashFile(source);
+    if (file.hash.isEmpty()) {
+        qWarning() << "Failed to read" << source;
+        return false;
+    }
+
+    const QString object = objectPath(file.hash, file.executable);
+    if (QFileInfo::exists(object)) {
+        return true;
+    }
+
+    // Copied, not linked: the source may be changed or deleted afterwards
+    const QString temp = object + PartialSuffix;
+    QDir().mkpath(QFileInfo(object).absolutePath());
+    QFile::remove(temp);
+    if (!Reflink::clone(source, temp) && !QFile::copy(source, temp)) {
+        qWarning() << "Failed to store" << source;
+        return false;
+    }
+
+    // Shared by every version, so nothing may write to it
+    QFile::Permissions permissions = QFile::ReadOwner | QFile::ReadGroup | QFile::ReadOther;
+    if (file.executable) {
+        permissions |= QFile::ExeOwner | QFile::ExeGroup | QFile::ExeOther;
+    }
+    QFile::setPermissions(temp, permissions);
+    if (::rename(QFile::encodeName(temp).constData(), QFile::encodeName(object).constData()) != 0) {
+        QFile::remove(temp);
+        return false;
+    }
+    return true;
+}
+
+bool InstallStore::linkObject(const QString& object, const QString& target) const {
+    const QByteArray targetName = QFile::encodeName(target);
+    if (::link(QFile::encodeName(object).constData(), targetName.constData()) == 0) {
+        return true;
+    }
+    // Past the filesystem's link limit a clone or copy still works
+    if (Reflink::clone(object, target) || QFile::copy(object, target)) {
+        return true;
+    }
+    qWarning() << "Failed to link" << object << "to" << target;
+    return false;
+}
+
+bool InstallStore::removeVersion(const QString& name) {
+    if (!hasVersion(name) || name == activeVersion()) {
+        return false;
+    }
+    if (name == previousVersion()) {
+        setPrevious(QString());
+    }
+    QFile::remove(manifestPath(name));
+    return QDir(versionPath(name)).removeRecursively();
+}
+
+QStringList InstallStore::versions() const {
+    QStringList names = QDir(m_root + "/" + VersionDir).entryList({"*.json"}, QDir::Files, QDir::Name);
+    for (QString& name : names) {
+        name.chop(5);
+    }
+    return names;
+}
+
+bool InstallStore::hasVersion(const QString& name) const {
+    return validName(name) && QFileInfo::exists(manifestPath(name));
+}
+
+bool InstallStore::activate(const QString& name) {
+    if (!hasVersion(name) || !QFileInfo(versionPath(name)).isDir()) {
+        qWarning() << "Game version" << name << "is not installed";
+        return false;
+    }
+    const QString active = activeVersion();
+    if (name == active) {
+        return true;
+    }
+
+    // rename() replaces the old link atomically; the game never sees a
+    // missing or half-switched install
+    const QByteArray temp = QFile::encodeName(currentPath() + PartialSuffix);
+    const QByteArray target = QFile::encodeName(QString(TreeDir) + "/" + name);
+    ::unlink(temp.constData());
+    if (::symlink(target.constData(), temp.constData()) != 0
+        || ::rename(temp.constData(), QFile::encodeName(currentPath()).constData()) != 0) {
+        qWarning() << "Failed to activate game version" << name << std::strerror(errno);
+        ::unlink(temp.constData());
+        return false;
+    }
+    if (!active.isEmpty()) {
+        setPrevious(active);
+    }
+    return true;
+}
+
+bool InstallStore::rollback() {
+    const QString previous = previousVersion();
+    return !previous.isEmpty() && activate(previous);
+}
+
+QString InstallStore::activeVersion() const {
+    const QString target = QFile::symLinkTarget(currentPath());
+    return target.isEmpty() ? QString() : QFileInfo(target).fileName();
+}
+
+QString InstallStore::previousVersion() const {
+    QFile file(m_root + "/" + PreviousFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    const QString name = QString::fromUtf8(file.readAll()).trimmed();
+    return hasVersion(name) ? name : QString();
+}
+
+bool InstallStore::setPrevious(const QString& name) const {
+    QSaveFile file(m_root + "/" + PreviousFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(name.toUtf8());
+    return file.commit();
+}
+
+QString InstallStore::versionPath(const QString& name) const {
+    return m_root + "/" + TreeDir + "/" + name;
+}
+
+int InstallStore::collectGarbage() {
+    QSet<QString> referenced;
+    for (const QString& name : versions()) {
+        Manifest manifest;
+        if (!loadManifest(name, manifest)) {
+            // Its objects cannot be told apart from garbage
+            qWarning() << "Not collecting game files; manifest of" << name << "is unreadable";
+            return 0;
+        }
+        for (const File& file : manifest.files) {
+            referenced.insert(QFileInfo(objectPath(file.hash, file.executable)).fileName());
+        }
+    }
+
+    const QStringList trees = QDir(m_root + "/" + TreeDir).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& tree : trees) {
+        if (!hasVersion(tree)) {
+            QDir(versionPath(tree)).removeRecursively();
+        }
+    }
+
+    int removed = 0;
+    QDirIterator it(m_root + "/" + ObjectDir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        if (!referenced.contains(it.fileName()) && QFile::remove(path)) {
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+InstallStore::Stats InstallStore::stats() const {
+    Stats stats;
+    for (const QString& name : versions()) {
+        Manifest manifest;
+        if (loadManifest(name, manifest)) {
+            ++stats.versions;
+            for (const File& file : manifest.files) {
+                stats.logicalBytes += file.size;
+            }
+        }
+    }
+    QDirIterator it(m_root + "/" + ObjectDir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        ++stats.objects;
+        stats.storedBytes += it.fileInfo().size();
+    }
+    return stats;
+}
+
+QString InstallStore::objectPath(const QByteArray& hash, bool executable) const {
+    // The mode lives on the shared inode, so it is part of the name
+    return m_root + "/" + ObjectDir + "/" + QString::fromLatin1(hash.left(2)) + "/"
+        + QString::fromLatin1(hash) + (executable ? "x" : "");
+}
+
+QString InstallStore::manifestPath(const QString& name) const {
+    return m_root + "/" + VersionDir + "/" + name + ".json";
+}
+
+bool InstallStore::saveManifest(const Manifest& manifest) const {
+    QJsonArray files;
+    for (const File& file : manifest.files) {
+        QJsonObject object;
+        object["path"] = file.path;
+        object["sha256"] = QString::fromLatin1(file.hash);
+        object["size"] = file.size;
+        if (file.executable) {
+            object["executable"] = true;
+        }
+        files.append(object);
+    }
+    QJsonArray symlinks;
+    for (const auto& link : manifest.symlinks) {
+        symlinks.append(QJsonArray{link.first, link.second});
+    }
+
+    QJsonObject root;
+    root["version"] = ManifestVersion;
+    root["name"] = manifest.name;
+    root["directories"] = QJsonArray::fromStringList(manifest.directories);
+    root["files"] = files;
+    root["symlinks"] = symlinks;
+
+    QSaveFile file(manifestPath(manifest.name));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+bool InstallStore::loadManifest(const QString& name, Manifest& manifest) const {
+    QFile file(manifestPath(name));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != ManifestVersion) {
+        return false;
+    }
+
+    manifest.name = root.value("name").toString();
+    for (const QJsonValue& directory : root.value("directories").toArray()) {
+        manifest.directories.append(directory.toString());
+    }
+    for (const QJsonValue& value : root.value("files").toArray()) {
+        const QJsonObject object = value.toObject();
+        manifest.files.append({object.value("path").toString(),
+                               object.value("sha256").toString().toLatin1(),
+                               object.value("size").toInteger(),
+                               object.value("executable").toBool()});
+    }
+    for (const QJsonValue& value : root.value("symlinks").toArray()) {
+        const QJsonArray link = value.toArray();
+        manifest.symlinks.append({link.at(0).toString(), link.at(1).toString()});
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QByteArray>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Several game versions installed side by side.
+//
+// Every file is stored once under objects/, named by its SHA-256, and
+// made read-only. A version is a manifest (versions/<name>.json) plus a
+// tree of hardlinks to those objects (trees/<name>), so a patch release
+// costs only the files it changed. "current" is a symlink to the active
+// tree; activating a version replaces it with a single rename, so the
+// switch is atomic and takes no time regardless of install size.
+class InstallStore {
+public:
+    struct Stats {
+        int versions = 0;
+        int objects = 0;
+        qint64 logicalBytes = 0;  // Sum of every version's files
+        qint64 storedBytes = 0;   // Objects on disk
+    };
+
+    explicit InstallStore(const QString& root = QString());
+
+    void setRoot(const QString& root) { m_root = root; }
+    QString root() const { return m_root; }
+
+    // Import the files under source as version name. The tree appears
+    // only once complete; an existing version is not replaced.
+    bool addVersion(const QString& name, const QString& source);
+    // The active version cannot be removed
+    bool removeVersion(const QString& name);
+    QStringList versions() const;
+    bool hasVersion(const QString& name) const;
+
+    // Point "current" at name; the version it replaces becomes the one
+    // rollback() returns to
+    bool activate(const QString& name);
+    bool rollback();
+    QString activeVersion() const;
+    QString previousVersion() const;
+
+    // What the game is started from
+    QString currentPath() const { return m_root + "/current"; }
+    QString versionPath(const QString& name) const;
+
+    // Delete objects no version refers to and trees left half-built.
+    // Returns the number of objects deleted.
+    int collectGarbage();
+
+    Stats stats() const;
+
+private:
+    struct File {
+        QString path;
+        QByteArray hash;
+        qint64 size;
+        bool executable;
+    };
+
+    struct Manifest {
+        QString name;
+        QStringList directories;
+        QVector<File> files;
+        QVector<QPair<QString, QString>> symlinks;  // Path, target
+    };
+
+    bool storeObject(const QString& source, File& file);
+    bool linkObject(const QString& object, const QString& target) const;
+    QString objectPath(const QByteArray& hash, bool executable) const;
+    QString manifestPath(const QString& name) const;
+    bool saveManifest(const Manifest& manifest) const;
+    bool loadManifest(const QString& name, Manifest& manifest) const;
+    bool setPrevious(const QString& name) const;
+
+    QString m_root;
+};
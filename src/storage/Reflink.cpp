@@ -0,0 +1,33 @@
+#include "Reflink.hpp"
+#include <QFile>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+bool Reflink::clone(const QString& source, const QString& target) {
+    const int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    const int out = ::open(QFile::encodeName(target).constData(),
+                           O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+    const bool ok = ::ioctl(out, FICLONE, in) == 0;
+    const int error = errno;
+    ::close(out);
+    ::close(in);
+    if (!ok) {
+        ::unlink(QFile::encodeName(target).constData());
+        errno = error;
+    }
+    return ok;
+}
+
+bool Reflink::isUnsupported(int error) {
+    return error == EOPNOTSUPP || error == EXDEV || error == EINVAL || error == ENOTTY;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QString>
+
+// Copy-on-write file clones (FICLONE), as offered by btrfs and XFS. A
+// clone shares its extents with the source until either is written, so
+// it costs no space and no I/O.
+class Reflink {
+public:
+    // Create target as a clone of source; target must not exist. On
+    // failure errno tells why.
+    static bool clone(const QString& source, const QString& target);
+
+    // Whether errno from a failed clone() means the filesystem cannot
+    // clone at all, rather than something wrong with this file
+    static bool isUnsupported(int error);
+};
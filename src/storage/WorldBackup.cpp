@@ -0,0 +1,531 @@
+#include "WorldBackup.hpp"
+#include "Reflink.hpp"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zstd.h>
+
+namespace {
+
+constexpr int ManifestVersion = 1;
+constexpr int DefaultCompressionLevel = 3;
+
+// FastCDC-style boundaries: nothing is cut below MinChunk, a stricter
+// mask before AverageChunk and a looser one after it keep sizes close to
+// the average, MaxChunk bounds the worst case
+constexpr qsizetype MinChunk = 16 * 1024;
+constexpr qsizetype AverageChunk = 64 * 1024;
+constexpr qsizetype MaxChunk = 256 * 1024;
+constexpr quint64 MaskBeforeAverage = ~0ULL << (64 - 18);
+constexpr quint64 MaskAfterAverage = ~0ULL << (64 - 14);
+constexpr qint64 ReadBlock = 1024 * 1024;
+
+const char* const ChunkDir = "chunks";
+const char* const SnapshotDir = "snapshots";
+const char* const StagingDir = "staging";
+
+// Random values for the gear hash, fixed so boundaries are the same in
+// every build
+struct GearTable {
+    quint64 values[256];
+
+    constexpr GearTable() : values() {
+        quint64 state = 0x9e3779b97f4a7c15ULL;
+        for (quint64& value : values) {
+            // splitmix64
+            state += 0x9e3779b97f4a7c15ULL;
+            quint64 z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+constexpr GearTable Gear;
+
+qsizetype cutPoint(const uchar* data, qsizetype size) {
+    if (size <= MinChunk) {
+        return size;
+    }
+    const qsizetype average = std::min(size, AverageChunk);
+    const qsizetype end = std::min(size, MaxChunk);
+
+    // Each shift pushes older bytes out of the top bits, which the masks
+    // test, so a boundary depends on the last 64 bytes only
+    quint64 hash = 0;
+    qsizetype i = MinChunk;
+    for (; i < average; ++i) {
+        hash = (hash << 1) + Gear.values[data[i]];
+        if (!(hash & MaskBeforeAverage)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + Gear.values[data[i]];
+        if (!(hash & MaskAfterAverage)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+QByteArray chunkHash(const QByteArray& data) {
+    return QCryptographicHash::hash(data, QCryptographicHash::Blake2b_256).toHex();
+}
+
+bool statFile(const QString& path, struct stat& st) {
+    return ::lstat(QFile::encodeName(path).constData(), &st) == 0;
+}
+
+} // namespace
+
+WorldBackup::WorldBackup(const QString& repository)
+    : m_repository(repository)
+    , m_compressionLevel(DefaultCompressionLevel)
+    , m_reflinkEnabled(true)
+    , m_running(false)
+    , m_capturing(false)
+    , m_cancelled(false) {
+}
+
+WorldBackup::Result WorldBackup::backup(const QString& source) {
+    Result result;
+    if (m_running.exchange(true)) {
+        qWarning() << "A world backup is already running";
+        return result;
+    }
+    const Result done = capture(source);
+    m_running = false;
+    return done;
+}
+
+WorldBackup::Result WorldBackup::capture(const QString& source) {
+    QElapsedTimer timer;
+    timer.start();
+    Result result;
+    m_cancelled = false;
+    m_capturing = true;
+
+    Manifest previous;
+    const QStringList existing = snapshots();
+    if (!existing.isEmpty() && !loadManifest(existing.last(), previous)) {
+        qWarning() << "Could not read snapshot" << existing.last() << "- backing up everything";
+    }
+    QHash<QString, const FileEntry*> previousFiles;
+    for (const FileEntry& entry : previous.files) {
+        previousFiles.insert(entry.path, &entry);
+    }
+
+    {
+        QMutexLocker locker(&m_chunkMutex);
+        m_chunks.clear();
+    }
+
+    // Unchanged files are taken from the previous snapshot without being
+    // opened
+    Manifest manifest;
+    QVector<int> changed;
+    const QDir sourceDir(source);
+    QDirIterator it(source, QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QString relative = sourceDir.relativeFilePath(path);
+        struct stat st;
+        if (!statFile(path, st)) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            manifest.directories.append(relative);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        FileEntry entry;
+        entry.path = relative;
+        entry.size = st.st_size;
+        entry.mtimeNs = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        entry.mode = st.st_mode & 07777;
+        const FileEntry* known = previousFiles.value(relative);
+        if (known && known->size == entry.size && known->mtimeNs == entry.mtimeNs) {
+            entry.chunks = known->chunks;
+            result.reusedChunks += entry.chunks.size();
+        } else {
+            changed.append(manifest.files.size());
+        }
+        manifest.files.append(entry);
+    }
+    result.files = manifest.files.size();
+    result.changedFiles = changed.size();
+
+    // Clone what changed so the game can run again while it is read
+    const QString staging = m_repository + "/" + StagingDir;
+    QDir(staging).removeRecursively();
+    QString readRoot = source;
+    if (m_reflinkEnabled && !changed.isEmpty()) {
+        result.reflinked = true;
+        for (int index : changed) {
+            const QString& relative = manifest.files.at(index).path;
+            const QString clone = staging + "/" + relative;
+            QDir().mkpath(QFileInfo(clone).absolutePath());
+            if (!Reflink::clone(source + "/" + relative, clone)) {
+                if (!Reflink::isUnsupported(errno)) {
+                    qWarning() << "Failed to clone" << relative << "for backup";
+                }
+                result.reflinked = false;
+                QDir(staging).removeRecursively();
+                break;
+            }
+        }
+        if (result.reflinked) {
+            readRoot = staging;
+        }
+    }
+    if (result.reflinked) {
+        m_capturing = false;
+        result.captureMs = timer.elapsed();
+    }
+
+    QMutex resultMutex;
+    std::atomic<bool> failed(false);
+    FileEntry* entries = manifest.files.data();
+    for (int index : changed) {
+        m_pool.start([&, index]() {
+            if (m_cancelled || failed) {
+                return;
+            }
+            Result local;
+            FileEntry& entry = entries[index];
+            if (!ingest(readRoot + "/" + entry.path, entry, local)) {
+                failed = true;
+                return;
+            }
+            QMutexLocker locker(&resultMutex);
+            result.bytesRead += local.bytesRead;
+            result.bytesWritten += local.bytesWritten;
+            result.newChunks += local.newChunks;
+            result.reusedChunks += local.reusedChunks;
+        });
+    }
+    m_pool.waitForDone();
+    QDir(staging).removeRecursively();
+
+    if (m_capturing) {
+        m_capturing = false;
+        result.captureMs = timer.elapsed();
+    }
+    if (m_cancelled || failed) {
+        // Chunks already written are kept; the next backup reuses them
+        result.elapsedMs = timer.elapsed();
+        return result;
+    }
+
+    const QString stamp = QDateTime::currentDateTimeUtc().toString("yyyyMMdd-HHmmsszzz");
+    manifest.id = stamp;
+    for (int n = 1; QFileInfo::exists(manifestPath(manifest.id)); ++n) {
+        manifest.id = stamp + "-" + QString::number(n);
+    }
+    if (!saveManifest(manifest)) {
+        result.elapsedMs = timer.elapsed();
+        return result;
+    }
+
+    result.ok = true;
+    result.snapshot = manifest.id;
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
+
+bool WorldBackup::ingest(const QString& path, FileEntry& entry, Result& result) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open" << path << "for backup";
+        return false;
+    }
+
+    // Reads ahead to a full MaxChunk so cut points do not depend on how
+    // the file happens to be read
+    entry.chunks.clear();
+    entry.size = 0;
+    QByteArray buffer;
+    bool atEnd = false;
+    for (;;) {
+        while (!atEnd && buffer.size() < MaxChunk) {
+            const QByteArray block = file.read(ReadBlock);
+            if (block.isEmpty()) {
+                atEnd = true;
+            }
+            buffer.append(block);
+            result.bytesRead += block.size();
+        }
+        if (buffer.isEmpty()) {
+            break;
+        }
+        if (m_cancelled) {
+            return false;
+        }
+
+        const qsizetype length = cutPoint(reinterpret_cast<const uchar*>(buffer.constData()),
+                                          buffer.size());
+        const QByteArray data = buffer.left(length);
+        buffer.remove(0, length);
+        const QByteArray hash = chunkHash(data);
+        if (!storeChunk(hash, data, result)) {
+            return false;
+        }
+        entry.chunks.append({hash, length});
+        entry.size += length;
+    }
+    return file.error() == QFile::NoError;
+}
+
+bool WorldBackup::storeChunk(const QByteArray& hash, const QByteArray& data, Result& result) {
+    // Claimed before it is written so two workers never store the same
+    // chunk
+    {
+        QMutexLocker locker(&m_chunkMutex);
+        if (m_chunks.contains(hash)) {
+            ++result.reusedChunks;
+            return true;
+        }
+        m_chunks.insert(hash);
+    }
+
+    // Only chunks of changed files get here, so a stat each costs in
+    // proportion to what changed, not to the size of the repository
+    const QString path = chunkPath(hash);
+    struct stat st;
+    if (statFile(path, st)) {
+        ++result.reusedChunks;
+        return true;
+    }
+
+    QByteArray compressed(qsizetype(ZSTD_compressBound(data.size())), Qt::Uninitialized);
+    const size_t size = ZSTD_compress(compressed.data(), compressed.size(), data.constData(),
+                                      data.size(), m_compressionLevel);
+    bool ok = !ZSTD_isError(size);
+    if (ok) {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QSaveFile file(path);
+        ok = file.open(QIODevice::WriteOnly) && file.write(compressed.constData(), qint64(size)) == qint64(size)
+            && file.commit();
+    }
+    if (!ok) {
+        qWarning() << "Failed to store backup chunk" << hash;
+        QMutexLocker locker(&m_chunkMutex);
+        m_chunks.remove(hash);
+        return false;
+    }
+
+    ++result.newChunks;
+    result.bytesWritten += qint64(size);
+    return true;
+}
+
+bool WorldBackup::restore(const QString& snapshot, const QString& target) {
+    Manifest manifest;
+    if (!loadManifest(snapshot, manifest)) {
+        qWarning() << "No backup snapshot" << snapshot;
+        return false;
+    }
+    if (QFileInfo::exists(target)) {
+        qWarning() << "Not restoring over existing" << target;
+        return false;
+    }
+
+    QDir().mkpath(target);
+    for (const QString& directory : manifest.directories) {
+        QDir().mkpath(target + "/" + directory);
+    }
+
+    // Files are rebuilt in parallel, each one chunk at a time
+    std::atomic<bool> failed(false);
+    for (const FileEntry& entry : manifest.files) {
+        m_pool.start([&, entry]() {
+            if (!failed && !restoreFile(entry, target + "/" + entry.path)) {
+                failed = true;
+            }
+        });
+    }
+    m_pool.waitForDone();
+
+    if (failed) {
+        QDir(target).removeRecursively();
+        return false;
+    }
+    return true;
+}
+
+bool WorldBackup::restoreFile(const FileEntry& entry, const QString& target) const {
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    QFile out(target);
+    if (!out.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to create" << target;
+        return false;
+    }
+
+    for (const Chunk& chunk : entry.chunks) {
+        QFile in(chunkPath(chunk.hash));
+        if (!in.open(QIODevice::ReadOnly)) {
+            qWarning() << "Backup chunk" << chunk.hash << "is missing";
+            return false;
+        }
+        const QByteArray compressed = in.readAll();
+        QByteArray data(chunk.size, Qt::Uninitialized);
+        const size_t size = ZSTD_decompress(data.data(), data.size(), compressed.constData(),
+                                            compressed.size());
+        if (ZSTD_isError(size) || qint64(size) != chunk.size || chunkHash(data) != chunk.hash) {
+            qWarning() << "Backup chunk" << chunk.hash << "is corrupt";
+            return false;
+        }
+        if (out.write(data) != data.size()) {
+            qWarning() << "Failed to write" << target;
+            return false;
+        }
+    }
+    out.close();
+
+    const QByteArray name = QFile::encodeName(target);
+    ::chmod(name.constData(), mode_t(entry.mode));
+    const struct timespec times[2] = {
+        {0, UTIME_OMIT},
+        {time_t(entry.mtimeNs / 1000000000), long(entry.mtimeNs % 1000000000)},
+    };
+    ::utimensat(AT_FDCWD, name.constData(), times, 0);
+    return true;
+}
+
+QStringList WorldBackup::snapshots() const {
+    QStringList ids = QDir(m_repository + "/" + SnapshotDir).entryList({"*.json"}, QDir::Files, QDir::Name);
+    for (QString& id : ids) {
+        id.chop(5);
+    }
+    return ids;
+}
+
+int WorldBackup::prune(int keep) {
+    QStringList ids = snapshots();
+    while (ids.size() > keep) {
+        QFile::remove(manifestPath(ids.takeFirst()));
+    }
+
+    QSet<QByteArray> referenced;
+    for (const QString& id : ids) {
+        Manifest manifest;
+        if (!loadManifest(id, manifest)) {
+            // Deleting chunks it might use would lose data
+            qWarning() << "Not pruning backup chunks; snapshot" << id << "is unreadable";
+            return 0;
+        }
+        for (const FileEntry& entry : manifest.files) {
+            for (const Chunk& chunk : entry.chunks) {
+                referenced.insert(chunk.hash);
+            }
+        }
+    }
+
+    int removed = 0;
+    QDirIterator it(m_repository + "/" + ChunkDir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        if (!referenced.contains(it.fileName().toLatin1()) && QFile::remove(path)) {
+            ++removed;
+        }
+    }
+    return removed;
+}
+
+QString WorldBackup::chunkPath(const QByteArray& hash) const {
+    return m_repository + "/" + ChunkDir + "/" + QString::fromLatin1(hash.left(2)) + "/"
+        + QString::fromLatin1(hash);
+}
+
+QString WorldBackup::manifestPath(const QString& id) const {
+    return m_repository + "/" + SnapshotDir + "/" + id + ".json";
+}
+
+bool WorldBackup::saveManifest(const Manifest& manifest) const {
+    QJsonArray files;
+    for (const FileEntry& entry : manifest.files) {
+        QJsonArray chunks;
+        for (const Chunk& chunk : entry.chunks) {
+            chunks.append(QJsonArray{QString::fromLatin1(chunk.hash), chunk.size});
+        }
+        QJsonObject object;
+        object["path"] = entry.path;
+        object["size"] = entry.size;
+        // Nanoseconds do not survive a trip through a double
+        object["mtime"] = QString::number(entry.mtimeNs);
+        object["mode"] = int(entry.mode);
+        object["chunks"] = chunks;
+        files.append(object);
+    }
+
+    QJsonObject root;
+    root["version"] = ManifestVersion;
+    root["id"] = manifest.id;
+    root["directories"] = QJsonArray::fromStringList(manifest.directories);
+    root["files"] = files;
+
+    const QString path = manifestPath(manifest.id);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write backup snapshot" << path;
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+bool WorldBackup::loadManifest(const QString& id, Manifest& manifest) const {
+    QFile file(manifestPath(id));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != ManifestVersion) {
+        return false;
+    }
+
+    manifest.id = root.value("id").toString();
+    for (const QJsonValue& directory : root.value("directories").toArray()) {
+        manifest.directories.append(directory.toString());
+    }
+    for (const QJsonValue& value : root.value("files").toArray()) {
+        const QJsonObject object = value.toObject();
+        FileEntry entry;
+        entry.path = object.value("path").toString();
+        entry.size = object.value("size").toInteger();
+        entry.mtimeNs = object.value("mtime").toString().toLongLong();
+        entry.mode = uint(object.value("mode").toInt());
+        for (const QJsonValue& chunk : object.value("chunks").toArray()) {
+            const QJsonArray pair = chunk.toArray();
+            entry.chunks.append({pair.at(0).toString().toLatin1(), pair.at(1).toInteger()});
+        }
+        manifest.files.append(entry);
+    }
+    return true;
+}
+
+WorldBackup::~WorldBackup() {
+    m_cancelled = true;
+    m_pool.waitForDone();
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+
+// Incremental, deduplicating backups of the game's worlds.
+//
+// Files are split into chunks at content-defined boundaries (a gear
+// rolling hash), so an append or an edit in the middle of a LevelDB log
+// only produces new chunks around the change. Chunks are named by their
+// BLAKE2b hash, compressed with zstd and stored once across all
+// snapshots; a snapshot is a manifest listing each file's chunks.
+//
+// Files whose size and mtime match the previous snapshot are not read at
+// all, so an incremental backup costs time in proportion to what changed.
+// Changed files are hashed and compressed on a thread pool.
+//
+// Worlds must not change while they are captured. Where the filesystem
+// can reflink (btrfs on Bazzite), changed files are first cloned into a
+// staging area, which takes milliseconds; the rest of the backup reads
+// the clones while the game may already run again. Otherwise capture
+// lasts for the whole backup, and cancel() discards it.
+class WorldBackup {
+public:
+    struct Result {
+        bool ok = false;
+        QString snapshot;
+        int files = 0;
+        int changedFiles = 0;
+        qint64 bytesRead = 0;      // Of changed files
+        qint64 bytesWritten = 0;   // Compressed, new chunks only
+        int newChunks = 0;
+        int reusedChunks = 0;
+        bool reflinked = false;
+        qint64 captureMs = 0;      // Time the source had to stay unchanged
+        qint64 elapsedMs = 0;
+    };
+
+    explicit WorldBackup(const QString& repository = QString());
+    ~WorldBackup();
+
+    void setRepository(const QString& path) { m_repository = path; }
+    QString repository() const { return m_repository; }
+    void setCompressionLevel(int level) { m_compressionLevel = level; }
+    // Clone changed files before reading them when the filesystem can
+    void setReflinkEnabled(bool enabled) { m_reflinkEnabled = enabled; }
+    void setMaxThreadCount(int count) { m_pool.setMaxThreadCount(count); }
+
+    // Snapshot source into the repository. Blocks; run it off the GUI
+    // thread. Fails right away if another backup is running.
+    Result backup(const QString& source);
+
+    // Write the snapshot into target, which must not exist yet
+    bool restore(const QString& snapshot, const QString& target);
+
+    // Oldest first
+    QStringList snapshots() const;
+
+    // Keep the newest keep snapshots and delete chunks none of them use.
+    // Returns the number of chunks deleted.
+    int prune(int keep);
+
+    bool isRunning() const { return m_running; }
+    // True while the source must not change
+    bool isCapturing() const { return m_capturing; }
+    // Abort a backup in progress; no snapshot is recorded
+    void cancel() { m_cancelled = true; }
+
+private:
+    struct Chunk {
+        QByteArray hash;  // Hex
+        qint64 size;
+    };
+
+    struct FileEntry {
+        QString path;     // Relative to the source
+        qint64 size = 0;
+        qint64 mtimeNs = 0;
+        uint mode = 0;
+        QVector<Chunk> chunks;
+    };
+
+    struct Manifest {
+        QString id;
+        QStringList directories;
+        QVector<FileEntry> files;
+    };
+
+    Result capture(const QString& source);
+    bool ingest(const QString& path, FileEntry& entry, Result& result);
+    bool storeChunk(const QByteArray& hash, const QByteArray& data, Result& result);
+    bool restoreFile(const FileEntry& entry, const QString& target) const;
+    QString chunkPath(const QByteArray& hash) const;
+    QString manifestPath(const QString& id) const;
+    bool saveManifest(const Manifest& manifest) const;
+    bool loadManifest(const QString& id, Manifest& manifest) const;
+
+    QString m_repository;
+    int m_compressionLevel;
+    bool m_reflinkEnabled;
+    QThreadPool m_pool;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_capturing;
+    std::atomic<bool> m_cancelled;
+
+    // Chunks claimed by the workers during this backup; whether one is
+    // in the repository already is checked on disk
+    QMutex m_chunkMutex;
+    QSet<QByteArray> m_chunks;
+};
@@ -4,6 +4,7 @@
 #include <QTimer>
 #include <QtMath>
 #include <QPropertyAnimation>
+#include "../gamepad/AllySystemControl.hpp"
 
 LauncherWindow::LauncherWindow(QWidget* parent)
     : QMainWindow(parent)
@@ -53,6 +54,16 @@ bool LauncherWindow::event(QEvent* event) {
     }
 }
 
+void LauncherWindow::showEvent(QShowEvent* event) {
+    AllySystemControl::instance()->setPollingPaused(false);
+    QMainWindow::showEvent(event);
+}
+
+void LauncherWindow::hideEvent(QHideEvent* event) {
+    AllySystemControl::instance()->setPollingPaused(true);
+    QMainWindow::hideEvent(event);
+}
+
 void LauncherWindow::touchEvent(QTouchEvent* event) {
     switch (event->type()) {
         case QEvent::TouchBegin:
@@ -18,6 +18,8 @@ protected:
     bool event(QEvent* event) override;
     void touchEvent(QTouchEvent* event) override;
     void gestureEvent(QGestureEvent* event) override;
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
 
 private:
     void setupTouchSupport();
@@ -0,0 +1,72 @@
+#include "SupervisorMode.hpp"
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QPixmapCache>
+#include <malloc.h>
+#include "../game/GamescopeSupervisor.hpp"
+#include "../gamepad/AllySystemControl.hpp"
+
+SupervisorMode::SupervisorMode(WindowFactory factory, QObject* parent)
+    : QObject(parent)
+    , m_factory(std::move(factory))
+    , m_active(false)
+    , m_quitOnLastWindowClosed(true)
+    , m_restoreMs(0) {
+}
+
+void SupervisorMode::follow(GamescopeSupervisor* gamescope) {
+    // Queued: the launch may have been started from inside the window,
+    // which must not be destroyed under its own event handler
+    connect(gamescope, &GamescopeSupervisor::started, this, &SupervisorMode::enter, Qt::QueuedConnection);
+    connect(gamescope, &GamescopeSupervisor::stopped, this, &SupervisorMode::leave, Qt::QueuedConnection);
+}
+
+void SupervisorMode::showLauncher() {
+    if (!m_window) {
+        m_window.reset(m_factory());
+    }
+    m_window->show();
+}
+
+void SupervisorMode::enter() {
+    if (m_active) {
+        return;
+    }
+    m_active = true;
+
+    // With no window left, Qt would otherwise take the game for the end
+    // of the session
+    m_quitOnLastWindowClosed = QGuiApplication::quitOnLastWindowClosed();
+    QGuiApplication::setQuitOnLastWindowClosed(false);
+    if (m_window) {
+        m_window->hide();
+        m_window.reset();
+    }
+    QPixmapCache::clear();
+    AllySystemControl::instance()->setSupervising(true);
+
+    // What the widgets freed would otherwise stay in malloc's free lists
+    ::malloc_trim(0);
+    emit entered();
+}
+
+void SupervisorMode::leave() {
+    if (!m_active) {
+        return;
+    }
+    m_active = false;
+
+    AllySystemControl::instance()->setSupervising(false);
+    QElapsedTimer timer;
+    timer.start();
+    showLauncher();
+    m_restoreMs = timer.elapsed();
+    QGuiApplication::setQuitOnLastWindowClosed(m_quitOnLastWindowClosed);
+    emit left();
+}
+
+SupervisorMode::~SupervisorMode() {
+    if (m_active) {
+        AllySystemControl::instance()->setSupervising(false);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QObject>
+#include <QWidget>
+#include <functional>
+#include <memory>
+
+class GamescopeSupervisor;
+
+// What the launcher shrinks to while the game runs.
+//
+// When the game starts the window is destroyed, and with it the widget
+// tree and the pixmaps it cached; the heap it leaves behind is returned
+// to the kernel. What remains is the event loop with hardware control,
+// telemetry and the gamescope supervisor, which notices the game exit.
+// The window is then built and shown again.
+class SupervisorMode : public QObject {
+    Q_OBJECT
+
+public:
+    using WindowFactory = std::function<QWidget*()>;
+
+    explicit SupervisorMode(WindowFactory factory, QObject* parent = nullptr);
+    ~SupervisorMode();
+
+    // Enter when gamescope starts and leave when it stops
+    void follow(GamescopeSupervisor* gamescope);
+
+    // Build the window if there is none and show it
+    void showLauncher();
+
+    void enter();
+    void leave();
+    bool isActive() const { return m_active; }
+    QWidget* window() const { return m_window.get(); }
+    // How long the last leave() took to bring the window back
+    qint64 restoreMs() const { return m_restoreMs; }
+
+signals:
+    void entered();
+    void left();
+
+private:
+    WindowFactory m_factory;
+    std::unique_ptr<QWidget> m_window;
+    bool m_active;
+    bool m_quitOnLastWindowClosed;  // Before entering
+    qint64 m_restoreMs;
+};
@@ -0,0 +1,163 @@
+#include "AllocationCounter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <dlfcn.h>
+
+namespace {
+
+using Malloc = void* (*)(std::size_t);
+using Calloc = void* (*)(std::size_t, std::size_t);
+using Realloc = void* (*)(void*, std::size_t);
+using AlignedAlloc = void* (*)(std::size_t, std::size_t);
+using PosixMemalign = int (*)(void**, std::size_t, std::size_t);
+using Free = void (*)(void*);
+
+struct Allocator {
+    Malloc malloc = nullptr;
+    Calloc calloc = nullptr;
+    Realloc realloc = nullptr;
+    AlignedAlloc alignedAlloc = nullptr;
+    PosixMemalign posixMemalign = nullptr;
+    Free free = nullptr;
+};
+
+std::atomic<quint64> g_count{0};
+Allocator g_next;
+// The first allocation happens before main() and any other thread
+bool g_resolving = false;
+
+// dlsym() may allocate while the next allocator is looked up; those
+// few requests are served from here and never freed
+alignas(std::max_align_t) char g_bootstrap[16 * 1024];
+std::size_t g_bootstrapUsed = 0;
+
+void* bootstrapAllocate(std::size_t size) {
+    const std::size_t aligned = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    if (aligned > sizeof(g_bootstrap) - g_bootstrapUsed) {
+        return nullptr;
+    }
+    void* memory = g_bootstrap + g_bootstrapUsed;
+    g_bootstrapUsed += aligned;
+    return memory;
+}
+
+bool isBootstrap(const void* memory) {
+    return memory >= g_bootstrap && memory < g_bootstrap + sizeof(g_bootstrap);
+}
+
+template<typename Function>
+Function next(const char* name) {
+    return reinterpret_cast<Function>(::dlsym(RTLD_NEXT, name));
+}
+
+const Allocator& nextAllocator() {
+    if (!g_next.free) {
+        g_resolving = true;
+        g_next.malloc = next<Malloc>("malloc");
+        g_next.calloc = next<Calloc>("calloc");
+        g_next.realloc = next<Realloc>("realloc");
+        g_next.alignedAlloc = next<AlignedAlloc>("aligned_alloc");
+        g_next.posixMemalign = next<PosixMemalign>("posix_memalign");
+        g_next.free = next<Free>("free");
+        g_resolving = false;
+    }
+    return g_next;
+}
+
+} // namespace
+
+quint64 allocationCount() {
+    return g_count.load(std::memory_order_relaxed);
+}
+
+extern "C" {
+
+void* malloc(std::size_t size) {
+    if (g_resolving) {
+        return bootstrapAllocate(size);
+    }
+    g_count.fetch_add(1, std::memory_order_relaxed);
+    return nextAllocator().malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) {
+    if (g_resolving) {
+        // Static storage is already zeroed
+        return size == 0 || count <= sizeof(g_bootstrap) / size ? bootstrapAllocate(count * size) : nullptr;
+    }
+    g_count.fetch_add(1, std::memory_order_relaxed);
+    return nextAllocator().calloc(count, size);
+}
+
+void* realloc(void* memory, std::size_t size) {
+    if (isBootstrap(memory)) {
+        // The old size is unknown, but no bootstrap block outgrows the rest
+        // of the buffer it came from
+        void* moved = malloc(size);
+        if (moved) {
+            std::memcpy(moved, memory, std::min<std::size_t>(size, g_bootstrap + sizeof(g_bootstrap)
+                                                                   - static_cast<char*>(memory)));
+        }
+        return moved;
+    }
+    g_count.fetch_add(1, std::memory_order_relaxed);
+    return nextAllocator().realloc(memory, size);
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size) {
+    g_count.fetch_add(1, std::memory_order_relaxed);
+    return nextAllocator().alignedAlloc(alignment, size);
+}
+
+int posix_memalign(void** memory, std::size_t alignment, std::size_t size) {
+    g_count.fetch_add(1, std::memory_order_relaxed);
+    return nextAllocator().posixMemalign(memory, alignment, size);
+}
+
+void free(void* memory) {
+    if (memory && !isBootstrap(memory)) {
+        nextAllocator().free(memory);
+    }
+}
+
+} // extern "C"
+
+// Counted through malloc whether or not the C++ runtime's own operator
+// new calls it
+void* operator new(std::size_t size) {
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    free(memory);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Heap allocations made by the process so far, for the benchmarks'
+// allocations-per-call figures. Counts malloc, calloc, realloc,
+// aligned_alloc, posix_memalign and every operator new.
+//
+// The counting allocator wraps the C library's through dlsym(RTLD_NEXT)
+// and is linked into the Benchmarks executable only, so the test suite
+// runs on the unmodified allocator.
+quint64 allocationCount();
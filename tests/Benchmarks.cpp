@@ -0,0 +1,322 @@
+#include "Benchmarks.hpp"
+#include "AllocationCounter.hpp"
+#include "TestHelpers.hpp"
+#include "../src/game/FrameTimeHistogram.hpp"
+#include "../src/game/FrameTimeLog.hpp"
+#include "../src/game/GameManager.hpp"
+#include "../src/game/LaunchPlan.hpp"
+#include "../src/hardware/SysfsAttribute.hpp"
+#include "../src/hardware/TelemetryStore.hpp"
+#include "../src/storage/ArchiveExtractor.hpp"
+#include "../src/storage/WorldBackup.hpp"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+namespace {
+
+// Per-call QFile open/read/close, as AllySystemControl used to do it
+QString legacyReadFromSysfs(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    QString value = QString::fromUtf8(file.readAll()).trimmed();
+    file.close();
+    return value;
+}
+
+// Whole-buffer split and per-field copies, as FrameTimeLog used to parse
+QVector<double> legacyParseFrameTimes(const QByteArray& data) {
+    QVector<double> frameTimes;
+    int column = -1;
+    for (const QByteArray& rawLine : data.split('\n')) {
+        const QByteArray line = rawLine.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        const QList<QByteArray> fields = line.split(',');
+        const int header = fields.indexOf("frametime");
+        if (header >= 0) {
+            column = header;
+            continue;
+        }
+        bool ok = false;
+        const double frameTime = column >= 0 && column < fields.size() ? fields[column].toDouble(&ok) : 0.0;
+        if (ok && frameTime > 0.0) {
+            frameTimes.append(frameTime);
+        }
+    }
+    return frameTimes;
+}
+
+} // namespace
+
+void Benchmarks::benchmarkLegacySysfsRead() {
+    QTemporaryDir root;
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon3/temp1_input", "45000\n");
+    const QString path = root.path() + "/class/hwmon/hwmon3/temp1_input";
+
+    const int calls = 10000;
+    const quint64 before = allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < calls; ++i) {
+        QVERIFY(!legacyReadFromSysfs(path).isEmpty());
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    const quint64 allocations = allocationCount() - before;
+    qInfo() << "legacy QFile read:" << calls * 1e9 / elapsedNs << "calls/s,"
+            << double(allocations) / calls << "allocations/call";
+
+    QBENCHMARK {
+        legacyReadFromSysfs(path).toFloat();
+    }
+}
+
+void Benchmarks::benchmarkFrameTimeParse() {
+    // About 90 MB: an hour and a half of mangoapp rows at 60 fps
+    QTemporaryDir dir;
+    const QString path = dir.path() + "/mangoapp.csv";
+    const int frames = 90 * 60 * 60;
+    const QByteArray log = mangoappLog(frames, 5);
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(log);
+    }
+    const double megabytes = log.size() / 1e6;
+
+    // Streaming allocates the same for a one-minute log as for this one
+    const QString minutePath = dir.path() + "/minute.csv";
+    {
+        QFile file(minutePath);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(mangoappLog(60 * 60, 5));
+    }
+    FrameTimeHistogram minute;
+    quint64 before = allocationCount();
+    QCOMPARE(FrameTimeLog::readAll(minutePath, minute), qint64(60 * 60));
+    const quint64 minuteAllocations = allocationCount() - before;
+    FrameTimeHistogram session;
+    before = allocationCount();
+    QCOMPARE(FrameTimeLog::readAll(path, session), qint64(frames));
+    QCOMPARE(allocationCount() - before, minuteAllocations);
+
+    QElapsedTimer timer;
+    timer.start();
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(legacyParseFrameTimes(file.readAll()).size(), frames);
+    const qint64 legacyNs = timer.nsecsElapsed();
+    file.close();
+
+    FrameTimeHistogram histogram;
+    timer.restart();
+    QCOMPARE(FrameTimeLog::readAll(path, histogram), qint64(frames));
+    const qint64 streamingNs = timer.nsecsElapsed();
+
+    qInfo() << "frame time log:" << megabytes << "MB, legacy split parser"
+            << megabytes * 1e9 / legacyNs << "MB/s, streaming parser"
+            << megabytes * 1e9 / streamingNs << "MB/s";
+    QVERIFY(streamingNs < legacyNs);
+
+    QBENCHMARK {
+        histogram.clear();
+        FrameTimeLog::readAll(path, histogram);
+    }
+}
+
+void Benchmarks::benchmarkSysfsAttributeRead() {
+    QTemporaryDir root;
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon3/temp1_input", "45000\n");
+    SysfsAttribute attr(root.path() + "/class/hwmon/hwmon3/temp1_input");
+
+    qint64 value = 0;
+    QVERIFY(attr.readInt(value));
+
+    const int calls = 10000;
+    const quint64 before = allocationCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < calls; ++i) {
+        attr.readInt(value);
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    const quint64 allocations = allocationCount() - before;
+    qInfo() << "persistent pread:" << calls * 1e9 / elapsedNs << "calls/s,"
+            << double(allocations) / calls << "allocations/call";
+    QCOMPARE(allocations, quint64(0));
+
+    QBENCHMARK {
+        attr.readInt(value);
+    }
+}
+
+void Benchmarks::benchmarkTelemetryAppend() {
+    TelemetryStore store;
+    qint64 t = 1700000000000;
+    const quint64 before = allocationCount();
+    QBENCHMARK {
+        store.append(t, {65.0f, 60.0f, 15.0f, 1600.0f, 80.0f, 12.5f});
+        t += 250;
+    }
+    QCOMPARE(allocationCount() - before, quint64(0));
+}
+
+void Benchmarks::benchmarkTelemetryQuery() {
+    TelemetryStore store;
+    const qint64 start = 1700000000000;
+    for (qint64 t = 0; t < 8 * 3600 * 1000; t += 1000) {
+        store.append(start + t, {65.0f, 60.0f, 15.0f, 1600.0f, 80.0f, 12.5f});
+    }
+
+    const qint64 end = start + 8 * 3600 * 1000;
+    TelemetryStore::Point points[TelemetryStore::TierCapacity[1]];
+    QBENCHMARK {
+        store.query(TelemetryStore::TenSeconds, TelemetryStore::Temperature,
+                    end - 3600 * 1000, end, points, TelemetryStore::TierCapacity[1]);
+    }
+}
+
+void Benchmarks::benchmarkLaunchPlan() {
+    // Cold: detection and plan compilation on every launch, as before
+    // plans were cached. Cached: load, validate and materialize only.
+    QTemporaryDir dir;
+    auto* manager = GameManager::instance();
+
+    const int launches = 200;
+    LaunchPlan plan;
+    bool cached = true;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < launches; ++i) {
+        // An empty cache directory every time, so every launch misses
+        manager->setLaunchPlanCacheDirectory(dir.path() + "/cold/" + QString::number(i));
+        manager->prepareLaunchPlan(plan, &cached);
+        plan.materialize();
+    }
+    const qint64 coldNs = timer.nsecsElapsed();
+    QVERIFY(!cached);
+
+    manager->setLaunchPlanCacheDirectory(dir.path() + "/warm");
+    QVERIFY(manager->prepareLaunchPlan(plan, &cached));
+    timer.restart();
+    for (int i = 0; i < launches; ++i) {
+        manager->prepareLaunchPlan(plan, &cached);
+        plan.materialize();
+    }
+    const qint64 cachedNs = timer.nsecsElapsed();
+    QVERIFY(cached);
+
+    qInfo() << "cold plan:" << coldNs / launches / 1000 << "us/launch,"
+            << "cached plan:" << cachedNs / launches / 1000 << "us/launch";
+    QVERIFY(cachedNs < coldNs);
+
+    QBENCHMARK {
+        manager->prepareLaunchPlan(plan, &cached);
+        plan.materialize();
+    }
+    manager->setLaunchPlanCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                                         + "/launch-plans");
+}
+
+void Benchmarks::benchmarkWorldBackup() {
+    // A full backup reads the whole world; an incremental one only what
+    // changed, however large the world and the repository have grown
+    QTemporaryDir dir;
+    const QString world = dir.path() + "/worlds";
+    const int files = 64;
+    const qsizetype fileSize = 512 * 1024;
+    auto addWorld = [&](int index) {
+        for (int i = 0; i < files; ++i) {
+            writeFakeSysfs(world, QString("w%1/db/%2.ldb").arg(index).arg(i, 6, 10, QChar('0')),
+                           randomBytes(fileSize, index * files + i));
+        }
+    };
+    addWorld(1);
+
+    WorldBackup backup(dir.path() + "/repo");
+    const WorldBackup::Result full = backup.backup(world);
+    QVERIFY(full.ok);
+    QCOMPARE(full.bytesRead, qint64(files) * fileSize);
+
+    // Every round rewrites the same log with new contents
+    const qsizetype changedSize = 256 * 1024;
+    int round = 0;
+    auto incremental = [&]() -> qint64 {
+        writeFakeSysfs(world, "w1/db/LOG", randomBytes(changedSize, 1000 + round++));
+        const WorldBackup::Result result = backup.backup(world);
+        if (!result.ok || result.changedFiles != 1 || result.bytesRead != changedSize) {
+            return -1;
+        }
+        return result.elapsedMs;
+    };
+    QVERIFY(incremental() >= 0);
+    const qint64 smallMs = incremental();
+    QVERIFY(smallMs >= 0);
+
+    // Four times the chunks, same change
+    for (int index = 2; index <= 4; ++index) {
+        addWorld(index);
+    }
+    QVERIFY(backup.backup(world).ok);
+    const qint64 largeMs = incremental();
+    QVERIFY(largeMs >= 0);
+
+    qint64 incrementalMs = 0;
+    QBENCHMARK {
+        incrementalMs = incremental();
+        QVERIFY(incrementalMs >= 0);
+    }
+    qInfo() << "full backup:" << full.elapsedMs << "ms for" << full.bytesRead / 1024 << "KiB,"
+            << "incremental of" << changedSize / 1024 << "KiB:" << smallMs << "ms, with a 4x repository"
+            << largeMs << "ms, last" << incrementalMs << "ms";
+}
+
+void Benchmarks::benchmarkArchiveExtract() {
+    // A few hundred MiB, half compressible, in entries the size of game assets
+    QTemporaryDir dir;
+    const QString archive = dir.path() + "/game.apk";
+    const int count = 600;
+    const qsizetype entrySize = 512 * 1024;
+    QVector<ZipEntry> entries;
+    for (int i = 0; i < count; ++i) {
+        entries.append({QString("assets/%1/%2.bin").arg(i % 20).arg(i),
+                        randomBytes(entrySize / 2, i) + QByteArray(entrySize / 2, char('a' + i % 26))});
+    }
+    writeZip(archive, entries);
+    entries.clear();
+
+    ArchiveExtractor extractor;
+    const ArchiveExtractor::Result first = extractor.extract(archive, dir.path() + "/ours");
+    QVERIFY(first.ok);
+    QCOMPARE(first.extracted, count);
+    QCOMPARE(first.bytesWritten, qint64(count) * entrySize);
+
+    ArchiveExtractor::Result again;
+    QBENCHMARK {
+        again = extractor.extract(archive, dir.path() + "/ours");
+    }
+    QVERIFY(again.ok);
+    QCOMPARE(again.skipped, count);
+
+    const QString unzip = QStandardPaths::findExecutable("unzip");
+    if (unzip.isEmpty()) {
+        QSKIP("unzip is not installed");
+    }
+    QElapsedTimer timer;
+    timer.start();
+    QProcess process;
+    process.start(unzip, {"-q", "-o", archive, "-d", dir.path() + "/unzip"});
+    QVERIFY(process.waitForFinished(-1));
+    QCOMPARE(process.exitCode(), 0);
+    qInfo() << "extract" << qint64(count) * entrySize / (1024 * 1024) << "MiB:"
+            << first.elapsedMs << "ms, unzip" << timer.elapsed() << "ms, unchanged"
+            << again.elapsedMs << "ms";
+}
+
+QTEST_MAIN(Benchmarks)
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QObject>
+#include <QtTest>
+
+class Benchmarks : public QObject {
+    Q_OBJECT
+
+private slots:
+    void benchmarkLegacySysfsRead();
+    void benchmarkSysfsAttributeRead();
+    void benchmarkFrameTimeParse();
+    void benchmarkTelemetryAppend();
+    void benchmarkTelemetryQuery();
+    void benchmarkLaunchPlan();
+    void benchmarkWorldBackup();
+    void benchmarkArchiveExtract();
+};
@@ -0,0 +1,117 @@
+#include "TestHelpers.hpp"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QtTest>
+#include <zlib.h>
+
+void writeFakeSysfs(const QString& root, const QString& relativePath, const QByteArray& value) {
+    const QString path = root + '/' + relativePath;
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(value);
+}
+
+QByteArray randomBytes(qsizetype size, quint32 seed) {
+    QByteArray data(size, Qt::Uninitialized);
+    QRandomGenerator generator(seed);
+    generator.fillRange(reinterpret_cast<quint32*>(data.data()), size / 4);
+    return data;
+}
+
+void writeZip(const QString& path, const QVector<ZipEntry>& entries) {
+    auto put16 = [](QByteArray& out, quint16 value) {
+        out.append(char(value & 0xff)).append(char(value >> 8));
+    };
+    auto put32 = [&](QByteArray& out, quint32 value) {
+        put16(out, quint16(value & 0xffff));
+        put16(out, quint16(value >> 16));
+    };
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QByteArray directory;
+    for (const ZipEntry& entry : entries) {
+        const bool isDirectory = entry.name.endsWith('/');
+        const bool compressed = !entry.stored && !isDirectory;
+        QByteArray payload = entry.data;
+        if (compressed) {
+            z_stream stream = {};
+            QVERIFY(deflateInit2(&stream, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+            payload.resize(qsizetype(deflateBound(&stream, uLong(entry.data.size()))));
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(entry.data.constData()));
+            stream.avail_in = uInt(entry.data.size());
+            stream.next_out = reinterpret_cast<Bytef*>(payload.data());
+            stream.avail_out = uInt(payload.size());
+            QCOMPARE(deflate(&stream, Z_FINISH), Z_STREAM_END);
+            payload.resize(qsizetype(stream.total_out));
+            deflateEnd(&stream);
+        }
+        const QByteArray name = entry.name.toUtf8();
+        const quint32 crc = quint32(crc32_z(0, reinterpret_cast<const Bytef*>(entry.data.constData()),
+                                            size_t(entry.data.size())));
+        const quint32 offset = quint32(file.pos());
+
+        QByteArray local;
+        put32(local, 0x04034b50);
+        put16(local, 20);
+        put16(local, 0);
+        put16(local, compressed ? 8 : 0);
+        put32(local, 0);  // DOS time and date
+        put32(local, crc);
+        put32(local, quint32(payload.size()));
+        put32(local, quint32(entry.data.size()));
+        put16(local, quint16(name.size()));
+        put16(local, 0);
+        file.write(local + name);
+        file.write(payload);
+
+        put32(directory, 0x02014b50);
+        put16(directory, 3 << 8 | 20);  // Made on Unix
+        put16(directory, 20);
+        put16(directory, 0);
+        put16(directory, compressed ? 8 : 0);
+        put32(directory, 0);
+        put32(directory, crc);
+        put32(directory, quint32(payload.size()));
+        put32(directory, quint32(entry.data.size()));
+        put16(directory, quint16(name.size()));
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put32(directory, (isDirectory ? 040755 : 0100000 | entry.mode) << 16);
+        put32(directory, offset);
+        directory += name;
+    }
+
+    QByteArray end;
+    put32(end, 0x06054b50);
+    put16(end, 0);
+    put16(end, 0);
+    put16(end, quint16(entries.size()));
+    put16(end, quint16(entries.size()));
+    put32(end, quint32(directory.size()));
+    put32(end, quint32(file.pos()));
+    put16(end, 0);
+    file.write(directory + end);
+}
+
+QByteArray mangoappLog(int frames, int seed) {
+    QByteArray log = "os,cpu,gpu,ram,kernel,driver,cpuscheduler\n"
+                     "Bazzite,AMD Ryzen Z1 Extreme,AMD Radeon Graphics,16GB,6.8.0,Mesa 24.1,performance\n"
+                     "fps,frametime,cpu_load,gpu_load,cpu_temp,gpu_temp,gpu_core_clock,gpu_mem_clock,"
+                     "gpu_power,ram_used,elapsed\n";
+    QRandomGenerator random(seed);
+    qint64 elapsedNs = 0;
+    for (int i = 0; i < frames; ++i) {
+        const double frameTime = 14.0 + random.bounded(6.0) + (i % 997 == 0 ? 30.0 : 0.0);
+        elapsedNs += qint64(frameTime * 1e6);
+        log += QByteArray::number(1000.0 / frameTime, 'f', 1) + ',' + QByteArray::number(frameTime, 'f', 3)
+            + ',' + QByteArray::number(30 + i % 40) + ",95,68,61,1800,1000,14.2,6.1,"
+            + QByteArray::number(elapsedNs) + '\n';
+    }
+    return log;
+}
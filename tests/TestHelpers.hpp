@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// Fixtures shared by the test suite and the benchmarks
+
+// Create a file in a fake sysfs tree rooted at root
+void writeFakeSysfs(const QString& root, const QString& relativePath, const QByteArray& value);
+
+// Incompressible data, the same for the same seed
+QByteArray randomBytes(qsizetype size, quint32 seed);
+
+struct ZipEntry {
+    QString name;  // Directories end in '/'
+    QByteArray data;
+    bool stored = false;  // Deflated otherwise
+    quint32 mode = 0644;
+};
+
+// Write a ZIP archive as an APK build would: raw deflate, Unix modes
+void writeZip(const QString& path, const QVector<ZipEntry>& entries);
+
+// mangoapp CSV as MangoHud writes it: system info, then one row per frame
+QByteArray mangoappLog(int frames, int seed);
@@ -1,9 +1,484 @@
 #include "TestSuite.hpp"
+#include "TestHelpers.hpp"
 #include "../src/steam/SteamIntegration.hpp"
+#include "../src/core/Config.hpp"
 #include "../src/gamepad/AllySystemControl.hpp"
+#include "../src/game/FrameCapture.hpp"
+#include "../src/game/FrameTimeHistogram.hpp"
+#include "../src/game/FrameTimeLog.hpp"
 #include "../src/game/GameManager.hpp"
+#include "../src/game/GameScheduler.hpp"
+#include "../src/game/GamescopeSupervisor.hpp"
+#include "../src/game/LaunchPipeline.hpp"
+#include "../src/game/LaunchPlan.hpp"
+#include "../src/game/PresetTuner.hpp"
+#include "../src/game/ResolutionScaler.hpp"
+#include "../src/game/ShaderCacheManager.hpp"
+#include "../src/game/ShaderCacheStore.hpp"
+#include "../src/game/ShaderPrewarmer.hpp"
+#include "../src/game/TdpGovernor.hpp"
 #include "../src/ui/LauncherWindow.hpp"
+#include "../src/ui/SupervisorMode.hpp"
+#include "../src/hardware/SysfsAttribute.hpp"
+#include "../src/hardware/EnergyMeter.hpp"
+#include "../src/hardware/FanCurve.hpp"
+#include "../src/hardware/GpuClockControl.hpp"
+#include "../src/hardware/HardwareState.hpp"
+#include "../src/hardware/PollScheduler.hpp"
+#include "../src/hardware/SensorRegistry.hpp"
+#include "../src/hardware/TelemetrySampler.hpp"
+#include "../src/hardware/TelemetryStore.hpp"
+#include "../src/network/DownloadManager.hpp"
+#include "../src/storage/ArchiveExtractor.hpp"
+#include "../src/storage/InstallStore.hpp"
+#include "../src/storage/WorldBackup.hpp"
+#include <QCryptographicHash>
+#include <QDirIterator>
+#include <QEventLoop>
+#include <QGridLayout>
+#include <QGuiApplication>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLabel>
+#include <QProcess>
+#include <QRandomGenerator>
 #include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+QByteArray readFakeSysfs(const QString& root, const QString& relativePath) {
+    QFile file(root + '/' + relativePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+// Minimal ROG Ally sysfs layout: hwmon/drm numbering deliberately differs
+// from the old hardcoded hwmon*/card0 paths.
+void createFakeAllyTree(const QString& root) {
+    writeFakeSysfs(root, "class/hwmon/hwmon0/name", "acpitz\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon0/temp1_input", "30000\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon2/name", "k10temp\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon2/temp1_input", "55000\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon4/name", "amdgpu\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon4/temp1_input", "52000\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon5/name", "asus\n");
+    writeFakeSysfs(root, "class/hwmon/hwmon5/fan1_input", "3200\n");
+    writeFakeSysfs(root, "class/power_supply/ACAD/type", "Mains\n");
+    writeFakeSysfs(root, "class/power_supply/ACAD/online", "0\n");
+    writeFakeSysfs(root, "class/power_supply/BAT0/type", "Battery\n");
+    writeFakeSysfs(root, "class/power_supply/BAT0/capacity", "80\n");
+    writeFakeSysfs(root, "class/power_supply/BAT0/status", "Discharging\n");
+    writeFakeSysfs(root, "class/power_supply/BAT0/power_now", "12000000\n");
+    writeFakeSysfs(root, "class/power_supply/BAT0/energy_now", "32000000\n");
+    writeFakeSysfs(root, "class/powercap/powercap0/name", "powercap0\n");
+    writeFakeSysfs(root, "class/powercap/powercap0/tdp", "15000000\n");
+    writeFakeSysfs(root, "class/drm/card0-eDP-1/status", "connected\n");
+    writeFakeSysfs(root, "class/drm/card1/device/vendor", "0x1002\n");
+    writeFakeSysfs(root, "class/drm/card1/device/pp_dpm_sclk", "0: 800Mhz\n1: 1600Mhz *\n2: 2700Mhz\n");
+    writeFakeSysfs(root, "class/drm/card1/device/power_dpm_force_performance_level", "auto\n");
+    writeFakeSysfs(root, "devices/platform/asus-nb-wmi/profile", "1\n");
+    writeFakeSysfs(root, "devices/platform/asus-nb-wmi/fan_speed", "20\n");
+}
+
+// Kernel uevent datagram as received on NETLINK_KOBJECT_UEVENT
+QByteArray fakeUevent(const QByteArray& action, const QByteArray& devpath, const QByteArray& subsystem) {
+    QByteArray message = action + '@' + devpath;
+    message += '\0';
+    message += "ACTION=" + action;
+    message += '\0';
+    message += "DEVPATH=" + devpath;
+    message += '\0';
+    message += "SUBSYSTEM=" + subsystem;
+    message += '\0';
+    return message;
+}
+
+// Stand-in for a download server: one file over HTTP/1.1 with ranges and
+// an ETag, plus the ways real connections go wrong
+class RangeServer {
+public:
+    explicit RangeServer(const QByteArray& body) {
+        setBody(body);
+        QObject::connect(&m_server, &QTcpServer::newConnection, [this]() {
+            while (QTcpSocket* socket = m_server.nextPendingConnection()) {
+                serve(socket);
+            }
+        });
+        m_server.listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url() const { return QUrl(QString("http://127.0.0.1:%1/game.apk").arg(m_server.serverPort())); }
+    const QByteArray& body() const { return m_body; }
+    QByteArray sha256() const { return QCryptographicHash::hash(m_body, QCryptographicHash::Sha256).toHex(); }
+    void setBody(const QByteArray& body) {
+        m_body = body;
+        m_etag = '"' + QCryptographicHash::hash(body, QCryptographicHash::Sha1).toHex().left(16) + '"';
+    }
+
+    qint64 dropAfter = -1;     // Bytes sent before hanging up, for the next dropCount responses
+    int dropCount = 0;
+    qint64 slowStart = -1;     // Responses from this offset trickle; -2 slows all
+    int chunkDelayMs = 20;     // Per 16 KiB when slow
+    qint64 bytesServed = 0;
+    QList<QByteArray> ranges;  // Range header of every GET
+
+private:
+    void serve(QTcpSocket* socket) {
+        auto request = std::make_shared<QByteArray>();
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, socket, request]() {
+            if (request->endsWith("\r\n\r\n")) {
+                return;
+            }
+            request->append(socket->readAll());
+            if (request->contains("\r\n\r\n")) {
+                *request = request->left(request->indexOf("\r\n\r\n") + 4);
+                respond(socket, *request);
+            }
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+
+    void respond(QTcpSocket* socket, const QByteArray& request) {
+        const QList<QByteArray> lines = request.trimmed().split('\n');
+        const bool head = lines.first().startsWith("HEAD");
+        QByteArray range;
+        QByteArray ifRange;
+        for (const QByteArray& line : lines) {
+            const qsizetype colon = line.indexOf(':');
+            const QByteArray name = line.left(colon).trimmed().toLower();
+            if (name == "range") {
+                range = line.mid(colon + 1).trimmed();
+            } else if (name == "if-range") {
+                ifRange = line.mid(colon + 1).trimmed();
+            }
+        }
+
+        qint64 start = 0;
+        qint64 end = m_body.size();
+        QByteArray status = "200 OK";
+        QByteArray headers = "Accept-Ranges: bytes\r\nETag: " + m_etag + "\r\nConnection: close\r\n";
+        if (!head) {
+            ranges.append(range);
+        }
+        if (!head && range.startsWith("bytes=") && (ifRange.isEmpty() || ifRange == m_etag)) {
+            const QList<QByteArray> bounds = range.mid(6).split('-');
+            start = bounds.at(0).toLongLong();
+            end = std::min<qint64>(bounds.at(1).toLongLong() + 1, m_body.size());
+            status = "206 Partial Content";
+            headers += "Content-Range: bytes " + QByteArray::number(start) + "-" + QByteArray::number(end - 1)
+                + "/" + QByteArray::number(m_body.size()) + "\r\n";
+        }
+        headers += "Content-Length: " + QByteArray::number(end - start) + "\r\n";
+        socket->write("HTTP/1.1 " + status + "\r\n" + headers + "\r\n");
+        if (head) {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        qint64 stop = end;
+        if (dropCount > 0 && dropAfter >= 0) {
+            --dropCount;
+            stop = std::min(end, start + dropAfter);
+        }
+        const bool slow = slowStart == -2 || (slowStart >= 0 && start == slowStart);
+        auto offset = std::make_shared<qint64>(start);
+        auto* timer = new QTimer(socket);
+        timer->setInterval(slow ? chunkDelayMs : 0);
+        QObject::connect(timer, &QTimer::timeout, socket, [=, this]() {
+            // Hung up on by the client
+            if (socket->state() != QAbstractSocket::ConnectedState) {
+                timer->stop();
+                return;
+            }
+            if (socket->bytesToWrite() > 256 * 1024) {
+                return;
+            }
+            const qint64 length = std::min<qint64>(slow ? 16 * 1024 : 64 * 1024, stop - *offset);
+            socket->write(m_body.constData() + *offset, length);
+            *offset += length;
+            bytesServed += length;
+            if (*offset >= stop) {
+                timer->stop();
+                if (stop < end) {
+                    socket->abort();
+                } else {
+                    socket->disconnectFromHost();
+                }
+            }
+        });
+        timer->start();
+    }
+
+    QTcpServer m_server;
+    QByteArray m_body;
+    QByteArray m_etag;
+};
+
+// amdgpu tables captured from a ROG Ally (Phoenix), a Steam Deck (Van
+// Gogh) and an RX 6800 (Navi 21, with the RDNA3-style deep-sleep line)
+const QByteArray PhoenixDpmSclk =
+    "0: 800Mhz \n"
+    "1: 1100Mhz *\n"
+    "2: 2700Mhz \n";
+const QByteArray PhoenixOdClkVoltage =
+    "OD_SCLK:\n"
+    "0: 800Mhz\n"
+    "1: 2700Mhz\n"
+    "OD_RANGE:\n"
+    "SCLK:     800Mhz       2700Mhz\n";
+const QByteArray VanGoghOdClkVoltage =
+    "OD_SCLK:\n"
+    "0:        200Mhz\n"
+    "1:       1600Mhz\n"
+    "OD_CCLK:\n"
+    "0:       1400Mhz\n"
+    "1:       3500Mhz\n"
+    "OD_RANGE:\n"
+    "SCLK:     200Mhz       1600Mhz\n"
+    "CCLK:    1400Mhz       3500Mhz\n";
+const QByteArray Navi21DpmSclk =
+    "S: 19Mhz *\n"
+    "0: 500Mhz \n"
+    "1: 1274Mhz \n"
+    "2: 2615Mhz \n";
+const QByteArray Navi21OdClkVoltage =
+    "OD_SCLK:\n"
+    "0: 500Mhz\n"
+    "1: 2615Mhz\n"
+    "OD_MCLK:\n"
+    "0: 97Mhz\n"
+    "1: 1000MHz\n"
+    "OD_VDDGFX_OFFSET:\n"
+    "0mV\n"
+    "OD_RANGE:\n"
+    "SCLK:     500Mhz       3150Mhz\n"
+    "MCLK:     674Mhz       1200Mhz\n";
+
+// Thirty-minute temperature trace: idle desktop, ramp into a game,
+// hovering around 80 °C, then cooling down. Includes sensor jitter.
+double simulatedTemperature(qint64 ms) {
+    const double s = ms / 1000.0;
+    double base;
+    if (s < 600) {
+        base = 45.0;
+    } else if (s < 720) {
+        base = 45.0 + (s - 600) / 120.0 * 40.0;
+    } else if (s < 1500) {
+        base = 78.0 + 4.0 * std::sin((s - 720) / 60.0);
+    } else if (s < 1620) {
+        base = 78.0 - (s - 1500) / 120.0 * 30.0;
+    } else {
+        base = 48.0;
+    }
+    return base + 0.3 * std::sin(s * 7.3);
+}
+
+// Times at which reads observe the trace crossing threshold, with 0.5 °C
+// hysteresis so jitter does not count as a crossing
+QVector<qint64> thresholdCrossings(const QVector<QPair<qint64, double>>& reads, double threshold) {
+    QVector<qint64> crossings;
+    int side = 0;
+    for (const auto& read : reads) {
+        int next = side;
+        if (read.second > threshold + 0.5) {
+            next = 1;
+        } else if (read.second < threshold - 0.5) {
+            next = -1;
+        }
+        if (next != side) {
+            if (side != 0) {
+                crossings.append(read.first);
+            }
+            side = next;
+        }
+    }
+    return crossings;
+}
+
+struct GovernorReplay {
+    double energyJoules = 0.0;
+    int missedSeconds = 0;
+    int reversals = 0;
+    int maxTdpAboveLimit = 0;
+};
+
+// Closed-loop replay: frame times recorded uncapped at 15 W are scaled to
+// the TDP the governor picked (fps ~ TDP^0.7) and capped at the target,
+// one second of frames per control step. Without a governor the TDP stays
+// at the fixed preset value.
+GovernorReplay replayGovernor(const QVector<double>& recorded, const QVector<double>& temperatures,
+                              TdpGovernor* governor, int targetFps) {
+    GovernorReplay result;
+    int tdp = 15;
+    int lastDirection = 0;
+    int frame = 0;
+    if (governor) {
+        governor->setTargetFps(targetFps);
+        governor->reset(tdp, 0);
+    }
+
+    for (int second = 0; second < temperatures.size() && frame < recorded.size(); ++second) {
+        const double scale = std::pow(15.0 / tdp, 0.7);
+        double elapsed = 0.0;
+        int frames = 0;
+        while (elapsed < 1000.0 && frame < recorded.size()) {
+            const double ms = std::max(recorded[frame++] * scale, 1000.0 / targetFps);
+            elapsed += ms;
+            ++frames;
+            if (governor) {
+                governor->addFrameTime(ms);
+            }
+        }
+        if (frames * 1000.0 / elapsed < targetFps * 0.95) {
+            ++result.missedSeconds;
+        }
+        result.energyJoules += tdp;
+
+        if (governor) {
+            const int next = governor->update((second + 1) * 1000, temperatures[second]).tdp;
+            const int direction = next > tdp ? 1 : (next < tdp ? -1 : 0);
+            if (direction != 0) {
+                if (lastDirection != 0 && direction != lastDirection) {
+                    ++result.reversals;
+                }
+                lastDirection = direction;
+            }
+            if (temperatures[second] > governor->limits().thermalLimit && next > tdp) {
+                ++result.maxTdpAboveLimit;
+            }
+            tdp = next;
+        }
+    }
+    return result;
+}
+
+struct ScalerReplay {
+    int changes = 0;
+    int reversals = 0;
+    double overBudget = 0.0;  // Fraction of frames more than 5% over the budget
+    double minScale = 1.0;
+    QVector<double> scales;        // At the end of each second
+    QVector<qint64> changeTimes;   // ms
+};
+
+// Closed-loop replay: the trace holds the GPU time of a frame at full
+// resolution, 60 samples per second of play. At a lower scale a frame
+// costs that times the fraction of pixels left plus a fixed CPU time,
+// and gamescope's limiter holds it to at least the frame budget. The
+// scaler runs every 250 ms, as in GameManager.
+ScalerReplay replayScaler(const QVector<double>& gpuTimes, double cpuMs, ResolutionScaler& scaler) {
+    ScalerReplay result;
+    const double budget = 1000.0 / scaler.targetFps();
+    const double endMs = gpuTimes.size() * 1000.0 / 60.0;
+    double now = 0.0;
+    qint64 nextUpdate = 250;
+    int frames = 0;
+    int over = 0;
+    int lastDirection = 0;
+
+    while (now < endMs) {
+        const int sample = std::min(int(now * 60.0 / 1000.0), int(gpuTimes.size()) - 1);
+        const double scale = scaler.scale();
+        const double ms = std::max(cpuMs + gpuTimes[sample] * scale * scale, budget);
+        now += ms;
+        ++frames;
+        if (ms > budget * 1.05) {
+            ++over;
+        }
+        scaler.addFrameTime(ms);
+
+        for (; nextUpdate <= now; nextUpdate += 250) {
+            const double before = scaler.scale();
+            if (scaler.update(nextUpdate)) {
+                const int direction = scaler.scale() > before ? 1 : -1;
+                if (lastDirection != 0 && direction != lastDirection) {
+                    ++result.reversals;
+                }
+                lastDirection = direction;
+                result.changeTimes.append(nextUpdate);
+            }
+            result.minScale = std::min(result.minScale, scaler.scale());
+            if (nextUpdate % 1000 == 0) {
+                result.scales.append(scaler.scale());
+            }
+        }
+    }
+    result.changes = result.changeTimes.size();
+    result.overBudget = frames > 0 ? double(over) / frames : 0.0;
+    return result;
+}
+
+// GPU times of a game scene by scene: {full-resolution GPU ms, seconds}
+QVector<double> sceneTrace(const QVector<QPair<double, int>>& scenes) {
+    QVector<double> trace;
+    for (const auto& scene : scenes) {
+        for (int i = 0; i < scene.second * 60; ++i) {
+            trace.append(scene.first * (1.0 + 0.08 * std::sin(i * 0.37) + 0.03 * std::sin(i * 1.91)));
+        }
+    }
+    return trace;
+}
+
+// A field of /proc/self/status or /proc/self/task/<tid>/status
+qint64 procStatusValue(const QString& path, const QByteArray& field) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        if (line.startsWith(field + ':')) {
+            return line.mid(field.size() + 1).trimmed().split(' ').first().toLongLong();
+        }
+    }
+    return 0;
+}
+
+qint64 residentKiB() {
+    return procStatusValue("/proc/self/status", "VmRSS");
+}
+
+// Times any thread of the process has been switched out, each one a
+// wakeup when it next runs
+qint64 contextSwitches() {
+    qint64 switches = 0;
+    for (const QString& tid : QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QString status = "/proc/self/task/" + tid + "/status";
+        switches += procStatusValue(status, "voluntary_ctxt_switches")
+                  + procStatusValue(status, "nonvoluntary_ctxt_switches");
+    }
+    return switches;
+}
+
+// Let the event loop idle; unlike QTest::qWait() it does not poll
+void idleEventLoop(int ms) {
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+} // namespace
 
 // Steam Integration Tests
 void TestSuite::testSteamInitialization() {
@@ -12,9 +487,11 @@ void TestSuite::testSteamInitialization() {
     QVERIFY(steam->initialize());
     QVERIFY(steam->isSteamRunning());
     
-    // Test Steam environment variables
-    QCOMPARE(qgetenv("SDL_VIDEODRIVER"), QByteArray("wayland"));
-    QCOMPARE(qgetenv("STEAM_RUNTIME_PREFER_HOST_LIBRARIES"), QByteArray("1"));
+    // Steam's variables are for the game; the launch plan carries them
+    const LaunchPlan plan = GameManager::instance()->compileLaunchPlan();
+    QCOMPARE(plan.environment.value("SDL_VIDEODRIVER"), QString("wayland"));
+    QCOMPARE(plan.environment.value("STEAM_RUNTIME_PREFER_HOST_LIBRARIES"), QString("1"));
+    QCOMPARE(plan.processEnvironment().value("SDL_VIDEODRIVER"), QString("wayland"));
 }
 
 void TestSuite::testSteamGamepadConfig() {
@@ -46,8 +523,12 @@ void TestSuite::testPerformanceProfiles() {
     
     // Test profile-specific settings
     QCOMPARE(control->currentTDP(), 15);
+    QSignalSpy tdpSpy(control, &AllySystemControl::tdpChanged);
     QVERIFY(control->setPerformanceProfile(AllySystemControl::PerformanceProfile::TURBO));
     QCOMPARE(control->currentTDP(), 25);
+    // The profile's TDP is announced like a direct setTDP()
+    QCOMPARE(tdpSpy.count(), 1);
+    QCOMPARE(tdpSpy.first().first().toInt(), 25);
 }
 
 void TestSuite::testTDPControl() {
@@ -76,6 +557,665 @@ void TestSuite::testTemperatureMonitoring() {
     QVERIFY(temp >= 0.0f && temp <= 100.0f);
 }
 
+void TestSuite::testSysfsAttribute() {
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon3/temp1_input", "45000\n");
+    writeFakeSysfs(root.path(), "devices/platform/asus-nb-wmi/fan_speed", "100\n");
+
+    Sysfs::setRoot(root.path());
+    QCOMPARE(Sysfs::path("class/hwmon"), root.path() + "/class/hwmon");
+
+    SysfsAttribute temp(Sysfs::path("class/hwmon/hwmon3/temp1_input"));
+    qint64 value = 0;
+    QVERIFY(temp.readInt(value));
+    QCOMPARE(value, qint64(45000));
+    QVERIFY(temp.isOpen());
+
+    // The descriptor stays open and picks up new values from offset 0
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon3/temp1_input", "51250\n");
+    QVERIFY(temp.readInt(value));
+    QCOMPARE(value, qint64(51250));
+
+    // Shorter writes must not leave stale trailing digits behind
+    SysfsAttribute fan(Sysfs::path("devices/platform/asus-nb-wmi/fan_speed"),
+                       SysfsAttribute::Mode::WriteOnly);
+    QVERIFY(fan.writeInt(40));
+    QCOMPARE(readFakeSysfs(root.path(), "devices/platform/asus-nb-wmi/fan_speed"), QByteArray("40"));
+
+    SysfsAttribute missing(Sysfs::path("class/power_supply/BAT0/capacity"));
+    QVERIFY(!missing.exists());
+    QVERIFY(!missing.readInt(value));
+
+    Sysfs::setRoot("/sys");
+}
+
+void TestSuite::testSensorDiscovery() {
+    using Sensor = SensorRegistry::Sensor;
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    Sysfs::setRoot(root.path());
+
+    auto* registry = SensorRegistry::instance();
+    registry->scan();
+
+    QCOMPARE(registry->handle(Sensor::CpuTemperature).path,
+             root.path() + "/class/hwmon/hwmon2/temp1_input");
+    QCOMPARE(registry->handle(Sensor::CpuTemperature).scale, 0.001);
+    QCOMPARE(registry->handle(Sensor::GpuTemperature).path,
+             root.path() + "/class/hwmon/hwmon4/temp1_input");
+    QCOMPARE(registry->handle(Sensor::GpuClock).path,
+             root.path() + "/class/drm/card1/device/pp_dpm_sclk");
+    QCOMPARE(registry->handle(Sensor::BatteryCapacity).path,
+             root.path() + "/class/power_supply/BAT0/capacity");
+    QVERIFY(registry->has(Sensor::AcOnline));
+    QVERIFY(registry->has(Sensor::FanRpm));
+    QVERIFY(registry->handle(Sensor::TdpLimit).writable);
+    QVERIFY(!registry->has(Sensor::BatteryCurrentNow));
+    QVERIFY(!registry->has(Sensor::GpuOverdriveTable));
+
+    SysfsAttribute temp(registry->handle(Sensor::CpuTemperature).path);
+    qint64 raw = 0;
+    QVERIFY(temp.readInt(raw));
+    QCOMPARE(raw * registry->handle(Sensor::CpuTemperature).scale, 55.0);
+
+    // Without the Ally node the TDP goes to the RAPL package zone, not
+    // its MMIO mirror or a subzone
+    QDir(root.path() + "/class/powercap/powercap0").removeRecursively();
+    for (const char* zone : {"intel-rapl-mmio:0", "intel-rapl:0", "intel-rapl:0:0"}) {
+        const QString dir = QString("class/powercap/") + zone;
+        writeFakeSysfs(root.path(), dir + "/name", QByteArray(zone).endsWith(":0:0") ? "core\n" : "package-0\n");
+        writeFakeSysfs(root.path(), dir + "/constraint_0_power_limit_uw", "15000000\n");
+    }
+    registry->rescan(SensorRegistry::Subsystem::Powercap);
+    QCOMPARE(registry->handle(Sensor::TdpLimit).path,
+             root.path() + "/class/powercap/intel-rapl:0/constraint_0_power_limit_uw");
+
+    Sysfs::setRoot("/sys");
+}
+
+void TestSuite::testSensorHotplug() {
+    using Sensor = SensorRegistry::Sensor;
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    Sysfs::setRoot(root.path());
+
+    auto* registry = SensorRegistry::instance();
+    registry->scan();
+    const QString cpuTemp = registry->handle(Sensor::CpuTemperature).path;
+
+    QSignalSpy spy(registry, &SensorRegistry::sensorsChanged);
+
+    // Battery driver rebinds as BAT1
+    QDir(root.path() + "/class/power_supply/BAT0").removeRecursively();
+    writeFakeSysfs(root.path(), "class/power_supply/BAT1/type", "Battery\n");
+    writeFakeSysfs(root.path(), "class/power_supply/BAT1/capacity", "79\n");
+
+    // Periodic change events must not trigger a rescan
+    registry->handleUevent(fakeUevent("change", "/devices/LNXSYSTM:00/PNP0C0A:00/power_supply/BAT0",
+                                      "power_supply"));
+    QCOMPARE(spy.count(), 0);
+
+    registry->handleUevent(fakeUevent("add", "/devices/LNXSYSTM:00/PNP0C0A:00/power_supply/BAT1",
+                                      "power_supply"));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).value<SensorRegistry::Subsystem>(), SensorRegistry::Subsystem::PowerSupply);
+    QCOMPARE(registry->handle(Sensor::BatteryCapacity).path,
+             root.path() + "/class/power_supply/BAT1/capacity");
+
+    // Other subsystems are left untouched
+    QCOMPARE(registry->handle(Sensor::CpuTemperature).path, cpuTemp);
+
+    Sysfs::setRoot("/sys");
+}
+
+void TestSuite::testTelemetrySampler() {
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    Sysfs::setRoot(root.path());
+    SensorRegistry::instance()->scan();
+
+    TelemetrySampler sampler;
+    sampler.setSensors(SensorRegistry::instance()->handles());
+    sampler.setFixedInterval(5);
+    QSignalSpy spy(&sampler, &TelemetrySampler::sampleAvailable);
+    sampler.start();
+    QVERIFY(spy.wait(1000));
+
+    TelemetrySample sample = sampler.latest();
+    QCOMPARE(sample.cpuTemperature, 55.0f);
+    QCOMPARE(sample.gpuTemperature, 52.0f);
+    QCOMPARE(sample.batteryLevel, 80);
+    QCOMPARE(sample.batteryPower, 12.0f);
+    QCOMPARE(sample.fanRpm, 3200);
+    QVERIFY(!sample.charging);
+
+    // Many samples are published while the GUI thread is busy, but only
+    // one notification is queued for them
+    QThread::msleep(100);
+    const int before = spy.count();
+    QCoreApplication::processEvents();
+    QVERIFY(sampler.version() > 10);
+    QVERIFY(spy.count() - before <= 1);
+
+    writeFakeSysfs(root.path(), "class/power_supply/BAT0/status", "Charging\n");
+    QTRY_VERIFY_WITH_TIMEOUT(sampler.latest().charging, 1000);
+
+    sampler.stop();
+    Sysfs::setRoot("/sys");
+}
+
+void TestSuite::testTelemetrySlowSensor() {
+    // An EC-backed attribute that blocks for 200 ms on every read
+    std::atomic<int> reads{0};
+    TelemetrySampler sampler;
+    sampler.setSource([&reads](TelemetrySample& sample, quint32) {
+        QThread::msleep(200);
+        sample.cpuTemperature = 60.0f + reads.fetch_add(1);
+    });
+    sampler.setFixedInterval(1);
+
+    int samples = 0;
+    connect(&sampler, &TelemetrySampler::sampleAvailable, this, [&]() {
+        sampler.latest();
+        ++samples;
+    });
+
+    // Measure how late a 5 ms GUI timer fires while the sampler is busy
+    qint64 worstGapMs = 0;
+    QElapsedTimer gap;
+    QTimer tick;
+    tick.setTimerType(Qt::PreciseTimer);
+    connect(&tick, &QTimer::timeout, this, [&]() {
+        worstGapMs = qMax(worstGapMs, gap.restart());
+    });
+
+    sampler.start();
+    gap.start();
+    tick.start(5);
+    QTest::qWait(1000);
+    tick.stop();
+    sampler.stop();
+
+    qInfo() << "slow sensor:" << reads.load() << "reads," << samples
+            << "samples consumed, worst GUI timer gap" << worstGapMs << "ms";
+    QVERIFY(reads.load() >= 3);
+    QVERIFY(samples >= 3);
+    QVERIFY(worstGapMs < 50);
+}
+
+void TestSuite::testTelemetryStore() {
+    QVERIFY(TelemetryStore::storageBytes() < 256 * 1024);
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("telemetry.bin");
+    const qint64 start = 1700000000000;
+
+    {
+        TelemetryStore store;
+        QVERIFY(store.openFile(path));
+        QVERIFY(store.isFileBacked());
+
+        // Ten hours of 2 s samples; temperature ramps 40..99 every minute
+        for (qint64 t = 0; t < 10 * 3600 * 1000; t += 2000) {
+            const float temp = 40.0f + (t / 1000) % 60;
+            store.append(start + t, {temp, 50.0f, 15.0f, 1600.0f, 80.0f, 12.0f});
+        }
+
+        // Rings are full but never grow
+        QCOMPARE(store.size(TelemetryStore::Seconds), TelemetryStore::TierCapacity[0] + 1);
+        QCOMPARE(store.size(TelemetryStore::Minutes), TelemetryStore::TierCapacity[2] + 1);
+
+        const qint64 end = start + 10 * 3600 * 1000;
+        const auto minutes = store.query(TelemetryStore::Minutes, TelemetryStore::Temperature,
+                                         end - 10 * 60 * 1000, end);
+        QVERIFY(minutes.size() >= 10);
+        for (const auto& point : minutes.mid(0, minutes.size() - 1)) {
+            QCOMPARE(point.min, 40.0f);
+            QCOMPARE(point.max, 98.0f);
+            QCOMPARE(point.avg, 69.0f);
+        }
+
+        const auto tens = store.query(TelemetryStore::TenSeconds, TelemetryStore::Temperature,
+                                      end - 60 * 1000, end - 50 * 1000);
+        QVERIFY(!tens.isEmpty());
+        QCOMPARE(tens.first().max - tens.first().min, 8.0f);
+
+        // Old ranges fall back to coarser tiers
+        QCOMPARE(store.tierFor(end - 60 * 1000), TelemetryStore::Seconds);
+        QCOMPARE(store.tierFor(end - 3600 * 1000), TelemetryStore::TenSeconds);
+        QCOMPARE(store.tierFor(end - 6 * 3600 * 1000), TelemetryStore::Minutes);
+        QCOMPARE(store.summarize(TelemetryStore::PowerDraw, start, end).avg, 12.0f);
+    }
+
+    // History survives reopening the backing file
+    TelemetryStore reopened;
+    QVERIFY(reopened.openFile(path));
+    QCOMPARE(reopened.size(TelemetryStore::Minutes), TelemetryStore::TierCapacity[2] + 1);
+}
+
+void TestSuite::testAdaptivePolling() {
+    const qint64 duration = 30 * 60 * 1000;
+    const QVector<double> thresholds = {50.0, 60.0, 70.0, 80.0};
+
+    QVector<QPair<qint64, double>> truth;
+    for (qint64 t = 0; t < duration; t += 50) {
+        truth.append({t, simulatedTemperature(t)});
+    }
+
+    // Old behaviour: every sensor every 2 s
+    QVector<QPair<qint64, double>> fixed;
+    for (qint64 t = 0; t < duration; t += 2000) {
+        fixed.append({t, simulatedTemperature(t)});
+    }
+
+    PollScheduler scheduler;
+    scheduler.setThresholds(PollScheduler::Temperature, thresholds);
+    scheduler.setActiveGroups(PollScheduler::groupBit(PollScheduler::Temperature));
+    scheduler.reset(0);
+    QVector<QPair<qint64, double>> adaptive;
+    for (qint64 t = 0; t < duration; t = scheduler.nextDeadline()) {
+        adaptive.append({t, simulatedTemperature(t)});
+        scheduler.update(PollScheduler::Temperature, t, simulatedTemperature(t));
+    }
+
+    qInfo() << "temperature reads: fixed" << fixed.size() << "adaptive" << adaptive.size();
+    QVERIFY(adaptive.size() < fixed.size() * 3 / 4);
+
+    // Every crossing is seen, no later than the fixed 2 s poll saw it
+    for (double threshold : thresholds) {
+        const auto expected = thresholdCrossings(truth, threshold);
+        const auto seenFixed = thresholdCrossings(fixed, threshold);
+        const auto seenAdaptive = thresholdCrossings(adaptive, threshold);
+        QCOMPARE(seenAdaptive.size(), expected.size());
+
+        QCOMPARE(seenFixed.size(), expected.size());
+
+        qint64 worstFixed = 0;
+        qint64 worstAdaptive = 0;
+        for (int i = 0; i < expected.size(); ++i) {
+            worstFixed = qMax(worstFixed, seenFixed[i] - expected[i]);
+            worstAdaptive = qMax(worstAdaptive, seenAdaptive[i] - expected[i]);
+        }
+        QVERIFY(worstAdaptive <= qMax(worstFixed, qint64(4000)));
+    }
+
+    // Battery draining 1% every 90 s is read at minutes scale
+    PollScheduler battery;
+    battery.setActiveGroups(PollScheduler::groupBit(PollScheduler::Battery));
+    battery.reset(0);
+    int batteryReads = 0;
+    for (qint64 t = 0; t < duration; t = battery.nextDeadline()) {
+        battery.update(PollScheduler::Battery, t, 100 - t / 90000);
+        ++batteryReads;
+    }
+    QVERIFY(batteryReads < duration / 2000 / 10);
+
+    // The sampler batches due groups into one wakeup and counts them
+    TelemetrySampler sampler;
+    sampler.setSource([](TelemetrySample& sample, quint32) {
+        sample.cpuTemperature = 45.0f;
+    });
+    sampler.start();
+    QTest::qWait(3000);
+    qInfo() << "idle sampler:" << sampler.wakeupsPerMinute() << "wakeups/min,"
+            << sampler.reads(PollScheduler::Temperature) << "temperature reads,"
+            << sampler.reads(PollScheduler::Battery) << "battery reads";
+    QCOMPARE(sampler.reads(PollScheduler::Battery), quint64(1));
+    QVERIFY(sampler.wakeups() < 3000 / 250);
+
+    // Pausing leaves only the temperature group running
+    sampler.setActiveGroups(PollScheduler::groupBit(PollScheduler::Temperature));
+    sampler.requestPoll(PollScheduler::AllGroups);
+    QTest::qWait(100);
+    QCOMPARE(sampler.reads(PollScheduler::Battery), quint64(1));
+    sampler.stop();
+}
+
+void TestSuite::testFanCurve() {
+    FanCurve curve;
+    QVariantMap dynamic;
+    dynamic["temp_thresholds"] = QVariantList{45, 55, 65, 75, 85};
+    dynamic["speeds"] = QVariantList{30, 50, 70, 85, 100};
+    QVERIFY(curve.load(dynamic));
+    QCOMPARE(curve.interpolate(20.0), 30.0);
+    QCOMPARE(curve.interpolate(50.0), 40.0);
+    QCOMPARE(curve.interpolate(80.0), 92.5);
+    QCOMPARE(curve.interpolate(95.0), 100.0);
+
+    QVariantMap broken;
+    broken["temp_thresholds"] = QVariantList{60, 50};
+    broken["speeds"] = QVariantList{40, 60};
+    QVERIFY(!curve.load(broken));
+    QCOMPARE(curve.points().size(), 5);
+
+    // Replay traces at the old 2 s tick. The old ladder wrote on every
+    // tick; the curve should only write when its output changes.
+    auto replay = [&curve](const std::function<double(qint64)>& trace, qint64 duration) {
+        int writes = 0;
+        int speed = -1;
+        int previous = -1;
+        for (qint64 t = 0; t < duration; t += 2000) {
+            const int next = curve.update(t, trace(t));
+            if (previous >= 0) {
+                // Ramp limit: 25 %/s up, 5 %/s down, plus one quantum
+                QVERIFY(next - previous <= 25 * 2 + 5);
+                QVERIFY(previous - next <= 5 * 2 + 5);
+            }
+            previous = next;
+            if (next != speed) {
+                speed = next;
+                ++writes;
+            }
+        }
+        return writes;
+    };
+
+    const qint64 session = 30 * 60 * 1000;
+    const int oldWrites = session / 2000;
+    const int sessionWrites = replay(simulatedTemperature, session);
+
+    // Hovering right on a curve point with sensor jitter
+    curve.reset(70);
+    const int hoverWrites = replay([](qint64 ms) {
+        return 65.0 + 1.2 * std::sin(ms / 1000.0 * 1.7);
+    }, session);
+
+    qInfo() << "fan writes: old" << oldWrites << "session" << sessionWrites << "hover" << hoverWrites;
+    QVERIFY(sessionWrites < oldWrites / 10);
+    QVERIFY(hoverWrites <= 3);
+    QVERIFY(curve.output() >= 70);
+}
+
+void TestSuite::testHardwareState() {
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+
+    // GPU clock node that refuses writes
+    const QString sclk = root.path() + "/class/drm/card1/device/pp_dpm_sclk";
+    QVERIFY(QFile::remove(sclk));
+    QVERIFY(QDir().mkpath(sclk));
+
+    auto* control = AllySystemControl::instance();
+    control->setSysfsRoot(root.path());
+    QSignalSpy spy(control, &AllySystemControl::hardwareStateChanged);
+
+    HardwareState balanced;
+    balanced.set(HardwareState::PowerProfile, 1).set(HardwareState::Tdp, 15);
+    QVERIFY(control->applyHardwareState(balanced));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(readFakeSysfs(root.path(), "class/powercap/powercap0/tdp"), QByteArray("15000000"));
+
+    // Re-applying an unchanged state writes nothing
+    writeFakeSysfs(root.path(), "class/powercap/powercap0/tdp", "1");
+    QVERIFY(control->applyHardwareState(balanced));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(readFakeSysfs(root.path(), "class/powercap/powercap0/tdp"), QByteArray("1"));
+
+    // Only the changed knob is written, with one consolidated signal
+    writeFakeSysfs(root.path(), "devices/platform/asus-nb-wmi/profile", "9");
+    HardwareState turbo = balanced;
+    turbo.set(HardwareState::Tdp, 25);
+    QVERIFY(control->applyHardwareState(turbo));
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.last().at(0).toUInt(), HardwareState::knobBit(HardwareState::Tdp));
+    QCOMPARE(readFakeSysfs(root.path(), "class/powercap/powercap0/tdp"), QByteArray("25000000"));
+    QCOMPARE(readFakeSysfs(root.path(), "devices/platform/asus-nb-wmi/profile"), QByteArray("9"));
+    QVERIFY(control->knobLatencyNs(HardwareState::Tdp) > 0);
+    QCOMPARE(control->currentTDP(), 25);
+
+    // A failed GPU write rolls the TDP back and leaves the state untouched
+    HardwareState saver;
+    saver.set(HardwareState::Tdp, 10).set(HardwareState::GpuClock, 1200);
+    QVERIFY(!control->applyHardwareState(saver));
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(readFakeSysfs(root.path(), "class/powercap/powercap0/tdp"), QByteArray("25000000"));
+    QCOMPARE(control->currentTDP(), 25);
+    QCOMPARE(control->appliedState().value(HardwareState::Tdp), 25);
+    QVERIFY(!control->appliedState().has(HardwareState::GpuClock));
+
+    // The first apply on a tree has nothing applied to roll back to; the
+    // knobs it writes are read first and restored to what was there
+    QTemporaryDir fresh;
+    createFakeAllyTree(fresh.path());
+    const QString freshSclk = fresh.path() + "/class/drm/card1/device/pp_dpm_sclk";
+    QVERIFY(QFile::remove(freshSclk));
+    QVERIFY(QDir().mkpath(freshSclk));
+    control->setSysfsRoot(fresh.path());
+    QVERIFY(control->appliedState().isEmpty());
+
+    HardwareState first;
+    first.set(HardwareState::PowerProfile, 2).set(HardwareState::Tdp, 25).set(HardwareState::GpuClock, 1200);
+    QVERIFY(!control->applyHardwareState(first));
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(control->appliedState().value(HardwareState::PowerProfile), 1);
+    QCOMPARE(control->appliedState().value(HardwareState::Tdp), 15);
+    QVERIFY(!control->appliedState().has(HardwareState::GpuClock));
+    QCOMPARE(readFakeSysfs(fresh.path(), "devices/platform/asus-nb-wmi/profile").trimmed(), QByteArray("1"));
+    QCOMPARE(readFakeSysfs(fresh.path(), "class/powercap/powercap0/tdp").trimmed(), QByteArray("15000000"));
+    QCOMPARE(readFakeSysfs(fresh.path(), "class/drm/card1/device/power_dpm_force_performance_level").trimmed(),
+             QByteArray("auto"));
+
+    control->setSysfsRoot("/sys");
+}
+
+void TestSuite::testEnergyAccounting() {
+    using Profile = AllySystemControl::PerformanceProfile;
+    const int turbo = static_cast<int>(Profile::TURBO);
+    const int balanced = static_cast<int>(Profile::BALANCED);
+    const int silent = static_cast<int>(Profile::SILENT);
+
+    // Synthetic discharge: 20 minutes at ~25 W in turbo, a charging break
+    // that must not count, then 20 minutes at ~15 W in balanced. energy_now
+    // moves in 0.1 Wh steps like the EC reports it.
+    EnergyMeter meter;
+    double energy = 50.0;
+    qint64 t = 0;
+    auto play = [&](int profile, double watts, qint64 durationMs, bool discharging) {
+        meter.setProfile(profile);
+        for (const qint64 end = t + durationMs; t < end; t += 2000) {
+            const double power = watts + 2.0 * std::sin(t / 7000.0);
+            meter.addSample(t, power, std::floor(energy * 10.0) / 10.0, discharging);
+            meter.addFrames(120);  // 60 fps
+            if (discharging) {
+                energy -= power * 2.0 / 3600.0;
+            }
+        }
+    };
+    play(turbo, 25.0, 20 * 60 * 1000, true);
+    play(turbo, 20.0, 5 * 60 * 1000, false);
+    play(balanced, 15.0, 20 * 60 * 1000, true);
+
+    QVERIFY(qAbs(meter.drainWatts(turbo) - 25.0) < 1.0);
+    QVERIFY(qAbs(meter.drainWatts(balanced) - 15.0) < 1.0);
+    QVERIFY(qAbs(meter.sessionJoules() - 40.0 * 60 * 20) < 40.0 * 60 * 20 * 0.02);
+    QVERIFY(qAbs(meter.joulesPerFrame(balanced) - 15.0 / 60.0) < 0.02);
+    // Frames rendered while charging are left out like the energy
+    QVERIFY(qAbs(meter.joulesPerFrame(turbo) - 25.0 / 60.0) < 0.02);
+    QVERIFY(qAbs(meter.remainingMinutes(balanced) - energy * 60.0 / 15.0) < 3.0);
+    QVERIFY(meter.remainingMinutes(turbo) < meter.remainingMinutes(balanced));
+    QCOMPARE(meter.drainWatts(silent), -1.0);
+
+    // A battery without power_now falls back to current x voltage
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    QVERIFY(QFile::remove(root.path() + "/class/power_supply/BAT0/power_now"));
+    writeFakeSysfs(root.path(), "class/power_supply/BAT0/current_now", "1500000\n");
+    writeFakeSysfs(root.path(), "class/power_supply/BAT0/voltage_now", "15000000\n");
+    writeFakeSysfs(root.path(), "class/power_supply/BAT0/energy_now", "2000000\n");
+
+    Sysfs::setRoot(root.path());
+    SensorRegistry::instance()->scan();
+    {
+        TelemetrySampler sampler;
+        sampler.setSensors(SensorRegistry::instance()->handles());
+        sampler.setFixedInterval(5);
+        sampler.start();
+        QTRY_VERIFY(sampler.version() > 0);
+        const TelemetrySample sample = sampler.latest();
+        QVERIFY(qAbs(sample.batteryPower - 22.5f) < 0.01f);
+        QVERIFY(qAbs(sample.batteryEnergy - 2.0f) < 0.01f);
+        sampler.stop();
+    }
+
+    // At 22.5 W, 2 Wh lasts about five minutes: turbo is stepped down
+    auto* control = AllySystemControl::instance();
+    control->setSysfsRoot(root.path());
+    QVERIFY(control->setPerformanceProfile(Profile::TURBO));
+    control->setAutoDownshift(true, 120);
+    QTRY_COMPARE_WITH_TIMEOUT(control->currentProfile(), Profile::BALANCED, 10000);
+    QVERIFY(control->remainingPlaytimeMinutes(Profile::TURBO) < 10.0);
+
+    control->setAutoDownshift(false, 120);
+    control->setSysfsRoot("/sys");
+}
+
+void TestSuite::testGpuClockTables() {
+    GpuDpmTable dpm;
+    QVERIFY(dpm.parse(PhoenixDpmSclk));
+    QCOMPARE(dpm.levelsMhz, QVector<int>({800, 1100, 2700}));
+    QCOMPARE(dpm.currentLevel, 1);
+    QCOMPARE(dpm.currentMhz(), 1100);
+    QCOMPARE(dpm.nearestLevel(1200), 1);
+    QCOMPARE(dpm.nearestLevel(2000), 2);
+    QCOMPARE(dpm.nearestLevel(500), 0);
+    QCOMPARE(GpuDpmTable::parseCurrentMhz(PhoenixDpmSclk.constData()), 1100);
+
+    QVERIFY(dpm.parse(Navi21DpmSclk));
+    QCOMPARE(dpm.levelsMhz.size(), 3);
+    QVERIFY(dpm.sleeping);
+    QCOMPARE(dpm.currentMhz(), 19);
+    QCOMPARE(GpuDpmTable::parseCurrentMhz(Navi21DpmSclk.constData()), 19);
+    QCOMPARE(GpuDpmTable::parseCurrentMhz("0: 800Mhz\n1: 2700Mhz"), -1);
+    QVERIFY(!dpm.parse("0: 800Mhz\n2: 1600Mhz\n"));
+    QVERIFY(!dpm.parse("garbage"));
+
+    GpuOdTable od;
+    QVERIFY(od.parse(PhoenixOdClkVoltage));
+    QCOMPARE(od.sclkMin, 800);
+    QCOMPARE(od.sclkMax, 2700);
+    QCOMPARE(od.rangeMin, 800);
+    QCOMPARE(od.rangeMax, 2700);
+    QVERIFY(od.parse(VanGoghOdClkVoltage));
+    QCOMPARE(od.sclkMax, 1600);
+    QCOMPARE(od.rangeMin, 200);
+    QVERIFY(od.parse(Navi21OdClkVoltage));
+    QCOMPARE(od.sclkMax, 2615);
+    QCOMPARE(od.rangeMax, 3150);
+    QVERIFY(!od.parse("OD_SCLK:\n"));
+
+    // Minimal amdgpu: OD and level writes are only accepted in manual
+    // mode, and OD changes only take effect on commit
+    using Sensor = SensorRegistry::Sensor;
+    QByteArray level = "auto";
+    int odMin = 800;
+    int odMax = 2700;
+    int pendingMin = odMin;
+    int pendingMax = odMax;
+    int dpmLevel = 1;
+    bool odSupported = true;
+    bool commitWorks = true;
+    QList<QByteArray> writes;
+
+    auto reader = [&](Sensor sensor) -> QByteArray {
+        if (sensor == Sensor::GpuPerformanceLevel) {
+            return level + '\n';
+        }
+        if (sensor == Sensor::GpuClock) {
+            QByteArray text;
+            const int levels[] = {800, 1100, 2700};
+            for (int i = 0; i < 3; ++i) {
+                text += QByteArray::number(i) + ": " + QByteArray::number(levels[i]) + "Mhz"
+                        + (i == dpmLevel ? " *" : " ") + '\n';
+            }
+            return text;
+        }
+        if (sensor == Sensor::GpuOverdriveTable && odSupported) {
+            return "OD_SCLK:\n0: " + QByteArray::number(odMin) + "Mhz\n1: " + QByteArray::number(odMax)
+                   + "Mhz\nOD_RANGE:\nSCLK:     800Mhz       2700Mhz\n";
+        }
+        return QByteArray();
+    };
+    auto writer = [&](Sensor sensor, const QByteArray& value) {
+        writes.append(value);
+        if (sensor == Sensor::GpuPerformanceLevel) {
+            level = value;
+            return true;
+        }
+        if (level != "manual") {
+            return false;
+        }
+        if (sensor == Sensor::GpuClock) {
+            dpmLevel = value.toInt();
+            return true;
+        }
+        if (sensor != Sensor::GpuOverdriveTable || !odSupported) {
+            return false;
+        }
+        const QList<QByteArray> fields = value.split(' ');
+        if (fields.size() == 3 && fields[0] == "s") {
+            (fields[1] == "0" ? pendingMin : pendingMax) = fields[2].toInt();
+        } else if (value == "c" && commitWorks) {
+            odMin = pendingMin;
+            odMax = pendingMax;
+        }
+        return true;
+    };
+
+    GpuClockControl control(reader, writer);
+    QVERIFY(control.refresh());
+    QVERIFY(control.setClock(1600));
+    QCOMPARE(writes, QList<QByteArray>({"manual", "s 0 800", "s 1 1600", "c"}));
+    QCOMPARE(control.appliedClock(), 1600);
+    QCOMPARE(odMax, 1600);
+
+    // Out-of-range requests are clamped to OD_RANGE
+    QVERIFY(control.setClock(5000));
+    QCOMPARE(odMax, 2700);
+
+    // A commit the driver silently ignored is caught on read-back
+    commitWorks = false;
+    QVERIFY(!control.setClock(1200));
+    QCOMPARE(control.appliedClock(), 2700);
+    // The earlier clock is still in effect, and with it manual mode
+    QCOMPARE(level, QByteArray("manual"));
+
+    // Without overdrive the nearest DPM level is forced instead
+    odSupported = false;
+    level = "auto";
+    writes.clear();
+    GpuClockControl levels(reader, writer);
+    QVERIFY(levels.setClock(2000));
+    QCOMPARE(writes, QList<QByteArray>({"manual", "2"}));
+    QCOMPARE(levels.appliedClock(), 2700);
+    QCOMPARE(levels.effectiveClock(), 2700);
+
+    int mhz = 0;
+    QVERIFY(levels.currentClock(mhz));
+    QCOMPARE(mhz, 2700);
+
+    // Clock 0 hands the GPU back to automatic mode, which is also what
+    // it reads as there
+    QVERIFY(levels.setClock(0));
+    QCOMPARE(level, QByteArray("auto"));
+    QCOMPARE(levels.appliedClock(), 0);
+    QVERIFY(levels.currentClock(mhz));
+    QCOMPARE(mhz, 0);
+
+    // A clock that does not take leaves the level as it was found
+    writes.clear();
+    GpuClockControl stuck(reader, [&](Sensor sensor, const QByteArray& value) {
+        if (sensor == Sensor::GpuClock) {
+            writes.append(value);
+            return true;
+        }
+        return writer(sensor, value);
+    });
+    QVERIFY(!stuck.setClock(800));
+    QCOMPARE(writes, QList<QByteArray>({"manual", "0", "auto"}));
+    QCOMPARE(level, QByteArray("auto"));
+}
+
 // Game Optimization Tests
 void TestSuite::testGraphicsPresets() {
     auto* manager = GameManager::instance();
@@ -90,22 +1230,1539 @@ void TestSuite::testGraphicsPresets() {
     QVERIFY(manager->enableFSR(true));
 }
 
+void TestSuite::testTdpGovernor() {
+    QTemporaryDir dir;
+    const QString logPath = dir.path() + "/mangoapp.csv";
+
+    // Ten minutes captured uncapped at 15 W: light, heavy, light, medium
+    // and light scenes. Temperature spikes past the limit mid-way.
+    const QVector<double> sceneFps = {110, 50, 110, 75, 110};
+    QVector<double> temperatures;
+    {
+        QFile log(logPath);
+        QVERIFY(log.open(QIODevice::WriteOnly));
+        log.write("os,cpu,gpu,ram,kernel,driver,cpuscheduler\n");
+        log.write("Bazzite,AMD Ryzen Z1 Extreme,AMD Radeon Graphics,16GB,6.8.0,Mesa 24.1,performance\n");
+        log.write("fps,frametime,cpu_load,gpu_load,cpu_temp,gpu_temp\n");
+        for (int second = 0; second < 600; ++second) {
+            const double fps = sceneFps[second / 120];
+            for (int i = 0; i < int(fps); ++i) {
+                const double frameTime = 1000.0 / fps * (1.0 + 0.05 * std::sin(second * 13.0 + i));
+                log.write(QByteArray::number(fps, 'f', 1) + ',' + QByteArray::number(frameTime, 'f', 3) + ",40,90,60,58\n");
+            }
+            temperatures.append(second >= 300 && second < 360 ? 90.0 : 65.0);
+        }
+    }
+
+    const QVector<double> recorded = FrameTimeLog::readAll(logPath);
+    QVERIFY(recorded.size() > 50000);
+
+    // Incremental reads only return complete lines
+    {
+        FrameTimeLog tail;
+        tail.setPath(dir.path() + "/stats.txt");
+        QFile stats(tail.path());
+        QVERIFY(stats.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+        stats.write("16.6\n16.");
+        QCOMPARE(tail.readNew().size(), 1);
+        stats.write("8\n");
+        const QVector<double> next = tail.readNew();
+        QCOMPARE(next.size(), 1);
+        QCOMPARE(next.first(), 16.8);
+    }
+
+    const GovernorReplay fixed = replayGovernor(recorded, temperatures, nullptr, 60);
+    TdpGovernor governor;
+    const GovernorReplay governed = replayGovernor(recorded, temperatures, &governor, 60);
+
+    qInfo() << "fixed 15 W:" << fixed.energyJoules << "J," << fixed.missedSeconds << "s below target";
+    qInfo() << "governor:" << governed.energyJoules << "J," << governed.missedSeconds << "s below target,"
+            << governed.reversals << "reversals";
+
+    // Same frame rate for far less energy, and power is never added
+    // while over the thermal limit
+    QVERIFY(governed.energyJoules < fixed.energyJoules * 0.75);
+    QVERIFY(governed.missedSeconds < fixed.missedSeconds);
+    QCOMPARE(governed.maxTdpAboveLimit, 0);
+    QVERIFY(governed.reversals <= 30);
+}
+
+void TestSuite::testResolutionScaler() {
+    // Steps of about a fifth of the pixels each, down to the floor
+    ResolutionScaler scaler;
+    QCOMPARE(scaler.scale(), 1.0);
+    QCOMPARE(scaler.steps().last(), 0.5);
+    for (int i = 1; i < scaler.steps().size(); ++i) {
+        QVERIFY(scaler.steps()[i] < scaler.steps()[i - 1]);
+        QVERIFY(scaler.steps()[i] >= scaler.steps()[i - 1] * 0.85);
+    }
+    const ResolutionScaler::Size size = ResolutionScaler::scaledSize(1920, 1080, 0.9);
+    QCOMPARE(size.width, 1728);
+    QCOMPARE(size.height, 972);
+    QCOMPARE(ResolutionScaler::scaledSize(1920, 1080, 0.729).height % 2, 0);
+
+    // Light, heavy, in between two steps, light again; recorded as a
+    // plain frame time log
+    QTemporaryDir dir;
+    const QString tracePath = dir.path() + "/gpu_times.txt";
+    {
+        QFile file(tracePath);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        for (double ms : sceneTrace({{10.0, 30}, {20.0, 60}, {13.5, 120}, {8.0, 90}})) {
+            file.write(QByteArray::number(ms, 'f', 3) + '\n');
+        }
+    }
+    const QVector<double> trace = FrameTimeLog::readAll(tracePath);
+    QCOMPARE(trace.size(), 300 * 60);
+
+    const ScalerReplay replay = replayScaler(trace, 4.0, scaler);
+    qInfo() << "dynamic resolution:" << replay.changes << "changes," << replay.reversals
+            << "reversals," << replay.overBudget * 100 << "% of frames over budget";
+    auto changesBetween = [&replay](int fromSecond, int toSecond) {
+        return std::count_if(replay.changeTimes.begin(), replay.changeTimes.end(), [=](qint64 ms) {
+            return ms >= fromSecond * 1000 && ms < toSecond * 1000;
+        });
+    };
+    QCOMPARE(replay.scales.size(), 300);
+
+    // Full scale while it fits; down within a few seconds when it does not
+    QCOMPARE(replay.scales[29], 1.0);
+    QVERIFY(replay.scales[32] < 0.85);
+    QVERIFY(replay.overBudget < 0.03);
+
+    // Step ups that do not hold are retried less and less often instead of
+    // flipping between two steps
+    QVERIFY(changesBetween(40, 90) <= 2);
+    QVERIFY(changesBetween(90, 210) <= 8);
+    QVERIFY(changesBetween(150, 210) <= 2);
+    QVERIFY(replay.reversals <= 12);
+
+    // And back to full scale once the load is gone
+    QCOMPARE(replay.scales.last(), 1.0);
+
+    // A game held up by the CPU drops to the floor and stays there
+    ResolutionScaler cpuBound;
+    const ScalerReplay floor = replayScaler(sceneTrace({{5.0, 60}}), 25.0, cpuBound);
+    QCOMPARE(cpuBound.scale(), 0.5);
+    QCOMPARE(floor.minScale, 0.5);
+    QVERIFY(floor.changes <= 4);
+    QVERIFY(floor.changeTimes.last() < 10000);
+
+    ResolutionScaler::Settings settings;
+    settings.minScale = 0.7;
+    cpuBound.setSettings(settings);
+    cpuBound.reset();
+    const ScalerReplay raised = replayScaler(sceneTrace({{5.0, 60}}), 25.0, cpuBound);
+    QCOMPARE(cpuBound.scale(), 0.7);
+    QCOMPARE(raised.minScale, 0.7);
+}
+
+void TestSuite::testFrameCapture() {
+    // Histogram statistics against exact ones over the same frames
+    QVector<double> frames;
+    FrameTimeHistogram histogram;
+    FrameTimeHistogram odd;
+    FrameTimeHistogram even;
+    QRandomGenerator random(11);
+    for (int i = 0; i < 200000; ++i) {
+        const double frameTime = 12.0 + random.bounded(10.0) + (i % 500 == 0 ? 40.0 : 0.0);
+        frames.append(frameTime);
+        histogram.add(frameTime);
+        (i % 2 ? odd : even).add(frameTime);
+    }
+    std::sort(frames.begin(), frames.end());
+    double sum = 0.0;
+    for (double frameTime : frames) {
+        sum += frameTime;
+    }
+    const double mean = sum / frames.size();
+    double squares = 0.0;
+    for (double frameTime : frames) {
+        squares += (frameTime - mean) * (frameTime - mean);
+    }
+    auto slowestFps = [&frames](double fraction) {
+        const int count = int(frames.size() * fraction);
+        double time = 0.0;
+        for (int i = frames.size() - count; i < frames.size(); ++i) {
+            time += frames[i];
+        }
+        return count * 1000.0 / time;
+    };
+    auto near = [](double value, double expected, double tolerance) {
+        return std::abs(value / expected - 1.0) < tolerance;
+    };
+
+    QCOMPARE(histogram.count(), quint64(frames.size()));
+    QVERIFY(near(histogram.averageFps(), frames.size() * 1000.0 / sum, 1e-9));
+    QVERIFY(near(histogram.variance(), squares / (frames.size() - 1), 1e-9));
+    QCOMPARE(histogram.minimum(), frames.first());
+    QCOMPARE(histogram.maximum(), frames.last());
+    for (double p : {0.5, 0.9, 0.99, 0.999}) {
+        QVERIFY(near(histogram.percentile(p), frames[int(std::ceil(p * frames.size())) - 1], 0.008));
+    }
+    QVERIFY(near(histogram.lowFps(0.01), slowestFps(0.01), 0.008));
+    QVERIFY(near(histogram.lowFps(0.001), slowestFps(0.001), 0.008));
+
+    // Merging halves is the same as adding everything to one
+    odd.merge(even);
+    QCOMPARE(odd.count(), histogram.count());
+    QVERIFY(near(odd.variance(), histogram.variance(), 1e-9));
+    QCOMPARE(odd.percentile(0.99), histogram.percentile(0.99));
+
+    QTemporaryDir dir;
+    const QString logPath = dir.path() + "/mangoapp.csv";
+    auto append = [&logPath](const QByteArray& data) {
+        QFile log(logPath);
+        QVERIFY(log.open(QIODevice::Append));
+        log.write(data);
+    };
+
+    // Tailing: only complete lines, a truncated log again from the start,
+    // and a log replaced by a new session's
+    append(mangoappLog(3, 1));
+    FrameTimeLog tail;
+    tail.setPath(logPath);
+    QCOMPARE(tail.readNew().size(), 3);
+    append("60.0,16.");
+    QVERIFY(tail.readNew().isEmpty());
+    append("500,40,95\n");
+    QCOMPARE(tail.readNew(), QVector<double>{16.5});
+    QVERIFY(QFile::resize(logPath, 0));
+    append("fps,frametime\n60,16.1\n");
+    QCOMPARE(tail.readNew(), QVector<double>{16.1});
+    {
+        QFile replacement(dir.path() + "/next.csv");
+        QVERIFY(replacement.open(QIODevice::WriteOnly));
+        replacement.write(mangoappLog(50, 2));
+    }
+    QVERIFY(QFile::remove(logPath));
+    QVERIFY(QFile::rename(dir.path() + "/next.csv", logPath));
+    QCOMPARE(tail.readNew().size(), 50);
+
+    // A stats pipe is read as it is written, without blocking on it
+    const QString pipePath = dir.path() + "/stats.pipe";
+    QCOMPARE(::mkfifo(QFile::encodeName(pipePath).constData(), 0600), 0);
+    FrameTimeLog pipe;
+    pipe.setPath(pipePath);
+    QVERIFY(pipe.readNew().isEmpty());
+    const int writer = ::open(QFile::encodeName(pipePath).constData(), O_WRONLY | O_NONBLOCK);
+    QVERIFY(writer >= 0);
+    QCOMPARE(::write(writer, "16.7\n16.", 8), ssize_t(8));
+    QCOMPARE(pipe.readNew(), QVector<double>{16.7});
+    QCOMPARE(::write(writer, "9\n", 2), ssize_t(2));
+    QCOMPARE(pipe.readNew(), QVector<double>{16.9});
+    ::close(writer);
+    QVERIFY(pipe.readNew().isEmpty());
+
+    // A three-hour log streams into the fixed-size histogram
+    const QString longLog = dir.path() + "/session.csv";
+    {
+        QFile file(longLog);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(mangoappLog(3 * 3600 * 60, 3));
+    }
+    FrameTimeHistogram session;
+    QCOMPARE(FrameTimeLog::readAll(longLog, session), qint64(3 * 3600 * 60));
+    QVERIFY(session.averageFps() > 50 && session.averageFps() < 72);
+
+    // Live capture starts after what the log already holds and keeps the
+    // recent past apart from the session
+    FrameCapture capture;
+    capture.setPath(logPath);
+    capture.setWindow(100);
+    capture.start();
+    QVERIFY(capture.isRunning());
+    QSignalSpy capturedSpy(&capture, &FrameCapture::framesCaptured);
+    append("60,16.0,40\n60,17.0,40\n30,33.0,40\n");
+    capture.poll();
+    QCOMPARE(capturedSpy.count(), 1);
+    QCOMPARE(capturedSpy.first().first().value<QVector<double>>().size(), 3);
+    const FrameCapture::Summary live = capture.sessionSummary();
+    QCOMPARE(live.frames, quint64(3));
+    QVERIFY(near(live.averageFps, 3000.0 / 66.0, 1e-9));
+    QVERIFY(near(live.low1Fps, 1000.0 / 33.0, 0.008));
+    QCOMPARE(capture.recentSummary().frames, quint64(3));
+
+    QTest::qWait(250);
+    capture.poll();
+    QCOMPARE(capture.recentSummary().frames, quint64(0));
+    QCOMPARE(capture.sessionSummary().frames, quint64(3));
+    capture.reset();
+    QCOMPARE(capture.sessionSummary().frames, quint64(0));
+    capture.stop();
+    QVERIFY(!capture.isRunning());
+}
+
+void TestSuite::testPresetTuner() {
+    QTemporaryDir dir;
+    const QString statePath = dir.path() + "/hardware";
+    const QString logPath = dir.path() + "/frames.log";
+
+    // Fake game: the GPU clock is held to 100 MHz per watt of TDP, a frame
+    // takes 20000 / clock ms and the cap holds it back to 1000 / cap ms.
+    // Frames are logged in real time, 100 ms of them at a go. The cap is
+    // the one of the stub gamescope it runs in.
+    QFile game(dir.path() + "/game");
+    QVERIFY(game.open(QIODevice::WriteOnly));
+    game.write("#!/bin/sh\n"
+               "read tdp clock < " + statePath.toUtf8() + "\n"
+               "cap=$FPS_LIMIT\n"
+               "i=0\n"
+               "while :; do\n"
+               "    awk -v tdp=$tdp -v clock=$clock -v cap=$cap -v seed=$$$i 'BEGIN {\n"
+               "        srand(seed); effective = clock < tdp * 100 ? clock : tdp * 100\n"
+               "        for (t = 0; t < 100; t += frame) {\n"
+               "            frame = 20000 / effective * (0.97 + 0.06 * rand())\n"
+               "            if (frame < 1000 / cap) frame = 1000 / cap\n"
+               "            printf \"%.3f\\n\", frame\n"
+               "        }\n"
+               "    }' >> " + logPath.toUtf8() + "\n"
+               "    i=$((i + 1))\n"
+               "    sleep 0.1\n"
+               "done\n");
+    game.close();
+    game.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    QFile gamescope(dir.path() + "/gamescope");
+    QVERIFY(gamescope.open(QIODevice::WriteOnly));
+    gamescope.write("#!/bin/sh\n"
+                    "while [ $# -gt 0 ]; do\n"
+                    "    case $1 in\n"
+                    "        --fps-limit) FPS_LIMIT=$2; shift 2 ;;\n"
+                    "        --) shift; break ;;\n"
+                    "        *) shift ;;\n"
+                    "    esac\n"
+                    "done\n"
+                    "export FPS_LIMIT\n"
+                    "exec \"$@\"\n");
+    gamescope.close();
+    gamescope.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    GamescopeSupervisor::instance()->setProgram(gamescope.fileName());
+
+    // Simulated power: idle, a cost for the clock and the power limit
+    // set, and the GPU's draw growing with clock² at the load it carries
+    PresetTuner::Point current;
+    auto apply = [&current, &dir](const PresetTuner::Point& point) {
+        current = point;
+        writeFakeSysfs(dir.path(), "hardware", QByteArray::number(point.tdp) + ' '
+                       + QByteArray::number(point.gpuClock) + '\n');
+        return true;
+    };
+    auto sampler = [&current](double& watts, double& temperature) {
+        const double effective = std::min(current.gpuClock, current.tdp * 100);
+        const double uncapped = effective * 0.05;
+        const double load = std::min<double>(current.fpsCap, uncapped) / uncapped;
+        watts = 3.0 + 0.001 * current.gpuClock + 0.02 * current.tdp
+              + 0.008 * effective * load * effective / 1000.0;
+        temperature = 30.0 + 2.0 * watts;
+        return true;
+    };
+
+    PresetTuner tuner;
+    tuner.setCommand(game.fileName());
+    tuner.setFrameTimeLog(logPath);
+    tuner.setGrid({{8, 15, 25}, {1200, 2200}, {30, 60}});
+    PresetTuner::Settings settings;
+    settings.warmupMs = 150;
+    settings.durationMs = 600;
+    settings.sampleIntervalMs = 100;
+    settings.minFrames = 10;
+    settings.thermalLimit = 80;
+    tuner.setSettings(settings);
+    QVERIFY(!tuner.start());  // Nothing to apply settings with yet
+    tuner.setApply(apply);
+    tuner.setSampler(sampler);
+    // The cap only reaches the game the way GameManager passes it on
+    tuner.setWrapper(&GameManager::tuningCommand);
+
+    QSignalSpy finishedSpy(&tuner, &PresetTuner::finished);
+    QVERIFY(tuner.start());
+    QVERIFY(tuner.isRunning());
+    QVERIFY(finishedSpy.wait(30000));
+    QCOMPARE(finishedSpy.first().first().toBool(), true);
+    QVERIFY(!tuner.isRunning());
+
+    // Every point measured, the game stopped after each
+    const QVector<PresetTuner::Result> results = tuner.results();
+    QCOMPARE(results.size(), 12);
+    for (const PresetTuner::Result& result : results) {
+        QVERIFY(result.valid);
+        const double uncapped = std::min(result.point.gpuClock, result.point.tdp * 100) * 0.05;
+        const double expectedFps = std::min<double>(result.point.fpsCap, uncapped);
+        QVERIFY(std::abs(result.averageFps / expectedFps - 1.0) < 0.05);
+        QVERIFY(result.p99FrameTime >= result.p50FrameTime);
+        QVERIFY(result.watts > 0.0);
+    }
+    QVERIFY(QProcess::execute("pgrep", {"-f", game.fileName()}) != 0);
+    GamescopeSupervisor::instance()->setProgram("gamescope");
+
+    // The hottest point is left out; every other point is either on the
+    // frontier or beaten by one of it on both watts and smoothness
+    const QVector<PresetTuner::Result> frontier = PresetTuner::paretoFrontier(results);
+    QVERIFY(!frontier.isEmpty());
+    auto same = [](const PresetTuner::Result& a, const PresetTuner::Result& b) {
+        return a.point.tdp == b.point.tdp && a.point.gpuClock == b.point.gpuClock
+            && a.point.fpsCap == b.point.fpsCap;
+    };
+    for (const PresetTuner::Result& result : results) {
+        const bool onFrontier = std::any_of(frontier.begin(), frontier.end(), [&](const auto& point) {
+            return same(point, result);
+        });
+        if (result.throttled) {
+            QCOMPARE(result.point.tdp, 25);
+            QVERIFY(!onFrontier);
+            continue;
+        }
+        const bool dominated = std::any_of(frontier.begin(), frontier.end(), [&](const auto& point) {
+            return !same(point, result) && point.watts <= result.watts && point.low1Fps >= result.low1Fps;
+        });
+        QVERIFY(onFrontier != dominated);
+    }
+    QVERIFY(std::any_of(results.begin(), results.end(), [](const auto& result) { return result.throttled; }));
+    for (int i = 1; i < frontier.size(); ++i) {
+        QVERIFY(frontier[i].watts > frontier[i - 1].watts);
+        QVERIFY(frontier[i].low1Fps > frontier[i - 1].low1Fps);
+    }
+
+    // 30 fps is held at the lowest TDP and clock; 60 needs 15 W, and no
+    // more clock than it takes
+    const QVector<PresetTuner::Result> chosen = PresetTuner::choosePresets(frontier);
+    QCOMPARE(chosen.size(), 2);
+    QCOMPARE(chosen[0].point.fpsCap, 30);
+    QCOMPARE(chosen[0].point.tdp, 8);
+    QCOMPARE(chosen[0].point.gpuClock, 1200);
+    QCOMPARE(chosen[1].point.fpsCap, 60);
+    QCOMPARE(chosen[1].point.tdp, 15);
+    QCOMPARE(chosen[1].point.gpuClock, 1200);
+
+    // Chosen points become the user presets, saved with the config
+    auto* config = Config::instance();
+    const QVariant graphics = config->value("graphics");
+    auto* manager = GameManager::instance();
+    // A setting the user changed before survives; defaults are not copied
+    manager->setUserConfigPath(dir.path() + "/config/config.json");
+    QVERIFY(Config::saveOverrides(dir.path() + "/config/config.json", {{"downloads", QVariantMap{{"segments", 5}}}}));
+    QVERIFY(!manager->storeTunedPresets({}));
+    QVERIFY(manager->storeTunedPresets(chosen));
+    {
+        QFile saved(dir.path() + "/config/config.json");
+        QVERIFY(saved.open(QIODevice::ReadOnly));
+        const QVariantMap user = QJsonDocument::fromJson(saved.readAll()).object().toVariantMap();
+        QCOMPARE(user.keys(), QStringList({"downloads", "graphics"}));
+        QCOMPARE(user.value("graphics").toMap().keys(), QStringList{"userPresets"});
+        QCOMPARE(user.value("downloads").toMap().value("segments").toInt(), 5);
+    }
+    const QVariantMap presets = config->value("graphics").toMap().value("userPresets").toMap();
+    QCOMPARE(presets.value("batterySaver").toMap().value("tdp").toInt(), 8);
+    QCOMPARE(presets.value("batterySaver").toMap().value("fpsCap").toInt(), 30);
+    QCOMPARE(presets.value("balanced").toMap().value("fpsCap").toInt(), 60);
+    QCOMPARE(presets.value("performance").toMap().value("tdp").toInt(), 15);
+    QCOMPARE(presets.value("performance").toMap().value("gpuClock").toInt(), 1200);
+
+    // ...and come back over the defaults on the next start
+    config->setValue("graphics", graphics);
+    QVERIFY(config->loadOverrides(dir.path() + "/config/config.json"));
+    const QVariantMap reloaded = config->value("graphics").toMap().value("userPresets").toMap();
+    QCOMPARE(reloaded.value("batterySaver").toMap().value("tdp").toInt(), 8);
+    QCOMPARE(reloaded.value("performance").toMap().value("fpsCap").toInt(), 60);
+    QCOMPARE(config->value("graphics").toMap().value("refreshRate"), graphics.toMap().value("refreshRate"));
+    config->setValue("graphics", graphics);
+    manager->setUserConfigPath(Config::userConfigPath());
+}
+
+void TestSuite::testGameScheduler() {
+    using Affinity = GameScheduler::Affinity;
+
+    // Raising the game's priority takes privileges; lowering it does not
+    const bool privileged = ::geteuid() == 0;
+    GameScheduler::Policy policy = GameScheduler::Policy::fromConfig({
+        {"cgroup", "game"},
+        {"cpuWeight", 800},
+        {"ioWeight", 20000},
+        {"affinity", "pin"},
+        {"cpus", QVariantList{0}},
+        {"gameNice", privileged ? -5 : 5},
+        {"launcherNice", privileged ? 3 : 0},
+        {"idleBackgroundIo", true}
+    });
+    QCOMPARE(policy.affinity, Affinity::Pin);
+    QCOMPARE(policy.cpus, QVector<int>{0});
+    QVERIFY(GameScheduler::Policy::fromConfig({}).cgroup.isEmpty());
+    // Nothing to prefer without cores
+    QCOMPARE(GameScheduler::Policy::fromConfig({{"affinity", "prefer"}}).affinity, Affinity::None);
+
+    // Fake cgroup v2 directory, laid out as the kernel populates it
+    QTemporaryDir root;
+    writeFakeSysfs(root.path(), "cgroup.subtree_control", "");
+    for (const char* file : {"cgroup.procs", "cpu.weight", "io.weight"}) {
+        writeFakeSysfs(root.path(), QString("game/") + file, "");
+    }
+    GameScheduler scheduler;
+    scheduler.setCgroupRoot(root.path());
+    scheduler.setPolicy(policy);
+    QVERIFY(scheduler.prepare());
+    QCOMPARE(scheduler.cgroupPath(), root.path() + "/game");
+    QCOMPARE(readFakeSysfs(root.path(), "game/cpu.weight"), QByteArray("800"));
+    QCOMPARE(readFakeSysfs(root.path(), "game/io.weight"), QByteArray("10000"));
+    QVERIFY(readFakeSysfs(root.path(), "cgroup.subtree_control").startsWith('+'));
+
+    // A stub game, spawned the way gamescope is
+    auto spawn = [](const GameScheduler& owner, QProcess& process) {
+        process.setChildProcessModifier(owner.childModifier());
+        process.start("sleep", {"30"});
+        return process.waitForStarted();
+    };
+    QProcess stub;
+    QVERIFY(spawn(scheduler, stub));
+    const pid_t pid = pid_t(stub.processId());
+    QCOMPARE(readFakeSysfs(root.path(), "game/cgroup.procs"), QByteArray::number(pid));
+    QCOMPARE(::getpriority(PRIO_PROCESS, pid), policy.gameNice);
+    cpu_set_t cpus;
+    QCOMPARE(::sched_getaffinity(pid, sizeof(cpus), &cpus), 0);
+    QCOMPARE(CPU_COUNT(&cpus), 1);
+    QVERIFY(CPU_ISSET(0, &cpus));
+    stub.kill();
+    stub.waitForFinished();
+
+    // On a delegated cgroup v2 hierarchy the stub really lands in the group
+    GameScheduler system;
+    if (!system.cgroupRoot().isEmpty() && QFileInfo(system.cgroupRoot()).isWritable()) {
+        GameScheduler::Policy isolated = policy;
+        isolated.cgroup = "ally-mc-test-" + QString::number(QCoreApplication::applicationPid());
+        system.setPolicy(isolated);
+        QVERIFY(system.prepare());
+        QProcess game;
+        QVERIFY(spawn(system, game));
+        QVERIFY(readFakeSysfs("/proc", QString::number(game.processId()) + "/cgroup")
+                    .contains("/" + isolated.cgroup.toUtf8() + "\n"));
+        game.kill();
+        game.waitForFinished();
+        QTRY_VERIFY(QDir().rmdir(system.cgroupPath()));
+    } else {
+        qInfo() << "No delegated cgroup v2 hierarchy; checked against a fake one only";
+    }
+
+    // While the game runs the launcher is off its cores, in the idle I/O
+    // class and, where it can be undone, niced
+    auto launcherThreads = []() {
+        QVector<pid_t> tids;
+        for (const QString& name : QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            tids.append(pid_t(name.toInt()));
+        }
+        return tids;
+    };
+    auto ioClass = [](pid_t tid) {
+        return int(::syscall(SYS_ioprio_get, 1, tid)) >> 13;
+    };
+    const int niceBefore = ::getpriority(PRIO_PROCESS, 0);
+    cpu_set_t before;
+    QCOMPARE(::sched_getaffinity(0, sizeof(before), &before), 0);
+    const bool spareCores = CPU_COUNT(&before) > 1 && CPU_ISSET(0, &before);
+    policy.affinity = Affinity::Prefer;
+    scheduler.setPolicy(policy);
+    scheduler.lowerLauncher();
+    QVERIFY(scheduler.isLauncherLowered());
+    for (pid_t tid : launcherThreads()) {
+        QCOMPARE(ioClass(tid), 3);
+        if (policy.launcherNice != 0) {
+            QCOMPARE(::getpriority(PRIO_PROCESS, tid), policy.launcherNice);
+        }
+        QCOMPARE(::sched_getaffinity(tid, sizeof(cpus), &cpus), 0);
+        QCOMPARE(bool(CPU_ISSET(0, &cpus)), !spareCores);
+    }
+    scheduler.restoreLauncher();
+    QVERIFY(!scheduler.isLauncherLowered());
+    for (pid_t tid : launcherThreads()) {
+        QVERIFY(ioClass(tid) != 3);
+        QCOMPARE(::getpriority(PRIO_PROCESS, tid), niceBefore);
+        QCOMPARE(::sched_getaffinity(tid, sizeof(cpus), &cpus), 0);
+        QVERIFY(CPU_EQUAL(&cpus, &before));
+    }
+}
+
+void TestSuite::testLaunchPipeline() {
+    // Stubbed stages that only sleep, shaped like a real launch: one
+    // stage everything waits on, a fan-out, and a spawn joining it all
+    auto sleeping = [](int ms, bool ok = true) {
+        return [ms, ok]() {
+            QThread::msleep(ms);
+            return ok;
+        };
+    };
+
+    LaunchPipeline pipeline;
+    QThread* spawnThread = nullptr;
+    QVERIFY(pipeline.addStage("directories", sleeping(40)));
+    QVERIFY(pipeline.addStage("shader-cache", sleeping(150), {"directories"}));
+    QVERIFY(pipeline.addStage("controller-hints", sleeping(30), {"directories"}));
+    QVERIFY(pipeline.addStage("environment", sleeping(100)));
+    QVERIFY(pipeline.addStage("spawn", [&spawnThread]() {
+        spawnThread = QThread::currentThread();
+        QThread::msleep(10);
+        return true;
+    }, {"shader-cache", "controller-hints", "environment"}, LaunchPipeline::Affinity::OwnerThread));
+    QVERIFY(!pipeline.addStage("orphan", sleeping(1), {"missing"}));
+
+    QSignalSpy stageSpy(&pipeline, &LaunchPipeline::stageFinished);
+    QVERIFY(pipeline.start());
+    QVERIFY(pipeline.isRunning());
+    QVERIFY(pipeline.waitForFinished(5000));
+    QCOMPARE(stageSpy.count(), 5);
+    QCOMPARE(spawnThread, QThread::currentThread());
+
+    // Every stage started only after all of its dependencies finished
+    const QVector<QPair<QString, QString>> edges = {
+        {"directories", "shader-cache"}, {"directories", "controller-hints"},
+        {"shader-cache", "spawn"}, {"controller-hints", "spawn"}, {"environment", "spawn"}
+    };
+    for (const auto& edge : edges) {
+        const LaunchPipeline::StageTiming before = pipeline.timing(edge.first);
+        const LaunchPipeline::StageTiming after = pipeline.timing(edge.second);
+        QVERIFY(before.ok && after.ok);
+        QVERIFY(after.startMs >= before.startMs + before.durationMs);
+    }
+
+    // Independent stages overlapped: the run took about as long as the
+    // critical path (200 ms), well short of the serial sum (330 ms)
+    QCOMPARE(pipeline.criticalPath(), QStringList({"directories", "shader-cache", "spawn"}));
+    qInfo() << "launch pipeline:" << pipeline.elapsedMs() << "ms";
+    QVERIFY(pipeline.elapsedMs() >= 200);
+    QVERIFY(pipeline.elapsedMs() < 300);
+
+    // A failing stage skips its dependents but not unrelated stages
+    LaunchPipeline failing;
+    bool spawned = false;
+    failing.addStage("directories", sleeping(5));
+    failing.addStage("controller-hints", sleeping(5, false), {"directories"});
+    failing.addStage("shader-cache", sleeping(20), {"directories"});
+    failing.addStage("spawn", [&spawned]() {
+        spawned = true;
+        return true;
+    }, {"controller-hints", "shader-cache"});
+
+    QSignalSpy finishedSpy(&failing, &LaunchPipeline::finished);
+    QVERIFY(failing.start());
+    QVERIFY(!failing.waitForFinished(5000));
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.first().first().toBool(), false);
+    QVERIFY(!spawned);
+    QVERIFY(failing.timing("shader-cache").ok);
+    QVERIFY(!failing.timing("controller-hints").ok);
+    QCOMPARE(failing.timing("spawn").startMs, qint64(-1));
+}
+
 void TestSuite::testShaderCache() {
     auto* manager = GameManager::instance();
-    QString cachePath = QDir::homePath() + "/.local/share/minecraft/shader_cache";
+    // Preparing a launch activates the partition of the current driver
+    // build and game version
+    QVERIFY(manager->applyROGAllyOptimizations());
+    const ShaderCacheStore& store = manager->shaderCacheStore();
+    QVERIFY(!store.activePartition().isEmpty());
+    const QString cachePath = store.partitionPath(store.activePartition());
     
-    manager->optimizeShaderCache();
+    LaunchPlan plan;
+    manager->optimizeShaderCache(plan);
+    QCOMPARE(plan.environment.value("MESA_SHADER_CACHE_DIR"), cachePath);
+    QCOMPARE(plan.environment.value("MESA_GLSL_CACHE_DIR"), cachePath);
+    QCOMPARE(plan.environment.value("__GL_SHADER_DISK_CACHE_PATH"), cachePath);
+    // Pre-warming compiles into the same partition
+    QTRY_COMPARE(manager->shaderPrewarmer().environment().value("MESA_SHADER_CACHE_DIR"), cachePath);
+    QCOMPARE(manager->shaderPrewarmer().environment().value("__GL_SHADER_DISK_CACHE_PATH"), cachePath);
+    QVERIFY(plan.materialize() >= 0);
     QVERIFY(QDir(cachePath).exists());
-    QCOMPARE(qgetenv("MESA_GLSL_CACHE_DIR"), cachePath.toUtf8());
+}
+
+void TestSuite::testShaderCacheBudget() {
+    // 4 directories of 50 files, 100 KiB each, accessed one minute apart
+    // from oldest (d0/f0) to newest (d3/f49)
+    QTemporaryDir dir;
+    const QString root = dir.path() + "/cache";
+    const qint64 fileSize = 100 * 1024;
+    const QDateTime now = QDateTime::currentDateTime();
+    for (int d = 0; d < 4; ++d) {
+        QDir().mkpath(root + QString("/d%1").arg(d));
+        for (int f = 0; f < 50; ++f) {
+            QFile file(root + QString("/d%1/f%2").arg(d).arg(f));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            QVERIFY(file.resize(fileSize));
+            file.setFileTime(now.addSecs((d * 50 + f - 200) * 60), QFileDevice::FileAccessTime);
+        }
+    }
+
+    ShaderCacheManager cache;
+    cache.setEvictionDelay(10);
+    cache.setBudget(10 * 1024 * 1024);
+    cache.setGameRunning(true);
+    QVERIFY(cache.open(root));
+    QCOMPARE(cache.fileCount(), 200);
+    QCOMPARE(cache.totalSize(), 200 * fileSize);
+
+    // Over budget, but nothing is deleted while the game runs
+    QSignalSpy evictedSpy(&cache, &ShaderCacheManager::evicted);
+    QVERIFY(!cache.evict());
+    QTest::qWait(50);
+    QCOMPARE(evictedSpy.count(), 0);
+    QVERIFY(QFile::exists(root + "/d0/f0"));
+
+    // Once it exits, the least recently used files go first
+    cache.setGameRunning(false);
+    QVERIFY(evictedSpy.wait(5000));
+    QVERIFY(cache.totalSize() <= cache.budget());
+    QCOMPARE(cache.fileCount(), int(cache.totalSize() / fileSize));
+    QVERIFY(!QFile::exists(root + "/d0/f0"));
+    QVERIFY(!QFile::exists(root + "/d1/f49"));
+    QVERIFY(QFile::exists(root + "/d3/f49"));
+
+    // New shaders show up through inotify and the budget still holds
+    QDir().mkpath(root + "/d4");
+    for (int f = 0; f < 40; ++f) {
+        QFile file(root + QString("/d4/f%1").arg(f));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(fileSize, 'x'));
+    }
+    QTRY_COMPARE(evictedSpy.count(), 2);
+    QVERIFY(cache.totalSize() <= cache.budget());
+    QVERIFY(QFile::exists(root + "/d4/f39"));
+
+    // The persisted index matches the tree on disk
+    cache.close();
+    qint64 onDisk = 0;
+    QDirIterator it(root, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        onDisk += it.fileInfo().size();
+    }
+    ShaderCacheManager reopened;
+    reopened.setBudget(cache.budget());
+    QVERIFY(reopened.open(root));
+    QCOMPARE(reopened.directoriesRead(), 0);
+    QCOMPARE(reopened.totalSize(), onDisk);
+
+    // Two partitions hardlinked to the same blobs, as ShaderCacheStore
+    // leaves them: each file counts once, and the store's own files are
+    // never touched
+    QTemporaryDir linkedDir;
+    const QString linkedRoot = linkedDir.path() + "/cache";
+    QVERIFY(QDir().mkpath(linkedRoot + "/blobs"));
+    QVERIFY(QDir().mkpath(linkedRoot + "/partitions/a"));
+    QVERIFY(QDir().mkpath(linkedRoot + "/partitions/b"));
+    writeFakeSysfs(linkedRoot, "partitions.json", "{}");
+    const int blobs = 20;
+    for (int f = 0; f < blobs; ++f) {
+        const QString blob = linkedRoot + QString("/blobs/f%1").arg(f);
+        QFile file(blob);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QVERIFY(file.resize(fileSize));
+        file.close();
+        for (const char* partition : {"a", "b"}) {
+            const QString link = linkedRoot + QString("/partitions/%1/f%2").arg(partition).arg(f);
+            QCOMPARE(::link(QFile::encodeName(blob).constData(), QFile::encodeName(link).constData()), 0);
+        }
+    }
+
+    ShaderCacheManager shared;
+    shared.setEvictionDelay(10);
+    shared.setBudget(10 * fileSize);
+    shared.setExcluded(ShaderCacheStore::metadataPaths());
+    QSignalSpy sharedSpy(&shared, &ShaderCacheManager::evicted);
+    QVERIFY(shared.open(linkedRoot));
+    QCOMPARE(shared.fileCount(), 2 * blobs);
+    QCOMPARE(shared.totalSize(), blobs * fileSize);
+    QVERIFY(sharedSpy.wait(5000));
+    QVERIFY(shared.totalSize() <= shared.budget());
+    int stillLinked = 0;
+    for (int f = 0; f < blobs; ++f) {
+        QVERIFY(QFile::exists(linkedRoot + QString("/blobs/f%1").arg(f)));
+        if (QFile::exists(linkedRoot + QString("/partitions/a/f%1").arg(f))
+            || QFile::exists(linkedRoot + QString("/partitions/b/f%1").arg(f))) {
+            ++stillLinked;
+        }
+    }
+    QCOMPARE(shared.totalSize(), stillLinked * fileSize);
+    QVERIFY(QFile::exists(linkedRoot + "/partitions.json"));
+}
+
+void TestSuite::testShaderCacheRescan() {
+    // 100k entries laid out like Mesa's cache: 256 directories named by
+    // the first byte of the entry hash
+    QTemporaryDir dir;
+    const QString root = dir.path() + "/cache";
+    const int directories = 256;
+    const int files = 100000;
+    for (int i = 0; i < files; ++i) {
+        const QString subdir = root + QString("/%1").arg(i % directories, 2, 16, QChar('0'));
+        if (i < directories) {
+            QVERIFY(QDir().mkpath(subdir));
+        }
+        QFile file(subdir + QString("/%1").arg(i, 38, 16, QChar('0')));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    {
+        ShaderCacheManager cache;
+        QVERIFY(cache.open(root));
+        QCOMPARE(cache.fileCount(), files);
+        QCOMPARE(cache.directoriesRead(), directories + 1);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int walked = 0;
+    qint64 walkedSize = 0;
+    QDirIterator it(root, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        walkedSize += it.fileInfo().size();
+        ++walked;
+    }
+    const qint64 walkNs = timer.nsecsElapsed();
+    QCOMPARE(walked, files);
+
+    ShaderCacheManager cache;
+    timer.restart();
+    QVERIFY(cache.open(root));
+    const qint64 rescanNs = timer.nsecsElapsed();
+    QCOMPARE(cache.fileCount(), files);
+    QCOMPARE(cache.totalSize(), walkedSize);
+    QCOMPARE(cache.directoriesRead(), 0);
+
+    qInfo() << "full walk:" << walkNs / 1000000.0 << "ms, indexed rescan:" << rescanNs / 1000000.0 << "ms";
+    QVERIFY(rescanNs < walkNs);
+
+    // A changed directory is the only one listed again
+    QFile added(root + "/7f/added");
+    QVERIFY(added.open(QIODevice::WriteOnly));
+    added.close();
+    cache.rescan();
+    QCOMPARE(cache.directoriesRead(), 1);
+    QCOMPARE(cache.fileCount(), files + 1);
+}
+
+void TestSuite::testShaderPrewarm() {
+    using State = ShaderPrewarmer::State;
+
+    // Stub replay tool logging start and end of each database
+    QTemporaryDir dir;
+    const QString logPath = dir.path() + "/replay.log";
+    QFile stub(dir.path() + "/fossilize-replay");
+    QVERIFY(stub.open(QIODevice::WriteOnly));
+    stub.write("#!/bin/sh\n"
+               "for db; do :; done\n"
+               "echo \"start $(basename $db) $* cache=$MESA_SHADER_CACHE_DIR\" >> " + logPath.toUtf8() + "\n"
+               "sleep 0.5\n"
+               "echo \"done $(basename $db)\" >> " + logPath.toUtf8() + "\n");
+    stub.close();
+    stub.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    auto log = [&logPath]() {
+        QFile file(logPath);
+        return file.open(QIODevice::ReadOnly) ? QString::fromUtf8(file.readAll()) : QString();
+    };
+
+    const QString databases = dir.path() + "/fossilize";
+    QDir().mkpath(databases);
+    for (const char* name : {"a.foz", "b.foz", "c.foz"}) {
+        writeFakeSysfs(databases, name, QByteArray("FOSSILIZEDB") + name);
+    }
+
+    // Start hot: nothing runs until the APU cools down
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon2/temp1_input", "90000\n");
+    auto* control = AllySystemControl::instance();
+    control->setSysfsRoot(root.path());
+    QTRY_COMPARE_WITH_TIMEOUT(control->getCurrentTemperature(), 90.0f, 5000);
+
+    auto prewarmer = std::make_unique<ShaderPrewarmer>();
+    prewarmer->setCommand(stub.fileName(), {"--num-threads", "1"});
+    prewarmer->setDatabaseDirectory(databases);
+    prewarmer->setStatePath(dir.path() + "/state.json");
+    prewarmer->setIdleDelay(10);
+    // The replay compiles into the cache the game is given
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("MESA_SHADER_CACHE_DIR", dir.path() + "/partition");
+    prewarmer->setEnvironment(environment);
+    prewarmer->setPartition(ShaderCacheStore::partitionKey("driver1", "1.20"));
+    prewarmer->monitor(control);
+    prewarmer->setGameRunning(false);
+    QTRY_COMPARE(prewarmer->state(), State::Paused);
+    QVERIFY(!prewarmer->isReplaying());
+
+    writeFakeSysfs(root.path(), "class/hwmon/hwmon2/temp1_input", "50000\n");
+    QTRY_COMPARE_WITH_TIMEOUT(prewarmer->state(), State::Running, 5000);
+    QTRY_VERIFY(log().contains("start a.foz --num-threads 1 " + databases + "/a.foz cache="
+                               + dir.path() + "/partition"));
+
+    // Low battery stops the replay in place; it finishes once allowed
+    prewarmer->updateConditions(50.0, 20, false);
+    QCOMPARE(prewarmer->state(), State::Paused);
+    QVERIFY(prewarmer->isReplaying());
+    QTest::qWait(1000);
+    QVERIFY(!log().contains("done a.foz"));
+    prewarmer->updateConditions(50.0, 20, true);
+    QCOMPARE(prewarmer->state(), State::Running);
+    QTRY_VERIFY(log().contains("done a.foz"));
+
+    // A game launch kills the replay on the spot
+    QTRY_VERIFY(log().contains("start b.foz"));
+    prewarmer->setGameRunning(true);
+    QVERIFY(!prewarmer->isReplaying());
+    QCOMPARE(prewarmer->state(), State::Idle);
+    QTest::qWait(700);
+    QVERIFY(!log().contains("done b.foz"));
+
+    // After a restart only what did not finish is replayed
+    prewarmer = std::make_unique<ShaderPrewarmer>();
+    prewarmer->setCommand(stub.fileName());
+    prewarmer->setDatabaseDirectory(databases);
+    prewarmer->setStatePath(dir.path() + "/state.json");
+    prewarmer->setPartition(ShaderCacheStore::partitionKey("driver1", "1.20"));
+    prewarmer->setIdleDelay(10);
+    prewarmer->setGameRunning(false);
+    QTRY_COMPARE_WITH_TIMEOUT(prewarmer->state(), State::Finished, 5000);
+    QCOMPARE(log().count("start a.foz"), 1);
+    QCOMPARE(log().count("start b.foz"), 2);
+    QVERIFY(log().contains("done b.foz"));
+    QVERIFY(log().contains("done c.foz"));
+    QCOMPARE(prewarmer->pendingCount(), 0);
+
+    // A driver update compiles into a new partition, which has none of
+    // the databases yet
+    prewarmer->setPartition(ShaderCacheStore::partitionKey("driver2", "1.20"));
+    QTRY_COMPARE_WITH_TIMEOUT(prewarmer->state(), State::Finished, 5000);
+    QCOMPARE(log().count("done a.foz"), 2);
+    QCOMPARE(log().count("done b.foz"), 2);
+    QCOMPARE(log().count("done c.foz"), 2);
+
+    // Switching back finds the first driver's databases still replayed
+    prewarmer->setPartition(ShaderCacheStore::partitionKey("driver1", "1.20"));
+    QCOMPARE(prewarmer->state(), State::Finished);
+    QCOMPARE(prewarmer->pendingCount(), 0);
+
+    // A launch that fails gives the idle time back to the launcher's
+    // pre-warming
+    auto* manager = GameManager::instance();
+    auto* gamescope = GamescopeSupervisor::instance();
+    gamescope->setProgram(dir.path() + "/missing-gamescope");
+    manager->shaderPrewarmer().setIdleDelay(10);
+    QSignalSpy failedSpy(manager, &GameManager::launchFailed);
+    QVERIFY(manager->launchGame());
+    QCOMPARE(manager->shaderPrewarmer().state(), State::Idle);
+    QTRY_COMPARE_WITH_TIMEOUT(failedSpy.count(), 1, 10000);
+    QTRY_VERIFY(manager->shaderPrewarmer().state() != State::Idle);
+    manager->shaderPrewarmer().setIdleDelay(60 * 1000);
+    gamescope->setProgram("gamescope");
+
+    control->setSysfsRoot("/sys");
+}
+
+void TestSuite::testShaderCacheStore() {
+    // Hardlinks are what tmpfs and ext4 offer, so that path is forced
+    QTemporaryDir dir;
+    ShaderCacheStore store(dir.path());
+    store.setLinkMode(ShaderCacheStore::LinkMode::Hardlink);
+    const QByteArray blobA(64 * 1024, 'a');
+    const QByteArray blobB(32 * 1024, 'b');
+    const QByteArray blobC(16 * 1024, 'c');
+
+    const QString v120 = store.activate("driver1", "1.20");
+    QVERIFY(!v120.isEmpty());
+    writeFakeSysfs(v120, "mesa_shader_cache/01/a", blobA);
+    writeFakeSysfs(v120, "mesa_shader_cache/02/b", blobB);
+
+    // A game update starts from the previous version's cache
+    const QString v121 = store.activate("driver1", "1.21");
+    QCOMPARE(readFakeSysfs(v121, "mesa_shader_cache/01/a"), blobA);
+    QCOMPARE(readFakeSysfs(v121, "mesa_shader_cache/02/b"), blobB);
+    writeFakeSysfs(v121, "mesa_shader_cache/03/c", blobC);
+
+    // Only inactive partitions are linked into the store, so with one of
+    // them nothing is saved yet
+    ShaderCacheStore::Stats stats = store.deduplicate();
+    QCOMPARE(stats.partitions, 2);
+    QCOMPARE(stats.files, 5);
+    QCOMPARE(stats.sharedFiles, 2);
+    QCOMPARE(stats.logicalBytes, qint64(2 * (blobA.size() + blobB.size()) + blobC.size()));
+    QCOMPARE(stats.storedBytes, stats.logicalBytes);
+
+    const QString v122 = store.activate("driver1", "1.22");
+    QCOMPARE(readFakeSysfs(v122, "mesa_shader_cache/03/c"), blobC);
+    stats = store.deduplicate();
+    QCOMPARE(stats.files, 8);
+    QCOMPARE(stats.sharedFiles, 5);
+    QCOMPARE(stats.savedBytes(), qint64(blobA.size() + blobB.size()));
+    QVERIFY(stats.dedupRatio() > 1.4);
+
+    // Switching back finds the old cache warm, and the active partition
+    // owns its files: writing one leaves the other versions alone
+    QCOMPARE(store.activate("driver1", "1.20"), v120);
+    QCOMPARE(readFakeSysfs(v120, "mesa_shader_cache/01/a"), blobA);
+    writeFakeSysfs(v120, "mesa_shader_cache/01/a", "rewritten");
+    QCOMPARE(readFakeSysfs(v121, "mesa_shader_cache/01/a"), blobA);
+    QCOMPARE(store.deduplicate().sharedFiles, 6);
+
+    // The manifest survives a restart
+    ShaderCacheStore reopened(dir.path());
+    reopened.setLinkMode(ShaderCacheStore::LinkMode::Hardlink);
+    QCOMPARE(reopened.partitions().size(), 3);
+    QCOMPARE(reopened.activePartition(), ShaderCacheStore::partitionKey("driver1", "1.20"));
+    QCOMPARE(reopened.stats().sharedFiles, 6);
+
+    // Versions that are no longer installed are dropped
+    QVERIFY(reopened.collectGarbage("driver1", {"1.20", "1.22"}) == 0);
+    QVERIFY(!QFileInfo::exists(v121));
+    QCOMPARE(reopened.partitions().size(), 2);
+
+    // A new driver starts empty; the old driver's partitions and their
+    // blobs go once it is unreachable
+    const QString v121New = reopened.activate("driver2", "1.21");
+    QVERIFY(QDir(v121New).entryList(QDir::AllEntries | QDir::NoDotAndDotDot).isEmpty());
+    const qint64 freed = reopened.collectGarbage("driver2");
+    QVERIFY(freed >= blobA.size() + blobB.size() + blobC.size());
+    QCOMPARE(reopened.partitions(), QStringList{ShaderCacheStore::partitionKey("driver2", "1.21")});
+    QVERIFY(!QFileInfo::exists(v120));
+    QVERIFY(!QFileInfo::exists(v122));
+    QCOMPARE(reopened.stats().storedBytes, qint64(0));
+
+    // Build ID read from an ICD manifest pointing at an ELF file
+    QTemporaryDir icd;
+    QFile manifestFile(icd.path() + "/radeon_icd.x86_64.json");
+    QVERIFY(manifestFile.open(QIODevice::WriteOnly));
+    manifestFile.write(QJsonDocument(QJsonObject{
+        {"ICD", QJsonObject{{"library_path", QCoreApplication::applicationFilePath()}}}
+    }).toJson());
+    manifestFile.close();
+    const QString buildId = ShaderCacheStore::driverBuildId({icd.path()});
+    QVERIFY(!buildId.isEmpty());
+    QVERIFY(buildId != "unknown");
+    QCOMPARE(ShaderCacheStore::driverBuildId({icd.path()}), buildId);
+    QCOMPARE(ShaderCacheStore::driverBuildId({dir.path() + "/none"}), QString("unknown"));
+}
+
+void TestSuite::testWorldBackup() {
+    QTemporaryDir dir;
+    const QString world = dir.path() + "/worlds/w1";
+    const QByteArray table = randomBytes(2 * 1024 * 1024, 1);
+    const QByteArray log = randomBytes(1024 * 1024, 2);
+    writeFakeSysfs(world, "db/000005.ldb", table);
+    writeFakeSysfs(world, "db/000006.log", log);
+    writeFakeSysfs(world, "level.dat", "level");
+    QDir().mkpath(world + "/db/lost");
+
+    WorldBackup backup(dir.path() + "/repo");
+    const WorldBackup::Result first = backup.backup(dir.path() + "/worlds");
+    QVERIFY(first.ok);
+    QCOMPARE(first.files, 3);
+    QCOMPARE(first.changedFiles, 3);
+    QCOMPARE(first.bytesRead, qint64(table.size() + log.size() + 5));
+    QVERIFY(first.newChunks >= 3);
+    QVERIFY(first.captureMs <= first.elapsedMs);
+
+    // Nothing changed: nothing is read
+    const WorldBackup::Result unchanged = backup.backup(dir.path() + "/worlds");
+    QVERIFY(unchanged.ok);
+    QCOMPARE(unchanged.changedFiles, 0);
+    QCOMPARE(unchanged.bytesRead, qint64(0));
+    QCOMPARE(unchanged.newChunks, 0);
+
+    // An append only reads that file and stores the chunks around the end
+    QFile append(world + "/db/000006.log");
+    QVERIFY(append.open(QIODevice::Append));
+    append.write(randomBytes(100 * 1024, 3));
+    append.close();
+    const WorldBackup::Result incremental = backup.backup(dir.path() + "/worlds");
+    QVERIFY(incremental.ok);
+    QCOMPARE(incremental.changedFiles, 1);
+    QCOMPARE(incremental.bytesRead, qint64(log.size() + 100 * 1024));
+    QVERIFY(incremental.newChunks <= 4);
+    QVERIFY(incremental.reusedChunks > incremental.newChunks);
+    QCOMPARE(backup.snapshots().size(), 3);
+
+    // Restores match the world as it was at each snapshot
+    const QString restored = dir.path() + "/restored";
+    QVERIFY(backup.restore(first.snapshot, restored));
+    QCOMPARE(readFakeSysfs(restored, "w1/db/000005.ldb"), table);
+    QCOMPARE(readFakeSysfs(restored, "w1/db/000006.log"), log);
+    QCOMPARE(readFakeSysfs(restored, "w1/level.dat"), QByteArray("level"));
+    QVERIFY(QFileInfo(restored + "/w1/db/lost").isDir());
+    QCOMPARE(QFileInfo(restored + "/w1/db/000005.ldb").lastModified(),
+             QFileInfo(world + "/db/000005.ldb").lastModified());
+    QVERIFY(!backup.restore(first.snapshot, restored));
+
+    // Pruning drops the chunks only older snapshots used
+    QVERIFY(backup.prune(1) > 0);
+    QCOMPARE(backup.snapshots(), QStringList{incremental.snapshot});
+    QVERIFY(backup.restore(incremental.snapshot, dir.path() + "/latest"));
+    QCOMPARE(readFakeSysfs(dir.path() + "/latest", "w1/db/000006.log"),
+             readFakeSysfs(world, "db/000006.log"));
+    QVERIFY(!backup.restore(first.snapshot, dir.path() + "/gone"));
+}
+
+void TestSuite::testInstallStore() {
+    // Two synthetic releases: a patch changes the library and a few assets
+    QTemporaryDir dir;
+    const QString v1 = dir.path() + "/v1";
+    const QString v2 = dir.path() + "/v2";
+    const int assets = 200;
+    for (int i = 0; i < assets; ++i) {
+        const QString asset = QString("assets/%1/%2.png").arg(i % 10).arg(i);
+        const QByteArray data = randomBytes(16 * 1024, i);
+        writeFakeSysfs(v1, asset, data);
+        writeFakeSysfs(v2, asset, i < 10 ? randomBytes(16 * 1024, 1000 + i) : data);
+    }
+    writeFakeSysfs(v1, "lib/x86_64/libminecraftpe.so", randomBytes(2 * 1024 * 1024, 1));
+    writeFakeSysfs(v2, "lib/x86_64/libminecraftpe.so", randomBytes(2 * 1024 * 1024, 2));
+    writeFakeSysfs(v1, "bin/launch", "#!/bin/sh\n");
+    QFile::setPermissions(v1 + "/bin/launch", QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    QVERIFY(::symlink("x86_64", QFile::encodeName(v1 + "/lib/native").constData()) == 0);
+
+    InstallStore store(dir.path() + "/store");
+    QVERIFY(store.addVersion("1.21.0", v1));
+    const InstallStore::Stats one = store.stats();
+    QVERIFY(store.addVersion("1.21.1", v2));
+    QVERIFY(!store.addVersion("1.21.1", v2));
+    const InstallStore::Stats two = store.stats();
+    QCOMPARE(two.versions, 2);
+    QCOMPARE(store.versions(), (QStringList{"1.21.0", "1.21.1"}));
+
+    // The patch costs what it changed, not another install
+    const qint64 overhead = two.storedBytes - one.storedBytes;
+    const qint64 changed = 10 * 16 * 1024 + 2 * 1024 * 1024;
+    qInfo() << "second version:" << (two.logicalBytes - one.logicalBytes) / 1024 << "KiB,"
+            << "stored" << overhead / 1024 << "KiB";
+    QCOMPARE(overhead, changed);
+
+    // Trees are complete, read-only and keep modes and links
+    const QString tree = store.versionPath("1.21.0");
+    QCOMPARE(readFakeSysfs(tree, "assets/3/13.png"), randomBytes(16 * 1024, 13));
+    QVERIFY(QFileInfo(tree + "/bin/launch").isExecutable());
+    QVERIFY(!(QFileInfo(tree + "/assets/3/13.png").permissions() & QFile::WriteOwner));
+    QCOMPARE(QFileInfo(tree + "/lib/native").symLinkTarget(), QFileInfo(tree + "/lib/x86_64").absoluteFilePath());
+
+    // Switching is one rename
+    QVERIFY(store.activate("1.21.0"));
+    QCOMPARE(store.activeVersion(), QString("1.21.0"));
+    QElapsedTimer timer;
+    timer.start();
+    const int switches = 100;
+    for (int i = 0; i < switches; ++i) {
+        QVERIFY(store.activate(i % 2 ? "1.21.0" : "1.21.1"));
+    }
+    const qint64 switchUs = timer.nsecsElapsed() / switches / 1000;
+    qInfo() << "version switch:" << switchUs << "us";
+    QVERIFY(switchUs < 50000);
+    QCOMPARE(store.activeVersion(), QString("1.21.0"));
+    QCOMPARE(readFakeSysfs(store.currentPath(), "lib/x86_64/libminecraftpe.so"),
+             randomBytes(2 * 1024 * 1024, 1));
+
+    // Rollback returns to the version that was replaced
+    QCOMPARE(store.previousVersion(), QString("1.21.1"));
+    QVERIFY(store.rollback());
+    QCOMPARE(store.activeVersion(), QString("1.21.1"));
+    QCOMPARE(readFakeSysfs(store.currentPath(), "assets/0/0.png"), randomBytes(16 * 1024, 1000));
+    QVERIFY(!store.activate("2.0"));
+    QCOMPARE(store.activeVersion(), QString("1.21.1"));
+
+    // Objects only the removed version used are collected
+    QVERIFY(!store.removeVersion("1.21.1"));
+    QVERIFY(store.removeVersion("1.21.0"));
+    QVERIFY(store.previousVersion().isEmpty());
+    QVERIFY(!store.rollback());
+    QCOMPARE(store.collectGarbage(), 10 + 2);
+    const InstallStore::Stats after = store.stats();
+    QCOMPARE(after.versions, 1);
+    QCOMPARE(after.storedBytes, after.logicalBytes);
+    QCOMPARE(readFakeSysfs(store.currentPath(), "assets/9/199.png"), randomBytes(16 * 1024, 199));
+}
+
+void TestSuite::testArchiveExtractor() {
+    // Laid out like an APK: stored media, deflated text and libraries
+    QTemporaryDir dir;
+    const QString archive = dir.path() + "/game.apk";
+    const QString target = dir.path() + "/staging";
+    const QByteArray library = randomBytes(1024 * 1024, 2) + QByteArray(1024 * 1024, '\0');
+    QVector<ZipEntry> entries{
+        {"assets/", {}},
+        {"assets/textures/", {}},
+        {"AndroidManifest.xml", "<manifest/>", true},
+        {"assets/textures/stone.png", randomBytes(300 * 1024, 1), true},
+        {"assets/lang/en_US.lang", QByteArray("tile.stone.name=Stone\n").repeated(20000)},
+        {"assets/empty.txt", QByteArray()},
+        {"lib/x86_64/libminecraftpe.so", library, false, 0755},
+    };
+    writeZip(archive, entries);
+
+    // A small buffer makes every large entry stream through many inflate calls
+    ArchiveExtractor extractor;
+    extractor.setBufferSize(16 * 1024);
+    ArchiveExtractor::Result result = extractor.extract(archive, target);
+    QVERIFY(result.ok);
+    QCOMPARE(result.entries, 7);
+    QCOMPARE(result.extracted, 5);
+    QCOMPARE(result.skipped, 0);
+    QCOMPARE(readFakeSysfs(target, "AndroidManifest.xml"), QByteArray("<manifest/>"));
+    QCOMPARE(readFakeSysfs(target, "assets/textures/stone.png"), randomBytes(300 * 1024, 1));
+    QCOMPARE(readFakeSysfs(target, "assets/lang/en_US.lang"), entries[4].data);
+    QCOMPARE(readFakeSysfs(target, "lib/x86_64/libminecraftpe.so"), library);
+    QVERIFY(QFileInfo(target + "/lib/x86_64/libminecraftpe.so").permissions() & QFile::ExeOwner);
+    QVERIFY(!(QFileInfo(target + "/AndroidManifest.xml").permissions() & QFile::ExeOwner));
+    QVERIFY(QFileInfo(target + "/assets/empty.txt").isFile());
+    QVERIFY(QFileInfo(target + "/assets/textures").isDir());
+    QVERIFY(QFileInfo::exists(target + ".manifest.json"));
+
+    // Nothing changed, nothing is written
+    result = extractor.extract(archive, target);
+    QVERIFY(result.ok);
+    QCOMPARE(result.extracted, 0);
+    QCOMPARE(result.skipped, 5);
+
+    // A file changed on disk is restored
+    writeFakeSysfs(target, "assets/empty.txt", "modified");
+    result = extractor.extract(archive, target);
+    QCOMPARE(result.extracted, 1);
+    QCOMPARE(readFakeSysfs(target, "assets/empty.txt"), QByteArray());
+
+    // An update writes the entries it changed and removes the ones it dropped
+    entries[4].data = QByteArray("tile.stone.name=Pierre\n").repeated(20000);
+    entries.remove(3);
+    writeZip(archive, entries);
+    result = extractor.extract(archive, target);
+    QVERIFY(result.ok);
+    QCOMPARE(result.extracted, 1);
+    QCOMPARE(result.skipped, 3);
+    QCOMPARE(readFakeSysfs(target, "assets/lang/en_US.lang"), entries[3].data);
+    QVERIFY(!QFileInfo::exists(target + "/assets/textures/stone.png"));
+
+    // A damaged entry fails its CRC and leaves nothing behind
+    QFile file(archive);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QByteArray bytes = file.readAll();
+    bytes.replace("<manifest/>", "<manifesT/>");
+    file.seek(0);
+    file.write(bytes);
+    file.close();
+    result = extractor.extract(archive, dir.path() + "/damaged");
+    QVERIFY(!result.ok);
+    QVERIFY(!QFileInfo::exists(dir.path() + "/damaged/AndroidManifest.xml"));
+
+    // Entries may not climb out of the target
+    writeZip(archive, {{"../escaped", "x"}});
+    QVERIFY(!extractor.extract(archive, dir.path() + "/unsafe").ok);
+    QVERIFY(!QFileInfo::exists(dir.path() + "/escaped"));
+}
+
+void TestSuite::testDownloadManager() {
+    QTemporaryDir dir;
+    RangeServer server(randomBytes(6 * 1024 * 1024, 7));
+    DownloadManager manager;
+    manager.setSegmentCount(3);
+    manager.setMinSegmentSize(1024 * 1024);
+    manager.setRetryDelay(10);
+    QSignalSpy finished(&manager, &DownloadManager::finished);
+
+    // Three segments in parallel, hashed as they arrive
+    const QString target = dir.path() + "/game.apk";
+    int id = manager.enqueue({server.url(), target, server.sha256()});
+    QVERIFY(finished.wait(10000));
+    QCOMPARE(finished.takeFirst(), (QVariantList{id, true, QString()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "game.apk"), server.body());
+    QVERIFY(server.ranges.size() >= 3);
+    QVERIFY(!QFileInfo::exists(target + ".part"));
+    QVERIFY(!QFileInfo::exists(target + ".part.json"));
+
+    // Connections dropped mid-transfer continue where they broke
+    QFile::remove(target);
+    server.ranges.clear();
+    server.dropAfter = 300 * 1024;
+    server.dropCount = 5;
+    id = manager.enqueue({server.url(), target, server.sha256()});
+    QVERIFY(finished.wait(10000));
+    QCOMPARE(finished.takeFirst(), (QVariantList{id, true, QString()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "game.apk"), server.body());
+    QVERIFY(server.ranges.size() >= 3 + 5);
+
+    // One crawling connection: the others take over what it has left
+    QFile::remove(target);
+    server.ranges.clear();
+    server.slowStart = 4 * 1024 * 1024;
+    server.chunkDelayMs = 50;
+    QElapsedTimer timer;
+    timer.start();
+    id = manager.enqueue({server.url(), target, server.sha256()});
+    QVERIFY(finished.wait(10000));
+    QCOMPARE(finished.takeFirst(), (QVariantList{id, true, QString()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "game.apk"), server.body());
+    qInfo() << "slow segment:" << timer.elapsed() << "ms," << server.ranges.size() << "requests";
+    QVERIFY(server.ranges.size() > 3);
+    // Alone, the slow connection needs 6.4 s for its 2 MiB
+    QVERIFY(timer.elapsed() < 5000);
+    server.slowStart = -1;
+
+    // A bad download never reaches its destination
+    id = manager.enqueue({server.url(), dir.path() + "/bad.apk", QByteArray(64, '0')});
+    QVERIFY(finished.wait(10000));
+    QCOMPARE(finished.takeFirst(), (QVariantList{id, false, QString("SHA-256 mismatch")}));
+    QVERIFY(!QFileInfo::exists(dir.path() + "/bad.apk"));
+    QVERIFY(!QFileInfo::exists(dir.path() + "/bad.apk.part"));
+
+    // Capped while a game runs
+    manager.setGameBandwidthLimit(2 * 1024 * 1024);
+    manager.setGameRunning(true);
+    QCOMPARE(manager.bandwidthLimit(), qint64(2 * 1024 * 1024));
+    timer.restart();
+    id = manager.enqueue({server.url(), dir.path() + "/capped.apk", server.sha256()});
+    QVERIFY(finished.wait(15000));
+    QCOMPARE(finished.takeFirst(), (QVariantList{id, true, QString()}));
+    qInfo() << "6 MiB capped at 2 MiB/s:" << timer.elapsed() << "ms";
+    QVERIFY(timer.elapsed() >= 2000);
+    manager.setGameRunning(false);
+    QCOMPARE(manager.bandwidthLimit(), qint64(0));
+
+    // A more urgent job takes the only slot; the other waits, then resumes
+    manager.setMaxActiveJobs(1);
+    server.slowStart = -2;
+    server.chunkDelayMs = 10;
+    QSignalSpy progress(&manager, &DownloadManager::progress);
+    const int low = manager.enqueue({server.url(), dir.path() + "/low.apk", server.sha256(), 0});
+    QTRY_VERIFY(!progress.isEmpty());
+    const int high = manager.enqueue({server.url(), dir.path() + "/high.apk", server.sha256(), 10});
+    QVERIFY(manager.isActive(high));
+    QVERIFY(!manager.isActive(low));
+    QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 2, 20000);
+    QCOMPARE(finished.at(0), (QVariantList{high, true, QString()}));
+    QCOMPARE(finished.at(1), (QVariantList{low, true, QString()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "low.apk"), server.body());
+    QCOMPARE(readFakeSysfs(dir.path(), "high.apk"), server.body());
+    QCOMPARE(manager.jobCount(), 0);
+}
+
+void TestSuite::testDownloadResume() {
+    // Cut off by an exit halfway, finished by the next run
+    QTemporaryDir dir;
+    RangeServer server(randomBytes(6 * 1024 * 1024, 8));
+    server.slowStart = -2;
+    server.chunkDelayMs = 10;
+    auto interrupt = [&](const DownloadManager::Request& request, qint64 atLeast) {
+        DownloadManager manager;
+        manager.setMinSegmentSize(1024 * 1024);
+        QSignalSpy progress(&manager, &DownloadManager::progress);
+        manager.enqueue(request);
+        const bool reached = QTest::qWaitFor([&]() {
+            return !progress.isEmpty() && progress.last().at(1).toLongLong() > atLeast;
+        }, 10000);
+        return reached ? progress.last().at(1).toLongLong() : qint64(-1);
+    };
+    auto complete = [&](const DownloadManager::Request& request) {
+        DownloadManager manager;
+        manager.setMinSegmentSize(1024 * 1024);
+        QSignalSpy finished(&manager, &DownloadManager::finished);
+        manager.enqueue(request);
+        return finished.wait(10000) && finished.first().at(1).toBool();
+    };
+
+    const QString target = dir.path() + "/game.apk";
+    const qint64 before = interrupt({server.url(), target, server.sha256()}, 2 * 1024 * 1024);
+    QVERIFY(before > 0);
+    QVERIFY(QFileInfo::exists(target + ".part.json"));
+    server.bytesServed = 0;
+    QVERIFY(complete({server.url(), target, server.sha256()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "game.apk"), server.body());
+    QVERIFY(!QFileInfo::exists(target + ".part.json"));
+
+    // Only what was missing went over the wire again, give or take what
+    // was in flight when it stopped
+    qInfo() << "resumed after" << before / 1024 << "KiB, fetched" << server.bytesServed / 1024 << "KiB more";
+    QVERIFY(server.bytesServed < server.body().size() - before + 1024 * 1024);
+
+    // A file replaced on the server in between is not stitched onto the
+    // old one
+    const QString update = dir.path() + "/update.apk";
+    QVERIFY(interrupt({server.url(), update, server.sha256()}, 1024 * 1024) > 0);
+    server.setBody(randomBytes(6 * 1024 * 1024, 9));
+    QVERIFY(complete({server.url(), update, server.sha256()}));
+    QCOMPARE(readFakeSysfs(dir.path(), "update.apk"), server.body());
 }
 
 void TestSuite::testVulkanLayers() {
     auto* manager = GameManager::instance();
-    manager->setupVulkanLayers();
+    LaunchPlan plan;
+    manager->setupVulkanLayers(plan);
+    QVERIFY(plan.materialize() >= 0);
     
     QString layersPath = QDir::homePath() + "/.local/share/vulkan/implicit_layer.d/";
     QVERIFY(QDir(layersPath).exists());
-    QVERIFY(qgetenv("VK_LAYER_MESA_overlay") == "1");
+    QCOMPARE(plan.environment.value("VK_LAYER_MESA_overlay"), QString("1"));
+}
+
+void TestSuite::testLaunchPlan() {
+    QTemporaryDir dir;
+    auto* manager = GameManager::instance();
+    manager->setLaunchPlanCacheDirectory(dir.path() + "/plans");
+
+    // The first launch compiles and caches, the next one reuses it
+    LaunchPlan cold;
+    bool cached = true;
+    QVERIFY(manager->prepareLaunchPlan(cold, &cached));
+    QVERIFY(!cached);
+    QVERIFY(!cold.program.isEmpty());
+    QCOMPARE(cold.environment.value("MESA_VK_WSI_PRESENT_MODE"), QString("mailbox"));
+    QCOMPARE(cold.environment.value("SDL_VIDEODRIVER"), QString("wayland"));
+
+    LaunchPlan warm;
+    QVERIFY(manager->prepareLaunchPlan(warm, &cached));
+    QVERIFY(cached);
+    QCOMPARE(warm.serialize(), cold.serialize());
+    QCOMPARE(warm.processEnvironment().value("PROTON_HIDE_NVIDIA_GPU"), QString("1"));
+
+    // Any config change invalidates the plan
+    Config::instance()->setValue("launchPlanTest", true);
+    QVERIFY(manager->prepareLaunchPlan(warm, &cached));
+    QVERIFY(!cached);
+    Config::instance()->remove("launchPlanTest");
+    QVERIFY(manager->prepareLaunchPlan(warm, &cached));
+    QVERIFY(cached);
+
+    // Planning leaves the launcher's own environment alone
+    QVERIFY(!qEnvironmentVariableIsSet("MESA_VK_WSI_PRESENT_MODE"));
+    QVERIFY(!qEnvironmentVariableIsSet("STEAM_GAMESCOPE_FSR"));
+
+    // Only files whose content changed are written
+    LaunchPlan plan;
+    plan.program = "true";
+    plan.directories << dir.path() + "/data";
+    plan.addFile(dir.path() + "/data/a.json", "{\"a\": 1}");
+    plan.addFile(dir.path() + "/data/b.json", "{\"b\": 2}");
+    QCOMPARE(plan.materialize(), 2);
+    QCOMPARE(plan.materialize(), 0);
+    {
+        QFile edited(dir.path() + "/data/b.json");
+        QVERIFY(edited.open(QIODevice::WriteOnly));
+        edited.write("{}");
+    }
+    QCOMPARE(plan.materialize(), 1);
+
+    // Corrupt or foreign cache entries are rejected
+    LaunchPlan roundTrip;
+    QVERIFY(LaunchPlan::deserialize(plan.serialize(), roundTrip));
+    QCOMPARE(roundTrip.files.size(), 2);
+    QCOMPARE(roundTrip.files[1].content, QByteArray("{\"b\": 2}"));
+    QVERIFY(!LaunchPlan::deserialize("{\"version\": 99}", roundTrip));
+    QVERIFY(!LaunchPlan::deserialize("not json", roundTrip));
+
+    manager->setLaunchPlanCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                                         + "/launch-plans");
+}
+
+void TestSuite::testGameScope() {
+    // Stub gamescope and xprop that log their arguments; the gamescope
+    // stub then stays alive like the real compositor
+    QTemporaryDir dir;
+    const QString logPath = dir.path() + "/invocations.log";
+    auto writeScript = [&dir](const QString& name, const QByteArray& body) {
+        QFile script(dir.path() + "/" + name);
+        QVERIFY(script.open(QIODevice::WriteOnly));
+        script.write("#!/bin/sh\n" + body);
+        script.close();
+        script.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    };
+    writeScript("gamescope", "echo \"gamescope $*\" >> " + logPath.toUtf8() + "\nexec sleep 60\n");
+    writeScript("xprop", "echo \"xprop $*\" >> " + logPath.toUtf8() + "\n");
+    auto invocations = [&logPath](const QString& program) {
+        QFile log(logPath);
+        QStringList lines;
+        if (log.open(QIODevice::ReadOnly)) {
+            for (const QString& line : QString::fromUtf8(log.readAll()).split('\n')) {
+                if (line.startsWith(program + " ")) {
+                    lines.append(line);
+                }
+            }
+        }
+        return lines;
+    };
+
+    auto* supervisor = GamescopeSupervisor::instance();
+    supervisor->setProgram(dir.path() + "/gamescope");
+    supervisor->setControlProgram(dir.path() + "/xprop");
+    supervisor->setDebounceInterval(50);
+    supervisor->setOutputSize(1920, 1080);
+    supervisor->setFpsLimit(60);
+    supervisor->setFsrEnabled(true);
+    QVERIFY(!supervisor->isRunning());
+    QSignalSpy startedSpy(supervisor, &GamescopeSupervisor::started);
+    QSignalSpy restartedSpy(supervisor, &GamescopeSupervisor::restarted);
+    QSignalSpy stoppedSpy(supervisor, &GamescopeSupervisor::stopped);
+
+    QVERIFY(supervisor->start());
+    QVERIFY(supervisor->start());
+    QCOMPARE(startedSpy.count(), 1);
+    const qint64 firstPid = supervisor->pid();
+    QVERIFY(firstPid > 0);
+    QTRY_COMPARE(invocations("gamescope").size(), 1);
+    QVERIFY(invocations("gamescope").first().contains("--fps-limit 60"));
+
+    // A burst of runtime changes is one update of the same process
+    QSignalSpy appliedSpy(supervisor, &GamescopeSupervisor::settingsApplied);
+    supervisor->setFpsLimit(30);
+    supervisor->setFpsLimit(40);
+    supervisor->setFsrEnabled(false);
+    supervisor->setFpsLimit(45);
+    QTRY_COMPARE(appliedSpy.count(), 1);
+    QCOMPARE(appliedSpy.takeFirst().first().toBool(), false);
+    QTRY_COMPARE(invocations("xprop").size(), 2);
+    QVERIFY(invocations("xprop").contains("xprop -root -f GAMESCOPE_FPS_LIMIT 32c -set GAMESCOPE_FPS_LIMIT 45"));
+    QVERIFY(invocations("xprop").contains("xprop -root -f GAMESCOPE_FSR_UPSCALE 32c -set GAMESCOPE_FSR_UPSCALE 0"));
+    QCOMPARE(supervisor->launchCount(), 1);
+    QCOMPARE(supervisor->pid(), firstPid);
+
+    // Re-applying the same values does nothing
+    supervisor->setFpsLimit(45);
+    supervisor->flush();
+    QCOMPARE(appliedSpy.count(), 0);
+
+    // So is a new render size: the game's X screen changes mode
+    supervisor->setRenderSize(1440, 810);
+    QTRY_COMPARE(appliedSpy.count(), 1);
+    QCOMPARE(appliedSpy.takeFirst().first().toBool(), false);
+    QTRY_COMPARE(invocations("xprop").size(), 3);
+    QVERIFY(invocations("xprop").contains("xprop -root -f GAMESCOPE_XWAYLAND_MODE_CONTROL 32c "
+                                          "-set GAMESCOPE_XWAYLAND_MODE_CONTROL 0,1440,810,0"));
+    QCOMPARE(supervisor->launchCount(), 1);
+
+    // A new output size needs a restart, which picks up everything else
+    supervisor->setOutputSize(1280, 800);
+    supervisor->setRenderSize(960, 600);
+    supervisor->setFpsLimit(60);
+    QTRY_COMPARE(appliedSpy.count(), 1);
+    QCOMPARE(appliedSpy.takeFirst().first().toBool(), true);
+    QCOMPARE(supervisor->launchCount(), 2);
+    const qint64 secondPid = supervisor->pid();
+    QVERIFY(secondPid != firstPid);
+    QTRY_COMPARE(invocations("gamescope").size(), 2);
+    QVERIFY(invocations("gamescope").last().contains("--output-width 1280 --output-height 800 --fps-limit 60"));
+    QVERIFY(invocations("gamescope").last().contains("--nested-width 960 --nested-height 600"));
+    QVERIFY(!invocations("gamescope").last().contains("--fsr"));
+    QCOMPARE(invocations("xprop").size(), 3);
+    // Still the same session to everyone waiting for the game to end
+    QCOMPARE(restartedSpy.count(), 1);
+    QCOMPARE(startedSpy.count(), 1);
+    QCOMPARE(stoppedSpy.count(), 0);
+
+    // A compositor that dies on its own is brought back
+    QSignalSpy crashedSpy(supervisor, &GamescopeSupervisor::crashed);
+    ::kill(static_cast<pid_t>(secondPid), SIGKILL);
+    QTRY_COMPARE(crashedSpy.count(), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(supervisor->launchCount(), 3, 5000);
+    QVERIFY(supervisor->isRunning());
+    QCOMPARE(restartedSpy.count(), 2);
+    QCOMPARE(stoppedSpy.count(), 0);
+
+    supervisor->stop();
+    QVERIFY(!supervisor->isRunning());
+    QCOMPARE(supervisor->launchCount(), 3);
+    QCOMPARE(startedSpy.count(), 1);
+    QCOMPARE(stoppedSpy.count(), 1);
+    supervisor->setRenderSize(0, 0);
+    supervisor->setProgram("gamescope");
+    supervisor->setControlProgram("xprop");
 }
 
 // UI Tests
@@ -151,6 +2808,102 @@ void TestSuite::testUIScaling() {
     QCOMPARE(font.pointSizeF(), QApplication::font().pointSizeF() * 1.5);
 }
 
+void TestSuite::testSupervisorMode() {
+    QTemporaryDir root;
+    createFakeAllyTree(root.path());
+    auto* control = AllySystemControl::instance();
+    control->setSysfsRoot(root.path());
+
+    // Stub gamescope standing in for a game that runs until told to quit
+    QTemporaryDir dir;
+    const QString quitPath = dir.path() + "/quit";
+    auto writeScript = [&dir](const QString& name, const QByteArray& body) {
+        QFile script(dir.path() + "/" + name);
+        QVERIFY(script.open(QIODevice::WriteOnly));
+        script.write("#!/bin/sh\n" + body);
+        script.close();
+        script.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    };
+    writeScript("gamescope", "while [ ! -e " + quitPath.toUtf8() + " ]; do sleep 0.1; done\n");
+    writeScript("xprop", "exit 0\n");
+    auto* gamescope = GamescopeSupervisor::instance();
+    gamescope->setProgram(dir.path() + "/gamescope");
+    gamescope->setControlProgram(dir.path() + "/xprop");
+
+    // A full-screen launcher with a library page's worth of widgets
+    int windowsBuilt = 0;
+    SupervisorMode supervisor([&windowsBuilt]() {
+        auto* window = new LauncherWindow;
+        auto* page = new QWidget;
+        auto* layout = new QGridLayout(page);
+        for (int i = 0; i < 1500; ++i) {
+            layout->addWidget(new QLabel(QString("World %1").arg(i)), i / 30, i % 30);
+        }
+        window->setCentralWidget(page);
+        window->resize(1920, 1080);
+        ++windowsBuilt;
+        return window;
+    });
+    supervisor.follow(gamescope);
+    supervisor.showLauncher();
+    QVERIFY(supervisor.window()->isVisible());
+    idleEventLoop(500);
+
+    const int idleMs = 2000;
+    const qint64 rssBefore = residentKiB();
+    qint64 switches = contextSwitches();
+    quint64 samplerWakeups = control->sampler().wakeups();
+    idleEventLoop(idleMs);
+    const qint64 switchesBefore = contextSwitches() - switches;
+    const quint64 samplerWakeupsBefore = control->sampler().wakeups() - samplerWakeups;
+
+    QSignalSpy enteredSpy(&supervisor, &SupervisorMode::entered);
+    QSignalSpy leftSpy(&supervisor, &SupervisorMode::left);
+    QVERIFY(gamescope->start());
+    QTRY_COMPARE(enteredSpy.count(), 1);
+    QVERIFY(supervisor.isActive());
+    QVERIFY(!supervisor.window());
+    QVERIFY(control->isSupervising());
+    QVERIFY(!QGuiApplication::quitOnLastWindowClosed());
+    idleEventLoop(100);
+
+    // Only what the fan curve and the energy meter need is still read
+    const quint64 fanReads = control->sampler().reads(PollScheduler::Fan);
+    const quint64 gpuReads = control->sampler().reads(PollScheduler::Gpu);
+    const qint64 rssSupervising = residentKiB();
+    switches = contextSwitches();
+    samplerWakeups = control->sampler().wakeups();
+    idleEventLoop(idleMs);
+    const qint64 switchesSupervising = contextSwitches() - switches;
+    const quint64 samplerWakeupsSupervising = control->sampler().wakeups() - samplerWakeups;
+    QCOMPARE(control->sampler().reads(PollScheduler::Fan), fanReads);
+    QCOMPARE(control->sampler().reads(PollScheduler::Gpu), gpuReads);
+
+    // Memory and wakeups depend on the machine and what else runs on it;
+    // they are reported, not checked
+    qInfo() << "RSS:" << rssBefore << "KiB with the launcher," << rssSupervising << "KiB supervising";
+    qInfo() << "Wakeups over" << idleMs << "ms:" << switchesBefore << "with the launcher ("
+            << samplerWakeupsBefore << "telemetry)," << switchesSupervising << "supervising ("
+            << samplerWakeupsSupervising << "telemetry)";
+
+    // The game exiting brings the launcher back
+    QFile quit(quitPath);
+    QVERIFY(quit.open(QIODevice::WriteOnly));
+    quit.close();
+    QTRY_COMPARE(leftSpy.count(), 1);
+    QVERIFY(!gamescope->isRunning());
+    QVERIFY(!supervisor.isActive());
+    QVERIFY(supervisor.window() && supervisor.window()->isVisible());
+    QVERIFY(!control->isSupervising());
+    QVERIFY(QGuiApplication::quitOnLastWindowClosed());
+    QCOMPARE(windowsBuilt, 2);
+    qInfo() << "Launcher restored in" << supervisor.restoreMs() << "ms";
+
+    gamescope->setProgram("gamescope");
+    gamescope->setControlProgram("xprop");
+    control->setSysfsRoot("/sys");
+}
+
 // Build System Tests
 void TestSuite::testInstallationPaths() {
     QString prefix = CMAKE_INSTALL_PREFIX;
@@ -169,4 +2922,3 @@ void TestSuite::testInstallationPaths() {
 }
 
 QTEST_MAIN(TestSuite)
-#include "TestSuite.moc"
\ No newline at end of file
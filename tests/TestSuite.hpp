@@ -21,6 +21,17 @@ private slots:
     void testFanControl();
     void testTemperatureMonitoring();
     void testBatteryMonitoring();
+    void testSysfsAttribute();
+    void testSensorDiscovery();
+    void testSensorHotplug();
+    void testTelemetrySampler();
+    void testTelemetrySlowSensor();
+    void testTelemetryStore();
+    void testAdaptivePolling();
+    void testFanCurve();
+    void testHardwareState();
+    void testEnergyAccounting();
+    void testGpuClockTables();
 
     // Build System Tests
     void testInstallationPaths();
@@ -29,8 +40,24 @@ private slots:
 
     // Game Optimization Tests
     void testGraphicsPresets();
+    void testTdpGovernor();
+    void testResolutionScaler();
+    void testFrameCapture();
+    void testPresetTuner();
+    void testGameScheduler();
+    void testLaunchPipeline();
     void testShaderCache();
+    void testShaderCacheBudget();
+    void testShaderCacheRescan();
+    void testShaderPrewarm();
+    void testShaderCacheStore();
+    void testWorldBackup();
+    void testInstallStore();
+    void testArchiveExtractor();
+    void testDownloadManager();
+    void testDownloadResume();
     void testVulkanLayers();
+    void testLaunchPlan();
     void testGameScope();
 
     // UI Tests
@@ -38,4 +65,5 @@ private slots:
     void testGestures();
     void testBigPictureMode();
     void testUIScaling();
-};
\ No newline at end of file
+    void testSupervisorMode();
+};